@@ -27,10 +27,12 @@
 
 
 #pragma once
+#include "byte_slice.h"
 #include "memwipe.h"
 
 #include <boost/utility/string_ref.hpp>
 
+#include <functional>
 #include <string>
 #include <utility>
 #include <list>
@@ -148,12 +150,17 @@ namespace net_utils
 		};
 
 
+		//! Hands a response body over in chunks, returning false to abort
+		typedef std::function<bool(byte_slice)> body_sink;
+
 		struct http_response_info 
 		{
 			int					m_response_code;
 			std::string			m_response_comment;
 			fields_list	        m_additional_fields;
 			std::string			m_body;
+			//! When set, writes the body to a sink in place of m_body, so it can be sent while it is written
+			std::function<bool(const body_sink&)> m_body_writer;
 			std::string			m_mime_tipe;
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
@@ -170,6 +177,21 @@ namespace net_utils
 				memwipe(&m_body[0], m_body.size());
 			}
 		};
+
+		//! Runs the body writer of a response, if any, leaving the whole body in m_body
+		inline bool render_body(http_response_info& response)
+		{
+			if (!response.m_body_writer)
+				return true;
+			std::string body;
+			const bool r = response.m_body_writer([&body](byte_slice chunk) {
+				body.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+				return true;
+			});
+			response.m_body_writer = nullptr;
+			response.m_body = std::move(body);
+			return r;
+		}
 	}
 }
 }
@@ -222,7 +222,8 @@ namespace net_utils
 		m_query_info.clear();
 		m_len_summary = 0;
 		m_newlines = 0;
-		m_bytes_read = 0;
+		// whatever is left is the start of the next pipelined request
+		m_bytes_read = m_cache.size();
 		return true;
 	}
 	//--------------------------------------------------------------------------------------------
@@ -259,7 +260,9 @@ namespace net_utils
 			m_cache.swap(buf);
 
 		m_is_stop_handling = false;
-		while(!m_is_stop_handling)
+		// keep going after a request is answered, since a client pipelining
+		// requests may have sent the next ones along with it
+		while(!m_is_stop_handling && !m_want_close)
 		{
 			switch(m_state)
 			{
@@ -318,7 +321,9 @@ namespace net_utils
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				if (!handle_retriving_query_body())
+					return false;
+				break;
 			case http_state_connection_close:
 				return false;
 			default:
@@ -370,7 +375,7 @@ namespace net_utils
 		boost::smatch result;	
 		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
 		{
-			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi))
+			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_lo))
 			{
 				m_state = http_state_error;
 				MERROR("Failed to analyze method");
@@ -598,11 +603,46 @@ namespace net_utils
 			response.m_response_comment = "OK";
 		}
 
+		// chunked transfer needs HTTP/1.1, anyone else gets the whole body at once
+		const bool chunked = response.m_body_writer && query_info.m_http_method != http::http_method_head &&
+			(query_info.m_http_ver_hi > 1 || (query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo >= 1));
+		if (response.m_body_writer && !chunked && !http::render_body(response))
+		{
+			response.m_body.clear();
+			response.m_response_code = 500;
+			response.m_response_comment = "Internal Server Error";
+			m_want_close = true;
+		}
+
 		std::string response_data = get_response_header(response);
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
 
 		LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 
+		if (chunked)
+		{
+			m_psnd_hndlr->do_send(byte_slice{std::move(response_data)});
+			const bool sent = response.m_body_writer([this](byte_slice chunk) {
+				if (chunk.empty())
+					return true;
+				char size_line[24];
+				snprintf(size_line, sizeof(size_line), "%zx\r\n", chunk.size());
+				return m_psnd_hndlr->do_send(byte_slice{std::string(size_line)}) &&
+					m_psnd_hndlr->do_send(std::move(chunk)) &&
+					m_psnd_hndlr->do_send(byte_slice{std::string("\r\n")});
+			});
+			// the header is gone already, so a body cut short can only be reported by closing
+			if (sent)
+				m_psnd_hndlr->do_send(byte_slice{std::string("0\r\n\r\n")});
+			else
+			{
+				MERROR("Failed to write chunked response body");
+				m_want_close = true;
+			}
+			m_psnd_hndlr->send_done();
+			return res;
+		}
+
 		if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
 			response_data += response.m_body;
 
@@ -646,9 +686,11 @@ namespace net_utils
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if (response.m_body_writer)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 
 		if(!response.m_mime_tipe.empty())
 		{
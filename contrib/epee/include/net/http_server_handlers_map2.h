@@ -26,14 +26,271 @@
 
 
 #pragma once 
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include "http_base.h"
 #include "jsonrpc_structs.h"
 #include "storages/portable_storage.h"
 #include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_to_json_stream.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+#define JSON_RPC_MAX_BATCH_SIZE 100
+#define JSON_RPC_SERVER_BUSY -32001
+
+namespace epee
+{
+  namespace net_utils
+  {
+    namespace http
+    {
+      //! Leaves `body` to be written out as JSON while the response is sent, in place of m_body
+      template<class t_struct>
+      void set_json_body_writer(http_response_info &response_info, t_struct &&body)
+      {
+        const auto ptr = std::make_shared<typename std::decay<t_struct>::type>(std::move(body));
+        response_info.m_body.clear();
+        response_info.m_body_writer = [ptr](const body_sink &sink) {
+          epee::serialization::json_stream_writer writer(sink);
+          return epee::serialization::store_t_to_json_stream(*ptr, writer);
+        };
+      }
+
+      //! Lets a handler with an `admit_rpc_call(name)` hold back or turn away calls;
+      //! the result must stay alive while the call runs, and be false to turn it away
+      template<typename t_handler>
+      auto admit_call(t_handler &handler, const char *name, int) -> decltype(handler.admit_rpc_call(name))
+      {
+        return handler.admit_rpc_call(name);
+      }
+
+      template<typename t_handler>
+      bool admit_call(t_handler &, const char *, long)
+      {
+        return true;
+      }
+    }
+  }
+
+  namespace json_rpc
+  {
+    inline std::string make_error_body(int64_t code, const std::string &message)
+    {
+      error_response rsp = AUTO_VAL_INIT(rsp);
+      rsp.jsonrpc = "2.0";
+      rsp.error.code = code;
+      rsp.error.message = message;
+      std::string body;
+      epee::serialization::store_t_to_json(rsp, body);
+      return body;
+    }
+
+    inline bool is_batch(const std::string &body)
+    {
+      const size_t pos = body.find_first_not_of(" \t\r\n");
+      return pos != std::string::npos && body[pos] == '[';
+    }
+
+    // Splits a JSON-RPC 2.0 batch array into the text of its items, tracking
+    // only strings and nesting: the items are parsed when they are handled.
+    // If has_id is given, it tells for each item whether it has an "id" key,
+    // since one without is a notification, which gets no response
+    inline bool split_batch(const std::string &body, std::vector<std::string> &items, std::vector<char> *has_id = nullptr)
+    {
+      static const char *whitespace = " \t\r\n";
+      items.clear();
+      if (has_id)
+        has_id->clear();
+      size_t depth = 0, start = 0, string_start = 0;
+      bool in_string = false, escaped = false, done = false, id_string = false, item_has_id = false;
+      const auto add_item = [&](size_t end) {
+        const size_t first = body.find_first_not_of(whitespace, start);
+        if (first >= end)
+          return false;
+        items.push_back(body.substr(first, body.find_last_not_of(whitespace, end - 1) + 1 - first));
+        if (has_id)
+          has_id->push_back(item_has_id);
+        item_has_id = false;
+        start = end + 1;
+        return true;
+      };
+      for (size_t i = body.find_first_not_of(whitespace); i < body.size(); ++i)
+      {
+        const char c = body[i];
+        const bool is_whitespace = c != '\0' && strchr(whitespace, c);
+        if (done)
+        {
+          if (!is_whitespace)
+            return false;
+        }
+        else if (in_string)
+        {
+          if (escaped)
+            escaped = false;
+          else if (c == '\\')
+            escaped = true;
+          else if (c == '"')
+          {
+            in_string = false;
+            // an "id" key of the item itself if a ':' follows
+            id_string = depth == 2 && body.compare(string_start, i - string_start, "id") == 0;
+            continue;
+          }
+        }
+        else if (is_whitespace)
+          continue;
+        else if (c == '"')
+        {
+          in_string = true;
+          string_start = i + 1;
+        }
+        else if (c == '[' || c == '{')
+        {
+          if (depth++ == 0)
+            start = i + 1;
+        }
+        else if (c == ']' || c == '}')
+        {
+          if (depth == 0)
+            return false;
+          if (--depth > 0)
+            continue;
+          // an empty batch is fine here, and rejected by the caller
+          if (c != ']' || (!add_item(i) && !items.empty()))
+            return false;
+          done = true;
+        }
+        else if (c == ',' && depth == 1)
+        {
+          if (!add_item(i))
+            return false;
+        }
+        else if (c == ':' && id_string)
+          item_has_id = true;
+        id_string = false;
+      }
+      return done;
+    }
+
+    // Runs the jobs of a batch on the calling thread and, through post, on up
+    // to one more thread per job. Each job is claimed by whichever thread gets
+    // to it first, and the calling thread runs all those left, so the batch is
+    // done even if the posted helpers never get a thread; any that run after
+    // it find nothing left to do
+    template<typename t_post>
+    void run_batch_concurrently(std::vector<std::function<void()>> &jobs, t_post post)
+    {
+      struct batch_state
+      {
+        std::vector<std::function<void()>> *jobs;
+        size_t count;
+        std::atomic<size_t> next;
+        size_t finished;
+        boost::mutex mutex;
+        boost::condition_variable cond;
+      };
+      const auto state = std::make_shared<batch_state>();
+      state->jobs = &jobs;
+      state->count = jobs.size();
+      state->next = 0;
+      state->finished = 0;
+      const auto run_jobs = [](batch_state &state) {
+        for (size_t i = state.next++; i < state.count; i = state.next++)
+        {
+          try { (*state.jobs)[i](); }
+          catch (const std::exception &e) { MERROR("Exception in JSON-RPC batch job: " << e.what()); }
+          boost::unique_lock<boost::mutex> lock(state.mutex);
+          if (++state.finished == state.count)
+            state.cond.notify_all();
+        }
+      };
+      for (size_t i = 1; i < jobs.size(); ++i)
+        post([state, run_jobs]() { run_jobs(*state); });
+      run_jobs(*state);
+      boost::unique_lock<boost::mutex> lock(state->mutex);
+      while (state->finished < state->count)
+        state->cond.wait(lock);
+    }
+
+    // Handles a batch by handing each item back to the JSON-RPC map as a request of
+    // its own, so each is checked and charged for as if it came alone. run gets the
+    // items as jobs, which it may run concurrently; the responses keep their order,
+    // and if they were all notifications there are none.
+    template<typename t_run, typename t_handle>
+    void handle_batch(const epee::net_utils::http::http_request_info &query_info, epee::net_utils::http::http_response_info &response_info, t_run run, t_handle handle)
+    {
+      response_info.m_mime_tipe = "application/json";
+      response_info.m_header_info.m_content_type = " application/json";
+      std::vector<std::string> bodies;
+      std::vector<char> has_id;
+      if (!split_batch(query_info.m_body, bodies, &has_id))
+      {
+        response_info.m_body = make_error_body(-32700, "Parse error");
+        return;
+      }
+      if (bodies.empty() || bodies.size() > JSON_RPC_MAX_BATCH_SIZE)
+      {
+        response_info.m_body = make_error_body(-32600, "Invalid Request");
+        return;
+      }
+
+      epee::net_utils::http::http_request_info item_query_info = query_info;
+      item_query_info.m_body.clear();
+      std::vector<epee::net_utils::http::http_response_info> responses(bodies.size());
+      std::vector<char> notifications(bodies.size(), 0);
+      std::vector<std::function<void()>> jobs;
+      jobs.reserve(bodies.size());
+      for (size_t i = 0; i < bodies.size(); ++i)
+      {
+        jobs.push_back([&, i]() {
+          epee::net_utils::http::http_response_info &response = responses[i];
+          if (bodies[i][0] != '{')
+          {
+            response.m_body = make_error_body(-32600, "Invalid Request");
+            return;
+          }
+          notifications[i] = !has_id[i];
+          epee::net_utils::http::http_request_info item = item_query_info;
+          item.m_body = std::move(bodies[i]);
+          try { handle(item, response); }
+          catch (const std::exception &e) { MERROR("Exception in JSON-RPC batch item: " << e.what()); response.m_body.clear(); }
+          // streamed responses are joined with the rest
+          if (!epee::net_utils::http::render_body(response))
+            response.m_body.clear();
+          if (response.m_body.empty())
+            response.m_body = make_error_body(-32603, "Internal error");
+        });
+      }
+      run(jobs);
+
+      response_info.m_body.clear();
+      for (size_t i = 0; i < responses.size(); ++i)
+      {
+        if (notifications[i])
+          continue;
+        response_info.m_body += response_info.m_body.empty() ? "[" : ",";
+        response_info.m_body += responses[i].m_body;
+      }
+      if (response_info.m_body.empty())
+      {
+        response_info.m_response_code = 204;
+        response_info.m_response_comment = "No Content";
+        return;
+      }
+      response_info.m_body += "]";
+    }
+  }
+}
+
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
@@ -63,7 +320,19 @@
   bool handled = false; \
   if(false) return true; //just a stub to have "else if"
 
-#define MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, cond) \
+#define STORE_OBJECTS_TO_JSON(obj) epee::serialization::store_t_to_json(obj, response_info.m_body);
+#define STREAM_OBJECTS_TO_JSON(obj) epee::net_utils::http::set_json_body_writer(response_info, std::move(obj));
+
+#define ADMIT_URI_CALL(s_pattern) \
+      const auto admission_ = epee::net_utils::http::admit_call(*this, s_pattern, 0); \
+      if (!admission_) \
+      { \
+        response_info.m_response_code = 503; \
+        response_info.m_response_comment = "Service Unavailable"; \
+        return true; \
+      }
+
+#define MAP_URI_AUTO_JON2_WITH(s_pattern, callback_f, command_type, cond, store) \
     else if((query_info.m_URI == s_pattern) && (cond)) \
     { \
       handled = true; \
@@ -79,6 +348,7 @@
       } \
       uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::response> resp;\
+      ADMIT_URI_CALL(s_pattern) \
       MINFO(m_conn_context << "calling " << s_pattern); \
       bool res = false; \
       try { res = callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), &m_conn_context); } \
@@ -90,15 +360,20 @@
         return true; \
       } \
       uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
+      store(static_cast<command_type::response&>(resp)) \
       uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
       MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+#define MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, cond) MAP_URI_AUTO_JON2_WITH(s_pattern, callback_f, command_type, cond, STORE_OBJECTS_TO_JSON)
+
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
 
+// for large responses: the JSON is written out as it is sent, chunked to HTTP/1.1 clients
+#define MAP_URI_AUTO_JON2_STREAM(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_WITH(s_pattern, callback_f, command_type, true, STREAM_OBJECTS_TO_JSON)
+
 #define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) \
     else if(query_info.m_URI == s_pattern) \
     { \
@@ -115,6 +390,7 @@
       } \
       uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::response> resp;\
+      ADMIT_URI_CALL(s_pattern) \
       MINFO(m_conn_context << "calling " << s_pattern); \
       bool res = false; \
       try { res = callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), &m_conn_context); } \
@@ -135,6 +411,27 @@
       MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
     }
 
+// for plain text responses, written by callback_f(std::string& body, context*)
+#define MAP_URI_TEXT(s_pattern, callback_f, content_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      ADMIT_URI_CALL(s_pattern) \
+      MINFO(m_conn_context << "calling " << s_pattern); \
+      bool res = false; \
+      try { res = callback_f(response_info.m_body, &m_conn_context); } \
+      catch (const std::exception &e) { MERROR(m_conn_context << "Failed to " << #callback_f << "(): " << e.what()); } \
+      if (!res) \
+      { \
+        response_info.m_body.clear(); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      response_info.m_mime_tipe = content_type; \
+      response_info.m_header_info.m_content_type = " " content_type; \
+    }
+
 #define END_URI_MAP2() return handled;}
 
 
@@ -142,6 +439,15 @@
     { \
     uint64_t ticks = epee::misc_utils::get_tick_count(); \
     response_info.m_mime_tipe = "application/json"; \
+    if(epee::json_rpc::is_batch(query_info.m_body)) \
+    { \
+      epee::json_rpc::handle_batch(query_info, response_info, \
+        [this](std::vector<std::function<void()>> &jobs_) { this->run_json_rpc_batch(jobs_); }, \
+        [this, &m_conn_context](const epee::net_utils::http::http_request_info &item_query_info_, epee::net_utils::http::http_response_info &item_response_info_) { \
+          this->handle_http_request_map(item_query_info_, item_response_info_, m_conn_context); }); \
+      MDEBUG(query_info.m_URI << " batch processed with " << epee::misc_utils::get_tick_count() - ticks << "ms"); \
+      return true; \
+    } \
     epee::serialization::portable_storage ps; \
     if(!ps.load_from_json(query_info.m_body)) \
     { \
@@ -189,18 +495,34 @@
   resp.jsonrpc = "2.0"; \
   resp.id = req.id;
 
-#define FINALIZE_OBJECTS_TO_JSON(method_name) \
+#define ADMIT_JSON_RPC_CALL(method_name) \
+  const auto admission_ = epee::net_utils::http::admit_call(*this, method_name, 0); \
+  if (!admission_) \
+  { \
+    epee::json_rpc::error_response busy_resp = AUTO_VAL_INIT(busy_resp); \
+    busy_resp.jsonrpc = "2.0"; \
+    busy_resp.id = req.id; \
+    busy_resp.error.code = JSON_RPC_SERVER_BUSY; \
+    busy_resp.error.message = "Server busy"; \
+    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(busy_resp), response_info.m_body); \
+    return true; \
+  }
+
+#define FINALIZE_OBJECTS_TO_JSON_WITH(method_name, store) \
   uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-  epee::serialization::store_t_to_json(resp, response_info.m_body); \
+  store(resp) \
   uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
   response_info.m_mime_tipe = "application/json"; \
   response_info.m_header_info.m_content_type = " application/json"; \
   MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms");
 
-#define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) \
+#define FINALIZE_OBJECTS_TO_JSON(method_name) FINALIZE_OBJECTS_TO_JSON_WITH(method_name, STORE_OBJECTS_TO_JSON)
+
+#define MAP_JON_RPC_WE_WITH(method_name, callback_f, command_type, cond, store) \
     else if((callback_name == method_name) && (cond)) \
 { \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
+  ADMIT_JSON_RPC_CALL(method_name) \
   epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
   fail_resp.jsonrpc = "2.0"; \
   fail_resp.id = req.id; \
@@ -213,16 +535,22 @@
     epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
     return true; \
   } \
-  FINALIZE_OBJECTS_TO_JSON(method_name) \
+  FINALIZE_OBJECTS_TO_JSON_WITH(method_name, store) \
   return true;\
 }
 
+#define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) MAP_JON_RPC_WE_WITH(method_name, callback_f, command_type, cond, STORE_OBJECTS_TO_JSON)
+
 #define MAP_JON_RPC_WE(method_name, callback_f, command_type) MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, true)
 
+// for large responses: the JSON is written out as it is sent, chunked to HTTP/1.1 clients
+#define MAP_JON_RPC_WE_STREAM(method_name, callback_f, command_type) MAP_JON_RPC_WE_WITH(method_name, callback_f, command_type, true, STREAM_OBJECTS_TO_JSON)
+
 #define MAP_JON_RPC(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
+  ADMIT_JSON_RPC_CALL(method_name) \
   MINFO(m_conn_context << "calling RPC method " << method_name); \
   bool res = false; \
   try { res = callback_f(req.params, resp.result, &m_conn_context); } \
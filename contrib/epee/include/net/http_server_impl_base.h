@@ -30,6 +30,8 @@
 #pragma once 
 
 
+#include <functional>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/bind/bind.hpp>
 
@@ -130,6 +132,15 @@ namespace epee
       return m_net_server.get_connections_count();
     }
 
+    // Runs the items of a JSON-RPC batch one after the other. Servers whose
+    // handlers are safe to run concurrently can hide this to run them in parallel,
+    // eg with json_rpc::run_batch_concurrently on m_net_server's threads
+    void run_json_rpc_batch(std::vector<std::function<void()>> &jobs)
+    {
+      for (auto &job: jobs)
+        job();
+    }
+
   protected: 
     net_utils::boosted_tcp_server<net_utils::http::http_custom_handler<t_connection_context> > m_net_server;
   };
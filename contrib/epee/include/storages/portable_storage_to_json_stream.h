@@ -0,0 +1,297 @@
+// Copyright (c) 2024, The Monero Project
+
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "byte_slice.h"
+#include "byte_stream.h"
+#include "parserse_base_utils.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_json.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    //! An open object or array of a `json_stream_writer`
+    struct json_stream_frame
+    {
+      bool array;
+      size_t indent;
+      size_t count;
+    };
+
+    /*! Writes a KV_SERIALIZE map straight out as JSON, without building a
+      `portable_storage` tree first. It has the storing half of the
+      `portable_storage` interface, so `obj.store(writer)` works as with
+      `portable_storage`, and prints what `portable_storage::dump_as_json`
+      would, except that keys keep the order they are stored in rather than
+      being sorted. Output goes to the sink in chunks of about `chunk_size`
+      bytes, or stays in `stream()` when there is no sink.
+
+      Handles are only good until a value is written to an enclosing object,
+      which is how KV_SERIALIZE maps use them. */
+    class json_stream_writer
+    {
+    public:
+      typedef json_stream_frame* hsection;
+      typedef json_stream_frame* harray;
+      typedef storage_entry meta_entry;
+      typedef std::function<bool(byte_slice)> sink_type;
+
+      explicit json_stream_writer(sink_type sink = nullptr, size_t chunk_size = 64 * 1024, bool insert_newlines = true)
+        : m_sink(std::move(sink)), m_chunk_size(chunk_size), m_newlines(insert_newlines), m_error(false)
+      {
+        m_frames.push_back(json_stream_frame{false, 0, 0});
+        put("{");
+        newline();
+      }
+
+      json_stream_writer(const json_stream_writer&) = delete;
+      json_stream_writer& operator=(const json_stream_writer&) = delete;
+
+      hsection open_section(const std::string& name, hsection hparent, bool create_if_notexist = false)
+      {
+        // nothing written can be read back
+        if (!create_if_notexist)
+          return nullptr;
+        json_stream_frame* parent = resume(hparent);
+        if (!parent)
+          return nullptr;
+        key(*parent, name);
+        return open(false, parent->indent + 1);
+      }
+
+      template<class t_value>
+      bool set_value(const std::string& name, t_value&& v, hsection hparent)
+      {
+        json_stream_frame* parent = resume(hparent);
+        if (!parent)
+          return false;
+        key(*parent, name);
+        value(v, parent->indent + 1);
+        flush(false);
+        return !m_error;
+      }
+
+      template<class t_value>
+      harray insert_first_value(const std::string& name, t_value&& v, hsection hparent)
+      {
+        json_stream_frame* parent = resume(hparent);
+        if (!parent)
+          return nullptr;
+        key(*parent, name);
+        json_stream_frame* array = open(true, parent->indent + 1);
+        value(v, array->indent);
+        array->count = 1;
+        return array;
+      }
+
+      template<class t_value>
+      bool insert_next_value(harray harr, t_value&& v)
+      {
+        if (!resume(harr) || !harr->array)
+          return false;
+        put(",");
+        value(v, harr->indent);
+        ++harr->count;
+        flush(false);
+        return !m_error;
+      }
+
+      harray insert_first_section(const std::string& name, hsection& hchild, hsection hparent)
+      {
+        json_stream_frame* parent = resume(hparent);
+        if (!parent)
+          return nullptr;
+        key(*parent, name);
+        json_stream_frame* array = open(true, parent->indent + 1);
+        array->count = 1;
+        hchild = open(false, array->indent);
+        return array;
+      }
+
+      bool insert_next_section(harray harr, hsection& hchild)
+      {
+        if (!resume(harr) || !harr->array)
+          return false;
+        put(",");
+        ++harr->count;
+        hchild = open(false, harr->indent);
+        return !m_error;
+      }
+
+      //! Closes everything still open and hands what is left to the sink
+      bool finish()
+      {
+        if (m_frames.empty())
+          return !m_error;
+        while (!m_frames.empty())
+          close();
+        flush(true);
+        return !m_error;
+      }
+
+      //! The output not yet handed to the sink
+      byte_stream& stream() noexcept { return m_out; }
+      bool good() const noexcept { return !m_error; }
+
+    private:
+      void put(const char* s) { m_out.write(s, std::strlen(s)); }
+      void put(const std::string& s) { m_out.write(s.data(), s.size()); }
+
+      void newline()
+      {
+        if (m_newlines)
+          m_out.write("\r\n", 2);
+      }
+
+      void indent(size_t n)
+      {
+        for (size_t i = 0; i < n; ++i)
+          m_out.write("  ", 2);
+      }
+
+      json_stream_frame* open(bool array, size_t indent)
+      {
+        m_frames.push_back(json_stream_frame{array, indent, 0});
+        if (array)
+          put("[");
+        else
+        {
+          put("{");
+          newline();
+        }
+        return &m_frames.back();
+      }
+
+      void close()
+      {
+        const json_stream_frame& frame = m_frames.back();
+        if (frame.array)
+          put("]");
+        else
+        {
+          if (frame.count)
+            newline();
+          indent(frame.indent);
+          put("}");
+        }
+        m_frames.pop_back();
+      }
+
+      //! Closes whatever was opened after `h`, which must still be open
+      json_stream_frame* resume(json_stream_frame* h)
+      {
+        if (m_error || m_frames.empty())
+          return nullptr;
+        if (!h)
+          h = &m_frames.front();
+        auto it = m_frames.end();
+        while (it != m_frames.begin() && &*(it - 1) != h)
+          --it;
+        if (it == m_frames.begin())
+        {
+          m_error = true;
+          return nullptr;
+        }
+        while (&m_frames.back() != h)
+          close();
+        return h;
+      }
+
+      void key(json_stream_frame& parent, const std::string& name)
+      {
+        if (parent.count++)
+        {
+          put(",");
+          newline();
+        }
+        indent(parent.indent + 1);
+        put("\"");
+        put(misc_utils::parse::transform_to_escape_sequence(name));
+        put("\": ");
+      }
+
+      void value(const std::string& v, size_t) { put("\""); put(misc_utils::parse::transform_to_escape_sequence(v)); put("\""); }
+      void value(const bool v, size_t) { put(v ? "true" : "false"); }
+      void value(const int8_t v, size_t) { put(std::to_string(static_cast<int32_t>(v))); }
+      void value(const uint8_t v, size_t) { put(std::to_string(static_cast<int32_t>(v))); }
+      void value(const double v, size_t)
+      {
+        std::stringstream ss;
+        ss << v;
+        put(ss.str());
+      }
+      void value(const storage_entry& v, size_t indent)
+      {
+        std::stringstream ss;
+        dump_as_json(ss, v, indent, m_newlines);
+        put(ss.str());
+      }
+      template<class t_value>
+      typename std::enable_if<std::is_integral<t_value>::value>::type value(const t_value v, size_t)
+      {
+        put(std::to_string(v));
+      }
+
+      void flush(bool all)
+      {
+        if (!m_sink || m_error || m_out.size() == 0 || (!all && m_out.size() < m_chunk_size))
+          return;
+        if (!m_sink(byte_slice{std::move(m_out), false}))
+          m_error = true;
+        m_out = byte_stream{};
+      }
+
+      std::deque<json_stream_frame> m_frames;
+      byte_stream m_out;
+      sink_type m_sink;
+      size_t m_chunk_size;
+      bool m_newlines;
+      bool m_error;
+    };
+
+    //! Stores `str_in` as JSON through `writer`, and finishes it
+    template<class t_struct>
+    bool store_t_to_json_stream(const t_struct& str_in, json_stream_writer& writer)
+    {
+      return str_in.store(writer) && writer.finish();
+    }
+  }
+}
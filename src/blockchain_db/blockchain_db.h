@@ -30,6 +30,7 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <exception>
 #include <boost/program_options.hpp>
@@ -117,6 +118,16 @@ enum class relay_category : uint8_t
 
 bool matches_category(relay_method method, relay_category category) noexcept;
 
+//! the supply tally tables, whose keys are indices into the asset or reserve type lists
+enum class supply_tally_table : uint8_t
+{
+  circulating = 0, //!< pre audit fork tallies, by ASSET_TYPES and RESERVE_TYPES index
+  total_asset,     //!< total supply, by ASSET_TYPES_V2 index
+  reserve_asset    //!< reserve supply, by RESERVE_TYPES_V2 index
+};
+
+typedef std::map<std::pair<supply_tally_table, uint64_t>, boost::multiprecision::int128_t> supply_tallies;
+
 #pragma pack(push, 1)
 
 /**
@@ -1219,6 +1230,22 @@ public:
    */
   virtual std::vector<oracle::pricing_record> get_pricing_record_history() const = 0;
 
+  /**
+   * @brief fetch the raw values of all supply tallies
+   *
+   * @param tallies return-by-reference every stored tally, by table and index
+   */
+  virtual void get_supply_tallies(supply_tallies &tallies) const = 0;
+
+  /**
+   * @brief overwrite supply tallies, for repairing them
+   *
+   * Tallies not in the map are left alone.
+   *
+   * @param tallies the values to store, by table and index
+   */
+  virtual void set_supply_tallies(const supply_tallies &tallies) = 0;
+
   /**
    * <!--
    * TODO: Rewrite (if necessary) such that all calls to remove_* are
@@ -1557,6 +1584,22 @@ public:
   */
   virtual uint64_t get_output_id_from_asset_type_output_index(const std::string asset_type, const uint64_t &asset_type_output_index) const = 0;
 
+  /**
+   * @brief gets output ids and data for a batch of asset type output indices
+   *
+   * The lookups are done in ascending index order, so the asset type and
+   * amount tables are walked forward rather than searched once per index,
+   * which matters for the scattered decoy requests of get_outs.
+   *
+   * If any of the indices does not exist, throw OUTPUT_DNE.
+   *
+   * @param asset_type
+   * @param asset_type_output_indices asset type output indices, in any order, duplicates allowed
+   * @param output_ids return-by-reference outputs' global ids, in request order
+   * @param outputs return-by-reference outputs' data, in request order
+   */
+  virtual void get_output_data_from_asset_type_output_indices(const std::string &asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_ids, std::vector<output_data_t> &outputs) const = 0;
+
 
   /**
    * @brief gets an output's tx hash and index
@@ -1746,6 +1789,37 @@ public:
    */
   virtual bool check_pruning() = 0;
 
+  /**
+   * @brief trains compression dictionaries for the pruned and prunable tx data
+   *
+   * Once a table has a dictionary, tx data added to it is compressed, and
+   * compress_txs can compress what was stored before. Tables which already
+   * have a dictionary are left alone.
+   *
+   * @param max_samples the max number of txes to sample from each table
+   * @param dict_size the max size of each dictionary, in bytes
+   * @return success iff true
+   */
+  virtual bool train_tx_compression(size_t max_samples, size_t dict_size) = 0;
+
+  /**
+   * @brief compresses tx data stored before compression was enabled
+   *
+   * Each call commits its work, so it can be interrupted and resumed.
+   *
+   * @param max_txes the max number of txes to go through in this call
+   * @return the number of txes left to go through
+   */
+  virtual uint64_t compress_txs(uint64_t max_txes) = 0;
+
+  /**
+   * @brief gets the space used by the pruned and prunable tx data
+   *
+   * @param pruned_bytes return-by-reference the size of the pruned tx data
+   * @param prunable_bytes return-by-reference the size of the prunable tx data
+   */
+  virtual void get_tx_data_size(uint64_t &pruned_bytes, uint64_t &prunable_bytes) const = 0;
+
   /**
    * @brief get the max block size
    */
@@ -2027,6 +2101,21 @@ private:
 class db_rtxn_guard: public db_txn_guard { public: db_rtxn_guard(BlockchainDB *db): db_txn_guard(db, true) {} };
 class db_wtxn_guard: public db_txn_guard { public: db_wtxn_guard(BlockchainDB *db): db_txn_guard(db, false) {} };
 
+/**
+ * @brief a read txn pinned for the scope, along with the chain height it sees
+ *
+ * Reads made through the db while this is alive all see the same snapshot,
+ * so they agree with height() even if blocks are added or popped meanwhile.
+ */
+class db_read_snapshot: public db_rtxn_guard
+{
+public:
+  db_read_snapshot(BlockchainDB *db): db_rtxn_guard(db), m_height(db->height()) {}
+  uint64_t height() const { return m_height; }
+private:
+  const uint64_t m_height;
+};
+
 BlockchainDB *new_db();
 
 }  // namespace cryptonote
@@ -31,13 +31,21 @@
 #include <boost/format.hpp>
 #include <boost/circular_buffer.hpp>
 
+#include <algorithm>
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
+#include <fstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "common/util.h"
 #include "common/pruning.h"
+#include "common/metrics.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/cryptonote_tx_utils.h"
 #include "crypto/crypto.h"
@@ -59,7 +67,10 @@ using epee::string_tools::pod_to_hex;
 using namespace crypto;
 
 // Increase when the DB structure changes
-#define VERSION 5
+#define VERSION 6
+// Version 6 only adds zstd compressed tx data. A db stays at version 5 until a compression
+// dictionary is stored in it, so binaries which cannot read compressed txes refuse only those
+#define VERSION_UNCOMPRESSED 5
 
 namespace
 {
@@ -193,8 +204,8 @@ namespace
  * block_heights    block hash   block height
  * block_info       block ID     {block metadata}
  *
- * txs_pruned       txn ID       pruned txn blob
- * txs_prunable     txn ID       prunable txn blob
+ * txs_pruned       txn ID       pruned txn blob, maybe zstd compressed
+ * txs_prunable     txn ID       prunable txn blob, maybe zstd compressed
  * txs_prunable_hash txn ID      prunable txn hash
  * txs_prunable_tip txn ID       height
  * tx_indices       txn hash     {txn ID, metadata}
@@ -255,6 +266,41 @@ const char* const LMDB_RESERVE_ASSET_SUPPLY = "reserve_asset_supply";
 const char zerokey[8] = {0};
 const MDB_val zerokval = { sizeof(zerokey), (void *)zerokey };
 
+// zstd dictionaries for the tx data tables, in the properties table, and how
+// far compress_txs got with data stored before the dictionaries
+const char* const TXS_PRUNED_ZSTD_DICT = "txs_pruned_zstd_dict";
+const char* const TXS_PRUNABLE_ZSTD_DICT = "txs_prunable_zstd_dict";
+const char* const TXS_ZSTD_COMPRESSED_TO = "txs_zstd_compressed_to";
+const int TX_COMPRESSION_LEVEL = 9;
+
+unsigned long get_current_pid()
+{
+#ifdef _WIN32
+  return GetCurrentProcessId();
+#else
+  return getpid();
+#endif
+}
+
+// spent key image prefilter, saved next to the db on close
+const char* const KEY_IMAGE_FILTER_FILENAME = "key_images.filter";
+const uint32_t KEY_IMAGE_FILTER_MAGIC = 0x4649454b; // "KEIF"
+const uint32_t KEY_IMAGE_FILTER_VERSION = 2;
+const uint64_t KEY_IMAGE_FILTER_MIN_CAPACITY = 1 << 20;
+const size_t KEY_IMAGE_FILTER_BUILD_CHUNK = 65536; // key images read per read txn while building
+
+struct key_image_filter_header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t seed;
+  uint64_t num_blocks;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t height;
+  crypto::hash top_hash;
+};
+
 const std::string lmdb_error(const std::string& error_string, int mdb_res)
 {
   const std::string full_string = error_string + mdb_strerror(mdb_res);
@@ -267,6 +313,91 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+enum txn_end { txn_commit, txn_failed, txn_abort, txn_read };
+
+// how long a txn was open, by how it ended
+void observe_txn(txn_end end, uint64_t start_ticks)
+{
+  static const auto get = [](const char *result) -> tools::metrics::histogram& {
+    return tools::metrics::get_histogram("zephyr_lmdb_txn_seconds", "Time LMDB transactions were open, by how they ended",
+        tools::metrics::latency_buckets(), tools::metrics::label("result", result));
+  };
+  static tools::metrics::histogram *histograms[] = {&get("commit"), &get("failed"), &get("abort"), &get("read")};
+  histograms[end]->observe(tools::ticks_to_ns(tools::get_tick_count() - start_ticks) / 1e9);
+}
+
+// Serves ascending lookups into a DUPFIXED table whose records start with a uint64 sort
+// key. MDB_GET_MULTIPLE hands back the whole leaf page the cursor landed on, so later
+// targets on the same (or the next) page are found there instead of by another descent
+// of the duplicate tree. Decoys cluster around recent outputs, so this hits often.
+class dupfixed_page_reader
+{
+public:
+  dupfixed_page_reader(MDB_cursor *cur, const MDB_val &k, size_t record_size):
+    m_cur(cur), m_key(k), m_record_size(record_size), m_page(nullptr), m_count(0) {}
+
+  int get(uint64_t target, const void *&record)
+  {
+    if (m_count && target >= sort_key(0))
+    {
+      MDB_val k = m_key, page = {0, nullptr};
+      if (target > sort_key(m_count - 1) && target - sort_key(m_count - 1) <= m_count &&
+          !mdb_cursor_get(m_cur, &k, &page, MDB_NEXT_MULTIPLE) && page.mv_data)
+        set_page(page);
+      if (target >= sort_key(0) && target <= sort_key(m_count - 1))
+      {
+        size_t lo = 0, hi = m_count;
+        while (lo < hi)
+        {
+          const size_t mid = lo + (hi - lo) / 2;
+          if (sort_key(mid) < target)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+        if (sort_key(lo) != target)
+          return MDB_NOTFOUND;
+        record = m_page + lo * m_record_size;
+        return 0;
+      }
+    }
+
+    MDB_val k = m_key, v = {sizeof(target), (void *)&target};
+    m_count = 0;
+    int result = mdb_cursor_get(m_cur, &k, &v, MDB_GET_BOTH);
+    if (result)
+      return result;
+    record = v.mv_data;
+    // a key with a single record has no duplicate tree, and MDB_GET_MULTIPLE then succeeds
+    // without a page, so the record found is served as a page of its own
+    MDB_val page = {0, nullptr};
+    if (!mdb_cursor_get(m_cur, &k, &page, MDB_GET_MULTIPLE) && page.mv_data)
+      set_page(page);
+    else
+      set_page(v);
+    return 0;
+  }
+
+private:
+  uint64_t sort_key(size_t n) const
+  {
+    uint64_t key;
+    memcpy(&key, m_page + n * m_record_size, sizeof(key));
+    return key;
+  }
+
+  void set_page(const MDB_val &page)
+  {
+    m_page = (const char *)page.mv_data;
+    m_count = page.mv_size / m_record_size;
+  }
+
+  MDB_cursor *m_cur;
+  MDB_val m_key;
+  const size_t m_record_size;
+  const char *m_page;
+  size_t m_count;
+};
 
 }  // anonymous namespace
 
@@ -413,7 +544,7 @@ mdb_threadinfo::~mdb_threadinfo()
     mdb_txn_abort(m_ti_rtxn);
 }
 
-mdb_txn_safe::mdb_txn_safe(const bool check) : m_txn(NULL), m_tinfo(NULL), m_check(check)
+mdb_txn_safe::mdb_txn_safe(const bool check) : m_txn(NULL), m_tinfo(NULL), m_check(check), m_start(tools::get_tick_count())
 {
   if (check)
   {
@@ -430,6 +561,7 @@ mdb_txn_safe::~mdb_txn_safe()
   LOG_PRINT_L3("mdb_txn_safe: destructor");
   if (m_tinfo != nullptr)
   {
+    observe_txn(txn_read, m_tinfo->m_ti_start);
     mdb_txn_reset(m_tinfo->m_ti_rtxn);
     memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
   } else if (m_txn != nullptr)
@@ -449,6 +581,7 @@ mdb_txn_safe::~mdb_txn_safe()
       LOG_PRINT_L3("mdb_txn_safe: m_txn not NULL in destructor - calling mdb_txn_abort()");
     }
     mdb_txn_abort(m_txn);
+    observe_txn(txn_abort, m_start);
   }
   num_active_txns--;
 }
@@ -466,7 +599,9 @@ void mdb_txn_safe::commit(std::string message)
     message = "Failed to commit a transaction to the db";
   }
 
-  if (auto result = mdb_txn_commit(m_txn))
+  auto result = mdb_txn_commit(m_txn);
+  observe_txn(result ? txn_failed : txn_commit, m_start);
+  if (result)
   {
     m_txn = nullptr;
     throw0(DB_ERROR(lmdb_error(message + ": ", result).c_str()));
@@ -480,6 +615,7 @@ void mdb_txn_safe::abort()
   if(m_txn != nullptr)
   {
     mdb_txn_abort(m_txn);
+    observe_txn(txn_abort, m_start);
     m_txn = nullptr;
   }
   else
@@ -1291,12 +1427,13 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
   if (unprunable_size > blob.size())
     throw0(DB_ERROR("pruned tx size is larger than tx size"));
 
-  MDB_val pruned_blob = {unprunable_size, (void*)blob.data()};
+  std::string buffer;
+  MDB_val pruned_blob = compress_tx_data(m_txs_pruned_codec, {unprunable_size, (void*)blob.data()}, buffer);
   result = mdb_cursor_put(m_cur_txs_pruned, &val_tx_id, &pruned_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add pruned tx blob to db transaction: ", result).c_str()));
 
-  MDB_val prunable_blob = {blob.size() - unprunable_size, (void*)(blob.data() + unprunable_size)};
+  MDB_val prunable_blob = compress_tx_data(m_txs_prunable_codec, {blob.size() - unprunable_size, (void*)(blob.data() + unprunable_size)}, buffer);
   result = mdb_cursor_put(m_cur_txs_prunable, &val_tx_id, &prunable_blob, MDB_APPEND);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add prunable tx blob to db transaction: ", result).c_str()));
@@ -2085,6 +2222,9 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+  // even if this txn is aborted, the extra entry only makes for a false positive
+  if (const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter))
+    kif->filter.insert(kif->hash(k_image));
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -2134,6 +2274,8 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_committed_height = 0;
+  m_key_image_filter_stop = false;
 
   // reset may also need changing when initialize things here
 
@@ -2332,7 +2474,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       compatible = false;
     }
 #if VERSION > 0
-    else if (db_version < VERSION)
+    else if (db_version < VERSION_UNCOMPRESSED)
     {
       if (mdb_flags & MDB_RDONLY)
       {
@@ -2349,6 +2491,9 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      m_committed_height = read_height();
+      load_tx_compression_dictionaries();
+      init_key_image_filter();
       return;
     }
 #endif
@@ -2378,7 +2523,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     if (m_height == 0)
     {
       MDB_val_str(k, "version");
-      MDB_val_copy<uint32_t> v(VERSION);
+      MDB_val_copy<uint32_t> v(VERSION_UNCOMPRESSED);
       auto put_result = mdb_put(txn, m_properties, &k, &v, 0);
       if (put_result != MDB_SUCCESS)
       {
@@ -2394,7 +2539,10 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   // commit the transaction
   txn.commit();
 
+  m_committed_height = m_height;
   m_open = true;
+  load_tx_compression_dictionaries();
+  init_key_image_filter();
   // from here, init should be finished
 }
 
@@ -2406,6 +2554,7 @@ void BlockchainLMDB::close()
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
     BlockchainLMDB::batch_abort();
   }
+  stop_key_image_filter();
   BlockchainLMDB::sync();
   m_tinfo.reset();
 
@@ -2479,11 +2628,16 @@ void BlockchainLMDB::reset()
 
   // init with current version
   MDB_val_str(k, "version");
-  MDB_val_copy<uint32_t> v(VERSION);
+  MDB_val_copy<uint32_t> v(VERSION_UNCOMPRESSED);
   if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
   txn.commit();
+  m_committed_height = 0;
+  if (const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter))
+    kif->filter.clear();
+  m_txs_pruned_codec.set_dictionary(std::string());
+  m_txs_prunable_codec.set_dictionary(std::string());
   m_cum_size = 0;
   m_cum_count = 0;
 }
@@ -2808,7 +2962,7 @@ uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
   return pruning_seed;
 }
 
-static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
+bool BlockchainLMDB::is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id) const
 {
   MDB_val v;
   int ret = mdb_cursor_get(c_txs_pruned, tx_id, &v, MDB_SET);
@@ -2816,7 +2970,9 @@ static bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id)
     throw0(DB_ERROR(lmdb_error("Failed to find transaction pruned data: ", ret).c_str()));
   if (v.mv_size == 0)
     throw0(DB_ERROR("Invalid transaction pruned data"));
-  return cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  cryptonote::blobdata bd;
+  append_tx_data(m_txs_pruned_codec, v, bd);
+  return cryptonote::is_v1_tx(cryptonote::blobdata_ref{bd.data(), bd.size()});
 }
 
 enum { prune_mode_prune, prune_mode_update, prune_mode_check };
@@ -3119,6 +3275,311 @@ bool BlockchainLMDB::check_pruning()
   return prune_worker(prune_mode_check, 0);
 }
 
+void BlockchainLMDB::load_tx_compression_dictionaries()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(properties)
+  auto load = [&](const char *name, tools::zstd_dict_codec &codec) {
+    MDB_val_str(k, name);
+    MDB_val v;
+    int result = mdb_cursor_get(m_cur_properties, &k, &v, MDB_SET);
+    if (result == MDB_NOTFOUND)
+    {
+      codec.set_dictionary(std::string());
+      return;
+    }
+    if (result)
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to retrieve ") + name + ": ", result).c_str()));
+    if (!tools::zstd_dict_codec::available())
+      throw0(DB_ERROR("The blockchain has compressed transactions, but zstd support was not built in"));
+    if (!codec.set_dictionary(std::string((const char*)v.mv_data, v.mv_size), TX_COMPRESSION_LEVEL))
+      throw0(DB_ERROR((std::string("Failed to load ") + name).c_str()));
+    MINFO("Transaction compression dictionary " << name << " loaded, id " << codec.dictionary_id());
+  };
+  load(TXS_PRUNED_ZSTD_DICT, m_txs_pruned_codec);
+  load(TXS_PRUNABLE_ZSTD_DICT, m_txs_prunable_codec);
+  TXN_POSTFIX_RDONLY();
+}
+
+void BlockchainLMDB::append_tx_data(const tools::zstd_dict_codec &codec, const MDB_val &v, cryptonote::blobdata &bd) const
+{
+  // without a dictionary, nothing in the table is compressed; with one, raw
+  // blobs starting like a frame are stored compressed too, see compress_tx_data
+  const char *data = (const char*)v.mv_data;
+  if (codec.empty() || !tools::zstd_dict_codec::is_frame(data, v.mv_size))
+  {
+    bd.append(data, v.mv_size);
+    return;
+  }
+  if (!codec.decompress(data, v.mv_size, bd))
+    throw0(DB_ERROR("Failed to decompress transaction data"));
+}
+
+MDB_val BlockchainLMDB::compress_tx_data(const tools::zstd_dict_codec &codec, const MDB_val &v, std::string &buffer) const
+{
+  if (codec.empty())
+    return v;
+  // a raw blob which looks like a frame has to be stored compressed, even
+  // if larger, or it would be read back as one
+  const bool looks_compressed = tools::zstd_dict_codec::is_frame(v.mv_data, v.mv_size);
+  if (!codec.compress(v.mv_data, v.mv_size, buffer))
+  {
+    if (looks_compressed)
+      throw0(DB_ERROR("Failed to compress transaction data"));
+    return v;
+  }
+  if (!looks_compressed && buffer.size() >= v.mv_size)
+    return v;
+  return {buffer.size(), (void*)buffer.data()};
+}
+
+bool BlockchainLMDB::used_by_other_processes() const
+{
+  // stale slots left by processes which died would count too
+  int dead;
+  int result = mdb_reader_check(m_env, &dead);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to check db readers: ", result).c_str()));
+  unsigned others = 0;
+  result = mdb_reader_list(m_env, [](const char *msg, void *ctx) {
+    // a line per reader slot, starting with its pid, after a header line
+    char *end;
+    const long pid = strtol(msg, &end, 10);
+    if (end != msg && pid != (long)get_current_pid())
+      ++*(unsigned*)ctx;
+    return 0;
+  }, &others);
+  if (result < 0)
+    throw0(DB_ERROR(lmdb_error("Failed to list db readers: ", result).c_str()));
+  return others > 0;
+}
+
+bool BlockchainLMDB::train_tx_compression(size_t max_samples, size_t dict_size)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!tools::zstd_dict_codec::available())
+  {
+    MERROR("zstd support was not built in, cannot compress transactions");
+    return false;
+  }
+  if (max_samples == 0 || dict_size == 0)
+    return false;
+
+  // processes which opened the db before the dictionaries exist would not
+  // be able to read what gets compressed with them
+  if (used_by_other_processes())
+  {
+    MERROR("The blockchain is in use by another process, stop it before compressing transactions");
+    return false;
+  }
+
+  mdb_txn_safe txn;
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  bool has_dictionary = false;
+  auto train = [&](MDB_dbi dbi, const char *name) {
+    MDB_val_str(k, name);
+    MDB_val v;
+    result = mdb_get(txn, m_properties, &k, &v);
+    if (result == 0)
+    {
+      MINFO(name << " already exists, keeping it");
+      has_dictionary = true;
+      return true;
+    }
+    if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to retrieve ") + name + ": ", result).c_str()));
+
+    MDB_cursor *cur;
+    result = mdb_cursor_open(txn, dbi, &cur);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor: ", result).c_str()));
+
+    // take samples spread over the whole chain, as txes changed over forks
+    MDB_val key, val;
+    uint64_t first = 0, last = 0;
+    if ((result = mdb_cursor_get(cur, &key, &val, MDB_FIRST)) == 0)
+    {
+      first = *(const uint64_t*)key.mv_data;
+      if ((result = mdb_cursor_get(cur, &key, &val, MDB_LAST)) == 0)
+        last = *(const uint64_t*)key.mv_data;
+    }
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+
+    std::vector<std::string> samples;
+    const size_t max_bytes = dict_size * 128;
+    size_t bytes = 0;
+    uint64_t prev = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; result == 0 && i < max_samples && bytes < max_bytes; ++i)
+    {
+      // spread evenly even when there are fewer txes than samples, without overflowing
+      const uint64_t span = last - first;
+      uint64_t tx_id = first + span / max_samples * i + span % max_samples * i / max_samples;
+      MDB_val_set(kp, tx_id);
+      result = mdb_cursor_get(cur, &kp, &val, MDB_SET_RANGE);
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", result).c_str()));
+      tx_id = *(const uint64_t*)kp.mv_data;
+      if (tx_id == prev || val.mv_size < 8)
+        continue;
+      prev = tx_id;
+      samples.emplace_back((const char*)val.mv_data, val.mv_size);
+      bytes += val.mv_size;
+    }
+    mdb_cursor_close(cur);
+    if (samples.empty())
+    {
+      MINFO("Nothing to train " << name << " from, leaving that table uncompressed");
+      return true;
+    }
+
+    std::string dict;
+    if (!tools::zstd_dict_codec::train(samples, dict_size, dict))
+    {
+      MERROR("Failed to train " << name << " from " << samples.size() << " samples");
+      return false;
+    }
+    MINFO("Trained " << name << " from " << samples.size() << " samples (" << bytes << " bytes), " << dict.size() << " bytes");
+    v.mv_data = (void*)dict.data();
+    v.mv_size = dict.size();
+    if ((result = mdb_put(txn, m_properties, &k, &v, 0)))
+      throw0(DB_ERROR(lmdb_error(std::string("Failed to save ") + name + ": ", result).c_str()));
+    has_dictionary = true;
+    return true;
+  };
+
+  if (!train(m_txs_pruned, TXS_PRUNED_ZSTD_DICT) || !train(m_txs_prunable, TXS_PRUNABLE_ZSTD_DICT))
+    return false;
+
+  // binaries from before compression would read the frames as raw tx blobs, and they refuse
+  // dbs from later versions
+  if (has_dictionary)
+  {
+    MDB_val_str(vk, "version");
+    MDB_val_copy<uint32_t> vv(VERSION);
+    if ((result = mdb_put(txn, m_properties, &vk, &vv, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  }
+  txn.commit();
+
+  load_tx_compression_dictionaries();
+  return true;
+}
+
+uint64_t BlockchainLMDB::compress_txs(uint64_t max_txes)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (m_txs_pruned_codec.empty() && m_txs_prunable_codec.empty())
+    throw0(DB_ERROR("No transaction compression dictionary, train one first"));
+  if (used_by_other_processes())
+    throw0(DB_ERROR("The blockchain is in use by another process, stop it before compressing transactions"));
+
+  if (need_resize())
+  {
+    LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+    do_resize();
+  }
+
+  mdb_txn_safe txn;
+  int result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+  MDB_val_str(k, TXS_ZSTD_COMPRESSED_TO);
+  MDB_val v;
+  uint64_t start = 0;
+  result = mdb_get(txn, m_properties, &k, &v);
+  if (result == 0)
+  {
+    if (v.mv_size != sizeof(start))
+      throw0(DB_ERROR("Failed to retrieve compression progress: unexpected value size"));
+    memcpy(&start, v.mv_data, sizeof(start));
+  }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve compression progress: ", result).c_str()));
+
+  MDB_stat db_stats;
+  if ((result = mdb_stat(txn, m_txs_pruned, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+  const uint64_t count = db_stats.ms_entries;
+  const uint64_t end = std::min(count, start + max_txes);
+
+  MDB_cursor *c_txs_pruned, *c_txs_prunable;
+  if ((result = mdb_cursor_open(txn, m_txs_pruned, &c_txs_pruned)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+  if ((result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable)))
+    throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+
+  std::string buffer;
+  auto compress = [&](MDB_cursor *cur, const tools::zstd_dict_codec &codec, MDB_val *kp) {
+    if (codec.empty())
+      return;
+    MDB_val data;
+    result = mdb_cursor_get(cur, kp, &data, MDB_SET);
+    if (result == MDB_NOTFOUND)
+      return;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to find transaction data: ", result).c_str()));
+    if (tools::zstd_dict_codec::is_frame(data.mv_data, data.mv_size))
+    {
+      cryptonote::blobdata bd;
+      if (codec.decompress(data.mv_data, data.mv_size, bd))
+        return;
+    }
+    MDB_val compressed = compress_tx_data(codec, data, buffer);
+    if (compressed.mv_data == data.mv_data)
+      return;
+    if ((result = mdb_cursor_put(cur, kp, &compressed, MDB_CURRENT)))
+      throw0(DB_ERROR(lmdb_error("Failed to save compressed transaction data: ", result).c_str()));
+  };
+  for (uint64_t tx_id = start; tx_id < end; ++tx_id)
+  {
+    MDB_val_set(kp, tx_id);
+    compress(c_txs_pruned, m_txs_pruned_codec, &kp);
+    compress(c_txs_prunable, m_txs_prunable_codec, &kp);
+  }
+  mdb_cursor_close(c_txs_prunable);
+  mdb_cursor_close(c_txs_pruned);
+
+  v.mv_data = (void*)&end;
+  v.mv_size = sizeof(end);
+  if ((result = mdb_put(txn, m_properties, &k, &v, 0)))
+    throw0(DB_ERROR(lmdb_error("Failed to save compression progress: ", result).c_str()));
+  txn.commit();
+
+  return count - end;
+}
+
+void BlockchainLMDB::get_tx_data_size(uint64_t &pruned_bytes, uint64_t &prunable_bytes) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  auto size = [&](MDB_dbi dbi) {
+    MDB_stat db_stats;
+    int result = mdb_stat(m_txn, dbi, &db_stats);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to query tx data size: ", result).c_str()));
+    return uint64_t(db_stats.ms_branch_pages + db_stats.ms_leaf_pages + db_stats.ms_overflow_pages) * db_stats.ms_psize;
+  };
+  pruned_bytes = size(m_txs_pruned);
+  prunable_bytes = size(m_txs_prunable);
+  TXN_POSTFIX_RDONLY();
+}
+
 bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata_ref*)> f, bool include_blob, relay_category category) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3385,7 +3846,7 @@ std::pair<std::vector<uint64_t>, uint64_t> BlockchainLMDB::get_block_cumulative_
     const mdb_block_info *bi = ((const mdb_block_info *)v.mv_data) + (height - range_begin);
 
     res.push_back(bi->bi_cum_rct_by_asset_type[asset_type]);
-    if (height == heights[heights.size() - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE])
+    if (heights.size() >= CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE && height == heights[heights.size() - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE])
       num_spendable_global_outs = bi->bi_cum_rct;
 
     prev_height = height;
@@ -3749,6 +4210,22 @@ uint64_t BlockchainLMDB::height() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+
+  // with no txn pinned on this thread, a read txn opened just for this would
+  // see the last committed height anyway, so skip it. Callers wanting the
+  // height to match their other reads pin a txn first (see db_read_snapshot).
+  // A read only db is written by another process, so we never see commits.
+  if (!(m_write_txn && m_writer == boost::this_thread::get_id()) && !is_read_only())
+  {
+    const mdb_threadinfo *tinfo = m_tinfo.get();
+    if (!tinfo || !tinfo->m_ti_rflags.m_rf_txn || mdb_txn_env(tinfo->m_ti_rtxn) != m_env)
+      return m_committed_height;
+  }
+  return read_height();
+}
+
+uint64_t BlockchainLMDB::read_height() const
+{
   TXN_PREFIX_RDONLY();
   int result;
 
@@ -3934,6 +4411,69 @@ std::vector<oracle::pricing_record> BlockchainLMDB::get_pricing_record_history()
   return pricing_record_history;
 }
 
+void BlockchainLMDB::get_supply_tallies(supply_tallies &tallies) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  tallies.clear();
+  TXN_PREFIX_RDONLY();
+  RCURSOR(circ_supply_tally);
+  RCURSOR(total_asset_supply);
+  RCURSOR(reserve_asset_supply);
+
+  auto read = [&](MDB_cursor *cur, supply_tally_table table) {
+    MDB_val k, v;
+    MDB_cursor_op op = MDB_FIRST;
+    while (1)
+    {
+      int result = mdb_cursor_get(cur, &k, &v, op);
+      op = MDB_NEXT;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate supply tallies: ", result).c_str()));
+      const uint64_t idx = *(const uint64_t*)k.mv_data;
+      circ_supply_tally cst = *(const circ_supply_tally*)v.mv_data;
+      tallies[std::make_pair(table, idx)] = import_tally_from_cst(&cst);
+    }
+  };
+  read(m_cur_circ_supply_tally, supply_tally_table::circulating);
+  read(m_cur_total_asset_supply, supply_tally_table::total_asset);
+  read(m_cur_reserve_asset_supply, supply_tally_table::reserve_asset);
+
+  TXN_POSTFIX_RDONLY();
+}
+
+void BlockchainLMDB::set_supply_tallies(const supply_tallies &tallies)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  for (const auto &e: tallies)
+  {
+    MDB_dbi dbi;
+    switch (e.first.first)
+    {
+      case supply_tally_table::circulating: dbi = m_circ_supply_tally; break;
+      case supply_tally_table::total_asset: dbi = m_total_asset_supply; break;
+      case supply_tally_table::reserve_asset: dbi = m_reserve_asset_supply; break;
+      default: throw0(DB_ERROR("Unknown supply tally table"));
+    }
+    MDB_cursor *cur;
+    int result = mdb_cursor_open(*txn_ptr, dbi, &cur);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open cursor: ", result).c_str()));
+    MDB_val_copy<uint64_t> idx(e.first.second);
+    write_circulating_supply_data(cur, idx, e.second);
+    mdb_cursor_close(cur);
+  }
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
 uint64_t BlockchainLMDB::num_outputs() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4071,8 +4611,9 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  bd.clear();
+  append_tx_data(m_txs_pruned_codec, result0, bd);
+  append_tx_data(m_txs_prunable_codec, result1, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -4102,7 +4643,8 @@ bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_tx_data(m_txs_pruned_codec, result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -4143,7 +4685,8 @@ bool BlockchainLMDB::get_pruned_tx_blobs_from(const crypto::hash& h, size_t coun
       return false;
     if (res)
       throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx blob", res).c_str()));
-    bd.emplace_back(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+    bd.emplace_back();
+    append_tx_data(m_txs_pruned_codec, result, bd.back());
   }
 
   TXN_POSTFIX_RDONLY();
@@ -4283,14 +4826,14 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      tx_blob.assign((const char*)v.mv_data, v.mv_size);
+      append_tx_data(m_txs_pruned_codec, v, tx_blob);
 
       if (!pruned)
       {
         result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        append_tx_data(m_txs_prunable_codec, v, tx_blob);
       }
       current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
       size += current_block.second.back().second.size();
@@ -4328,7 +4871,8 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  bd.clear();
+  append_tx_data(m_txs_prunable_codec, result, bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -4535,6 +5079,72 @@ void BlockchainLMDB::get_output_id_from_asset_type_output_index(const std::strin
   TXN_POSTFIX_RDONLY();
 }
 
+void BlockchainLMDB::get_output_data_from_asset_type_output_indices(const std::string &asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_ids, std::vector<output_data_t> &outputs) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  TIME_MEASURE_START(db3);
+  check_open();
+  const size_t n_outputs = asset_type_output_indices.size();
+  output_ids.resize(n_outputs);
+  outputs.resize(n_outputs);
+  if (n_outputs == 0)
+    return;
+
+  // visit the requests in index order, so both dup-sets are walked forward. Outputs are
+  // appended to both tables together, so global ids come out in ascending order too
+  std::vector<size_t> order(n_outputs);
+  for (size_t i = 0; i < n_outputs; ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&asset_type_output_indices](size_t a, size_t b) {
+    return asset_type_output_indices[a] < asset_type_output_indices[b];
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_types);
+  RCURSOR(output_amounts);
+
+  MDB_val_copy<const char *> k_type(asset_type.c_str());
+  const uint64_t amount = 0;
+  MDB_val_set(k_amount, amount);
+  dupfixed_page_reader types_reader(m_cur_output_types, k_type, sizeof(outassettype));
+  dupfixed_page_reader amounts_reader(m_cur_output_amounts, k_amount, sizeof(outkey));
+
+  size_t prev = n_outputs;
+  for (const size_t i: order)
+  {
+    const uint64_t index = asset_type_output_indices[i];
+    if (prev != n_outputs && index == asset_type_output_indices[prev])
+    {
+      output_ids[i] = output_ids[prev];
+      outputs[i] = outputs[prev];
+      continue;
+    }
+
+    const void *record;
+    auto get_result = types_reader.get(index, record);
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE((std::string("Attempting to get output id by asset type output id (asset type " + asset_type + " asset type output id " + boost::lexical_cast<std::string>(index) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str())));
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output id by asset type output id from the db", get_result).c_str()));
+    const uint64_t output_id = ((const outassettype *)record)->output_id;
+
+    get_result = amounts_reader.get(output_id, record);
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount 0, index ") + boost::lexical_cast<std::string>(output_id) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
+
+    output_ids[i] = output_id;
+    outputs[i] = ((const outkey *)record)->data;
+    prev = i;
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  TIME_MEASURE_FINISH(db3);
+  LOG_PRINT_L3("db3: " << db3);
+}
+
 uint64_t BlockchainLMDB::get_output_id_from_asset_type_output_index(const std::string asset_type, const uint64_t &asset_type_output_index) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4644,6 +5254,10 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter);
+  if (kif && kif->ready && !kif->filter.maybe_contains(kif->hash(img)))
+    return false;
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -4689,6 +5303,203 @@ bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_ima
   return fret;
 }
 
+uint64_t BlockchainLMDB::key_image_filter::hash(const crypto::key_image& img) const
+{
+  // key images are already uniform, the seed keeps the bits we look at
+  // from being predictable
+  uint64_t w[4];
+  memcpy(w, &img, sizeof(w));
+  uint64_t h = (w[0] ^ seed) * 0xff51afd7ed558ccdull;
+  h ^= w[1] + (h >> 29);
+  h ^= (w[2] ^ w[3]) * 0xc4ceb9fe1a85ec53ull;
+  return h ^ (h >> 32);
+}
+
+void BlockchainLMDB::init_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // another process does the writing, we would not see the key images it adds
+  if (is_read_only())
+    return;
+
+  m_key_image_filter_stop = false;
+  if (load_key_image_filter())
+  {
+    MINFO("Loaded spent key image filter, " << m_key_image_filter->filter.get_count() << " entries");
+    return;
+  }
+
+  uint64_t num_key_images;
+  {
+    TXN_PREFIX_RDONLY();
+    MDB_stat db_stats;
+    if (int result = mdb_stat(m_txn, m_spent_keys, &db_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+    num_key_images = db_stats.ms_entries;
+  }
+  start_key_image_filter_build(std::max<uint64_t>(2 * num_key_images, KEY_IMAGE_FILTER_MIN_CAPACITY));
+}
+
+void BlockchainLMDB::start_key_image_filter_build(uint64_t capacity)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  std::shared_ptr<key_image_filter> kif = std::make_shared<key_image_filter>();
+  kif->seed = crypto::rand<uint64_t>();
+  kif->filter.init(capacity);
+  std::atomic_store(&m_key_image_filter, kif);
+
+  // key images spent from now on are added by add_spent_key, so the build
+  // can catch up with the existing ones in the background
+  m_key_image_filter_thread = boost::thread([this, kif]() {
+    try
+    {
+      if (build_key_image_filter(*kif))
+      {
+        MINFO("Built spent key image filter, " << kif->filter.get_count() << " entries");
+        kif->ready = true;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to build spent key image filter, key image lookups will go to the db: " << e.what());
+    }
+  });
+}
+
+void BlockchainLMDB::grow_key_image_filter()
+{
+  // called right after a write txn commits, so the build of the new filter
+  // sees every key image the old one was given
+  const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter);
+  if (!kif || !kif->ready || !kif->filter.is_full())
+    return;
+
+  MINFO("Spent key image filter is full at " << kif->filter.get_count() << " entries, rebuilding it larger");
+  if (m_key_image_filter_thread.joinable())
+    m_key_image_filter_thread.join();
+  start_key_image_filter_build(2 * kif->filter.get_count());
+}
+
+bool BlockchainLMDB::build_key_image_filter(key_image_filter &kif)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // a fresh read txn for every chunk, so a long build does not hold back a resize
+  crypto::key_image last;
+  bool started = false;
+  while (!m_key_image_filter_stop)
+  {
+    TXN_PREFIX_RDONLY();
+    RCURSOR(spent_keys);
+
+    MDB_val k = zerokval, v;
+    int result;
+    if (!started)
+    {
+      result = mdb_cursor_get(m_cur_spent_keys, &k, &v, MDB_FIRST);
+    }
+    else
+    {
+      v = {sizeof(last), (void *)&last};
+      result = mdb_cursor_get(m_cur_spent_keys, &k, &v, MDB_GET_BOTH_RANGE);
+      if (result == 0 && memcmp(v.mv_data, &last, sizeof(last)) == 0)
+        result = mdb_cursor_get(m_cur_spent_keys, &k, &v, MDB_NEXT_DUP);
+    }
+    for (size_t n = 0; n < KEY_IMAGE_FILTER_BUILD_CHUNK && result == 0; ++n)
+    {
+      memcpy(&last, v.mv_data, sizeof(last));
+      started = true;
+      kif.filter.insert(kif.hash(last));
+      result = mdb_cursor_get(m_cur_spent_keys, &k, &v, MDB_NEXT_DUP);
+    }
+    if (result == MDB_NOTFOUND)
+      return true;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate key images: ", result).c_str()));
+  }
+  return false;
+}
+
+void BlockchainLMDB::stop_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  m_key_image_filter_stop = true;
+  if (m_key_image_filter_thread.joinable())
+    m_key_image_filter_thread.join();
+  const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter);
+  if (kif && kif->ready)
+  {
+    try { save_key_image_filter(); }
+    catch (const std::exception &e) { MWARNING("Failed to save spent key image filter: " << e.what()); }
+  }
+  std::atomic_store(&m_key_image_filter, std::shared_ptr<key_image_filter>());
+}
+
+bool BlockchainLMDB::load_key_image_filter()
+{
+  const boost::filesystem::path path = boost::filesystem::path(m_folder) / KEY_IMAGE_FILTER_FILENAME;
+  std::ifstream file(path.string(), std::ios::binary);
+  if (!file)
+    return false;
+
+  key_image_filter_header header;
+  if (!file.read((char*)&header, sizeof(header)) || header.magic != KEY_IMAGE_FILTER_MAGIC || header.version != KEY_IMAGE_FILTER_VERSION)
+    return false;
+
+  // only valid for the exact chain state it was saved at
+  const uint64_t db_height = read_height();
+  if (header.height != db_height || db_height == 0 || header.top_hash != get_block_hash_from_height(db_height - 1))
+  {
+    MINFO("Spent key image filter is out of date, rebuilding it");
+    return false;
+  }
+  if (header.count > header.capacity)
+  {
+    MINFO("Spent key image filter is full, rebuilding it larger");
+    return false;
+  }
+
+  std::vector<uint64_t> words(header.num_blocks * tools::blocked_bloom_filter::BLOCK_WORDS);
+  if (words.empty() || !file.read((char*)words.data(), words.size() * sizeof(uint64_t)))
+    return false;
+  std::shared_ptr<key_image_filter> kif = std::make_shared<key_image_filter>();
+  kif->seed = header.seed;
+  kif->filter.load(header.num_blocks, words.data(), header.count, header.capacity);
+  kif->ready = true;
+  std::atomic_store(&m_key_image_filter, kif);
+  return true;
+}
+
+void BlockchainLMDB::save_key_image_filter() const
+{
+  const uint64_t db_height = read_height();
+  if (db_height == 0)
+    return;
+
+  const std::shared_ptr<key_image_filter> kif = std::atomic_load(&m_key_image_filter);
+  key_image_filter_header header;
+  header.magic = KEY_IMAGE_FILTER_MAGIC;
+  header.version = KEY_IMAGE_FILTER_VERSION;
+  header.seed = kif->seed;
+  header.num_blocks = kif->filter.get_num_blocks();
+  header.count = kif->filter.get_count();
+  header.capacity = kif->filter.get_capacity();
+  header.height = db_height;
+  header.top_hash = get_block_hash_from_height(db_height - 1);
+
+  std::vector<uint64_t> words(header.num_blocks * tools::blocked_bloom_filter::BLOCK_WORDS);
+  kif->filter.save(words.data());
+
+  const boost::filesystem::path path = boost::filesystem::path(m_folder) / KEY_IMAGE_FILTER_FILENAME;
+  std::ofstream file(path.string(), std::ios::binary | std::ios::trunc);
+  file.write((const char*)&header, sizeof(header));
+  file.write((const char*)words.data(), words.size() * sizeof(uint64_t));
+  if (!file)
+    throw0(DB_ERROR(("Failed to write " + path.string()).c_str()));
+}
+
 bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4776,18 +5587,19 @@ bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&
     transaction tx;
     if (pruned)
     {
-      blobdata_ref bd{reinterpret_cast<char*>(v.mv_data), v.mv_size};
+      blobdata bd;
+      append_tx_data(m_txs_pruned_codec, v, bd);
       if (!parse_and_validate_tx_base_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
     else
     {
       blobdata bd;
-      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      append_tx_data(m_txs_pruned_codec, v, bd);
       ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
       if (ret)
         throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      append_tx_data(m_txs_prunable_codec, v, bd);
       if (!parse_and_validate_tx_from_blob(bd, tx))
         throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
     }
@@ -4913,7 +5725,10 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
   if (m_tinfo.get())
   {
     if (m_tinfo->m_ti_rflags.m_rf_txn)
+    {
+      observe_txn(txn_read, m_tinfo->m_ti_start);
       mdb_txn_reset(m_tinfo->m_ti_rtxn);
+    }
     memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
   }
 
@@ -4936,10 +5751,12 @@ void BlockchainLMDB::batch_commit()
   check_open();
 
   LOG_PRINT_L3("batch transaction: committing...");
+  const uint64_t new_height = read_height();
   TIME_MEASURE_START(time1);
   m_write_txn->commit();
   TIME_MEASURE_FINISH(time1);
   time_commit1 += time1;
+  m_committed_height = new_height;
   LOG_PRINT_L3("batch transaction: committed");
 
   m_write_txn = nullptr;
@@ -4971,12 +5788,14 @@ void BlockchainLMDB::batch_stop()
     throw1(DB_ERROR("batch transaction owned by other thread"));
   check_open();
   LOG_PRINT_L3("batch transaction: committing...");
+  const uint64_t new_height = read_height();
   TIME_MEASURE_START(time1);
   try
   {
     m_write_txn->commit();
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
+    m_committed_height = new_height;
     cleanup_batch();
   }
   catch (const std::exception &e)
@@ -4984,6 +5803,7 @@ void BlockchainLMDB::batch_stop()
     cleanup_batch();
     throw;
   }
+  grow_key_image_filter();
   LOG_PRINT_L3("batch transaction: end");
 }
 
@@ -5050,7 +5870,10 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
     ret = true;
   }
   if (ret)
+  {
     tinfo->m_ti_rflags.m_rf_txn = true;
+    tinfo->m_ti_start = tools::get_tick_count();
+  }
   *mtxn = tinfo->m_ti_rtxn;
   *mcur = &tinfo->m_ti_rcursors;
 
@@ -5062,6 +5885,7 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
 void BlockchainLMDB::block_rtxn_stop() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  observe_txn(txn_read, m_tinfo->m_ti_start);
   mdb_txn_reset(m_tinfo->m_ti_rtxn);
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
   /* cancel out the increment from rtxn_start */
@@ -5106,7 +5930,10 @@ void BlockchainLMDB::block_wtxn_start()
     if (m_tinfo.get())
     {
       if (m_tinfo->m_ti_rflags.m_rf_txn)
+      {
+        observe_txn(txn_read, m_tinfo->m_ti_start);
         mdb_txn_reset(m_tinfo->m_ti_rtxn);
+      }
       memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
     }
   } else if (m_writer != boost::this_thread::get_id())
@@ -5123,14 +5950,17 @@ void BlockchainLMDB::block_wtxn_stop()
   {
     if (! m_batch_active)
 	{
+      const uint64_t new_height = read_height();
       TIME_MEASURE_START(time1);
       m_write_txn->commit();
       TIME_MEASURE_FINISH(time1);
       time_commit1 += time1;
+      m_committed_height = new_height;
 
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+      grow_key_image_filter();
 	}
   }
 }
@@ -5154,6 +5984,7 @@ void BlockchainLMDB::block_wtxn_abort()
 void BlockchainLMDB::block_rtxn_abort() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  observe_txn(txn_read, m_tinfo->m_ti_start);
   mdb_txn_reset(m_tinfo->m_ti_rtxn);
   memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
 }
@@ -27,10 +27,13 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include "common/bloom_filter.h"
+#include "common/zstd_dict_codec.h"
 #include <boost/thread/tss.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -141,6 +144,7 @@ typedef struct mdb_threadinfo
   MDB_txn *m_ti_rtxn;	// per-thread read txn
   mdb_txn_cursors m_ti_rcursors;	// per-thread read cursors
   mdb_rflags m_ti_rflags;	// per-thread read state
+  uint64_t m_ti_start;	// ticks the read txn started at, for the txn duration metrics
 
   ~mdb_threadinfo();
 } mdb_threadinfo;
@@ -180,6 +184,7 @@ struct mdb_txn_safe
   MDB_txn* m_txn;
   bool m_batch_txn = false;
   bool m_check;
+  uint64_t m_start; // ticks, for the txn duration metrics
   static std::atomic<uint64_t> num_active_txns;
 
   // could use a mutex here, but this should be sufficient.
@@ -273,6 +278,8 @@ public:
   virtual std::vector<std::pair<std::string, std::string>> get_audited_supply() const;
   virtual std::vector<std::pair<std::string, std::string>> get_circulating_supply() const;
   virtual std::vector<oracle::pricing_record> get_pricing_record_history() const;
+  virtual void get_supply_tallies(supply_tallies &tallies) const;
+  virtual void set_supply_tallies(const supply_tallies &tallies);
 
   virtual bool tx_exists(const crypto::hash& h) const;
   virtual bool tx_exists(const crypto::hash& h, uint64_t& tx_index) const;
@@ -302,6 +309,7 @@ public:
 
   virtual void get_output_id_from_asset_type_output_index(const std::string asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_indices) const;
   virtual uint64_t get_output_id_from_asset_type_output_index(const std::string asset_type, const uint64_t &asset_type_output_index) const;
+  virtual void get_output_data_from_asset_type_output_indices(const std::string &asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_ids, std::vector<output_data_t> &outputs) const;
 
   virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const;
   virtual void get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
@@ -326,6 +334,9 @@ public:
   virtual bool prune_blockchain(uint32_t pruning_seed = 0);
   virtual bool update_pruning();
   virtual bool check_pruning();
+  virtual bool train_tx_compression(size_t max_samples, size_t dict_size);
+  virtual uint64_t compress_txs(uint64_t max_txes);
+  virtual void get_tx_data_size(uint64_t &pruned_bytes, uint64_t &prunable_bytes) const;
 
   virtual void add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata_ref &blob);
   virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob);
@@ -451,7 +462,35 @@ private:
 
   inline void check_open() const;
 
+  // height as seen by the txn active on this thread, or a new read txn
+  uint64_t read_height() const;
+
+  // spent key image prefilter: has_key_image only goes to the db on a maybe
+  struct key_image_filter
+  {
+    tools::blocked_bloom_filter filter;
+    uint64_t seed;
+    std::atomic<bool> ready; // built, negatives can be trusted
+
+    key_image_filter(): seed(0), ready(false) {}
+    uint64_t hash(const crypto::key_image& img) const;
+  };
+  void init_key_image_filter();
+  void start_key_image_filter_build(uint64_t capacity);
+  void grow_key_image_filter();
+  bool build_key_image_filter(key_image_filter &kif);
+  void stop_key_image_filter();
+  bool load_key_image_filter();
+  void save_key_image_filter() const;
+
   bool prune_worker(int mode, uint32_t pruning_seed);
+  bool is_v1_tx(MDB_cursor *c_txs_pruned, MDB_val *tx_id) const;
+
+  // txs_pruned and txs_prunable values are compressed once the table has a dictionary
+  void load_tx_compression_dictionaries();
+  void append_tx_data(const tools::zstd_dict_codec &codec, const MDB_val &v, cryptonote::blobdata &bd) const;
+  MDB_val compress_tx_data(const tools::zstd_dict_codec &codec, const MDB_val &v, std::string &buffer) const;
+  bool used_by_other_processes() const;
 
   virtual bool is_read_only() const;
 
@@ -528,6 +567,14 @@ private:
 
   bool m_batch_transactions; // support for batch transactions
   bool m_batch_active; // whether batch transaction is in progress
+  std::atomic<uint64_t> m_committed_height; // height as of the last committed write txn
+
+  std::shared_ptr<key_image_filter> m_key_image_filter; // swapped whole with std::atomic_store when rebuilt larger
+  std::atomic<bool> m_key_image_filter_stop;
+  boost::thread m_key_image_filter_thread;
+
+  tools::zstd_dict_codec m_txs_pruned_codec;
+  tools::zstd_dict_codec m_txs_prunable_codec;
 
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
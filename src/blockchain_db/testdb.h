@@ -164,6 +164,9 @@ public:
   virtual bool prune_blockchain(uint32_t pruning_seed = 0) override { return true; }
   virtual bool update_pruning() override { return true; }
   virtual bool check_pruning() override { return true; }
+  virtual bool train_tx_compression(size_t max_samples, size_t dict_size) override { return true; }
+  virtual uint64_t compress_txs(uint64_t max_txes) override { return 0; }
+  virtual void get_tx_data_size(uint64_t &pruned_bytes, uint64_t &prunable_bytes) const override { pruned_bytes = prunable_bytes = 0; }
   virtual void prune_outputs(uint64_t amount) override {}
 
   virtual uint64_t get_max_block_size() override { return 100000000; }
@@ -179,8 +182,11 @@ public:
   virtual std::vector<std::pair<std::string, std::string>> get_audited_supply() const override { return std::vector<std::pair<std::string, std::string>>(); }
   virtual std::vector<std::pair<std::string, std::string>> get_circulating_supply() const override { return std::vector<std::pair<std::string, std::string>>(); }
   virtual std::vector<oracle::pricing_record> get_pricing_record_history() const override { return std::vector<oracle::pricing_record>(); }
+  virtual void get_supply_tallies(cryptonote::supply_tallies &tallies) const override { tallies.clear(); }
+  virtual void set_supply_tallies(const cryptonote::supply_tallies &tallies) override {}
   virtual void get_output_id_from_asset_type_output_index(const std::string asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_indices) const override { }
   virtual uint64_t get_output_id_from_asset_type_output_index(const std::string asset_type, const uint64_t &asset_type_output_index) const override { return 0; };
+  virtual void get_output_data_from_asset_type_output_indices(const std::string &asset_type, const std::vector<uint64_t> &asset_type_output_indices, std::vector<uint64_t> &output_ids, std::vector<cryptonote::output_data_t> &outputs) const override {}
 };
 
 }
@@ -0,0 +1,204 @@
+// Copyright (c) 2014-2023, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
+#include "common/command_line.h"
+#include "common/zstd_dict_codec.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "blockchain_db/blockchain_db.h"
+#include "profile_tools.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+static void print_sizes(BlockchainDB *db, const char *when)
+{
+  uint64_t pruned_bytes, prunable_bytes;
+  db->get_tx_data_size(pruned_bytes, prunable_bytes);
+  MINFO("Transaction data " << when << ": txs_pruned " << pruned_bytes / 1024.0f / 1024.0f << " MB, txs_prunable " << prunable_bytes / 1024.0f / 1024.0f << " MB");
+}
+
+// times what a syncing peer or a wallet refresh would read: recent blocks with their txes
+static void benchmark(BlockchainDB *db, uint64_t blocks, const char *when)
+{
+  const uint64_t height = db->height();
+  const uint64_t start = height > blocks ? height - blocks : 0;
+  uint64_t n_blocks = 0, n_txes = 0, n_bytes = 0;
+  TIME_MEASURE_START(t);
+  for (uint64_t h = start; h < height; )
+  {
+    std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> bs;
+    if (!db->get_blocks_from(h, 1, 1000, std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max(), bs, false, true, true) || bs.empty())
+      throw std::runtime_error("Failed to read blocks from height " + std::to_string(h));
+    for (const auto &b: bs)
+    {
+      n_bytes += b.first.first.size();
+      for (const auto &tx: b.second)
+        n_bytes += tx.second.size();
+      n_txes += b.second.size();
+    }
+    n_blocks += bs.size();
+    h += bs.size();
+  }
+  TIME_MEASURE_FINISH(t);
+  MINFO("Read " << n_blocks << " blocks, " << n_txes << " txes, " << n_bytes / 1024.0f / 1024.0f << " MB " << when << " in " << t << " ms");
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint64_t> arg_train_samples  = {"train-samples", "Number of txes to train each dictionary from", 20000};
+  const command_line::arg_descriptor<uint64_t> arg_dict_size  = {"dictionary-size", "Size of each dictionary in bytes", 112640};
+  const command_line::arg_descriptor<uint64_t> arg_batch_size  = {"batch-size", "Number of txes to compress per db transaction", 10000};
+  const command_line::arg_descriptor<uint64_t> arg_benchmark  = {"benchmark", "Time reading this many recent blocks before and after compressing", 0};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_train_samples);
+  command_line::add_arg(desc_cmd_sett, arg_dict_size);
+  command_line::add_arg(desc_cmd_sett, arg_batch_size);
+  command_line::add_arg(desc_cmd_sett, arg_benchmark);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Zephyr '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("zephyr-blockchain-compress.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  MINFO("Starting...");
+
+  if (!tools::zstd_dict_codec::available())
+  {
+    MERROR("zstd support was not built in");
+    return 1;
+  }
+
+  std::string data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+  while (boost::ends_with(data_dir, "/") || boost::ends_with(data_dir, "\\"))
+    data_dir.pop_back();
+  const uint64_t train_samples = command_line::get_arg(vm, arg_train_samples);
+  const uint64_t dict_size = command_line::get_arg(vm, arg_dict_size);
+  const uint64_t batch_size = command_line::get_arg(vm, arg_batch_size);
+  const uint64_t benchmark_blocks = command_line::get_arg(vm, arg_benchmark);
+  if (batch_size == 0)
+  {
+    MERROR("Batch size must be positive");
+    return 1;
+  }
+
+  std::unique_ptr<BlockchainDB> db(new_db());
+  if (!db)
+  {
+    MERROR("Failed to initialize a database");
+    throw std::runtime_error("Failed to initialize a database");
+  }
+  const std::string filename = (boost::filesystem::path(data_dir) / db->get_db_name()).string();
+  MINFO("Loading blockchain from folder " << filename << " ...");
+
+  try
+  {
+    db->open(filename, 0);
+  }
+  catch (const std::exception& e)
+  {
+    MERROR("Error opening database: " << e.what());
+    return 1;
+  }
+
+  print_sizes(db.get(), "before");
+  if (benchmark_blocks)
+    benchmark(db.get(), benchmark_blocks, "before");
+
+  // dictionaries already in the db are kept, so a stopped run picks up where it was
+  if (!db->train_tx_compression(train_samples, dict_size))
+  {
+    MERROR("Failed to train compression dictionaries");
+    return 1;
+  }
+
+  MINFO("Compressing transactions...");
+  const uint64_t total = db->get_tx_count();
+  uint64_t left;
+  do
+  {
+    left = db->compress_txs(batch_size);
+    MINFO("Processed " << total - std::min(total, left) << "/" << total << " transactions");
+  } while (left > 0);
+
+  print_sizes(db.get(), "after");
+  if (benchmark_blocks)
+    benchmark(db.get(), benchmark_blocks, "after");
+
+  db->close();
+
+  MINFO("Blockchain compressed OK, new transactions will be compressed too once the daemon is started again");
+  MINFO("Versions from before transaction compression will refuse to open this blockchain");
+  return 0;
+
+  CATCH_ENTRY("Compression error", 1);
+}
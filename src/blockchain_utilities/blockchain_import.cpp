@@ -29,12 +29,19 @@
 #include <atomic>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <unistd.h>
 #include "misc_log_ex.h"
+#include "profile_tools.h"
+#include "common/threadpool.h"
+#include "common/util.h"
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
 #include "blocks/blocks.h"
@@ -42,6 +49,7 @@
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
 #include "include_base_utils.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
@@ -68,6 +76,11 @@ uint64_t db_batch_size = 100;
 // frequently saved
 uint64_t db_batch_size_verify = 5000;
 
+// blocks the reader parses together, and how many such batches it may get
+// ahead of the writer
+size_t pipeline_batch_blocks = 256;
+size_t pipeline_depth = 8;
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -126,7 +139,140 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, bool force)
+// a block read and parsed ahead of the writer
+struct import_entry
+{
+  std::streampos end_pos; // just past this block's chunk, where a resume would start
+  bootstrap::block_package bp;
+  crypto::hash block_hash;
+  cryptonote::blobdata block_blob;
+  std::vector<cryptonote::blobdata> tx_blobs;
+};
+
+// hands parsed batches from the reader to the writer, in file order
+class import_queue
+{
+public:
+  import_queue(size_t depth): m_depth(depth), m_done(false), m_stop(false) {}
+
+  bool push(std::vector<import_entry> &&batch)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_stop && m_batches.size() >= m_depth)
+      m_cond.wait(lock);
+    if (m_stop)
+      return false;
+    m_batches.push_back(std::move(batch));
+    m_cond.notify_all();
+    return true;
+  }
+
+  bool pop(std::vector<import_entry> &batch)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_batches.empty() && !m_done)
+      m_cond.wait(lock);
+    if (m_batches.empty())
+      return false;
+    batch = std::move(m_batches.front());
+    m_batches.pop_front();
+    m_cond.notify_all();
+    return true;
+  }
+
+  void finish(const std::string &error)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_done = true;
+    m_error = error;
+    m_cond.notify_all();
+  }
+
+  void stop()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_stop = true;
+    m_cond.notify_all();
+  }
+
+  std::string error()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_error;
+  }
+
+private:
+  boost::mutex m_mutex;
+  boost::condition_variable m_cond;
+  std::deque<std::vector<import_entry>> m_batches;
+  size_t m_depth;
+  bool m_done;
+  bool m_stop;
+  std::string m_error;
+};
+
+struct import_stats
+{
+  std::atomic<uint64_t> read_bytes{0}, read_ns{0}, parsed_blocks{0}, parse_ns{0};
+  uint64_t written_blocks = 0, write_ns = 0, wait_ns = 0;
+
+  void print() const
+  {
+    auto rate = [](double n, uint64_t ns) { return ns ? n * 1e9 / ns : 0.0; };
+    MINFO("read " << read_bytes / 1048576.0 << " MB at " << rate(read_bytes / 1048576.0, read_ns) << " MB/s, parsed "
+        << parsed_blocks << " blocks at " << rate(parsed_blocks, parse_ns) << " blocks/s, "
+        << (opt_verify ? "verified " : "stored ") << written_blocks << " blocks at " << rate(written_blocks, write_ns)
+        << " blocks/s, writer waited " << wait_ns / 1e9 << " s for input");
+  }
+};
+
+// where the last committed batch ended in the bootstrap file, so a restart
+// does not have to scan the file again
+struct import_checkpoint
+{
+  uint64_t file_size;
+  uint64_t block_first;
+  uint64_t total_blocks;
+  uint64_t height;
+  uint64_t offset;
+};
+
+boost::filesystem::path get_checkpoint_path(cryptonote::core &core)
+{
+  const std::vector<std::string> filenames = core.get_blockchain_storage().get_db().get_filenames();
+  if (filenames.empty())
+    return boost::filesystem::path();
+  return boost::filesystem::path(filenames[0]).parent_path() / "import-progress";
+}
+
+bool load_checkpoint(const boost::filesystem::path &path, import_checkpoint &cp)
+{
+  if (path.empty())
+    return false;
+  std::ifstream f(path.string());
+  return f && (f >> cp.file_size >> cp.block_first >> cp.total_blocks >> cp.height >> cp.offset);
+}
+
+void save_checkpoint(const boost::filesystem::path &path, const import_checkpoint &cp)
+{
+  if (path.empty())
+    return;
+  const std::string tmp = path.string() + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios_base::trunc);
+    f << cp.file_size << " " << cp.block_first << " " << cp.total_blocks << " " << cp.height << " " << cp.offset << std::endl;
+    if (!f)
+    {
+      MWARNING("Failed to write import checkpoint to " << tmp);
+      return;
+    }
+  }
+  const std::error_code ec = tools::replace_file(tmp, path.string());
+  if (ec)
+    MWARNING("Failed to save import checkpoint to " << path << ": " << ec.message());
+}
+
+int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, std::vector<crypto::hash> &hashes, bool force)
 {
   if (blocks.empty())
     return 0;
@@ -138,19 +284,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   if (!force && new_height % HASH_OF_HASHES_STEP)
     return 0;
 
-  std::vector<crypto::hash> hashes;
-  for (const auto &b: blocks)
-  {
-    cryptonote::block block;
-    if (!parse_and_validate_block_from_blob(b.block, block))
-    {
-      MERROR("Failed to parse block: "
-          << epee::string_tools::buff_to_hex_nodelimer(b.block));
-      core.cleanup_handle_incoming_blocks();
-      return 1;
-    }
-    hashes.push_back(cryptonote::get_block_hash(block));
-  }
+  // block hashes were computed by the parse workers
   core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes, {});
 
   std::vector<block> pblocks;
@@ -214,9 +348,160 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
     return 1;
 
   blocks.clear();
+  hashes.clear();
   return 0;
 }
 
+// returns false at the end of the file, throws on a corrupt one
+bool read_chunk(std::ifstream &import_file, std::string &chunk)
+{
+  char buffer1[1024];
+  uint32_t chunk_size;
+  import_file.read(buffer1, sizeof(chunk_size));
+  // TODO: bootstrap.read_chunk();
+  if (! import_file) {
+    MINFO("End of file reached");
+    return false;
+  }
+
+  chunk.assign(buffer1, sizeof(chunk_size));
+  if (! ::serialization::parse_binary(chunk, chunk_size))
+  {
+    throw std::runtime_error("Error in deserialization of chunk size");
+  }
+  MDEBUG("chunk_size: " << chunk_size);
+
+  if (chunk_size > BUFFER_SIZE)
+  {
+    MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
+    throw std::runtime_error("Aborting: chunk size exceeds buffer size");
+  }
+  if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+  {
+    MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
+  }
+  else if (chunk_size == 0) {
+    throw std::runtime_error("ERROR: chunk_size == 0");
+  }
+  chunk.resize(chunk_size);
+  import_file.read(&chunk[0], chunk_size);
+  if (! import_file) {
+    if (import_file.eof())
+    {
+      MINFO("End of file reached - file was truncated");
+      return false;
+    }
+    throw std::runtime_error("ERROR: unexpected end of file: bytes read before error: "
+        + std::to_string(import_file.gcount()) + " of chunk_size " + std::to_string(chunk_size));
+  }
+  return true;
+}
+
+bool parse_entry(const std::string &chunk, uint8_t major_version, import_entry &entry)
+{
+  bootstrap::block_package &bp = entry.bp;
+  if (major_version == 0)
+  {
+    bootstrap::block_package_1 bp1;
+    if (!::serialization::parse_binary(chunk, bp1))
+      return false;
+    bp.block = std::move(bp1.block);
+    bp.txs = std::move(bp1.txs);
+    bp.block_weight = bp1.block_weight;
+    bp.cumulative_difficulty = bp1.cumulative_difficulty;
+    bp.coins_generated = bp1.coins_generated;
+  }
+  else if (!::serialization::parse_binary(chunk, bp))
+    return false;
+
+  entry.block_blob = cryptonote::block_to_blob(bp.block);
+  entry.block_hash = cryptonote::get_block_hash(bp.block);
+  entry.tx_blobs.reserve(bp.txs.size());
+  for (const transaction &tx: bp.txs)
+  {
+    entry.tx_blobs.push_back(cryptonote::tx_to_blob(tx));
+    // cached in the tx, so the writer does not hash it again
+    cryptonote::get_transaction_hash(tx);
+  }
+  return true;
+}
+
+// reader stage: reads chunks in file order, and parses and hashes each
+// batch of them on the compute threadpool
+void read_blocks(std::ifstream &import_file, uint8_t major_version, uint64_t h, uint64_t block_stop, import_queue &queue, import_stats &stats)
+{
+  tools::threadpool &tpool = tools::threadpool::getInstanceForCompute();
+  std::string error;
+  try
+  {
+    bool eof = false;
+    while (!eof)
+    {
+      std::vector<std::string> chunks;
+      std::vector<std::streampos> ends;
+      uint64_t bytes = 0;
+      TIME_MEASURE_NS_START(read_time);
+      while (chunks.size() < pipeline_batch_blocks)
+      {
+        if (h + chunks.size() > block_stop)
+        {
+          MINFO("Specified block number reached - stopping.  block: " << h + chunks.size() - 1 << "  total blocks: " << h + chunks.size());
+          eof = true;
+          break;
+        }
+        chunks.emplace_back();
+        if (!read_chunk(import_file, chunks.back()))
+        {
+          chunks.pop_back();
+          eof = true;
+          break;
+        }
+        bytes += chunks.back().size() + sizeof(uint32_t);
+        ends.push_back(import_file.tellg());
+      }
+      TIME_MEASURE_NS_FINISH(read_time);
+      stats.read_bytes += bytes;
+      stats.read_ns += read_time;
+      if (chunks.empty())
+        break;
+
+      TIME_MEASURE_NS_START(parse_time);
+      std::vector<import_entry> batch(chunks.size());
+      tools::threadpool::waiter waiter(tpool);
+      for (size_t i = 0; i < chunks.size(); ++i)
+      {
+        tpool.submit(&waiter, [&, i]() {
+          try
+          {
+            if (!parse_entry(chunks[i], major_version, batch[i]))
+              waiter.set_error();
+          }
+          catch (...)
+          {
+            waiter.set_error();
+          }
+        });
+      }
+      if (!waiter.wait())
+        throw std::runtime_error("Error in deserialization of chunk at height " + std::to_string(h) + " to " + std::to_string(h + chunks.size() - 1));
+      for (size_t i = 0; i < batch.size(); ++i)
+        batch[i].end_pos = ends[i];
+      TIME_MEASURE_NS_FINISH(parse_time);
+      stats.parsed_blocks += batch.size();
+      stats.parse_ns += parse_time;
+
+      h += batch.size();
+      if (!queue.push(std::move(batch)))
+        break;
+    }
+  }
+  catch (const std::exception &e)
+  {
+    error = e.what();
+  }
+  queue.finish(error);
+}
+
 int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
 {
   // Reset stats, in case we're using newly created db, accumulating stats
@@ -231,6 +516,7 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     MFATAL("bootstrap file not found: " << fs_import_file_path);
     return false;
   }
+  const uint64_t file_size = boost::filesystem::file_size(fs_import_file_path, ec);
 
   uint64_t block_first;
   uint64_t start_height = 1, seek_height;
@@ -240,8 +526,23 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   seek_height = start_height;
   BootstrapFile bootstrap;
   std::streampos pos;
-  // BootstrapFile bootstrap(import_file_path);
-  uint64_t total_source_blocks = bootstrap.count_blocks(import_file_path, pos, seek_height, block_first);
+  uint64_t total_source_blocks;
+  // a checkpoint past the db height is from blocks which were never synced to disk
+  const boost::filesystem::path checkpoint_path = get_checkpoint_path(core);
+  import_checkpoint cp;
+  if (opt_resume && load_checkpoint(checkpoint_path, cp) && cp.file_size == file_size && cp.height > 0 && cp.height <= start_height)
+  {
+    MINFO("Resuming from checkpoint at height " << cp.height);
+    pos = cp.offset;
+    seek_height = cp.height;
+    block_first = cp.block_first;
+    total_source_blocks = cp.total_blocks;
+  }
+  else
+  {
+    // BootstrapFile bootstrap(import_file_path);
+    total_source_blocks = bootstrap.count_blocks(import_file_path, pos, seek_height, block_first);
+  }
   MINFO("bootstrap file last block number: " << total_source_blocks+block_first-1 << " (zero-based height)  total blocks: " << total_source_blocks);
 
   if (total_source_blocks+block_first-1 <= start_height)
@@ -269,11 +570,6 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   uint64_t dummy;
   bootstrap.seek_to_first_chunk(import_file, major_version, minor_version, dummy, dummy);
 
-  std::string str1;
-  char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
-  block b;
-  transaction tx;
   int quit = 0;
   uint64_t bytes_read;
 
@@ -296,6 +592,7 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   std::cout << ENDL;
 
   std::vector<block_complete_entry> blocks;
+  std::vector<crypto::hash> hashes;
 
   // Skip to start_height before we start adding.
   {
@@ -304,237 +601,161 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     bytes_read = bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
     if (q2)
     {
-      quit = 2;
-      goto quitting;
+      import_file.close();
+      return 0;
     }
     h = start_height;
   }
+  MDEBUG("Skipped " << bytes_read << " bytes");
 
-  if (use_batch)
-  {
+  cryptonote::BlockchainDB &db = core.get_blockchain_storage().get_db();
+  // the writer sizes db batches from here, the reader owns import_file
+  std::ifstream size_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+  auto start_db_batch = [&](std::streampos from) {
     uint64_t bytes, h2;
     bool q2;
-    pos = import_file.tellg();
-    bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-    if (import_file.eof())
-      import_file.clear();
-    import_file.seekg(pos);
-    core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-  }
+    size_file.clear();
+    size_file.seekg(from);
+    bytes = bootstrap.count_bytes(size_file, db_batch_size, h2, q2);
+    db.batch_start(db_batch_size, bytes);
+  };
+  if (use_batch)
+    start_db_batch(import_file.tellg());
+
+  import_queue queue(pipeline_depth);
+  import_stats stats;
+  const uint64_t read_height = h;
+  boost::thread reader([&]() { read_blocks(import_file, major_version, read_height, block_stop, queue, stats); });
+  epee::misc_utils::auto_scope_leave_caller reader_dtor = epee::misc_utils::create_scope_leave_handler([&](){
+    queue.stop();
+    if (reader.joinable())
+      reader.join();
+  });
+
+  // coins generated by each block are what its supply tally starts from
+  uint64_t prev_coins_generated = (!opt_verify && h > 0) ? db.get_block_already_generated_coins(h - 1) : 0;
+  const int progress_interval = 10;
+  std::vector<import_entry> batch;
+  std::streampos last_pos = import_file.tellg();
   while (! quit)
   {
-    uint32_t chunk_size;
-    import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
-    if (! import_file) {
-      std::cout << refresh_string;
-      MINFO("End of file reached");
-      quit = 1;
+    TIME_MEASURE_NS_START(wait_time);
+    const bool got_batch = queue.pop(batch);
+    TIME_MEASURE_NS_FINISH(wait_time);
+    stats.wait_ns += wait_time;
+    if (!got_batch)
       break;
-    }
-    bytes_read += sizeof(chunk_size);
 
-    str1.assign(buffer1, sizeof(chunk_size));
-    if (! ::serialization::parse_binary(str1, chunk_size))
-    {
-      throw std::runtime_error("Error in deserialization of chunk size");
-    }
-    MDEBUG("chunk_size: " << chunk_size);
-
-    if (chunk_size > BUFFER_SIZE)
-    {
-      MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-      throw std::runtime_error("Aborting: chunk size exceeds buffer size");
-    }
-    if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+    TIME_MEASURE_NS_START(write_time);
+    for (import_entry &entry: batch)
     {
-      MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
-    }
-    else if (chunk_size == 0) {
-      MFATAL("ERROR: chunk_size == 0");
-      return 2;
-    }
-    import_file.read(buffer_block, chunk_size);
-    if (! import_file) {
-      if (import_file.eof())
-      {
-        std::cout << refresh_string;
-        MINFO("End of file reached - file was truncated");
-        quit = 1;
-        break;
-      }
-      else
+      ++h;
+      MDEBUG("loading block number " << h-1);
+      if ((h-1) % progress_interval == 0)
       {
-        MFATAL("ERROR: unexpected end of file: bytes read before error: "
-            << import_file.gcount() << " of chunk_size " << chunk_size);
-        return 2;
+        std::cout << refresh_string << "block " << h-1
+          << " / " << block_stop
+          << "\r" << std::flush;
       }
-    }
-    bytes_read += chunk_size;
-    MDEBUG("Total bytes read: " << bytes_read);
 
-    if (h > block_stop)
-    {
-      std::cout << refresh_string << "block " << h-1
-        << " / " << block_stop
-        << "\r" << std::flush;
-      std::cout << ENDL << ENDL;
-      MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
-    }
-
-    try
-    {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      bool res;
-      if (major_version == 0)
+      if (opt_verify)
       {
-        bootstrap::block_package_1 bp1;
-        res = ::serialization::parse_binary(str1, bp1);
-        if (res)
+        block_complete_entry bce;
+        bce.pruned = false;
+        bce.block = std::move(entry.block_blob);
+        for (cryptonote::blobdata &tx_blob: entry.tx_blobs)
+          bce.txs.push_back({std::move(tx_blob), crypto::null_hash});
+        blocks.push_back(std::move(bce));
+        hashes.push_back(entry.block_hash);
+        int ret = check_flush(core, blocks, hashes, false);
+        if (ret)
         {
-          bp.block = std::move(bp1.block);
-          bp.txs = std::move(bp1.txs);
-          bp.block_weight = bp1.block_weight;
-          bp.cumulative_difficulty = bp1.cumulative_difficulty;
-          bp.coins_generated = bp1.coins_generated;
+          quit = 2; // make sure we don't commit partial block data
+          break;
+        }
+        if (blocks.empty())
+        {
+          save_checkpoint(checkpoint_path, {file_size, block_first, total_source_blocks, h, (uint64_t)entry.end_pos});
+          stats.print();
         }
       }
       else
-        res = ::serialization::parse_binary(str1, bp);
-      if (!res)
-        throw std::runtime_error("Error in deserialization of chunk");
-
-      int display_interval = 1000;
-      int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
       {
-        ++h;
-        if ((h-1) % display_interval == 0)
-        {
-          std::cout << refresh_string;
-          MDEBUG("loading block number " << h-1);
-        }
-        else
-        {
-          MDEBUG("loading block number " << h-1);
-        }
-        b = bp.block;
+        const block &b = entry.bp.block;
         MDEBUG("block prev_id: " << b.prev_id << ENDL);
 
-        if ((h-1) % progress_interval == 0)
+        // tx number 1: coinbase tx
+        // tx number 2 onwards: archived_txs
+        //
+        // don't add coinbase transaction to txs, because add_block() calls
+        // add_transaction(blk_hash, blk.miner_tx) first, and
+        // then a for loop for the transactions in txs.
+        std::vector<std::pair<transaction, blobdata>> txs;
+        txs.reserve(entry.bp.txs.size());
+        for (size_t i = 0; i < entry.bp.txs.size(); ++i)
+          txs.push_back(std::make_pair(std::move(entry.bp.txs[i]), std::move(entry.tx_blobs[i])));
+
+        const size_t block_weight = entry.bp.block_weight;
+        const difficulty_type cumulative_difficulty = entry.bp.cumulative_difficulty;
+        const uint64_t coins_generated = entry.bp.coins_generated;
+        const uint64_t zeph_generated = coins_generated >= prev_coins_generated ? coins_generated - prev_coins_generated : 0;
+        // the supply tallies need what Blockchain::handle_block_to_main_chain computes when adding a block
+        uint64_t reserve_reward, yield_reward_zsd;
+        cryptonote::get_block_reserve_rewards_from_generated(zeph_generated, h - 1, b, reserve_reward, yield_reward_zsd);
+
+        try
         {
-          std::cout << refresh_string << "block " << h-1
-            << " / " << block_stop
-            << "\r" << std::flush;
+          uint64_t long_term_block_weight = core.get_blockchain_storage().get_next_long_term_block_weight(block_weight);
+          db.add_block(std::make_pair(b, std::move(entry.block_blob)), block_weight, long_term_block_weight, cumulative_difficulty, coins_generated, zeph_generated, reserve_reward, yield_reward_zsd, txs);
         }
-
-        if (opt_verify)
+        catch (const std::exception& e)
         {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::vector<tx_blob_entry> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back({cryptonote::blobdata(), crypto::null_hash});
-            cryptonote::tx_to_blob(tx, txs.back().blob);
-          }
-          block_complete_entry bce;
-          bce.pruned = false;
-          bce.block = std::move(block);
-          bce.txs = std::move(txs);
-          blocks.push_back(bce);
-          int ret = check_flush(core, blocks, false);
-          if (ret)
-          {
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
+          std::cout << refresh_string;
+          MFATAL("Error adding block to blockchain: " << e.what());
+          quit = 2; // make sure we don't commit partial block data
+          break;
         }
-        else
-        {
-          std::vector<std::pair<transaction, blobdata>> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
-          // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (const transaction &tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(std::make_pair(tx, tx_to_blob(tx)));
-          }
+        prev_coins_generated = coins_generated;
 
-          size_t block_weight;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-
-          block_weight = bp.block_weight;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-
-          try
-          {
-            uint64_t long_term_block_weight = core.get_blockchain_storage().get_next_long_term_block_weight(block_weight);
-            uint64_t reserve_reward = 0;
-            uint64_t yield_reward_zsd = 0;
-            core.get_blockchain_storage().get_db().add_block(std::make_pair(b, block_to_blob(b)), block_weight, long_term_block_weight, cumulative_difficulty, coins_generated, 0, reserve_reward, yield_reward_zsd, txs);
-          }
-          catch (const std::exception& e)
+        if (use_batch)
+        {
+          if ((h-1) % db_batch_size == 0)
           {
             std::cout << refresh_string;
-            MFATAL("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-
-          if (use_batch)
-          {
-            if ((h-1) % db_batch_size == 0)
-            {
-              uint64_t bytes, h2;
-              bool q2;
-              std::cout << refresh_string;
-              // zero-based height
-              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-              core.get_blockchain_storage().get_db().batch_stop();
-              pos = import_file.tellg();
-              bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-              import_file.seekg(pos);
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-              std::cout << ENDL;
-              core.get_blockchain_storage().get_db().show_stats();
-            }
+            // zero-based height
+            std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
+            db.batch_stop();
+            save_checkpoint(checkpoint_path, {file_size, block_first, total_source_blocks, h, (uint64_t)entry.end_pos});
+            start_db_batch(entry.end_pos);
+            std::cout << ENDL;
+            db.show_stats();
+            stats.print();
           }
         }
-        ++num_imported;
       }
+      ++num_imported;
+      ++stats.written_blocks;
+      last_pos = entry.end_pos;
     }
-    catch (const std::exception& e)
-    {
-      std::cout << refresh_string;
-      MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
-    }
+    TIME_MEASURE_NS_FINISH(write_time);
+    stats.write_ns += write_time;
   } // while
 
-quitting:
+  queue.stop();
+  reader.join();
   import_file.close();
+  std::cout << refresh_string;
 
-  if (opt_verify)
+  const std::string error = queue.error();
+  if (!error.empty())
   {
-    int ret = check_flush(core, blocks, true);
+    MFATAL("exception while reading from file, height=" << h << ": " << error);
+    return 2;
+  }
+
+  if (opt_verify && quit <= 1)
+  {
+    int ret = check_flush(core, blocks, hashes, true);
     if (ret)
       return ret;
   }
@@ -548,11 +769,14 @@ quitting:
     }
     else
     {
-      core.get_blockchain_storage().get_db().batch_stop();
+      db.batch_stop();
     }
   }
+  if (quit <= 1 && num_imported)
+    save_checkpoint(checkpoint_path, {file_size, block_first, total_source_blocks, h, (uint64_t)last_pos});
 
-  core.get_blockchain_storage().get_db().show_stats();
+  db.show_stats();
+  stats.print();
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
     // TODO: if there was an error, the last added block is probably at zero-based height h-2
@@ -34,6 +34,7 @@
 #include <boost/filesystem.hpp>
 #include "common/command_line.h"
 #include "common/pruning.h"
+#include "common/zstd_dict_codec.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
 #include "version.h"
@@ -54,6 +55,7 @@ static uint64_t records_per_sync = 16 * 65536;
 static const size_t slack = 512 * 1024 * 1024;
 
 static std::vector<bool> is_v1;
+static tools::zstd_dict_codec txs_pruned_codec;
 
 static std::error_code replace_file(const boost::filesystem::path& replacement_name, const boost::filesystem::path& replaced_name)
 {
@@ -89,12 +91,36 @@ static void close(MDB_env *env)
   mdb_env_close(env);
 }
 
+static void load_txs_pruned_dictionary(MDB_env *env)
+{
+  MDB_txn *txn;
+  MDB_dbi dbi;
+  int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  if (dbr) throw std::runtime_error("Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){
+    mdb_txn_abort(txn);
+  });
+  dbr = mdb_dbi_open(txn, "properties", 0, &dbi);
+  if (dbr) throw std::runtime_error("Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  MDB_val k = {strlen("txs_pruned_zstd_dict"), (void*)"txs_pruned_zstd_dict"}, v;
+  dbr = mdb_get(txn, dbi, &k, &v);
+  if (dbr == MDB_NOTFOUND)
+    return;
+  if (dbr) throw std::runtime_error("Failed to read txs_pruned dictionary: " + std::string(mdb_strerror(dbr)));
+  if (!txs_pruned_codec.set_dictionary(std::string((const char*)v.mv_data, v.mv_size)))
+    throw std::runtime_error("Failed to load txs_pruned dictionary");
+}
+
 static void mark_v1_tx(const MDB_val &k, const MDB_val &v)
 {
   const uint64_t tx_id = *(const uint64_t*)k.mv_data;
   if (tx_id >= is_v1.size())
     is_v1.resize(tx_id + 1, false);
-  is_v1[tx_id] = cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
+  std::string bd;
+  if (!txs_pruned_codec.empty() && tools::zstd_dict_codec::is_frame(v.mv_data, v.mv_size) && txs_pruned_codec.decompress(v.mv_data, v.mv_size, bd))
+    is_v1[tx_id] = cryptonote::is_v1_tx(bd);
+  else
+    is_v1[tx_id] = cryptonote::is_v1_tx(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size});
 }
 
 static void add_size(MDB_env *env, uint64_t bytes)
@@ -637,6 +663,7 @@ int main(int argc, char* argv[])
   MDB_env *env0 = NULL, *env1 = NULL;
   open(env0, paths[0], db_flags, true);
   open(env1, paths[1], db_flags, false);
+  load_txs_pruned_dictionary(env0);
   copy_table(env0, env1, "blocks", MDB_INTEGERKEY, 0);
   copy_table(env0, env1, "block_info", MDB_INTEGERKEY | MDB_DUPSORT| MDB_DUPFIXED, 0, BlockchainLMDB::compare_uint64);
   copy_table(env0, env1, "block_heights", MDB_INTEGERKEY | MDB_DUPSORT| MDB_DUPFIXED, 0, BlockchainLMDB::compare_hash32);
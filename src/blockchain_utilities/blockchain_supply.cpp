@@ -0,0 +1,406 @@
+// Copyright (c) 2014-2023, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include "common/command_line.h"
+#include "common/threadpool.h"
+#include "common/util.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "blockchain_db/blockchain_db.h"
+#include "supply_tally.h"
+#include "profile_tools.h"
+#include "version.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+template<typename Sink>
+static void replay_block(Sink &sink, const Blockchain &blockchain, uint64_t height)
+{
+  const BlockchainDB &db = blockchain.get_db();
+  const block b = db.get_block_from_height(height);
+
+  // miner txes do not touch the tallies
+  const uint8_t tx_hf_version = blockchain.get_ideal_hard_fork_version(height);
+  for (const crypto::hash &tx_hash: b.tx_hashes)
+  {
+    transaction tx;
+    if (!db.get_pruned_tx(tx_hash, tx))
+      throw std::runtime_error("Failed to get tx " + epee::string_tools::pod_to_hex(tx_hash));
+    replay_tx(sink, tx, tx_hash, tx_hf_version);
+  }
+
+  // the rewards are not stored, but follow from the coins generated
+  const uint64_t coins = db.get_block_already_generated_coins(height);
+  const uint64_t prev_coins = height ? db.get_block_already_generated_coins(height - 1) : 0;
+  const uint64_t zeph_generated = coins - prev_coins;
+  uint64_t reserve_reward, yield_reward_zsd;
+  get_block_reserve_rewards_from_generated(zeph_generated, height, b, reserve_reward, yield_reward_zsd);
+
+  if (b.major_version >= HF_VERSION_AUDIT)
+  {
+    if (height == AUDIT_FORK_HEIGHT)
+    {
+      sink.copy(circ(oracle::ASSET_TYPES, "ZEPH"), total("ZPH"));
+      sink.copy(circ(oracle::ASSET_TYPES, "ZYIELDRSV"), total("ZSD"));
+      sink.copy(circ(oracle::ASSET_TYPES, "ZEPH"), reserve("DJED"));
+      sink.copy(circ(oracle::ASSET_TYPES, "ZYIELDRSV"), reserve("YIELD"));
+    }
+    sink.plus(total("ZPH"), zeph_generated);
+    sink.plus(reserve("DJED"), reserve_reward);
+    if (yield_reward_zsd > 0)
+    {
+      sink.plus(total("ZSD"), yield_reward_zsd);
+      sink.plus(reserve("YIELD"), yield_reward_zsd);
+    }
+  }
+
+  if (b.major_version <= HF_VERSION_AUDIT)
+  {
+    if (height == 274662)
+      sink.set(circ(oracle::ASSET_TYPES, "ZEPH"), int128(1355092382175150195ull));
+    else
+      sink.plus(circ(oracle::ASSET_TYPES, "ZEPH"), reserve_reward);
+    if (yield_reward_zsd > 0)
+    {
+      sink.plus(circ(oracle::ASSET_TYPES, "ZEPHUSD"), yield_reward_zsd);
+      sink.plus(circ(oracle::RESERVE_TYPES, "ZYIELDRSV"), yield_reward_zsd);
+    }
+  }
+}
+
+// recomputed tallies after the blocks below height, with the hash of the last
+// of them so a later run can tell whether the chain still has them
+struct supply_checkpoint
+{
+  uint64_t height;
+  crypto::hash top_hash;
+  supply_tallies tallies;
+};
+
+static std::string tally_name(const tally_key &k)
+{
+  try
+  {
+    switch (k.first)
+    {
+      case supply_tally_table::circulating: return "circulating " + (k.second < oracle::ASSET_TYPES.size() ? oracle::ASSET_TYPES.at(k.second) : oracle::RESERVE_TYPES.at(k.second));
+      case supply_tally_table::total_asset: return "total " + oracle::ASSET_TYPES_V2.at(k.second);
+      case supply_tally_table::reserve_asset: return "reserve " + oracle::RESERVE_TYPES_V2.at(k.second);
+    }
+  }
+  catch (const std::out_of_range&) {}
+  return "table " + std::to_string((int)k.first) + " index " + std::to_string(k.second);
+}
+
+static std::vector<supply_checkpoint> load_checkpoints(const boost::filesystem::path &path)
+{
+  std::vector<supply_checkpoint> checkpoints;
+  std::ifstream f(path.string());
+  std::string line;
+  while (std::getline(f, line))
+  {
+    std::istringstream ss(line);
+    supply_checkpoint cp;
+    std::string hash;
+    size_t n;
+    if (!(ss >> cp.height >> hash >> n) || !epee::string_tools::hex_to_pod(hash, cp.top_hash))
+      continue;
+    bool ok = true;
+    for (size_t i = 0; i < n && ok; ++i)
+    {
+      unsigned table;
+      uint64_t idx;
+      std::string value;
+      ok = !!(ss >> table >> idx >> value);
+      if (ok)
+        cp.tallies[tally_key((supply_tally_table)table, idx)] = int128(value);
+    }
+    if (ok)
+      checkpoints.push_back(std::move(cp));
+  }
+  return checkpoints;
+}
+
+static void save_checkpoints(const boost::filesystem::path &path, const std::vector<supply_checkpoint> &checkpoints)
+{
+  const std::string tmp = path.string() + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios_base::trunc);
+    for (const supply_checkpoint &cp: checkpoints)
+    {
+      f << cp.height << " " << epee::string_tools::pod_to_hex(cp.top_hash) << " " << cp.tallies.size();
+      for (const auto &e: cp.tallies)
+        f << " " << (unsigned)e.first.first << " " << e.first.second << " " << e.second.str();
+      f << "\n";
+    }
+    if (!f)
+    {
+      MERROR("Failed to write checkpoints to " << tmp);
+      return;
+    }
+  }
+  const std::error_code ec = tools::replace_file(tmp, path.string());
+  if (ec)
+    MERROR("Failed to save checkpoints to " << path << ": " << ec.message());
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint64_t> arg_checkpoint_interval  = {"checkpoint-interval", "Blocks per replayed range and between checkpoints", 10000};
+  const command_line::arg_descriptor<unsigned> arg_threads  = {"threads", "Number of threads to replay with (0 for all cores)", 0};
+  const command_line::arg_descriptor<bool> arg_from_genesis  = {"from-genesis", "Ignore saved checkpoints and replay the whole chain", false};
+  const command_line::arg_descriptor<bool> arg_repair  = {"repair", "Overwrite diverging tallies in the db (stop the daemon first)", false};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_checkpoint_interval);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
+  command_line::add_arg(desc_cmd_sett, arg_from_genesis);
+  command_line::add_arg(desc_cmd_sett, arg_repair);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Zephyr '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("zephyr-blockchain-supply.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  MINFO("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+  bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
+  network_type net_type = opt_testnet ? TESTNET : opt_stagenet ? STAGENET : MAINNET;
+  std::string data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+  while (boost::ends_with(data_dir, "/") || boost::ends_with(data_dir, "\\"))
+    data_dir.pop_back();
+  const uint64_t interval = command_line::get_arg(vm, arg_checkpoint_interval);
+  const bool opt_repair = command_line::get_arg(vm, arg_repair);
+  if (interval == 0)
+  {
+    MERROR("Checkpoint interval must be positive");
+    return 1;
+  }
+  if (!command_line::is_arg_defaulted(vm, arg_threads))
+    tools::set_max_concurrency(command_line::get_arg(vm, arg_threads));
+
+  // Use Blockchain instead of lower-level BlockchainDB for the hard fork schedule
+  MINFO("Initializing source blockchain (BlockchainDB)");
+  std::unique_ptr<BlockchainAndPool> core_storage = std::make_unique<BlockchainAndPool>();
+  BlockchainDB *db = new_db();
+  if (db == NULL)
+  {
+    MERROR("Failed to initialize a database");
+    throw std::runtime_error("Failed to initialize a database");
+  }
+  const boost::filesystem::path db_path = boost::filesystem::path(data_dir) / db->get_db_name();
+  MINFO("Loading blockchain from folder " << db_path << " ...");
+  try
+  {
+    db->open(db_path.string(), opt_repair ? 0 : DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    MERROR("Error opening database: " << e.what());
+    return 1;
+  }
+  r = core_storage->blockchain.init(db, net_type);
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize source blockchain storage");
+  MINFO("Source blockchain storage initialized OK");
+
+  const Blockchain &blockchain = core_storage->blockchain;
+  const uint64_t db_height = db->height();
+
+  // pick up from the last checkpoint still on the chain
+  const boost::filesystem::path checkpoints_path = boost::filesystem::path(data_dir) / "supply-checkpoints";
+  std::vector<supply_checkpoint> checkpoints;
+  if (!command_line::get_arg(vm, arg_from_genesis))
+  {
+    for (supply_checkpoint &cp: load_checkpoints(checkpoints_path))
+      if (cp.height > 0 && cp.height <= db_height && db->get_block_hash_from_height(cp.height - 1) == cp.top_hash)
+        checkpoints.push_back(std::move(cp));
+  }
+  supply_tallies tallies;
+  uint64_t start_height = 0;
+  if (!checkpoints.empty())
+  {
+    tallies = checkpoints.back().tallies;
+    start_height = checkpoints.back().height;
+    MINFO("Resuming from checkpoint at height " << start_height);
+  }
+
+  // ranges end on checkpoint heights, and the audit fork block, whose
+  // update depends on other tallies, is replayed on its own
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (uint64_t h = start_height; h < db_height; )
+  {
+    uint64_t end = std::min(db_height, (h / interval + 1) * interval);
+    if (h < AUDIT_FORK_HEIGHT && end > AUDIT_FORK_HEIGHT)
+      end = AUDIT_FORK_HEIGHT;
+    else if (h == AUDIT_FORK_HEIGHT)
+      end = h + 1;
+    ranges.push_back({h, end});
+    h = end;
+  }
+
+  MINFO("Replaying blocks " << start_height << " to " << db_height << " in " << ranges.size() << " ranges on " << tools::get_max_concurrency() << " threads");
+  TIME_MEASURE_START(t);
+  std::vector<range_sink> results(ranges.size());
+  tools::threadpool &tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+  std::string error;
+  boost::mutex error_lock;
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    if (ranges[i].first == AUDIT_FORK_HEIGHT)
+      continue;
+    tpool.submit(&waiter, [&, i]() {
+      try
+      {
+        for (uint64_t h = ranges[i].first; h < ranges[i].second; ++h)
+          replay_block(results[i], blockchain, h);
+      }
+      catch (const std::exception &e)
+      {
+        boost::lock_guard<boost::mutex> lock(error_lock);
+        error = e.what();
+        waiter.set_error();
+      }
+    });
+  }
+  if (!waiter.wait())
+  {
+    MERROR("Failed to replay blocks: " << error);
+    return 1;
+  }
+
+  // merge in order, checkpointing at range ends
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    if (ranges[i].first == AUDIT_FORK_HEIGHT)
+    {
+      state_sink sink{tallies};
+      replay_block(sink, blockchain, AUDIT_FORK_HEIGHT);
+    }
+    else
+    {
+      for (const auto &e: results[i].fns)
+        tallies[e.first] = e.second(tallies[e.first]);
+    }
+    const uint64_t end = ranges[i].second;
+    if (end % interval == 0 || end == db_height)
+      checkpoints.push_back({end, db->get_block_hash_from_height(end - 1), tallies});
+  }
+  TIME_MEASURE_FINISH(t);
+  MINFO("Replayed " << db_height - start_height << " blocks in " << t << " ms");
+
+  // a checkpoint at the top is only useful until the next block
+  while (checkpoints.size() > 1 && checkpoints.back().height % interval)
+    checkpoints.pop_back();
+  save_checkpoints(checkpoints_path, checkpoints);
+
+  // missing tallies read as zero in the db too
+  supply_tallies stored, diverging;
+  db->get_supply_tallies(stored);
+  for (const auto &e: stored)
+    tallies.emplace(e.first, 0);
+  for (const auto &e: tallies)
+  {
+    const auto it = stored.find(e.first);
+    const int128 db_value = it == stored.end() ? int128(0) : it->second;
+    if (db_value == e.second)
+    {
+      MINFO(tally_name(e.first) << ": " << e.second.str() << " OK");
+      continue;
+    }
+    MERROR(tally_name(e.first) << ": db has " << db_value.str() << ", recomputed " << e.second.str() << " (" << int128(e.second - db_value).str() << ")");
+    diverging[e.first] = e.second;
+  }
+
+  int ret = 0;
+  if (diverging.empty())
+  {
+    MINFO("All supply tallies match at height " << db_height);
+  }
+  else if (opt_repair)
+  {
+    db->set_supply_tallies(diverging);
+    MINFO("Repaired " << diverging.size() << " supply tallies at height " << db_height);
+  }
+  else
+  {
+    MERROR(diverging.size() << " supply tallies diverge at height " << db_height << ", use --" << arg_repair.name << " to fix them");
+    ret = 2;
+  }
+
+  core_storage->blockchain.deinit();
+  return ret;
+
+  CATCH_ENTRY("Supply audit error", 1);
+}
@@ -0,0 +1,192 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/multiprecision/cpp_int.hpp>
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "blockchain_db/blockchain_db.h"
+#include "oracle/asset_types.h"
+#include "string_tools.h"
+
+namespace cryptonote
+{
+
+typedef boost::multiprecision::int128_t int128;
+typedef std::pair<supply_tally_table, uint64_t> tally_key;
+
+// The tally updates below mirror BlockchainLMDB::add_transaction_data and
+// BlockchainLMDB::add_block, and must be kept in step with them.
+
+// A tally update as a function of the tally before it, x -> max(lo, x + add).
+// Additions, subtractions clamped at zero and absolute writes are all of this
+// form, and so is any sequence of them, so block ranges can be replayed
+// independently and merged in order afterwards.
+struct tally_fn
+{
+  bool bounded = false;  // lo is -inf if not
+  bool constant = false; // x + add is -inf if so
+  int128 lo = 0;
+  int128 add = 0;
+
+  void plus(const int128 &d)
+  {
+    if (bounded)
+      lo += d;
+    add += d;
+  }
+
+  void minus_clamped(const int128 &d)
+  {
+    lo = bounded ? std::max(int128(0), lo - d) : int128(0);
+    bounded = true;
+    add -= d;
+  }
+
+  void set(const int128 &v)
+  {
+    bounded = true;
+    constant = true;
+    lo = v;
+    add = 0;
+  }
+
+  int128 operator()(const int128 &x) const
+  {
+    if (constant)
+      return lo;
+    return bounded ? std::max(lo, x + add) : x + add;
+  }
+};
+
+// the updates of a range of blocks
+struct range_sink
+{
+  std::map<tally_key, tally_fn> fns;
+
+  void plus(const tally_key &k, const int128 &d) { fns[k].plus(d); }
+  void minus_clamped(const tally_key &k, const int128 &d) { fns[k].minus_clamped(d); }
+  void set(const tally_key &k, const int128 &v) { fns[k].set(v); }
+  void copy(const tally_key &from, const tally_key &to) { throw std::runtime_error("Cross tally copy in a block range"); }
+};
+
+// the tallies themselves, for blocks which need them
+struct state_sink
+{
+  supply_tallies &tallies;
+
+  void plus(const tally_key &k, const int128 &d) { tallies[k] += d; }
+  void minus_clamped(const tally_key &k, const int128 &d) { tallies[k] = std::max(int128(0), tallies[k] - d); }
+  void set(const tally_key &k, const int128 &v) { tallies[k] = v; }
+  void copy(const tally_key &from, const tally_key &to) { tallies[to] = tallies[from]; }
+};
+
+inline uint64_t index_of(const std::vector<std::string> &types, const std::string &type)
+{
+  return std::find(types.begin(), types.end(), type) - types.begin();
+}
+
+inline tally_key circ(const std::vector<std::string> &types, const std::string &type) { return {supply_tally_table::circulating, index_of(types, type)}; }
+inline tally_key total(const std::string &type) { return {supply_tally_table::total_asset, index_of(oracle::ASSET_TYPES_V2, type)}; }
+inline tally_key reserve(const std::string &type) { return {supply_tally_table::reserve_asset, index_of(oracle::RESERVE_TYPES_V2, type)}; }
+
+template<typename Sink>
+void replay_tx(Sink &sink, const transaction &tx, const crypto::hash &tx_hash, uint8_t hf_version)
+{
+  std::string source, dest;
+  if (!get_tx_asset_types(tx, tx_hash, source, dest, false))
+    throw std::runtime_error("Failed to get asset types of tx " + epee::string_tools::pod_to_hex(tx_hash));
+  transaction_type tx_type;
+  if (!get_tx_type(source, dest, tx_type))
+    return; // the db skips those too
+
+  const bool audit_tx = tx_type == transaction_type::AUDIT_ZEPH || tx_type == transaction_type::AUDIT_STABLE || tx_type == transaction_type::AUDIT_RESERVE || tx_type == transaction_type::AUDIT_YIELD;
+  if (hf_version >= HF_VERSION_AUDIT)
+  {
+    if (audit_tx)
+    {
+      sink.plus(total(dest), int128(tx.amount_minted) + tx.rct_signatures.txnFee);
+    }
+    else if (source != dest)
+    {
+      if (tx_type == transaction_type::MINT_YIELD)
+      {
+        sink.plus(reserve("YIELD"), tx.amount_burnt);
+        sink.plus(total("ZYS"), tx.amount_minted);
+      }
+      else if (tx_type == transaction_type::REDEEM_YIELD)
+      {
+        sink.minus_clamped(total("ZYS"), tx.amount_burnt);
+        sink.minus_clamped(reserve("YIELD"), tx.amount_minted);
+      }
+      else
+      {
+        if (source == "ZPH")
+          sink.plus(reserve("DJED"), tx.amount_burnt);
+        else
+          sink.minus_clamped(total(source), tx.amount_burnt);
+        if (dest == "ZPH")
+          sink.minus_clamped(reserve("DJED"), tx.amount_minted);
+        else
+          sink.plus(total(dest), tx.amount_minted);
+      }
+    }
+  }
+  else if (source != dest)
+  {
+    if (source == "ZEPHUSD" && dest == "ZYIELD")
+    {
+      sink.plus(circ(oracle::RESERVE_TYPES, "ZYIELDRSV"), tx.amount_burnt);
+      sink.plus(circ(oracle::RESERVE_TYPES, "ZYIELD"), tx.amount_minted);
+    }
+    else if (source == "ZYIELD" && dest == "ZEPHUSD")
+    {
+      sink.minus_clamped(circ(oracle::RESERVE_TYPES, "ZYIELD"), tx.amount_burnt);
+      sink.minus_clamped(circ(oracle::RESERVE_TYPES, "ZYIELDRSV"), tx.amount_minted);
+    }
+    else
+    {
+      if (source == "ZEPH")
+        sink.plus(circ(oracle::ASSET_TYPES, source), tx.amount_burnt);
+      else
+        sink.minus_clamped(circ(oracle::ASSET_TYPES, source), tx.amount_burnt);
+      if (dest == "ZEPH")
+        sink.minus_clamped(circ(oracle::ASSET_TYPES, dest), tx.amount_minted);
+      else
+        sink.plus(circ(oracle::ASSET_TYPES, dest), tx.amount_minted);
+    }
+  }
+}
+
+}
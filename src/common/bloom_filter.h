@@ -0,0 +1,136 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once 
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include "int-util.h"
+
+namespace tools
+{
+  /**
+   * @brief blocked Bloom filter over well mixed 64 bit hashes
+   *
+   * Each key sets BITS_SET bits within a single 512 bit (cache line) block,
+   * so a lookup costs one cache miss. Inserts and lookups may run
+   * concurrently. There is no removal: a removed key only becomes a false
+   * positive, so a negative answer is always exact.
+   */
+  class blocked_bloom_filter
+  {
+  public:
+    static constexpr size_t BLOCK_WORDS = 8;
+    static constexpr size_t BITS_SET = 7;
+    static constexpr size_t BITS_PER_KEY = 12;
+
+    blocked_bloom_filter(): num_blocks(0), capacity(0) {}
+
+    // sized for capacity keys at about 0.5% false positives
+    void init(uint64_t capacity)
+    {
+      const uint64_t blocks = (capacity * BITS_PER_KEY + BLOCK_WORDS * 64 - 1) / (BLOCK_WORDS * 64);
+      init_blocks(blocks ? blocks : 1);
+      this->capacity = capacity;
+      clear();
+    }
+
+    void clear()
+    {
+      for (uint64_t i = 0; i < num_blocks * BLOCK_WORDS; ++i)
+        words[i].store(0, std::memory_order_relaxed);
+      count = 0;
+    }
+
+    void insert(uint64_t hash)
+    {
+      std::atomic<uint64_t> *block = get_block(hash);
+      const uint64_t h = hash * 0x9e3779b97f4a7c15ull;
+      uint32_t a = h, b = (h >> 32) | 1;
+      for (size_t i = 0; i < BITS_SET; ++i, a += b)
+        block[(a >> 6) & (BLOCK_WORDS - 1)].fetch_or(uint64_t(1) << (a & 63), std::memory_order_relaxed);
+      ++count;
+    }
+
+    bool maybe_contains(uint64_t hash) const
+    {
+      const std::atomic<uint64_t> *block = get_block(hash);
+      const uint64_t h = hash * 0x9e3779b97f4a7c15ull;
+      uint32_t a = h, b = (h >> 32) | 1;
+      for (size_t i = 0; i < BITS_SET; ++i, a += b)
+        if (!(block[(a >> 6) & (BLOCK_WORDS - 1)].load(std::memory_order_relaxed) & (uint64_t(1) << (a & 63))))
+          return false;
+      return true;
+    }
+
+    bool empty() const { return num_blocks == 0; }
+    uint64_t get_num_blocks() const { return num_blocks; }
+    uint64_t get_count() const { return count; }
+    uint64_t get_capacity() const { return capacity; }
+    // past its capacity the false positive rate climbs, and the owner should rebuild it larger
+    bool is_full() const { return count > capacity; }
+
+    // raw access for persisting, not to be used concurrently with inserts
+    void save(uint64_t *data) const
+    {
+      for (uint64_t i = 0; i < num_blocks * BLOCK_WORDS; ++i)
+        data[i] = words[i].load(std::memory_order_relaxed);
+    }
+    void load(uint64_t blocks, const uint64_t *data, uint64_t n, uint64_t capacity)
+    {
+      init_blocks(blocks);
+      for (uint64_t i = 0; i < num_blocks * BLOCK_WORDS; ++i)
+        words[i].store(data[i], std::memory_order_relaxed);
+      count = n;
+      this->capacity = capacity;
+    }
+
+  private:
+    void init_blocks(uint64_t blocks)
+    {
+      num_blocks = blocks;
+      words.reset(new std::atomic<uint64_t>[num_blocks * BLOCK_WORDS]);
+    }
+
+    // maps the hash onto [0, num_blocks) without a division
+    std::atomic<uint64_t> *get_block(uint64_t hash) const
+    {
+      uint64_t block;
+      mul128(hash, num_blocks, &block);
+      return &words[block * BLOCK_WORDS];
+    }
+
+    uint64_t num_blocks;
+    uint64_t capacity;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    std::atomic<uint64_t> count{0};
+  };
+}
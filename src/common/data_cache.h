@@ -32,6 +32,8 @@
 
 #include <unordered_set>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
 
 namespace tools
 {
@@ -56,7 +58,20 @@ namespace tools
       return (data.find(value) != data.end());
     }
 
+    // same as has(), but counted in the hit/miss statistics
+    bool lookup(const T& value)
+    {
+      const bool found = has(value);
+      ++(found ? hits : misses);
+      return found;
+    }
+
+    uint64_t get_hits() const { return hits; }
+    uint64_t get_misses() const { return misses; }
+
   private:
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
     mutable std::mutex m;
     std::unordered_set<T> data;
     T buf[MAX_SIZE] = {};
@@ -0,0 +1,139 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once 
+
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace tools
+{
+  // the weight of an entry towards the capacity of an lru_cache, one each by default
+  template<typename V>
+  struct lru_cache_unit_cost
+  {
+    size_t operator()(const V&) const { return 1; }
+  };
+
+  // fixed capacity key/value cache, evicting the least recently used entries
+  template<typename K, typename V, typename Hash = std::hash<K>, typename Cost = lru_cache_unit_cost<V>>
+  class lru_cache
+  {
+  public:
+    explicit lru_cache(size_t max_size): max_size(max_size), total_cost(0) {}
+
+    bool get(const K& key, V& value)
+    {
+      std::lock_guard<std::mutex> lock(m);
+      const auto i = index.find(key);
+      if (i == index.end())
+      {
+        ++misses;
+        return false;
+      }
+      entries.splice(entries.begin(), entries, i->second);
+      value = i->second->second;
+      ++hits;
+      return true;
+    }
+
+    // an entry weighing more than the whole capacity is not kept
+    void add(const K& key, const V& value)
+    {
+      std::lock_guard<std::mutex> lock(m);
+      const auto i = index.find(key);
+      if (i != index.end())
+      {
+        total_cost -= cost(i->second->second);
+        i->second->second = value;
+        entries.splice(entries.begin(), entries, i->second);
+      }
+      else
+      {
+        entries.emplace_front(key, value);
+        index.emplace(key, entries.begin());
+      }
+      total_cost += cost(value);
+      while (total_cost > max_size)
+      {
+        total_cost -= cost(entries.back().second);
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+    }
+
+    void remove(const K& key)
+    {
+      std::lock_guard<std::mutex> lock(m);
+      const auto i = index.find(key);
+      if (i == index.end())
+        return;
+      total_cost -= cost(i->second->second);
+      entries.erase(i->second);
+      index.erase(i);
+    }
+
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(m);
+      index.clear();
+      entries.clear();
+      total_cost = 0;
+    }
+
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(m);
+      return index.size();
+    }
+
+    size_t get_total_cost() const
+    {
+      std::lock_guard<std::mutex> lock(m);
+      return total_cost;
+    }
+
+    uint64_t get_hits() const { return hits; }
+    uint64_t get_misses() const { return misses; }
+
+  private:
+    typedef std::list<std::pair<K, V>> list_t;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    mutable std::mutex m;
+    const size_t max_size;
+    const Cost cost{};
+    size_t total_cost;
+    list_t entries; // most recently used first
+    std::unordered_map<K, typename list_t::iterator, Hash> index;
+  };
+}
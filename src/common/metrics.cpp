@@ -0,0 +1,273 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include "misc_log_ex.h"
+#include "metrics.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "metrics"
+
+namespace
+{
+  struct family
+  {
+    std::string help;
+    bool is_histogram;
+    std::map<std::string, std::unique_ptr<tools::metrics::counter>> counters;
+    std::map<std::string, std::unique_ptr<tools::metrics::histogram>> histograms;
+  };
+
+  struct registry
+  {
+    boost::mutex mutex;
+    std::map<std::string, family> families;
+  };
+
+  registry &get_registry()
+  {
+    static registry r;
+    return r;
+  }
+
+  family &get_family(registry &r, const std::string &name, const std::string &help, bool is_histogram)
+  {
+    auto it = r.families.find(name);
+    if (it == r.families.end())
+    {
+      it = r.families.emplace(name, family()).first;
+      it->second.help = help;
+      it->second.is_histogram = is_histogram;
+    }
+    CHECK_AND_ASSERT_THROW_MES(it->second.is_histogram == is_histogram, "Metric " << name << " is already registered with another type");
+    return it->second;
+  }
+
+  uint64_t to_bits(double v) noexcept
+  {
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(v), "Unexpected double size");
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+  }
+
+  double from_bits(uint64_t bits) noexcept
+  {
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+
+  std::string format_number(double v)
+  {
+    char s[32];
+    snprintf(s, sizeof(s), "%.15g", v);
+    return s;
+  }
+
+  void write_sample(std::string &out, const std::string &name, const std::string &labels, const std::string &value)
+  {
+    out += name;
+    if (!labels.empty())
+    {
+      out += '{';
+      out += labels;
+      out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+  }
+
+  void write_header(std::string &out, const std::string &name, const std::string &help, const char *type)
+  {
+    out += "# HELP " + name + " ";
+    for (const char c: help)
+    {
+      if (c == '\\')
+        out += "\\\\";
+      else if (c == '\n')
+        out += "\\n";
+      else
+        out += c;
+    }
+    out += "\n# TYPE " + name + " " + type + "\n";
+  }
+}
+
+namespace tools
+{
+namespace metrics
+{
+  static std::atomic<unsigned> next_shard{0};
+  static __thread unsigned thread_shard = 0; // shard + 1, 0 until picked
+
+  unsigned get_shard() noexcept
+  {
+    if (!thread_shard)
+      thread_shard = next_shard.fetch_add(1, std::memory_order_relaxed) % num_shards + 1;
+    return thread_shard - 1;
+  }
+
+  counter::counter()
+  {
+    for (shard &s: m_shards)
+      s.value.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t counter::value() const noexcept
+  {
+    uint64_t v = 0;
+    for (const shard &s: m_shards)
+      v += s.value.load(std::memory_order_relaxed);
+    return v;
+  }
+
+  histogram::histogram(std::vector<double> bounds): m_bounds(std::move(bounds))
+  {
+    std::sort(m_bounds.begin(), m_bounds.end());
+    m_bounds.erase(std::unique(m_bounds.begin(), m_bounds.end()), m_bounds.end());
+    // round up to whole cache lines, so shards do not share any
+    const size_t per_line = 64 / sizeof(std::atomic<uint64_t>);
+    m_stride = (m_bounds.size() + 2 + per_line - 1) / per_line * per_line;
+    m_data.reset(new std::atomic<uint64_t>[m_stride * num_shards]);
+    for (size_t i = 0; i < m_stride * num_shards; ++i)
+      m_data[i].store(0, std::memory_order_relaxed);
+  }
+
+  void histogram::observe(double v) noexcept
+  {
+    if (v != v)
+      return;
+    std::atomic<uint64_t> *data = get_shard_data(get_shard());
+    // a bucket counts what is less than or equal to its bound
+    const size_t bucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), v) - m_bounds.begin();
+    data[bucket].fetch_add(1, std::memory_order_relaxed);
+    std::atomic<uint64_t> &sum = data[m_bounds.size() + 1];
+    uint64_t bits = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(bits, to_bits(from_bits(bits) + v), std::memory_order_relaxed))
+      ;
+  }
+
+  void histogram::get(std::vector<uint64_t> &buckets, double &sum) const
+  {
+    buckets.assign(m_bounds.size() + 1, 0);
+    sum = 0;
+    for (unsigned shard = 0; shard < num_shards; ++shard)
+    {
+      const std::atomic<uint64_t> *data = get_shard_data(shard);
+      for (size_t i = 0; i < buckets.size(); ++i)
+        buckets[i] += data[i].load(std::memory_order_relaxed);
+      sum += from_bits(data[m_bounds.size() + 1].load(std::memory_order_relaxed));
+    }
+    for (size_t i = 1; i < buckets.size(); ++i)
+      buckets[i] += buckets[i - 1];
+  }
+
+  counter &get_counter(const std::string &name, const std::string &help, const std::string &labels)
+  {
+    registry &r = get_registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    std::unique_ptr<counter> &c = get_family(r, name, help, false).counters[labels];
+    if (!c)
+      c.reset(new counter());
+    return *c;
+  }
+
+  histogram &get_histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds, const std::string &labels)
+  {
+    registry &r = get_registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    std::unique_ptr<histogram> &h = get_family(r, name, help, true).histograms[labels];
+    if (!h)
+      h.reset(new histogram(bounds));
+    return *h;
+  }
+
+  std::string label(const std::string &key, const std::string &value)
+  {
+    std::string s = key + "=\"";
+    for (const char c: value)
+    {
+      if (c == '\\' || c == '"')
+        s += '\\';
+      if (c == '\n')
+        s += "\\n";
+      else
+        s += c;
+    }
+    s += '"';
+    return s;
+  }
+
+  const std::vector<double> &latency_buckets()
+  {
+    static const std::vector<double> bounds = {
+      0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+    return bounds;
+  }
+
+  void render(std::string &out)
+  {
+    registry &r = get_registry();
+    boost::lock_guard<boost::mutex> lock(r.mutex);
+    std::vector<uint64_t> buckets;
+    double sum;
+    for (const auto &e: r.families)
+    {
+      const std::string &name = e.first;
+      const family &f = e.second;
+      write_header(out, name, f.help, f.is_histogram ? "histogram" : "counter");
+      for (const auto &c: f.counters)
+        write_sample(out, name, c.first, std::to_string(c.second->value()));
+      for (const auto &h: f.histograms)
+      {
+        h.second->get(buckets, sum);
+        const std::string prefix = h.first.empty() ? std::string() : h.first + ",";
+        const std::vector<double> &bounds = h.second->bounds();
+        for (size_t i = 0; i < bounds.size(); ++i)
+          write_sample(out, name + "_bucket", prefix + label("le", format_number(bounds[i])), std::to_string(buckets[i]));
+        write_sample(out, name + "_bucket", prefix + label("le", "+Inf"), std::to_string(buckets.back()));
+        write_sample(out, name + "_sum", h.first, format_number(sum));
+        write_sample(out, name + "_count", h.first, std::to_string(buckets.back()));
+      }
+    }
+  }
+
+  void write_gauge(std::string &out, const std::string &name, const std::string &help, double value, const std::string &labels)
+  {
+    write_header(out, name, help, "gauge");
+    write_sample(out, name, labels, format_number(value));
+  }
+}
+}
@@ -0,0 +1,121 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "perf_timer.h"
+
+namespace tools
+{
+namespace metrics
+{
+  /*! Updates go to one of several shards, picked per thread, each on its own
+    cache line, so threads counting the same thing do not contend. Readers
+    add the shards up without taking any lock. */
+  constexpr unsigned num_shards = 16;
+
+  unsigned get_shard() noexcept;
+
+  //! A count that only goes up
+  class counter
+  {
+  public:
+    counter();
+    counter(const counter&) = delete;
+    counter& operator=(const counter&) = delete;
+
+    void inc(uint64_t n = 1) noexcept { m_shards[get_shard()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const noexcept;
+
+  private:
+    struct shard
+    {
+      std::atomic<uint64_t> value;
+      char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    shard m_shards[num_shards];
+  };
+
+  //! Counts of observations falling under each of a fixed set of upper bounds, and their sum
+  class histogram
+  {
+  public:
+    explicit histogram(std::vector<double> bounds);
+    histogram(const histogram&) = delete;
+    histogram& operator=(const histogram&) = delete;
+
+    void observe(double v) noexcept;
+
+    const std::vector<double> &bounds() const noexcept { return m_bounds; }
+    //! cumulative counts, one per bound then one for +Inf, which is the count of all observations
+    void get(std::vector<uint64_t> &buckets, double &sum) const;
+
+  private:
+    // each shard has a count per bucket, +Inf included, then the bits of its sum
+    std::atomic<uint64_t> *get_shard_data(unsigned shard) const noexcept { return m_data.get() + shard * m_stride; }
+
+    std::vector<double> m_bounds;
+    size_t m_stride;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_data;
+  };
+
+  //! Observes how long it lived, in seconds
+  class scoped_timer: public PerformanceTimer
+  {
+  public:
+    explicit scoped_timer(histogram &h): m_histogram(h) {}
+    ~scoped_timer() { m_histogram.observe(value() / 1e9); }
+
+  private:
+    histogram &m_histogram;
+  };
+
+  /*! The registry hands out a counter or histogram per name and label set,
+    creating it on first use. What it hands out lives as long as the process,
+    so callers on hot paths keep the reference instead of looking it up each
+    time. Labels are given already formatted, see label(). */
+  counter &get_counter(const std::string &name, const std::string &help, const std::string &labels = std::string());
+  histogram &get_histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds, const std::string &labels = std::string());
+
+  //! formats a label as key="value", join several with ','
+  std::string label(const std::string &key, const std::string &value);
+  //! bounds in seconds, from half a millisecond up to ten seconds
+  const std::vector<double> &latency_buckets();
+
+  //! Appends everything registered in the Prometheus text format
+  void render(std::string &out);
+  //! Appends a value sampled by the caller in the Prometheus text format
+  void write_gauge(std::string &out, const std::string &name, const std::string &help, double value, const std::string &labels = std::string());
+}
+}
@@ -0,0 +1,213 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "zstd_dict_codec.h"
+#include <cstring>
+#include <boost/thread/lock_guard.hpp>
+#include "misc_log_ex.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "util"
+
+// larger frames can only be garbage, transactions are much smaller
+#define ZSTD_DICT_CODEC_MAX_CONTENT_SIZE (64 * 1024 * 1024)
+
+namespace tools
+{
+#ifdef HAVE_ZSTD
+  struct zstd_dict_codec::state
+  {
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+    ZSTD_CCtx *cctx;
+    uint32_t dict_id;
+
+    state(): cdict(NULL), ddict(NULL), cctx(NULL), dict_id(0) {}
+    ~state()
+    {
+      ZSTD_freeCCtx(cctx);
+      ZSTD_freeDDict(ddict);
+      ZSTD_freeCDict(cdict);
+    }
+  };
+
+  namespace
+  {
+    struct dctx_holder
+    {
+      ZSTD_DCtx *dctx;
+      dctx_holder(): dctx(ZSTD_createDCtx()) {}
+      ~dctx_holder() { ZSTD_freeDCtx(dctx); }
+    };
+  }
+#else
+  struct zstd_dict_codec::state
+  {
+    uint32_t dict_id;
+  };
+#endif
+
+  zstd_dict_codec::zstd_dict_codec()
+  {
+  }
+
+  zstd_dict_codec::~zstd_dict_codec()
+  {
+  }
+
+  bool zstd_dict_codec::available()
+  {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool zstd_dict_codec::train(const std::vector<std::string> &samples, size_t dict_size, std::string &dict)
+  {
+#ifdef HAVE_ZSTD
+    std::string buffer;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const std::string &s: samples)
+    {
+      buffer += s;
+      sizes.push_back(s.size());
+    }
+    dict.resize(dict_size);
+    const size_t r = ZDICT_trainFromBuffer(&dict[0], dict.size(), buffer.data(), sizes.data(), sizes.size());
+    if (ZDICT_isError(r))
+    {
+      MERROR("Failed to train zstd dictionary from " << samples.size() << " samples: " << ZDICT_getErrorName(r));
+      dict.clear();
+      return false;
+    }
+    dict.resize(r);
+    return true;
+#else
+    MERROR("zstd support was not built in");
+    return false;
+#endif
+  }
+
+  bool zstd_dict_codec::is_frame(const void *data, size_t size)
+  {
+    // ZSTD_MAGICNUMBER, little endian
+    static const unsigned char magic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+    return size >= sizeof(magic) && memcmp(data, magic, sizeof(magic)) == 0;
+  }
+
+  bool zstd_dict_codec::set_dictionary(const std::string &dict, int level)
+  {
+    boost::lock_guard<boost::mutex> lock(m_cctx_lock);
+    if (dict.empty())
+    {
+      m_state.reset();
+      return true;
+    }
+#ifdef HAVE_ZSTD
+    std::shared_ptr<state> s = std::make_shared<state>();
+    s->dict_id = ZDICT_getDictID(dict.data(), dict.size());
+    s->cdict = ZSTD_createCDict(dict.data(), dict.size(), level);
+    s->ddict = ZSTD_createDDict(dict.data(), dict.size());
+    s->cctx = ZSTD_createCCtx();
+    CHECK_AND_ASSERT_MES(s->dict_id != 0, false, "Not a trained zstd dictionary");
+    CHECK_AND_ASSERT_MES(s->cdict && s->ddict && s->cctx, false, "Failed to load zstd dictionary");
+    CHECK_AND_ASSERT_MES(!ZSTD_isError(ZSTD_CCtx_setParameter(s->cctx, ZSTD_c_checksumFlag, 1)), false, "Failed to enable zstd checksums");
+    CHECK_AND_ASSERT_MES(!ZSTD_isError(ZSTD_CCtx_refCDict(s->cctx, s->cdict)), false, "Failed to reference zstd dictionary");
+    m_state = std::move(s);
+    return true;
+#else
+    MERROR("zstd support was not built in");
+    return false;
+#endif
+  }
+
+  uint32_t zstd_dict_codec::dictionary_id() const
+  {
+    return m_state ? m_state->dict_id : 0;
+  }
+
+  bool zstd_dict_codec::compress(const void *data, size_t size, std::string &out) const
+  {
+#ifdef HAVE_ZSTD
+    const std::shared_ptr<const state> s = m_state;
+    if (!s)
+      return false;
+    out.resize(ZSTD_compressBound(size));
+    boost::lock_guard<boost::mutex> lock(m_cctx_lock);
+    const size_t r = ZSTD_compress2(s->cctx, &out[0], out.size(), data, size);
+    if (ZSTD_isError(r))
+    {
+      MERROR("Failed to compress with zstd: " << ZSTD_getErrorName(r));
+      // drop the half written frame, parameters and dictionary are kept
+      ZSTD_CCtx_reset(s->cctx, ZSTD_reset_session_only);
+      return false;
+    }
+    out.resize(r);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool zstd_dict_codec::decompress(const void *data, size_t size, std::string &out) const
+  {
+#ifdef HAVE_ZSTD
+    const std::shared_ptr<const state> s = m_state;
+    if (!s || !is_frame(data, size))
+      return false;
+    if (ZSTD_getDictID_fromFrame(data, size) != s->dict_id)
+      return false;
+    const unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR || content_size > ZSTD_DICT_CODEC_MAX_CONTENT_SIZE)
+      return false;
+
+    static thread_local dctx_holder holder;
+    if (!holder.dctx)
+      return false;
+    const size_t offset = out.size();
+    out.resize(offset + content_size);
+    const size_t r = ZSTD_decompress_usingDDict(holder.dctx, &out[offset], content_size, data, size, s->ddict);
+    if (ZSTD_isError(r) || r != content_size)
+    {
+      out.resize(offset);
+      return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+namespace tools
+{
+  /**
+   * @brief zstd compression against a trained dictionary
+   *
+   * Meant for many small blobs sharing a structure (transaction prefixes,
+   * proofs), which compress poorly on their own. Compressed blobs are
+   * plain zstd frames carrying the dictionary id and a checksum, so a blob
+   * which is not such a frame can be told apart and used as is.
+   *
+   * Without zstd support, available() is false and no dictionary can be
+   * set, so nothing is ever compressed or decompressed.
+   */
+  class zstd_dict_codec
+  {
+  public:
+    zstd_dict_codec();
+    ~zstd_dict_codec();
+
+    //! whether zstd support was built in
+    static bool available();
+
+    //! builds a dictionary of up to dict_size bytes from sample blobs
+    static bool train(const std::vector<std::string> &samples, size_t dict_size, std::string &dict);
+
+    //! whether data starts like a zstd frame, a cheap pre-check for decompress
+    static bool is_frame(const void *data, size_t size);
+
+    //! loads a dictionary from train(), an empty one unloads it, not thread safe
+    bool set_dictionary(const std::string &dict, int level = 3);
+    bool empty() const { return !m_state; }
+    uint32_t dictionary_id() const;
+
+    //! replaces out with a frame, safe to call from several threads
+    bool compress(const void *data, size_t size, std::string &out) const;
+
+    //! appends the decompressed data to out, fails on frames not made with our dictionary
+    bool decompress(const void *data, size_t size, std::string &out) const;
+
+  private:
+    struct state;
+    std::shared_ptr<const state> m_state;
+    mutable boost::mutex m_cctx_lock;
+  };
+}
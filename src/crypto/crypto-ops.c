@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "warnings.h"
@@ -253,6 +254,230 @@ static void fe_copy(fe h, const fe f) {
   h[9] = f9;
 }
 
+/* Radix 2^51 field arithmetic */
+
+/*
+On targets with a 128-bit integer type, inversions and square roots run on
+five 51-bit limbs instead of ten 25.5-bit ones, roughly halving the cost of
+the long exponentiation chains in fe_invert and fe_divpowm1. Elements are
+converted at the chain boundaries, so fe stays the representation used by
+every other function in this file.
+*/
+
+static int fe_backend = FE_BACKEND_DEFAULT;
+
+int fe_select_backend(int backend) {
+  if (backend == FE_BACKEND_REF10) {
+    fe_backend = backend;
+    return 0;
+  }
+#if defined(FE_HAVE_RADIX51)
+  if (backend == FE_BACKEND_RADIX51) {
+    fe_backend = backend;
+    return 0;
+  }
+#endif
+  return -1;
+}
+
+int fe_get_backend(void) {
+  return fe_backend;
+}
+
+#if defined(FE_HAVE_RADIX51)
+
+typedef uint64_t fe51[5];
+typedef unsigned __int128 fe51_uint128;
+
+static const uint64_t fe51_mask = (((uint64_t) 1) << 51) - 1;
+
+static uint64_t fe51_load_8(const unsigned char *in) {
+  uint64_t result = 0;
+  int i;
+  for (i = 7; i >= 0; --i) {
+    result = (result << 8) | in[i];
+  }
+  return result;
+}
+
+static void fe51_from_fe(fe51 h, const fe f) {
+  unsigned char s[32];
+  fe_tobytes(s, f);
+  h[0] = fe51_load_8(s) & fe51_mask;
+  h[1] = (fe51_load_8(s + 6) >> 3) & fe51_mask;
+  h[2] = (fe51_load_8(s + 12) >> 6) & fe51_mask;
+  h[3] = (fe51_load_8(s + 19) >> 1) & fe51_mask;
+  h[4] = (fe51_load_8(s + 24) >> 12) & fe51_mask;
+}
+
+/*
+Each 51-bit limb splits exactly into a 26-bit and a 25-bit ref10 limb.
+*/
+
+static void fe_from_fe51(fe h, const fe51 f) {
+  uint64_t f0 = f[0];
+  uint64_t f1 = f[1];
+  uint64_t f2 = f[2];
+  uint64_t f3 = f[3];
+  uint64_t f4 = f[4];
+  uint64_t c;
+
+  c = f0 >> 51; f0 &= fe51_mask; f1 += c;
+  c = f1 >> 51; f1 &= fe51_mask; f2 += c;
+  c = f2 >> 51; f2 &= fe51_mask; f3 += c;
+  c = f3 >> 51; f3 &= fe51_mask; f4 += c;
+  c = f4 >> 51; f4 &= fe51_mask; f0 += c * 19;
+  c = f0 >> 51; f0 &= fe51_mask; f1 += c;
+
+  h[0] = (int32_t) (f0 & 0x3ffffff);
+  h[1] = (int32_t) (f0 >> 26);
+  h[2] = (int32_t) (f1 & 0x3ffffff);
+  h[3] = (int32_t) (f1 >> 26);
+  h[4] = (int32_t) (f2 & 0x3ffffff);
+  h[5] = (int32_t) (f2 >> 26);
+  h[6] = (int32_t) (f3 & 0x3ffffff);
+  h[7] = (int32_t) (f3 >> 26);
+  h[8] = (int32_t) (f4 & 0x3ffffff);
+  h[9] = (int32_t) (f4 >> 26);
+}
+
+static void fe51_reduce(fe51 h, fe51_uint128 t0, fe51_uint128 t1, fe51_uint128 t2, fe51_uint128 t3, fe51_uint128 t4) {
+  uint64_t r0, r1, r2, r3, r4, c;
+
+  r0 = (uint64_t) t0 & fe51_mask; t1 += (uint64_t) (t0 >> 51);
+  r1 = (uint64_t) t1 & fe51_mask; t2 += (uint64_t) (t1 >> 51);
+  r2 = (uint64_t) t2 & fe51_mask; t3 += (uint64_t) (t2 >> 51);
+  r3 = (uint64_t) t3 & fe51_mask; t4 += (uint64_t) (t3 >> 51);
+  r4 = (uint64_t) t4 & fe51_mask; c = (uint64_t) (t4 >> 51);
+  r0 += c * 19;
+  c = r0 >> 51; r0 &= fe51_mask; r1 += c;
+
+  h[0] = r0;
+  h[1] = r1;
+  h[2] = r2;
+  h[3] = r3;
+  h[4] = r4;
+}
+
+/*
+h = f * g
+Can overlap h with f or g.
+
+Preconditions:
+   |f|, |g| limbs bounded by 2^52.
+*/
+
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+  uint64_t g1_19 = 19 * g1;
+  uint64_t g2_19 = 19 * g2;
+  uint64_t g3_19 = 19 * g3;
+  uint64_t g4_19 = 19 * g4;
+
+  fe51_reduce(h,
+    (fe51_uint128) f0 * g0 + (fe51_uint128) f1 * g4_19 + (fe51_uint128) f2 * g3_19 + (fe51_uint128) f3 * g2_19 + (fe51_uint128) f4 * g1_19,
+    (fe51_uint128) f0 * g1 + (fe51_uint128) f1 * g0 + (fe51_uint128) f2 * g4_19 + (fe51_uint128) f3 * g3_19 + (fe51_uint128) f4 * g2_19,
+    (fe51_uint128) f0 * g2 + (fe51_uint128) f1 * g1 + (fe51_uint128) f2 * g0 + (fe51_uint128) f3 * g4_19 + (fe51_uint128) f4 * g3_19,
+    (fe51_uint128) f0 * g3 + (fe51_uint128) f1 * g2 + (fe51_uint128) f2 * g1 + (fe51_uint128) f3 * g0 + (fe51_uint128) f4 * g4_19,
+    (fe51_uint128) f0 * g4 + (fe51_uint128) f1 * g3 + (fe51_uint128) f2 * g2 + (fe51_uint128) f3 * g1 + (fe51_uint128) f4 * g0);
+}
+
+/*
+h = f * f
+Can overlap h with f.
+*/
+
+static void fe51_sq(fe51 h, const fe51 f) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t f0_2 = 2 * f0;
+  uint64_t f1_2 = 2 * f1;
+  uint64_t f2_38 = 38 * f2;
+  uint64_t f3_19 = 19 * f3;
+  uint64_t f4_19 = 19 * f4;
+  uint64_t f4_38 = 38 * f4;
+
+  fe51_reduce(h,
+    (fe51_uint128) f0 * f0 + (fe51_uint128) f4_38 * f1 + (fe51_uint128) f2_38 * f3,
+    (fe51_uint128) f0_2 * f1 + (fe51_uint128) f4_38 * f2 + (fe51_uint128) f3_19 * f3,
+    (fe51_uint128) f0_2 * f2 + (fe51_uint128) f1 * f1 + (fe51_uint128) f4_38 * f3,
+    (fe51_uint128) f0_2 * f3 + (fe51_uint128) f1_2 * f2 + (fe51_uint128) f4_19 * f4,
+    (fe51_uint128) f0_2 * f4 + (fe51_uint128) f1_2 * f3 + (fe51_uint128) f2 * f2);
+}
+
+static void fe51_sqn(fe51 h, const fe51 f, int n) {
+  int i;
+  fe51_sq(h, f);
+  for (i = 1; i < n; ++i) {
+    fe51_sq(h, h);
+  }
+}
+
+/* Same addition chain as fe_invert */
+
+static void fe51_invert(fe51 out, const fe51 z) {
+  fe51 t0;
+  fe51 t1;
+  fe51 t2;
+  fe51 t3;
+
+  fe51_sq(t0, z);
+  fe51_sqn(t1, t0, 2);
+  fe51_mul(t1, z, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq(t2, t0);
+  fe51_mul(t1, t1, t2);
+  fe51_sqn(t2, t1, 5);
+  fe51_mul(t1, t2, t1);
+  fe51_sqn(t2, t1, 10);
+  fe51_mul(t2, t2, t1);
+  fe51_sqn(t3, t2, 20);
+  fe51_mul(t2, t3, t2);
+  fe51_sqn(t2, t2, 10);
+  fe51_mul(t1, t2, t1);
+  fe51_sqn(t2, t1, 50);
+  fe51_mul(t2, t2, t1);
+  fe51_sqn(t3, t2, 100);
+  fe51_mul(t2, t3, t2);
+  fe51_sqn(t2, t2, 50);
+  fe51_mul(t1, t2, t1);
+  fe51_sqn(t1, t1, 5);
+  fe51_mul(out, t1, t0);
+}
+
+/* Same addition chain as fe_pow22523 */
+
+static void fe51_pow22523(fe51 out, const fe51 z) {
+  fe51 t0;
+  fe51 t1;
+  fe51 t2;
+
+  fe51_sq(t0, z);
+  fe51_sqn(t1, t0, 2);
+  fe51_mul(t1, z, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq(t0, t0);
+  fe51_mul(t0, t1, t0);
+  fe51_sqn(t1, t0, 5);
+  fe51_mul(t0, t1, t0);
+  fe51_sqn(t1, t0, 10);
+  fe51_mul(t1, t1, t0);
+  fe51_sqn(t2, t1, 20);
+  fe51_mul(t1, t2, t1);
+  fe51_sqn(t1, t1, 10);
+  fe51_mul(t0, t1, t0);
+  fe51_sqn(t1, t0, 50);
+  fe51_mul(t1, t1, t0);
+  fe51_sqn(t2, t1, 100);
+  fe51_mul(t1, t2, t1);
+  fe51_sqn(t1, t1, 50);
+  fe51_mul(t0, t1, t0);
+  fe51_sqn(t0, t0, 2);
+  fe51_mul(out, t0, z);
+}
+
+#endif
+
 /* From fe_invert.c */
 
 void fe_invert(fe out, const fe z) {
@@ -262,6 +487,16 @@ void fe_invert(fe out, const fe z) {
   fe t3;
   int i;
 
+#if defined(FE_HAVE_RADIX51)
+  if (fe_backend == FE_BACKEND_RADIX51) {
+    fe51 z51;
+    fe51_from_fe(z51, z);
+    fe51_invert(z51, z51);
+    fe_from_fe51(out, z51);
+    return;
+  }
+#endif
+
   fe_sq(t0, z);
   fe_sq(t1, t0);
   fe_sq(t1, t1);
@@ -1606,20 +1841,20 @@ static void ge_precomp_cmov(ge_precomp *t, const ge_precomp *u, unsigned char b)
   fe_cmov(t->xy2d, u->xy2d, b);
 }
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void select(ge_precomp *t, const ge_precomp row[8], signed char b) {
   ge_precomp minust;
   unsigned char bnegative = negative(b);
   unsigned char babs = b - (((-bnegative) & b) << 1);
 
   ge_precomp_0(t);
-  ge_precomp_cmov(t, &ge_base[pos][0], equal(babs, 1));
-  ge_precomp_cmov(t, &ge_base[pos][1], equal(babs, 2));
-  ge_precomp_cmov(t, &ge_base[pos][2], equal(babs, 3));
-  ge_precomp_cmov(t, &ge_base[pos][3], equal(babs, 4));
-  ge_precomp_cmov(t, &ge_base[pos][4], equal(babs, 5));
-  ge_precomp_cmov(t, &ge_base[pos][5], equal(babs, 6));
-  ge_precomp_cmov(t, &ge_base[pos][6], equal(babs, 7));
-  ge_precomp_cmov(t, &ge_base[pos][7], equal(babs, 8));
+  ge_precomp_cmov(t, &row[0], equal(babs, 1));
+  ge_precomp_cmov(t, &row[1], equal(babs, 2));
+  ge_precomp_cmov(t, &row[2], equal(babs, 3));
+  ge_precomp_cmov(t, &row[3], equal(babs, 4));
+  ge_precomp_cmov(t, &row[4], equal(babs, 5));
+  ge_precomp_cmov(t, &row[5], equal(babs, 6));
+  ge_precomp_cmov(t, &row[6], equal(babs, 7));
+  ge_precomp_cmov(t, &row[7], equal(babs, 8));
   fe_copy(minust.yplusx, t->yminusx);
   fe_copy(minust.yminusx, t->yplusx);
   fe_neg(minust.xy2d, t->xy2d);
@@ -1636,6 +1871,55 @@ Preconditions:
 */
 
 void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+  ge_scalarmult_precomp_table(h, a, ge_base);
+}
+
+/*
+Fills a fixed-base table in the ge_base layout for an arbitrary point:
+table[i][j] = (j + 1) * 256^i * P
+*/
+
+void ge_precomp_table_init(ge_precomp table[32][8], const ge_p3 *P) {
+  ge_p3 base = *P;
+  ge_p3 cur;
+  ge_cached base_cached;
+  ge_p1p1 t;
+  fe recip;
+  fe x;
+  fe y;
+  int i;
+  int j;
+
+  for (i = 0; i < 32; ++i) {
+    ge_p3_to_cached(&base_cached, &base);
+    cur = base;
+    for (j = 0; j < 8; ++j) {
+      fe_invert(recip, cur.Z);
+      fe_mul(x, cur.X, recip);
+      fe_mul(y, cur.Y, recip);
+      fe_add(table[i][j].yplusx, y, x);
+      fe_sub(table[i][j].yminusx, y, x);
+      fe_mul(table[i][j].xy2d, x, y);
+      fe_mul(table[i][j].xy2d, table[i][j].xy2d, fe_d2);
+      ge_add(&t, &cur, &base_cached);
+      ge_p1p1_to_p3(&cur, &t);
+    }
+    for (j = 0; j < 8; ++j) {
+      ge_p3_dbl(&t, &base);
+      ge_p1p1_to_p3(&base, &t);
+    }
+  }
+}
+
+/*
+h = a * P
+where table was filled by ge_precomp_table_init for P (or is ge_base).
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_precomp_table(ge_p3 *h, const unsigned char *a, const ge_precomp table[32][8]) {
   signed char e[64];
   signed char carry;
   ge_p1p1 r;
@@ -1662,7 +1946,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 
@@ -1672,7 +1956,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
 
   for (i = 0; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 }
@@ -1712,6 +1996,39 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* Batched ge_tobytes: encodes n points using a single field inversion
+   (Montgomery's trick). s receives 32 * n bytes, scratch must hold n
+   field elements. None of the Z coordinates may be zero. */
+
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, fe *scratch, size_t n) {
+  fe acc;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0)
+    return;
+
+  fe_copy(scratch[0], h[0].Z);
+  for (i = 1; i < n; ++i)
+    fe_mul(scratch[i], scratch[i - 1], h[i].Z);
+
+  fe_invert(acc, scratch[n - 1]);
+  for (i = n - 1; i > 0; --i) {
+    fe_mul(recip, acc, scratch[i - 1]);
+    fe_mul(acc, acc, h[i].Z);
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+  fe_mul(x, h[0].X, acc);
+  fe_mul(y, h[0].Y, acc);
+  fe_tobytes(s, y);
+  s[31] ^= fe_isnegative(x) << 7;
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -1967,6 +2284,16 @@ static void fe_divpowm1(fe r, const fe u, const fe v) {
 
   /*fe_pow22523(uv7, uv7);*/
 
+#if defined(FE_HAVE_RADIX51)
+  if (fe_backend == FE_BACKEND_RADIX51) {
+    fe51 uv7_51;
+    fe51_from_fe(uv7_51, uv7);
+    fe51_pow22523(uv7_51, uv7_51);
+    fe_from_fe51(t0, uv7_51);
+    goto pow22523_done;
+  }
+#endif
+
   /* From fe_pow22523.c */
 
   fe_sq(t0, uv7);
@@ -2014,6 +2341,9 @@ static void fe_divpowm1(fe r, const fe u, const fe v) {
   fe_mul(t0, t0, uv7);
 
   /* End fe_pow22523.c */
+#if defined(FE_HAVE_RADIX51)
+pow22523_done:
+#endif
   /* t0 = (uv^7)^((q-5)/8) */
   fe_mul(t0, t0, v3);
   fe_mul(r, t0, u); /* u^(m+1)v^(-(m+1)) */
@@ -30,12 +30,29 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* From fe.h */
 
 typedef int32_t fe[10];
 
+/* Field arithmetic backend used for inversions and square roots */
+
+#define FE_BACKEND_REF10 0
+#define FE_BACKEND_RADIX51 1
+
+#if defined(__SIZEOF_INT128__)
+#define FE_HAVE_RADIX51 1
+#define FE_BACKEND_DEFAULT FE_BACKEND_RADIX51
+#else
+#define FE_BACKEND_DEFAULT FE_BACKEND_REF10
+#endif
+
+/* Not thread safe, call before any other crypto ops are in flight. Returns 0 on success */
+int fe_select_backend(int backend);
+int fe_get_backend(void);
+
 /* From ge.h */
 
 typedef struct {
@@ -119,10 +136,13 @@ void ge_p3_tobytes(unsigned char *, const ge_p3 *);
 
 extern const ge_precomp ge_base[32][8];
 void ge_scalarmult_base(ge_p3 *, const unsigned char *);
+void ge_precomp_table_init(ge_precomp table[32][8], const ge_p3 *);
+void ge_scalarmult_precomp_table(ge_p3 *, const unsigned char *, const ge_precomp table[32][8]);
 
 /* From ge_tobytes.c */
 
 void ge_tobytes(unsigned char *, const ge_p2 *);
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, fe *, size_t);
 
 /* From sc_reduce.c */
 
@@ -34,6 +34,8 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <vector>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
@@ -202,6 +204,32 @@ namespace crypto {
     return true;
   }
 
+  void crypto_ops::generate_key_derivations(const public_key *keys1, std::size_t count, const secret_key &key2, key_derivation *derivations, bool *results) {
+    std::vector<ge_p2> points(count);
+    std::unique_ptr<fe[]> scratch(new fe[count]);
+    std::size_t valid = 0;
+    assert(sc_check(&key2) == 0);
+    for (std::size_t i = 0; i < count; ++i) {
+      ge_p3 point;
+      ge_p1p1 point3;
+      results[i] = ge_frombytes_vartime(&point, &keys1[i]) == 0;
+      if (!results[i]) {
+        continue;
+      }
+      ge_scalarmult(&points[valid], &unwrap(key2), &point);
+      ge_mul8(&point3, &points[valid]);
+      ge_p1p1_to_p2(&points[valid], &point3);
+      ++valid;
+    }
+    std::vector<key_derivation> encoded(valid);
+    ge_tobytes_batch(reinterpret_cast<unsigned char*>(encoded.data()), points.data(), scratch.get(), valid);
+    for (std::size_t i = 0, j = 0; i < count; ++i) {
+      if (results[i]) {
+        derivations[i] = encoded[j++];
+      }
+    }
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -0,0 +1,117 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "misc_log_ex.h"
+#include "compact_output_indices.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "cn"
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------
+  uint64_t output_index_delta_encoder::run_delta(size_t run, uint64_t index)
+  {
+    if (run == m_runs.size())
+      m_runs.push_back(0);
+    const uint64_t delta = index - m_runs[run];
+    m_runs[run] = index;
+    return delta;
+  }
+  //---------------------------------------------------------------
+  size_t output_index_delta_encoder::closest_run_below(uint64_t index) const
+  {
+    size_t run = m_runs.size();
+    for (size_t r = 0; r < m_runs.size(); ++r)
+      if (m_runs[r] < index && (run == m_runs.size() || m_runs[r] > m_runs[run]))
+        run = r;
+    return run;
+  }
+  //---------------------------------------------------------------
+  bool output_index_delta_decoder::run_index(uint64_t run, uint64_t delta, uint64_t &index)
+  {
+    CHECK_AND_ASSERT_MES(run <= m_runs.size(), false, "Invalid output index run");
+    if (run == m_runs.size())
+      m_runs.push_back(0);
+    m_runs[run] += delta;
+    index = m_runs[run];
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool get_compact_output_indices(const std::vector<std::vector<uint64_t>> &output_indices, const std::vector<std::vector<uint64_t>> &asset_type_output_indices, compact_output_indices &compact)
+  {
+    CHECK_AND_ASSERT_MES(output_indices.size() == asset_type_output_indices.size(), false, "Mismatched output indices and asset type output indices");
+
+    compact = compact_output_indices();
+
+    output_index_delta_encoder encoder;
+    for (size_t t = 0; t < output_indices.size(); ++t)
+    {
+      CHECK_AND_ASSERT_MES(output_indices[t].size() == asset_type_output_indices[t].size(), false, "Mismatched output indices and asset type output indices");
+      compact.n_outputs.push_back(output_indices[t].size());
+      for (size_t i = 0; i < output_indices[t].size(); ++i)
+      {
+        compact.output_index_deltas.push_back(encoder.global_delta(output_indices[t][i]));
+        const size_t run = encoder.closest_run_below(asset_type_output_indices[t][i]);
+        compact.asset_type_output_index_runs.push_back(run);
+        compact.asset_type_output_index_deltas.push_back(encoder.run_delta(run, asset_type_output_indices[t][i]));
+      }
+    }
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool get_output_indices(const compact_output_indices &compact, std::vector<std::vector<uint64_t>> &output_indices, std::vector<std::vector<uint64_t>> &asset_type_output_indices)
+  {
+    const size_t n_outputs = compact.output_index_deltas.size();
+    CHECK_AND_ASSERT_MES(compact.asset_type_output_index_runs.size() == n_outputs && compact.asset_type_output_index_deltas.size() == n_outputs,
+        false, "Mismatched output counts in compact output indices");
+
+    output_indices.clear();
+    asset_type_output_indices.clear();
+    output_indices.resize(compact.n_outputs.size());
+    asset_type_output_indices.resize(compact.n_outputs.size());
+    size_t offset = 0;
+    output_index_delta_decoder decoder;
+    for (size_t t = 0; t < compact.n_outputs.size(); ++t)
+    {
+      CHECK_AND_ASSERT_MES(compact.n_outputs[t] <= n_outputs - offset, false, "Compact output indices too short");
+      output_indices[t].reserve(compact.n_outputs[t]);
+      asset_type_output_indices[t].reserve(compact.n_outputs[t]);
+      for (uint64_t i = 0; i < compact.n_outputs[t]; ++i, ++offset)
+      {
+        output_indices[t].push_back(decoder.global_index(compact.output_index_deltas[offset]));
+        uint64_t index;
+        if (!decoder.run_index(compact.asset_type_output_index_runs[offset], compact.asset_type_output_index_deltas[offset], index))
+          return false;
+        asset_type_output_indices[t].push_back(index);
+      }
+    }
+    CHECK_AND_ASSERT_MES(offset == n_outputs, false, "Compact output indices too long");
+    return true;
+  }
+  //---------------------------------------------------------------
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <vector>
+#include "serialization/containers.h"
+
+namespace cryptonote
+{
+  // The global and asset type output indices of a block's txes, packed for
+  // get_blocks.bin. Indices within a block nearly always go up by one, so each
+  // is stored as a varint delta from the one before it, the first one's delta
+  // being its base. Asset type indices interleave one increasing run per asset
+  // type, so each names the run it continues (a new run starting from 0) and
+  // is a delta from that run's last index.
+  struct compact_output_indices
+  {
+    std::vector<uint64_t> n_outputs;
+    std::vector<uint64_t> output_index_deltas;
+    std::vector<uint64_t> asset_type_output_index_runs;
+    std::vector<uint64_t> asset_type_output_index_deltas;
+
+    BEGIN_SERIALIZE_OBJECT()
+      VERSION_FIELD(0)
+      FIELD(n_outputs)
+      FIELD(output_index_deltas)
+      FIELD(asset_type_output_index_runs)
+      FIELD(asset_type_output_index_deltas)
+    END_SERIALIZE()
+  };
+
+  // Delta codes output indices the way compact_output_indices and block_scan_view
+  // store them: global indices against the one before, asset type indices
+  // against the last one in the same run. Deltas wrap around if an index ever
+  // goes down, which still decodes correctly.
+  class output_index_delta_encoder
+  {
+  public:
+    uint64_t global_delta(uint64_t index) { const uint64_t delta = index - m_previous; m_previous = index; return delta; }
+    // run is an existing one, or n_runs() to start a new one from 0
+    uint64_t run_delta(size_t run, uint64_t index);
+    // the run whose last index is closest below this one, or n_runs() if none is
+    size_t closest_run_below(uint64_t index) const;
+    size_t n_runs() const { return m_runs.size(); }
+
+  private:
+    uint64_t m_previous = 0;
+    std::vector<uint64_t> m_runs;
+  };
+
+  class output_index_delta_decoder
+  {
+  public:
+    uint64_t global_index(uint64_t delta) { m_previous += delta; return m_previous; }
+    // fails unless run is an existing one, or the next new one
+    bool run_index(uint64_t run, uint64_t delta, uint64_t &index);
+
+  private:
+    uint64_t m_previous = 0;
+    std::vector<uint64_t> m_runs;
+  };
+
+  bool get_compact_output_indices(const std::vector<std::vector<uint64_t>> &output_indices, const std::vector<std::vector<uint64_t>> &asset_type_output_indices, compact_output_indices &compact);
+  bool get_output_indices(const compact_output_indices &compact, std::vector<std::vector<uint64_t>> &output_indices, std::vector<std::vector<uint64_t>> &asset_type_output_indices);
+}
@@ -308,6 +308,33 @@ void HardFork::on_block_popped(uint64_t nblocks)
       break;
 }
 
+void HardFork::on_blocks_added(uint64_t height)
+{
+  CRITICAL_REGION_LOCAL(lock);
+  db_rtxn_guard rtxn_guard(&db);
+
+  const uint64_t bc_height = db.height();
+  for (uint64_t h = height; h < bc_height; ++h)
+  {
+    const cryptonote::block b = db.get_block_from_height(h);
+    const uint8_t v = get_effective_version(get_block_vote(b));
+
+    while (versions.size() >= window_size) {
+      const uint8_t old_version = versions.front();
+      assert(last_versions[old_version] >= 1);
+      last_versions[old_version]--;
+      versions.pop_front();
+    }
+    last_versions[v]++;
+    versions.push_back(v);
+
+    uint8_t voted = get_voted_fork_index(h + 1);
+    if (voted > current_fork_index) {
+      current_fork_index = voted;
+    }
+  }
+}
+
 int HardFork::get_voted_fork_index(uint64_t height) const
 {
   CRITICAL_REGION_LOCAL(lock);
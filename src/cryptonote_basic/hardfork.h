@@ -160,6 +160,16 @@ namespace cryptonote
      */
     void on_block_popped(uint64_t new_chain_height);
 
+    /**
+     * @brief called when blocks were added to the db by another process
+     *
+     * Like add, but the versions are already recorded in the db, so
+     * this only updates the in memory voting window, and never writes.
+     *
+     * @param height the height of the first block which was added
+     */
+    void on_blocks_added(uint64_t height);
+
     /**
      * @brief returns current state at the given time
      *
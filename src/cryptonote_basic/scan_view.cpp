@@ -0,0 +1,155 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "cryptonote_format_utils.h"
+#include "compact_output_indices.h"
+#include "scan_view.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "cn"
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------
+  bool get_tx_scan_view(const transaction_prefix &tx, const std::vector<uint64_t> &output_indices, const std::vector<uint64_t> &asset_type_output_indices, tx_scan_view &view)
+  {
+    CHECK_AND_ASSERT_MES(output_indices.size() == tx.vout.size() && asset_type_output_indices.size() == tx.vout.size(),
+        false, "Mismatched output indices and outputs");
+
+    view = tx_scan_view();
+
+    // partial extra is fine, as long as the pubkeys are in there
+    std::vector<tx_extra_field> tx_extra_fields;
+    parse_tx_extra(tx.extra, tx_extra_fields);
+    tx_extra_pub_key pub_key_field;
+    for (size_t pk_index = 0; find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index); ++pk_index)
+      view.pub_keys.push_back(pub_key_field.pub_key);
+    tx_extra_additional_pub_keys additional_pub_keys;
+    if (find_tx_extra_field_by_type(tx_extra_fields, additional_pub_keys))
+      view.additional_pub_keys = std::move(additional_pub_keys.data);
+
+    for (const txin_v &in: tx.vin)
+      if (in.type() == typeid(txin_zephyr_key))
+        view.key_images.push_back(boost::get<txin_zephyr_key>(in).k_image);
+
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      crypto::public_key output_key;
+      std::string asset_type;
+      const boost::optional<crypto::view_tag> view_tag = get_output_view_tag(tx.vout[i]);
+      CHECK_AND_ASSERT_MES(get_output_public_key(tx.vout[i], output_key) && get_output_asset_type(tx.vout[i], asset_type) && view_tag,
+          false, "Unexpected output type");
+      view.output_keys.push_back(output_key);
+      view.view_tags.push_back(*view_tag);
+      view.asset_types.push_back(std::move(asset_type));
+    }
+    view.output_indices = output_indices;
+    view.asset_type_output_indices = asset_type_output_indices;
+    return true;
+  }
+  //---------------------------------------------------------------
+  void get_block_scan_view(const std::vector<tx_scan_view> &views, block_scan_view &block_view)
+  {
+    block_view = block_scan_view();
+
+    // each asset type is its own run of asset type output indices
+    output_index_delta_encoder encoder;
+    for (const tx_scan_view &view: views)
+    {
+      block_view.n_pub_keys.push_back(view.pub_keys.size());
+      block_view.n_additional_pub_keys.push_back(view.additional_pub_keys.size());
+      block_view.n_key_images.push_back(view.key_images.size());
+      block_view.n_outputs.push_back(view.output_keys.size());
+      block_view.pub_keys.insert(block_view.pub_keys.end(), view.pub_keys.begin(), view.pub_keys.end());
+      block_view.additional_pub_keys.insert(block_view.additional_pub_keys.end(), view.additional_pub_keys.begin(), view.additional_pub_keys.end());
+      block_view.key_images.insert(block_view.key_images.end(), view.key_images.begin(), view.key_images.end());
+      block_view.output_keys.insert(block_view.output_keys.end(), view.output_keys.begin(), view.output_keys.end());
+      block_view.view_tags.insert(block_view.view_tags.end(), view.view_tags.begin(), view.view_tags.end());
+      for (size_t i = 0; i < view.output_keys.size(); ++i)
+      {
+        const auto it = std::find(block_view.asset_type_names.begin(), block_view.asset_type_names.end(), view.asset_types[i]);
+        const uint64_t asset = it - block_view.asset_type_names.begin();
+        if (it == block_view.asset_type_names.end())
+          block_view.asset_type_names.push_back(view.asset_types[i]);
+        block_view.output_asset_types.push_back(asset);
+        block_view.output_index_deltas.push_back(encoder.global_delta(view.output_indices[i]));
+        block_view.asset_type_output_index_deltas.push_back(encoder.run_delta(asset, view.asset_type_output_indices[i]));
+      }
+    }
+  }
+  //---------------------------------------------------------------
+  bool get_tx_scan_views(const block_scan_view &block_view, std::vector<tx_scan_view> &views)
+  {
+    const size_t n_txes = block_view.n_outputs.size();
+    CHECK_AND_ASSERT_MES(block_view.n_pub_keys.size() == n_txes && block_view.n_additional_pub_keys.size() == n_txes && block_view.n_key_images.size() == n_txes,
+        false, "Mismatched tx counts in block scan view");
+    const size_t n_outputs = block_view.output_keys.size();
+    CHECK_AND_ASSERT_MES(block_view.view_tags.size() == n_outputs && block_view.output_asset_types.size() == n_outputs
+        && block_view.output_index_deltas.size() == n_outputs && block_view.asset_type_output_index_deltas.size() == n_outputs,
+        false, "Mismatched output counts in block scan view");
+
+    views.clear();
+    views.resize(n_txes);
+    size_t pub_key_offset = 0, additional_pub_key_offset = 0, key_image_offset = 0, output_offset = 0;
+    output_index_delta_decoder decoder;
+    for (size_t t = 0; t < n_txes; ++t)
+    {
+      tx_scan_view &view = views[t];
+      const auto take = [](const auto &column, size_t &offset, uint64_t count, auto &out) {
+        CHECK_AND_ASSERT_MES(count <= column.size() - offset, false, "Block scan view column too short");
+        out.assign(column.begin() + offset, column.begin() + offset + count);
+        offset += count;
+        return true;
+      };
+      const size_t first_output = output_offset;
+      if (!take(block_view.pub_keys, pub_key_offset, block_view.n_pub_keys[t], view.pub_keys)
+          || !take(block_view.additional_pub_keys, additional_pub_key_offset, block_view.n_additional_pub_keys[t], view.additional_pub_keys)
+          || !take(block_view.key_images, key_image_offset, block_view.n_key_images[t], view.key_images)
+          || !take(block_view.output_keys, output_offset, block_view.n_outputs[t], view.output_keys))
+        return false;
+      view.view_tags.assign(block_view.view_tags.begin() + first_output, block_view.view_tags.begin() + output_offset);
+      for (size_t i = first_output; i < output_offset; ++i)
+      {
+        const uint64_t asset = block_view.output_asset_types[i];
+        CHECK_AND_ASSERT_MES(asset < block_view.asset_type_names.size(), false, "Invalid asset type in block scan view");
+        view.asset_types.push_back(block_view.asset_type_names[asset]);
+        view.output_indices.push_back(decoder.global_index(block_view.output_index_deltas[i]));
+        uint64_t index;
+        if (!decoder.run_index(asset, block_view.asset_type_output_index_deltas[i], index))
+          return false;
+        view.asset_type_output_indices.push_back(index);
+      }
+    }
+    CHECK_AND_ASSERT_MES(pub_key_offset == block_view.pub_keys.size() && additional_pub_key_offset == block_view.additional_pub_keys.size()
+        && key_image_offset == block_view.key_images.size() && output_offset == n_outputs,
+        false, "Trailing data in block scan view");
+    return true;
+  }
+  //---------------------------------------------------------------
+}
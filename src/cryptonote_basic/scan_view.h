@@ -0,0 +1,96 @@
+// Copyright (c) 2014-2022, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "crypto/crypto.h"
+#include "serialization/containers.h"
+#include "serialization/crypto.h"
+#include "serialization/string.h"
+#include "cryptonote_basic.h"
+
+namespace cryptonote
+{
+  // What a wallet needs from a tx to tell whether it has to fetch it: the tx
+  // pubkeys and view tags find its outputs, the key images its spends
+  struct tx_scan_view
+  {
+    std::vector<crypto::public_key> pub_keys;
+    std::vector<crypto::public_key> additional_pub_keys;
+    std::vector<crypto::key_image> key_images;
+    std::vector<crypto::public_key> output_keys;
+    std::vector<crypto::view_tag> view_tags;
+    std::vector<std::string> asset_types;
+    std::vector<uint64_t> output_indices;
+    std::vector<uint64_t> asset_type_output_indices;
+  };
+
+  // The scan views of a block's txes, stored by column so each column packs
+  // tightly: counts and indices are varints, and output indices are deltas
+  // from the previous output of the block (of the same asset type for the
+  // asset type indices), which keeps them to a byte or two
+  struct block_scan_view
+  {
+    std::vector<uint64_t> n_pub_keys;
+    std::vector<uint64_t> n_additional_pub_keys;
+    std::vector<uint64_t> n_key_images;
+    std::vector<uint64_t> n_outputs;
+    std::vector<crypto::public_key> pub_keys;
+    std::vector<crypto::public_key> additional_pub_keys;
+    std::vector<crypto::key_image> key_images;
+    std::vector<crypto::public_key> output_keys;
+    std::vector<crypto::view_tag> view_tags;
+    std::vector<std::string> asset_type_names;
+    std::vector<uint64_t> output_asset_types;
+    std::vector<uint64_t> output_index_deltas;
+    std::vector<uint64_t> asset_type_output_index_deltas;
+
+    BEGIN_SERIALIZE_OBJECT()
+      VERSION_FIELD(0)
+      FIELD(n_pub_keys)
+      FIELD(n_additional_pub_keys)
+      FIELD(n_key_images)
+      FIELD(n_outputs)
+      FIELD(pub_keys)
+      FIELD(additional_pub_keys)
+      FIELD(key_images)
+      FIELD(output_keys)
+      FIELD(view_tags)
+      FIELD(asset_type_names)
+      FIELD(output_asset_types)
+      FIELD(output_index_deltas)
+      FIELD(asset_type_output_index_deltas)
+    END_SERIALIZE()
+  };
+
+  bool get_tx_scan_view(const transaction_prefix &tx, const std::vector<uint64_t> &output_indices, const std::vector<uint64_t> &asset_type_output_indices, tx_scan_view &view);
+  void get_block_scan_view(const std::vector<tx_scan_view> &views, block_scan_view &block_view);
+  bool get_tx_scan_views(const block_scan_view &block_view, std::vector<tx_scan_view> &views);
+}
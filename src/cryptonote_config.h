@@ -130,6 +130,7 @@
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_BLOCK_COUNT     1000
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT        20000
+#define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE             (100*1024*1024) // 100 MB
 #define MAX_RPC_CONTENT_LENGTH                          1048576 // 1 MB
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
@@ -193,6 +194,8 @@
 #define HASH_OF_HASHES_STEP                     512
 
 #define DEFAULT_TXPOOL_MAX_WEIGHT               648000000ull // 3 days at 300000, in bytes
+#define BLOCK_HEADER_CACHE_SIZE                 8192 // header records kept in memory for header RPCs
+#define DB_READ_ONLY_REPLICA_REORG_DEPTH        100 // deeper reorgs by the primary drop all cached state
 
 #define BULLETPROOF_MAX_OUTPUTS                 16
 #define BULLETPROOF_PLUS_MAX_OUTPUTS            16
@@ -260,6 +263,7 @@ namespace config
   const constexpr char HASH_KEY_MULTISIG_TX_PRIVKEYS_SEED[] = "multisig_tx_privkeys_seed";
   const constexpr char HASH_KEY_MULTISIG_TX_PRIVKEYS[] = "multisig_tx_privkeys";
   const constexpr char HASH_KEY_TXHASH_AND_MIXRING[] = "txhash_and_mixring";
+  const constexpr char HASH_KEY_TXHASH_AND_PRICING_RECORD[] = "txhash_and_pricing_record";
 
   // Multisig
   const uint32_t MULTISIG_MAX_SIGNERS{16};
@@ -0,0 +1,170 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "misc_log_ex.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "block_template_selection.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "txpool"
+
+namespace cryptonote
+{
+  constexpr size_t template_selection::max_changes;
+  //---------------------------------------------------------------------------------
+  void template_selection::clear(uint64_t empty_block_coinbase)
+  {
+    txes.clear();
+    tx_indices.clear();
+    total_weight = 0;
+    total_fee_in_zeph = 0;
+    coinbase = empty_block_coinbase;
+    total_conversion_zeph = 0;
+    total_conversion_stables = 0;
+    total_conversion_reserves = 0;
+    fee_map.clear();
+    key_images.clear();
+    no_room.clear();
+  }
+  //---------------------------------------------------------------------------------
+  void template_selection::add(template_tx e, uint64_t new_coinbase)
+  {
+    total_weight += e.weight;
+    total_fee_in_zeph += e.fee_in_zeph;
+    fee_map[e.fee_asset] += e.fee;
+    total_conversion_zeph += e.conversion_zeph;
+    total_conversion_stables += e.conversion_stables;
+    total_conversion_reserves += e.conversion_reserves;
+    coinbase = new_coinbase;
+    key_images.insert(e.key_images.begin(), e.key_images.end());
+    tx_indices[e.txid] = txes.size();
+    txes.push_back(std::move(e));
+  }
+  //---------------------------------------------------------------------------------
+  bool template_selection::remove(size_t index)
+  {
+    CHECK_AND_ASSERT_MES(index < txes.size(), false, "Block template tx index out of range");
+    const template_tx &e = txes[index];
+    total_weight -= e.weight;
+    total_fee_in_zeph -= e.fee_in_zeph;
+    fee_map[e.fee_asset] -= e.fee;
+    total_conversion_zeph -= e.conversion_zeph;
+    total_conversion_stables -= e.conversion_stables;
+    total_conversion_reserves -= e.conversion_reserves;
+    for (const crypto::key_image &ki: e.key_images)
+      key_images.erase(ki);
+    tx_indices.erase(e.txid);
+    txes.erase(txes.begin() + index);
+    for (size_t i = index; i < txes.size(); ++i)
+      tx_indices[txes[i].txid] = i;
+
+    uint64_t block_reward;
+    if (!get_block_reward(median_weight, total_weight, already_generated_coins, block_reward, version))
+      return false;
+    coinbase = block_reward + total_fee_in_zeph;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void template_selection::note_change(const crypto::hash &txid, double fee_per_byte, bool added)
+  {
+    // nobody is mining, or so much changed that a full pass is as good
+    if (!valid)
+      return;
+    if (changes.size() >= max_changes)
+    {
+      valid = false;
+      changes.clear();
+      return;
+    }
+    changes.push_back({txid, fee_per_byte, added});
+  }
+  //---------------------------------------------------------------------------------
+  bool update_template_selection(template_selection &sel, const template_pool &pool)
+  {
+    const auto try_add = [&sel, &pool](const crypto::hash &txid, double fee_per_byte) {
+      // already in, and only relayed on since
+      if (sel.tx_indices.find(txid) != sel.tx_indices.end())
+        return true;
+      if (pool.add(sel, txid, fee_per_byte) != template_fit::no_room)
+      {
+        sel.no_room.erase(txid);
+        return true;
+      }
+      sel.no_room[txid] = fee_per_byte;
+      // it might fit in place of cheaper ones, which only a full pass would find
+      for (const template_tx &e: sel.txes)
+        if (e.fee_per_byte < fee_per_byte)
+          return false;
+      return true;
+    };
+
+    std::vector<std::pair<crypto::hash, double>> spenders, candidates;
+    for (const template_change &change: sel.changes)
+    {
+      if (change.added)
+      {
+        if (!try_add(change.txid, change.fee_per_byte))
+          return false;
+        continue;
+      }
+      const auto it = sel.tx_indices.find(change.txid);
+      if (it == sel.tx_indices.end())
+      {
+        sel.no_room.erase(change.txid);
+        continue;
+      }
+      // the reserve ratio for the conversions after it was checked with it counted in
+      if (sel.txes[it->second].conversion)
+        return false;
+      const std::vector<crypto::key_image> key_images = sel.txes[it->second].key_images;
+      if (!sel.remove(it->second))
+        return false;
+      // a double spend of it was turned down for its key images, and may fit now
+      for (const crypto::key_image &ki: key_images)
+      {
+        spenders.clear();
+        pool.get_spenders(ki, spenders);
+        for (const auto &spender: spenders)
+          if (!try_add(spender.first, spender.second))
+            return false;
+      }
+      // and those turned away for want of room may fit in what it freed, best
+      // paying first as a full pass would try them
+      candidates.assign(sel.no_room.begin(), sel.no_room.end());
+      std::stable_sort(candidates.begin(), candidates.end(), [](const std::pair<crypto::hash, double> &a, const std::pair<crypto::hash, double> &b) {
+        return a.second > b.second;
+      });
+      for (const auto &candidate: candidates)
+        if (!try_add(candidate.first, candidate.second))
+          return false;
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <boost/multiprecision/cpp_int.hpp>
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "oracle/pricing_record.h"
+
+namespace cryptonote
+{
+  //! what a transaction chosen for the block template adds to it
+  struct template_tx
+  {
+    crypto::hash txid;
+    double fee_per_byte;
+    size_t weight;
+    uint64_t fee_in_zeph;
+    std::string fee_asset; //!< as keyed in the fee map
+    uint64_t fee;
+    bool conversion;
+    boost::multiprecision::int128_t conversion_zeph;
+    boost::multiprecision::int128_t conversion_stables;
+    boost::multiprecision::int128_t conversion_reserves;
+    std::vector<crypto::key_image> key_images;
+  };
+
+  //! a transaction added to or removed from the pool
+  struct template_change
+  {
+    crypto::hash txid;
+    double fee_per_byte;
+    bool added;
+  };
+
+  enum class template_fit { added, skipped, no_room };
+
+  /*! What the last block template was filled with, and what it was filled
+    for. While the chain tip and pricing record stay the same, the pool
+    changes made since can be applied to it by update_template_selection
+    instead of going over the whole pool again. */
+  struct template_selection
+  {
+    //! past this many unapplied changes, a full pass is as good
+    static constexpr size_t max_changes = 10000;
+
+    bool valid = false;
+    crypto::hash prev_id;
+    oracle::pricing_record pricing_record;
+    size_t median_weight = 0;
+    uint64_t already_generated_coins = 0;
+    uint8_t version = 0;
+    bool have_valid_pr = false;
+    size_t max_total_weight = 0;
+    std::vector<std::pair<std::string, std::string>> circ_supply;
+    std::vector<oracle::pricing_record> pricing_record_history;
+
+    std::vector<template_tx> txes;
+    std::unordered_map<crypto::hash, size_t> tx_indices; //!< where each chosen tx is in txes
+    size_t total_weight = 0;
+    uint64_t total_fee_in_zeph = 0;
+    uint64_t coinbase = 0;
+    boost::multiprecision::int128_t total_conversion_zeph;
+    boost::multiprecision::int128_t total_conversion_stables;
+    boost::multiprecision::int128_t total_conversion_reserves;
+    std::map<std::string, uint64_t> fee_map;
+    std::unordered_set<crypto::key_image> key_images;
+    //! txes turned away for want of room, with their fee per byte, to try again when some is freed
+    std::unordered_map<crypto::hash, double> no_room;
+
+    //! pool changes since, oldest first
+    std::vector<template_change> changes;
+
+    //! empties the selection, leaving the coinbase of an empty block
+    void clear(uint64_t empty_block_coinbase);
+    //! adds a tx that passed the checks, which make `new_coinbase` the coinbase
+    void add(template_tx e, uint64_t new_coinbase);
+    //! takes a chosen tx back out, and works the coinbase out again
+    bool remove(size_t index);
+    //! records a pool change to apply, if anything is kept
+    void note_change(const crypto::hash &txid, double fee_per_byte, bool added);
+  };
+
+  //! how update_template_selection gets at the pool
+  struct template_pool
+  {
+    //! checks a pool tx against the selection, and adds it if it fits
+    std::function<template_fit(template_selection &sel, const crypto::hash &txid, double fee_per_byte)> add;
+    //! the pool txes spending a key image, with their fee per byte
+    std::function<void(const crypto::key_image &key_image, std::vector<std::pair<crypto::hash, double>> &spenders)> get_spenders;
+  };
+
+  /**
+   * @brief applies the pool changes made since the selection was made
+   *
+   * An added tx is checked against the current totals, and appended if it
+   * fits. A removed plain transfer is taken out, and the txes that were
+   * turned down for spending one of its key images, or for want of the room
+   * it took, are tried again.
+   *
+   * @return false if a full pass over the pool is needed instead
+   */
+  bool update_template_selection(template_selection &sel, const template_pool &pool);
+}
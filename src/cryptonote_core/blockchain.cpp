@@ -30,6 +30,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <mutex>
 #include <boost/filesystem.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/format.hpp>
@@ -60,6 +61,7 @@
 #include "common/varint.h"
 #include "common/pruning.h"
 #include "common/data_cache.h"
+#include "common/metrics.h"
 #include "time_helper.h"
 #include "oracle/asset_types.h"
 #include "oracle/pricing_record.h"
@@ -67,8 +69,6 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "blockchain"
 
-#define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE (100*1024*1024) // 100 MB
-
 using namespace crypto;
 
 //#include "serialization/json_archive.h"
@@ -91,6 +91,45 @@ DISABLE_VS_WARNINGS(4267)
 // used to overestimate the block reward when estimating a per kB to use
 #define BLOCK_REWARD_OVERESTIMATE (10 * 1000000000000)
 
+namespace
+{
+  enum block_stage
+  {
+    block_stage_processing,
+    block_stage_header,
+    block_stage_timestamp,
+    block_stage_pricing_record,
+    block_stage_difficulty,
+    block_stage_pow,
+    block_stage_prevalidate,
+    block_stage_tx_exists,
+    block_stage_tx_pool,
+    block_stage_tx_checks,
+    block_stage_double_spend,
+    block_stage_miner_tx,
+    block_stage_db_add,
+    num_block_stages
+  };
+
+  //! records the handle_block_to_main_chain time stats, given in milliseconds
+  void observe_block_stages(const uint64_t (&ms)[num_block_stages])
+  {
+    static const char *const names[num_block_stages] = {
+      "processing", "header", "timestamp", "pricing_record", "difficulty", "pow", "prevalidate",
+      "tx_exists", "tx_pool", "tx_checks", "double_spend", "miner_tx", "db_add"
+    };
+    static tools::metrics::histogram *histograms[num_block_stages];
+    static std::once_flag once;
+    std::call_once(once, []() {
+      for (int i = 0; i < num_block_stages; ++i)
+        histograms[i] = &tools::metrics::get_histogram("zephyr_block_verification_seconds", "Time taken by each stage of adding a block to the main chain",
+            tools::metrics::latency_buckets(), tools::metrics::label("stage", names[i]));
+    });
+    for (int i = 0; i < num_block_stages; ++i)
+      histograms[i]->observe(ms[i] / 1000.0);
+  }
+}
+
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_reset_timestamps_and_difficulties_height(true), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
@@ -104,7 +143,10 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_btc_valid(false),
   m_batch_success(true),
   m_prepare_height(0),
-  m_rct_ver_cache()
+  m_rct_ver_cache(),
+  m_rct_sem_cache(),
+  m_block_header_cache(BLOCK_HEADER_CACHE_SIZE),
+  m_db_tip_hashes_start(0)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -135,6 +177,17 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_images, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // one read txn for the whole batch, rather than one per key image
+  db_rtxn_guard rtxn_guard(m_db);
+  spent.clear();
+  spent.reserve(key_images.size());
+  for (const crypto::key_image &ki: key_images)
+    spent.push_back(m_db->has_key_image(ki));
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
@@ -282,9 +335,9 @@ bool Blockchain::get_latest_acceptable_pr(oracle::pricing_record& pr) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   uint64_t current_height = get_current_blockchain_height();
-  block latest_bl;
+  block_header_record latest_bl = AUTO_VAL_INIT(latest_bl);
   for (size_t i = 1; i <= 10; i++) {
-    if (!get_block_by_hash(get_block_id_by_height(current_height - i), latest_bl)) {
+    if (!get_block_header_record(current_height - i, latest_bl)) {
       continue;
     }
 
@@ -509,6 +562,9 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   const crypto::hash seedhash = get_block_id_by_height(crypto::rx_seedheight(m_db->height()));
   if (seedhash != crypto::null_hash)
     rx_set_main_seedhash(seedhash.data, tools::get_max_concurrency());
+
+  if (m_db->is_read_only())
+    track_db_tip_hashes();
   
   return true;
 }
@@ -591,6 +647,133 @@ bool Blockchain::deinit()
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::refresh_from_db(bool &changed)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  changed = false;
+  CHECK_AND_ASSERT_MES(m_db->is_read_only(), false, "Refreshing from the db needs a read-only db");
+
+  CRITICAL_REGION_LOCAL(m_tx_pool);
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  uint64_t old_height, split_height, new_height, already_generated_coins;
+  crypto::hash top_hash, seedhash;
+  bool reset;
+  std::vector<block> new_blocks;
+  try
+  {
+    db_rtxn_guard rtxn_guard(m_db);
+
+    uint64_t top_height;
+    top_hash = m_db->top_block_hash(&top_height);
+    if (!m_db_tip_hashes.empty() && top_hash == m_db_tip_hashes.back())
+      return true;
+    new_height = top_height + 1;
+
+    old_height = m_db_tip_hashes_start + m_db_tip_hashes.size();
+    bool lost_track;
+    split_height = find_db_split_height(m_db_tip_hashes, m_db_tip_hashes_start, new_height,
+        [this](uint64_t height) { return m_db->get_block_hash_from_height(height); }, lost_track);
+    reset = split_height < old_height || lost_track;
+
+    // cached state is rebuilt from here, while notifiers only go as far
+    // back as the blocks we tracked, not down to genesis
+    uint64_t reset_height = split_height;
+    if (lost_track)
+    {
+      MWARNING("Chain in the db was reorganized deeper than the " << DB_READ_ONLY_REPLICA_REORG_DEPTH << " blocks tracked, reloading all cached state");
+      reset_height = 0;
+    }
+
+    if (reset)
+    {
+      MINFO("Chain in the db was reorganized from height " << split_height);
+      m_block_header_cache.clear();
+      truncate_rct_distribution_cache(reset_height);
+      m_timestamps_and_difficulties_height = 0;
+      m_reset_timestamps_and_difficulties_height = true;
+      m_hardfork->init();
+    }
+    else
+    {
+      m_hardfork->on_blocks_added(old_height);
+    }
+
+    if (!update_next_cumulative_weight_limit())
+    {
+      MERROR("Failed to update the next cumulative weight limit");
+      return false;
+    }
+
+    if (!m_block_notifiers.empty())
+      for (uint64_t h = split_height; h < new_height; ++h)
+        new_blocks.push_back(m_db->get_block_from_height(h));
+    already_generated_coins = m_db->get_block_already_generated_coins(top_height);
+    seedhash = get_block_id_by_height(crypto::rx_seedheight(new_height));
+
+    track_db_tip_hashes();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to refresh from the db: " << e.what());
+    return false;
+  }
+
+  changed = true;
+  invalidate_block_template_cache();
+
+  if (reset)
+  {
+    m_tx_pool.on_blockchain_dec(new_height - 1, top_hash);
+    std::shared_ptr<tools::Notify> reorg_notify = m_reorg_notify;
+    if (reorg_notify)
+      reorg_notify->notify("%s", std::to_string(split_height).c_str(), "%h", std::to_string(new_height).c_str(),
+          "%n", std::to_string(new_height - split_height).c_str(), "%d", std::to_string(old_height > split_height ? old_height - split_height : 0).c_str(), NULL);
+  }
+  else
+  {
+    m_tx_pool.on_blockchain_inc(new_height, top_hash);
+  }
+
+  send_miner_notifications(new_height, seedhash, top_hash, already_generated_coins);
+
+  for (const auto& notifier: m_block_notifiers)
+    notifier(split_height, epee::to_span(new_blocks));
+
+  rx_set_main_seedhash(seedhash.data, tools::get_max_concurrency());
+
+  MDEBUG("Followed the db to height " << new_height << ", top block " << top_hash);
+  return true;
+}
+//------------------------------------------------------------------
+uint64_t Blockchain::find_db_split_height(const std::vector<crypto::hash> &tip_hashes, uint64_t tip_hashes_start, uint64_t db_height,
+    const std::function<crypto::hash(uint64_t)> &get_db_hash, bool &lost_track)
+{
+  // walk back our last view of the chain until it agrees with the db
+  const uint64_t old_height = tip_hashes_start + tip_hashes.size();
+  uint64_t split_height = old_height;
+  while (split_height > tip_hashes_start)
+  {
+    const uint64_t h = split_height - 1;
+    if (h < db_height && get_db_hash(h) == tip_hashes[h - tip_hashes_start])
+      break;
+    --split_height;
+  }
+  lost_track = tip_hashes.empty() || (split_height < old_height && split_height == tip_hashes_start);
+  return split_height;
+}
+//------------------------------------------------------------------
+void Blockchain::track_db_tip_hashes()
+{
+  db_rtxn_guard rtxn_guard(m_db);
+  const uint64_t height = m_db->height();
+  m_db_tip_hashes_start = height > DB_READ_ONLY_REPLICA_REORG_DEPTH ? height - DB_READ_ONLY_REPLICA_REORG_DEPTH : 0;
+  m_db_tip_hashes.clear();
+  m_db_tip_hashes.reserve(height - m_db_tip_hashes_start);
+  for (uint64_t h = m_db_tip_hashes_start; h < height; ++h)
+    m_db_tip_hashes.push_back(m_db->get_block_hash_from_height(h));
+}
+//------------------------------------------------------------------
 // This function removes blocks from the top of blockchain.
 // It starts a batch and calls private method pop_block_from_blockchain().
 void Blockchain::pop_blocks(uint64_t nblocks)
@@ -650,11 +833,13 @@ block Blockchain::pop_block_from_blockchain()
   {
     const uint64_t blk_weight = m_db->get_block_weight(m_db->height() - 1);
     m_db->pop_block(popped_block, popped_txs);
+    m_block_header_cache.remove(get_block_hash(popped_block));
     if (!update_next_cumulative_weight_limit()) {
       MERROR("Error updating next cumulative weight limit after pop_block");
       throw;
     }
     m_db->pop_reserve_reward(popped_block, blk_weight);
+    truncate_rct_distribution_cache(m_db->height());
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
@@ -892,6 +1077,57 @@ bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orph
   return false;
 }
 //------------------------------------------------------------------
+bool Blockchain::get_block_header_record(const crypto::hash &h, block_header_record &record) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  db_rtxn_guard rtxn_guard(m_db);
+
+  // records are keyed by hash, so they stay valid as long as the block is in the main chain
+  uint64_t height;
+  if (!m_db->block_exists(h, &height))
+    return false;
+  if (m_block_header_cache.get(h, record))
+    return true;
+
+  try
+  {
+    const block blk = m_db->get_block_from_height(height);
+    record.hash = h;
+    record.prev_id = blk.prev_id;
+    record.miner_tx_hash = get_transaction_hash(blk.miner_tx);
+    record.height = height;
+    record.timestamp = blk.timestamp;
+    record.nonce = blk.nonce;
+    record.major_version = blk.major_version;
+    record.minor_version = blk.minor_version;
+    record.weight = m_db->get_block_weight(height);
+    record.long_term_weight = m_db->get_block_long_term_weight(height);
+    record.cumulative_difficulty = m_db->get_block_cumulative_difficulty(height);
+    record.difficulty = m_db->get_block_difficulty(height);
+    record.reward = 0;
+    for (const tx_out &out: blk.miner_tx.vout)
+      record.reward += out.amount;
+    record.num_txes = blk.tx_hashes.size();
+    record.pricing_record = blk.pricing_record;
+  }
+  catch (const BLOCK_DNE &e)
+  {
+    return false;
+  }
+
+  m_block_header_cache.add(h, record);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::get_block_header_record(uint64_t height, block_header_record &record) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  db_rtxn_guard rtxn_guard(m_db);
+  if (height >= m_db->height())
+    return false;
+  return get_block_header_record(m_db->get_block_hash_from_height(height), record);
+}
+//------------------------------------------------------------------
 // This function aggregates the cumulative difficulties and timestamps of the
 // last DIFFICULTY_BLOCKS_COUNT blocks and passes them to next_difficulty,
 // returning the result of that call.  Ignores the genesis block, and can use
@@ -1663,7 +1899,7 @@ uint64_t Blockchain::get_current_cumulative_block_weight_median() const
 // in a lot of places.  That flag is not referenced in any of the code
 // nor any of the makefiles, howeve.  Need to look into whether or not it's
 // necessary at all.
-bool Blockchain::create_block_template(block& b, const crypto::hash *from_block, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash)
+bool Blockchain::create_block_template(block& b, const crypto::hash *from_block, const account_public_address& miner_address, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash, bool use_cache)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   size_t median_weight;
@@ -1675,7 +1911,7 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
   m_tx_pool.lock();
   const auto unlock_guard = epee::misc_utils::create_scope_leave_handler([&]() { m_tx_pool.unlock(); });
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  if (m_btc_valid && !from_block) {
+  if (m_btc_valid && !from_block && use_cache) {
     // The pool cookie is atomic. The lack of locking is OK, as if it changes
     // just as we compare it, we'll just use a slightly old template, but
     // this would be the case anyway if we'd lock, and the change happened
@@ -1930,7 +2166,7 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
         ", cumulative weight " << cumulative_weight << " is now good");
 #endif
 
-    if (!from_block)
+    if (!from_block && use_cache)
       cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, seed_height, seed_hash, pool_cookie);
     return true;
   }
@@ -1952,11 +2188,17 @@ bool Blockchain::get_pricing_record(oracle::pricing_record& pr, uint64_t timesta
     
     std::array<std::string, 3> oracle_urls = get_config(m_nettype).ORACLE_URLS;
     std::shuffle(oracle_urls.begin(), oracle_urls.end(), std::default_random_engine(crypto::rand<unsigned>()));
+    static tools::metrics::histogram &fetch_ok_seconds = tools::metrics::get_histogram("zephyr_oracle_fetch_seconds",
+        "Time taken to fetch a pricing record from an oracle", tools::metrics::latency_buckets(), tools::metrics::label("result", "ok"));
+    static tools::metrics::histogram &fetch_failed_seconds = tools::metrics::get_histogram("zephyr_oracle_fetch_seconds",
+        "Time taken to fetch a pricing record from an oracle", tools::metrics::latency_buckets(), tools::metrics::label("result", "failed"));
     for (size_t n = 0; n < oracle_urls.size(); n++) {
       http_client.set_server(oracle_urls[n], boost::none, epee::net_utils::ssl_support_t::e_ssl_support_autodetect);
       std::string url = "/price/?timestamp=" + boost::lexical_cast<std::string>(timestamp) + "&version=" + std::to_string(hf_version);
 
+      tools::PerformanceTimer fetch_timer;
       r = epee::net_utils::invoke_http_json(url, req, res, http_client, std::chrono::seconds(10), "GET");
+      (r ? fetch_ok_seconds : fetch_failed_seconds).observe(fetch_timer.value() / 1e9);
       if (r) {
         LOG_PRINT_L1("Obtained pricing record from Oracle : " << oracle_urls[n]);
         break;
@@ -2522,65 +2764,78 @@ crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_i
 bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  // read only: no need for m_blockchain_lock, the read txn pins a consistent
+  // snapshot for the output lookups as well as the unlock checks below
+  const db_read_snapshot snapshot(m_db);
+  const uint8_t hf_version = get_snapshot_hard_fork_version(snapshot);
 
   res.outs.clear();
   res.outs.reserve(req.outputs.size());
 
-  // if an asset type is provided in the request, most indexes provided in the request are asset type output id's.
-  // need to use the asset type output id's provided to retrieve the respective global output id's
-  std::map<uint64_t, uint64_t> global_outs_by_asset_type_output_id;
-  if (!req.asset_type.empty())
+  std::vector<cryptonote::output_data_t> data;
+  try
   {
-    std::vector<uint64_t> asset_type_output_indices;
-    for (const auto &i: req.outputs)
+    std::vector<uint64_t> offsets;
+    offsets.reserve(req.outputs.size());
+    if (req.asset_type.empty())
     {
+      // if no asset type provided, the offsets provided are already global output id's
+      std::vector<uint64_t> amounts;
+      amounts.reserve(req.outputs.size());
+      for (const auto &i: req.outputs)
+      {
+        amounts.push_back(i.amount);
+        offsets.push_back(i.index);
+      }
+      m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, data);
+    }
+    else
+    {
+      // if an asset type is provided in the request, most indexes provided in the request are asset type output id's.
+      // they are resolved to global output id's and output data in a single sorted pass over the db.
       // some inputs in the request have already been used in attempted rings in the past. These inputs will
       // have the is_global_out flag set to true, since they already have the global output id saved
-      if (!i.is_global_out)
-        asset_type_output_indices.push_back(i.index);
-    }
-
-    std::vector<uint64_t> global_out_ids;
-    global_out_ids.reserve(asset_type_output_indices.size());
+      std::vector<uint64_t> asset_type_output_indices, global_amounts, global_offsets;
+      for (const auto &i: req.outputs)
+      {
+        if (i.is_global_out)
+        {
+          global_amounts.push_back(i.amount);
+          global_offsets.push_back(i.index);
+        }
+        else
+          asset_type_output_indices.push_back(i.index);
+      }
 
-    m_db->get_output_id_from_asset_type_output_index(req.asset_type, asset_type_output_indices, global_out_ids);
+      std::vector<uint64_t> asset_type_output_ids;
+      std::vector<cryptonote::output_data_t> asset_type_data, global_data;
+      m_db->get_output_data_from_asset_type_output_indices(req.asset_type, asset_type_output_indices, asset_type_output_ids, asset_type_data);
+      if (!global_offsets.empty())
+        m_db->get_output_key(epee::span<const uint64_t>(global_amounts.data(), global_amounts.size()), global_offsets, global_data);
 
-    uint64_t global_outs = 0;
-    for (const auto &i: req.outputs)
-    {
-      if (!i.is_global_out)
+      data.reserve(req.outputs.size());
+      size_t n_asset_type = 0, n_global = 0;
+      for (const auto &i: req.outputs)
       {
-        global_outs_by_asset_type_output_id[i.index] = global_out_ids[global_outs];
-        ++global_outs;
+        if (i.is_global_out)
+        {
+          offsets.push_back(global_offsets[n_global]);
+          data.push_back(global_data[n_global++]);
+        }
+        else
+        {
+          offsets.push_back(asset_type_output_ids[n_asset_type]);
+          data.push_back(asset_type_data[n_asset_type++]);
+        }
       }
     }
-  }
-
-  std::vector<cryptonote::output_data_t> data;
-  try
-  {
-    std::vector<uint64_t> amounts, offsets;
-    amounts.reserve(req.outputs.size());
-    offsets.reserve(req.outputs.size());
-    for (const auto &i: req.outputs)
-    {
-      amounts.push_back(i.amount);
-      // if no asset type provided, the offsets provided are already global output id's unless specifically set
-      if (req.asset_type.empty() || i.is_global_out)
-        offsets.push_back(i.index);
-      else
-        offsets.push_back(global_outs_by_asset_type_output_id[i.index]);
-    }
-    m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, data);
     if (data.size() != req.outputs.size())
     {
       MERROR("Unexpected output data size: expected " << req.outputs.size() << ", got " << data.size());
       return false;
     }
-    const uint8_t hf_version = m_hardfork->get_current_version();
     for (const auto &t: data)
-      res.outs.push_back({t.pubkey, t.commitment, is_tx_spendtime_unlocked(t.unlock_time, hf_version), t.height, crypto::null_hash});
+      res.outs.push_back({t.pubkey, t.commitment, is_tx_spendtime_unlocked(t.unlock_time, hf_version, snapshot.height()), t.height, crypto::null_hash});
 
     if (req.get_txid)
     {
@@ -2605,12 +2860,18 @@ bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMA
 //------------------------------------------------------------------
 void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint64_t& index, crypto::public_key& key, rct::key& mask, bool& unlocked) const
 {
+  const db_read_snapshot snapshot(m_db);
+  const uint8_t hf_version = get_snapshot_hard_fork_version(snapshot);
   const auto o_data = m_db->get_output_key(amount, index);
   key = o_data.pubkey;
   mask = o_data.commitment;
   tx_out_index toi = m_db->get_output_tx_and_index(amount, index);
-  const uint8_t hf_version = m_hardfork->get_current_version();
-  unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first), hf_version);
+  unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first), hf_version, snapshot.height());
+}
+//------------------------------------------------------------------
+uint8_t Blockchain::get_snapshot_hard_fork_version(const db_read_snapshot &snapshot) const
+{
+  return snapshot.height() > 0 ? m_db->get_hard_fork_version(snapshot.height() - 1) : 1;
 }
 //------------------------------------------------------------------
 bool Blockchain::get_output_distribution(uint64_t amount, std::string asset_type, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base, uint64_t &num_spendable_global_outs) const
@@ -2629,22 +2890,28 @@ bool Blockchain::get_output_distribution(uint64_t amount, std::string asset_type
     start_height = from_height;
 
   distribution.clear();
-  uint64_t db_height = m_db->height();
+  // no m_blockchain_lock: the height check and the cumulative output reads
+  // below all see the same db snapshot
+  const db_read_snapshot snapshot(m_db);
+  const uint64_t db_height = snapshot.height();
   if (db_height == 0)
     return false;
   if (start_height >= db_height || to_height >= db_height)
     return false;
   if (amount == 0)
   {
-    std::vector<uint64_t> heights;
-    heights.reserve(to_height + 1 - start_height);
     const uint64_t real_start_height = start_height > 0 ? start_height-1 : start_height;
-    for (uint64_t h = real_start_height; h <= to_height; ++h)
-      heights.push_back(h);
-    
-    std::pair<std::vector<uint64_t>, uint64_t> block_cum_outputs = m_db->get_block_cumulative_rct_outputs(heights, asset_type);
-    distribution = block_cum_outputs.first;
-    num_spendable_global_outs = block_cum_outputs.second;
+    get_rct_cumulative_distribution(asset_type, real_start_height, to_height, distribution);
+
+    // total rct outputs as of CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE blocks below the top of the range
+    if (to_height + 1 - real_start_height >= CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE)
+    {
+      std::vector<uint64_t> heights;
+      heights.reserve(CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE);
+      for (uint64_t h = to_height + 1 - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE; h <= to_height; ++h)
+        heights.push_back(h);
+      num_spendable_global_outs = m_db->get_block_cumulative_rct_outputs(heights, asset_type).second;
+    }
     if (start_height > 0)
     {
       base = distribution[0];
@@ -2658,6 +2925,68 @@ bool Blockchain::get_output_distribution(uint64_t amount, std::string asset_type
   }
 }
 //------------------------------------------------------------------
+void Blockchain::get_rct_cumulative_distribution(const std::string &asset_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const
+{
+  const uint64_t db_height = m_db->height();
+  CHECK_AND_ASSERT_THROW_MES(from_height <= to_height && to_height < db_height, "Invalid rct distribution range");
+
+  const auto read_from_db = [this, &asset_type](uint64_t from, uint64_t to, std::vector<uint64_t> &cumulative) {
+    std::vector<uint64_t> heights;
+    heights.reserve(to + 1 - from);
+    for (uint64_t h = from; h <= to; ++h)
+      heights.push_back(h);
+    std::vector<uint64_t> counts = m_db->get_block_cumulative_rct_outputs(heights, asset_type).first;
+    cumulative.insert(cumulative.end(), counts.begin(), counts.end());
+  };
+
+  // only cache known asset types, the name comes straight from the RPC request
+  const bool cacheable = std::find(oracle::ASSET_TYPES.begin(), oracle::ASSET_TYPES.end(), asset_type) != oracle::ASSET_TYPES.end()
+    || std::find(oracle::ASSET_TYPES_V2.begin(), oracle::ASSET_TYPES_V2.end(), asset_type) != oracle::ASSET_TYPES_V2.end();
+
+  distribution.clear();
+  CRITICAL_REGION_LOCAL(m_rct_distribution_cache_lock);
+  if (cacheable)
+  {
+    rct_distribution_cache_entry &entry = m_rct_distribution_cache[asset_type];
+    std::vector<uint64_t> &cumulative = entry.cumulative;
+
+    // a batch which was aborted after we read from it, or a reorg: start over
+    if (!cumulative.empty() && cumulative.size() <= db_height && m_db->get_block_hash_from_height(cumulative.size() - 1) != entry.top_hash)
+    {
+      MDEBUG("Cached " << asset_type << " rct distribution does not match the chain, rebuilding");
+      cumulative.clear();
+    }
+
+    // if the cache is ahead of our snapshot, it was filled by a reader that
+    // started after us and we can't check it against our view of the chain
+    if (cumulative.size() <= db_height)
+    {
+      if (cumulative.size() < db_height)
+      {
+        read_from_db(cumulative.size(), db_height - 1, cumulative);
+        entry.top_hash = m_db->get_block_hash_from_height(db_height - 1);
+      }
+      distribution.assign(cumulative.begin() + from_height, cumulative.begin() + to_height + 1);
+      return;
+    }
+  }
+  read_from_db(from_height, to_height, distribution);
+}
+//------------------------------------------------------------------
+void Blockchain::truncate_rct_distribution_cache(uint64_t height)
+{
+  CRITICAL_REGION_LOCAL(m_rct_distribution_cache_lock);
+  for (auto &e: m_rct_distribution_cache)
+  {
+    rct_distribution_cache_entry &entry = e.second;
+    if (entry.cumulative.size() <= height)
+      continue;
+    entry.cumulative.resize(height);
+    if (height > 0)
+      entry.top_hash = m_db->get_block_hash_from_height(height - 1);
+  }
+}
+//------------------------------------------------------------------
 // This function takes a list of block hashes from another node
 // on the network to find where the split point is between us and them.
 // This is used to see what to send another node that needs to sync.
@@ -4077,13 +4406,18 @@ uint64_t Blockchain::get_dynamic_base_fee_estimate(uint64_t grace_blocks) const
 // This function checks to see if a tx is unlocked.  unlock_time is either
 // a block index or a unix time.
 bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_version) const
+{
+  // ND: Instead of calling get_current_blockchain_height(), call m_db->height()
+  //    directly as get_current_blockchain_height() locks the recursive mutex.
+  return is_tx_spendtime_unlocked(unlock_time, hf_version, m_db->height());
+}
+//------------------------------------------------------------------
+bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_version, uint64_t height) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   if(unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER)
   {
-    // ND: Instead of calling get_current_blockchain_height(), call m_db->height()
-    //    directly as get_current_blockchain_height() locks the recursive mutex.
-    if(m_db->height()-1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= unlock_time)
+    if(height-1 + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS >= unlock_time)
       return true;
     else
       return false;
@@ -4091,7 +4425,7 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_versi
   else
   {
     //interpret as time
-    const uint64_t current_time = get_adjusted_time(m_db->height());
+    const uint64_t current_time = get_adjusted_time(height);
     if(current_time + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_SECONDS_V2 >= unlock_time)
       return true;
     else
@@ -4780,7 +5114,7 @@ leave: {
       }
 
       if (hf_version >= HF_VERSION_V6) {
-        if (!rct::verRctSemanticsZeph(tx.rct_signatures, pr_bl.pricing_record, tx_type, source, dest, tx.amount_burnt, tx.amount_minted, tx.vout, tx.vin, hf_version))
+        if (!ver_rct_semantics_zeph_cached(tx, pr_bl.pricing_record, tx_type, source, dest, hf_version, m_rct_sem_cache))
         {
           LOG_PRINT_L2(" transaction proof-of-value is now invalid for tx " << tx.hash);
           bvc.m_verifivation_failed = true;
@@ -4859,22 +5193,8 @@ leave: {
   }
 
   uint64_t reserve_reward = 0;
-  if (hf_version >= HF_VERSION_DJED) {
-    reserve_reward = get_reserve_reward(base_reward, hf_version);
-  }
-
   uint64_t yield_reward_zsd = 0;
-  if (hf_version >= HF_VERSION_V6) {
-    uint64_t yield_reward_in_zeph = get_zeph_yield_reward(base_reward);
-    reserve_reward += yield_reward_in_zeph;
-
-    if (!bl.pricing_record.has_missing_rates(bl.major_version)) {
-      const uint64_t YIELD_RSV_MIN = 2 * COIN; // 200%
-      if (bl.pricing_record.reserve_ratio > YIELD_RSV_MIN && bl.pricing_record.reserve_ratio_ma > YIELD_RSV_MIN) {
-        yield_reward_zsd = cryptonote::zeph_to_zephusd(yield_reward_in_zeph, bl.pricing_record, hf_version);
-      }
-    }
-  }
+  get_block_reserve_rewards(base_reward, bl, hf_version, reserve_reward, yield_reward_zsd);
 
   if (blockchain_height == HF_VERSION_V11_FORK_HEIGHT) {
     base_reward += UNAUDITABLE_ZEPH_AMOUNT;
@@ -4952,6 +5272,8 @@ leave: {
         << t1 << "/" << t2 << "/" << t3 << "/" << t_exists << "/" << t_pool
         << "/" << t_checktx << "/" << t_dblspnd << "/" << vmt << "/" << addblock << ")ms");
   }
+  observe_block_stages({block_processing_time, t1, t2, pricing_record, target_calculating_time, longhash_calculating_time,
+      t3, t_exists, t_pool, t_checktx, t_dblspnd, vmt, addblock});
 
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
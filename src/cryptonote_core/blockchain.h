@@ -53,6 +53,7 @@
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/powerof.h"
 #include "common/util.h"
+#include "common/lru_cache.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -113,6 +114,28 @@ namespace cryptonote
       uint64_t already_generated_coins; //!< the total coins minted after that block
     };
 
+    /**
+     * @brief compact header data for a main chain block, as served by the header RPCs
+     */
+    struct block_header_record
+    {
+      crypto::hash hash; //!< the block hash
+      crypto::hash prev_id; //!< the hash of the previous block
+      crypto::hash miner_tx_hash; //!< the hash of the coinbase transaction
+      uint64_t height; //!< the height of the block in the blockchain
+      uint64_t timestamp; //!< the block timestamp
+      uint32_t nonce; //!< the block nonce
+      uint8_t major_version; //!< the block major version
+      uint8_t minor_version; //!< the block minor version
+      uint64_t weight; //!< the weight of the block
+      uint64_t long_term_weight; //!< the long term weight of the block
+      difficulty_type difficulty; //!< the difficulty of the block
+      difficulty_type cumulative_difficulty; //!< the accumulated difficulty after that block
+      uint64_t reward; //!< the sum of the coinbase outputs
+      size_t num_txes; //!< the number of non coinbase transactions
+      oracle::pricing_record pricing_record; //!< the pricing record of the block
+    };
+
     /**
      * @brief Blockchain destructor
      */
@@ -153,6 +176,34 @@ namespace cryptonote
      */
     bool deinit();
 
+    /**
+     * @brief catches up with blocks written to a read-only db by another process
+     *
+     * Reloads the in memory state derived from the chain (hard fork voting,
+     * weight limits, difficulty and distribution caches) when the primary
+     * daemon owning the db has added or popped blocks since the last call.
+     *
+     * @param changed return-by-reference whether the chain changed
+     *
+     * @return false if the db is not read-only or reading from it failed
+     */
+    bool refresh_from_db(bool &changed);
+
+    /**
+     * @brief finds the first height where a db's chain departs from the hashes last seen in it
+     *
+     * @param tip_hashes the hashes of the blocks last seen at the top of the db
+     * @param tip_hashes_start the height of the first of tip_hashes
+     * @param db_height the current height of the db
+     * @param get_db_hash returns the hash of the block at a height in the db
+     * @param lost_track return-by-reference whether the chain departs at or below tip_hashes_start,
+     *        so the real split point is unknown and tip_hashes_start is returned in its place
+     *
+     * @return the height of the first block that changed, or the old height if none did
+     */
+    static uint64_t find_db_split_height(const std::vector<crypto::hash> &tip_hashes, uint64_t tip_hashes_start, uint64_t db_height,
+        const std::function<crypto::hash(uint64_t)> &get_db_hash, bool &lost_track);
+
     /**
      * @brief get a set of blockchain checkpoint hashes
      *
@@ -238,6 +289,29 @@ namespace cryptonote
      */
     bool get_block_by_hash(const crypto::hash &h, block &blk, bool *orphan = NULL) const;
 
+    /**
+     * @brief gets the header record of a main chain block
+     *
+     * Records are kept in an LRU cache, so only the first lookup of a given
+     * block needs to load and parse it.
+     *
+     * @param h the hash of the block
+     * @param record return-by-reference the header record
+     *
+     * @return true if the block is in the main chain, else false
+     */
+    bool get_block_header_record(const crypto::hash &h, block_header_record &record) const;
+
+    /**
+     * @brief gets the header record of the main chain block at a given height
+     *
+     * @param height the height of the block
+     * @param record return-by-reference the header record
+     *
+     * @return true if the block was found, else false
+     */
+    bool get_block_header_record(uint64_t height, block_header_record &record) const;
+
     /**
      * @brief performs some preprocessing on a group of incoming blocks to speed up verification
      *
@@ -272,6 +346,23 @@ namespace cryptonote
      */
     bool get_latest_acceptable_pr(oracle::pricing_record& pr) const;
 
+    /**
+     * @brief gets the cache of transactions whose Zephyr RCT semantics verified
+     *
+     * Shared by mempool admission and block validation, so pooled transactions
+     * are not re-verified when they are mined.
+     *
+     * @return the semantics verification cache
+     */
+    rct_ver_cache_t& get_rct_semantics_cache() const { return m_rct_sem_cache; }
+
+    /**
+     * @brief gets the cache of transactions whose RCT ring signatures verified
+     *
+     * @return the non-semantics verification cache
+     */
+    const rct_ver_cache_t& get_rct_ver_cache() const { return m_rct_ver_cache; }
+
     /**
      * @brief search the blockchain for a transaction by hash
      *
@@ -304,6 +395,17 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check if key images are already spent on the blockchain
+     *
+     * Same as have_tx_keyimg_as_spent, for a batch of key images looked
+     * up under a single db read txn.
+     *
+     * @param key_images the key images to search for
+     * @param spent return-by-reference whether each key image is spent
+     */
+    void have_tx_keyimgs_as_spent(const std::vector<crypto::key_image> &key_images, std::vector<bool> &spent) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -375,11 +477,13 @@ namespace cryptonote
      * @param height return-by-reference tells the miner what height it's mining against
      * @param expected_reward return-by-reference the total reward awarded to the miner finding this block, including transaction fees
      * @param ex_nonce extra data to be added to the miner transaction's extra
+     * @param use_cache false to build a template afresh, without touching the cached one;
+     * the oracle is only asked for a pricing record when a template is built
      *
      * @return true if block template filled in successfully, else false
      */
     bool create_block_template(block& b, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash);
-    bool create_block_template(block& b, const crypto::hash *from_block, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash);
+    bool create_block_template(block& b, const crypto::hash *from_block, const account_public_address& miner_address, difficulty_type& di, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash, bool use_cache = true);
 
     /**
      * @brief gets data required to create a block template and start mining on it
@@ -1235,6 +1339,27 @@ namespace cryptonote
     // cache for verifying transaction RCT non semantics
     mutable rct_ver_cache_t m_rct_ver_cache;
 
+    // cache for verifying transaction RCT semantics against their pricing record
+    mutable rct_ver_cache_t m_rct_sem_cache;
+
+    // per asset type cumulative rct output counts, indexed by height. Extended
+    // lazily from the db up to the height being queried, truncated on pop.
+    struct rct_distribution_cache_entry
+    {
+      std::vector<uint64_t> cumulative;
+      crypto::hash top_hash; // hash of the block at cumulative.size() - 1
+    };
+    mutable epee::critical_section m_rct_distribution_cache_lock;
+    mutable std::unordered_map<std::string, rct_distribution_cache_entry> m_rct_distribution_cache;
+
+    // header records of recently requested main chain blocks, by hash
+    mutable tools::lru_cache<crypto::hash, block_header_record> m_block_header_cache;
+
+    // hashes of the most recent blocks seen in a read-only db, to find where
+    // the primary reorganized the chain
+    std::vector<crypto::hash> m_db_tip_hashes;
+    uint64_t m_db_tip_hashes_start;
+
     /**
      * @brief Blockchain constructor
      *
@@ -1479,6 +1604,51 @@ namespace cryptonote
      */
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_version) const;
 
+    /**
+     * @brief checks if a transaction is unlocked at a given chain height
+     *
+     * Same as above, but against a chain height captured by the caller,
+     * so a batch of checks all use the same snapshot.
+     *
+     * @param unlock_time the unlock parameter (height or time)
+     * @param hf_version the consensus rules version to use
+     * @param height the chain height to check against
+     *
+     * @return true if spendable, otherwise false
+     */
+    bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint8_t hf_version, uint64_t height) const;
+
+    /**
+     * @brief gets the hard fork version of the top block of a db snapshot
+     *
+     * @param snapshot the db snapshot
+     *
+     * @return the hard fork version
+     */
+    uint8_t get_snapshot_hard_fork_version(const db_read_snapshot &snapshot) const;
+
+    /**
+     * @brief gets cumulative rct output counts for an asset type over a height range
+     *
+     * Served from the in-memory per asset distribution, which is first
+     * extended from the db to the current height if needed, so repeated
+     * calls only read the blocks added since the last one.
+     * Must be called with a db read txn active.
+     *
+     * @param asset_type the asset type to get the distribution for
+     * @param from_height the first height to return
+     * @param to_height the last height to return, must be below the chain height
+     * @param distribution return-by-reference the cumulative counts
+     */
+    void get_rct_cumulative_distribution(const std::string &asset_type, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution) const;
+
+    /**
+     * @brief drops cached rct distribution entries at or above the given height
+     *
+     * @param height the new chain height
+     */
+    void truncate_rct_distribution_cache(uint64_t height);
+
     /**
      * @brief stores an invalid block in a separate container
      *
@@ -1599,6 +1769,11 @@ namespace cryptonote
      */
     void invalidate_block_template_cache();
 
+    /**
+     * @brief records the hashes of the top blocks in the db, for refresh_from_db
+     */
+    void track_db_tip_hashes();
+
     /**
      * @brief stores a new cached block template
      *
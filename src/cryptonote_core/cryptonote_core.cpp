@@ -52,6 +52,7 @@ using namespace epee;
 #include "ringct/rctTypes.h"
 #include "blockchain_db/blockchain_db.h"
 #include "ringct/rctSigs.h"
+#include "ringct/bulletproofs_plus.h"
 #include "rpc/zmq_pub.h"
 #include "common/notify.h"
 #include "hardforks/hardforks.h"
@@ -115,6 +116,10 @@ namespace cryptonote
     "offline"
   , "Do not listen for peers, nor connect to any"
   };
+  const command_line::arg_descriptor<bool> arg_db_read_only_replica = {
+    "db-read-only-replica"
+  , "Serve RPC from the blockchain of another daemon sharing --data-dir, following its commits without p2p or block processing"
+  };
   const command_line::arg_descriptor<bool> arg_disable_dns_checkpoints = {
     "disable-dns-checkpoints"
   , "Do not retrieve checkpoints from DNS"
@@ -218,6 +223,11 @@ namespace cryptonote
   , "Keep alternative blocks on restart"
   , false
   };
+  static const command_line::arg_descriptor<size_t> arg_bpp_straus_cached_points = {
+    "bpp-straus-cached-points"
+  , "Number of Bulletproof+ generators with precomputed Straus multiples, 0 for the default"
+  , 0
+  };
 
   //-----------------------------------------------------------------------------------------------
   core::core(i_cryptonote_protocol* pprotocol):
@@ -235,7 +245,8 @@ namespace cryptonote
               m_disable_dns_checkpoints(false),
               m_update_download(0),
               m_nettype(UNDEFINED),
-              m_update_available(false)
+              m_update_available(false),
+              m_db_read_only_replica(false)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -339,6 +350,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_no_fluffy_blocks);
     command_line::add_arg(desc, arg_test_dbg_lock_sleep);
     command_line::add_arg(desc, arg_offline);
+    command_line::add_arg(desc, arg_db_read_only_replica);
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_block_download_max_size);
     command_line::add_arg(desc, arg_sync_pruned_blocks);
@@ -348,6 +360,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_reorg_notify);
     command_line::add_arg(desc, arg_block_rate_notify);
     command_line::add_arg(desc, arg_keep_alt_blocks);
+    command_line::add_arg(desc, arg_bpp_straus_cached_points);
 
     miner::init_options(desc);
     BlockchainDB::init_options(desc);
@@ -385,7 +398,8 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = !get_arg(vm, arg_no_fluffy_blocks);
-    m_offline = get_arg(vm, arg_offline);
+    m_db_read_only_replica = get_arg(vm, arg_db_read_only_replica);
+    m_offline = get_arg(vm, arg_offline) || m_db_read_only_replica;
     m_disable_dns_checkpoints = get_arg(vm, arg_disable_dns_checkpoints);
 
     if (command_line::get_arg(vm, arg_test_drop_download) == true)
@@ -488,6 +502,12 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES (boost::filesystem::exists(folder) || boost::filesystem::create_directories(folder), false,
       std::string("Failed to create directory ").append(folder.string()).c_str());
 
+    // no generator cache here: block verification must not trust generators read from disk
+    rct::bulletproof_plus_config bpp_config;
+    bpp_config.straus_cached_points = command_line::get_arg(vm, arg_bpp_straus_cached_points);
+    if (!rct::bulletproof_plus_configure(bpp_config))
+      MWARNING("Bulletproof+ precomputation settings not applied");
+
     // check for blockchain.bin
     try
     {
@@ -520,7 +540,7 @@ namespace cryptonote
     bool sync_on_blocks = true;
     uint64_t sync_threshold = 1;
 
-    if (m_nettype == FAKECHAIN && !keep_fakechain)
+    if (m_nettype == FAKECHAIN && !keep_fakechain && !m_db_read_only_replica)
     {
       // reset the db by removing the database file before opening it
       if (!db->remove_data_file(filename))
@@ -610,10 +630,17 @@ namespace cryptonote
 
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
+      if (m_db_read_only_replica)
+        db_flags |= DBF_RDONLY;
 
       db->open(filename, db_flags);
       if(!db->m_open)
         return false;
+      if (m_db_read_only_replica && db->height() == 0)
+      {
+        LOG_ERROR("No blockchain found in " << filename << ", a read-only replica needs a primary daemon to create it first");
+        return false;
+      }
     }
     catch (const DB_ERROR& e)
     {
@@ -680,8 +707,10 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
     // now that we have a valid m_blockchain_storage, we can clean out any
-    // transactions in the pool that do not conform to the current fork
-    m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+    // transactions in the pool that do not conform to the current fork,
+    // unless the pool belongs to the primary daemon
+    if (!m_db_read_only_replica)
+      m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
 
     bool show_time_stats = command_line::get_arg(vm, arg_show_time_stats) != 0;
     m_blockchain_storage.set_show_time_stats(show_time_stats);
@@ -695,8 +724,10 @@ namespace cryptonote
 
     // load json & DNS checkpoints, and verify them
     // with respect to what blocks we already have
+    // a replica can't roll back the chain, the primary enforces them
     const bool skip_dns_checkpoints = !command_line::get_arg(vm, arg_dns_checkpoints);
-    CHECK_AND_ASSERT_MES(update_checkpoints(skip_dns_checkpoints), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
+    if (!m_db_read_only_replica)
+      CHECK_AND_ASSERT_MES(update_checkpoints(skip_dns_checkpoints), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
 
    // DNS versions checking
     if (check_updates_string == "disabled" || not allow_dns)
@@ -718,6 +749,12 @@ namespace cryptonote
     if (!keep_alt_blocks && !m_blockchain_storage.get_db().is_read_only())
       m_blockchain_storage.get_db().drop_alt_blocks();
 
+    if (prune_blockchain && m_db_read_only_replica)
+    {
+      MERROR("Cannot prune the blockchain from a read-only replica, prune the primary instead");
+      return false;
+    }
+
     if (prune_blockchain)
     {
       // display a message if the blockchain is not pruned yet
@@ -1068,7 +1105,7 @@ namespace cryptonote
 
         const uint8_t hf_version = m_blockchain_storage.get_current_hard_fork_version();
         if (hf_version >= HF_VERSION_V6) {
-          if (!rct::verRctSemanticsZeph(tx_info[n].tx->rct_signatures, tx_info[n].tvc.pr, tx_info[n].tvc.m_type, tx_info[n].tvc.m_source_asset, tx_info[n].tvc.m_dest_asset, tx_info[n].tx->amount_burnt, tx_info[n].tx->amount_minted, tx_info[n].tx->vout, tx_info[n].tx->vin, hf_version)) {
+          if (!ver_rct_semantics_zeph_cached(*tx_info[n].tx, tx_info[n].tvc.pr, tx_info[n].tvc.m_type, tx_info[n].tvc.m_source_asset, tx_info[n].tvc.m_dest_asset, hf_version, m_blockchain_storage.get_rct_semantics_cache())) {
             set_semantics_failed(tx_info[n].tx_hash);
             tx_info[n].tvc.m_verifivation_failed = true;
             tx_info[n].result = false;
@@ -1298,11 +1335,7 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    for(auto& ki: key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_tx_keyimgs_as_spent(key_im, spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -1562,9 +1595,9 @@ namespace cryptonote
     return m_blockchain_storage.create_block_template(b, adr, diffic, height, expected_reward, ex_nonce, seed_height, seed_hash);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::get_block_template(block& b, const crypto::hash *prev_block, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash)
+  bool core::get_block_template(block& b, const crypto::hash *prev_block, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash, bool use_cache)
   {
-    return m_blockchain_storage.create_block_template(b, prev_block, adr, diffic, height, expected_reward, ex_nonce, seed_height, seed_hash);
+    return m_blockchain_storage.create_block_template(b, prev_block, adr, diffic, height, expected_reward, ex_nonce, seed_height, seed_hash, use_cache);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_miner_data(uint8_t& major_version, uint64_t& height, crypto::hash& prev_id, crypto::hash& seed_hash, difficulty_type& difficulty, uint64_t& median_weight, uint64_t& already_generated_coins, std::vector<tx_block_template_backlog_entry>& tx_backlog)
@@ -1842,6 +1875,11 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_cookie() const
+  {
+    return m_mempool.cookie();
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_pool_transaction(const crypto::hash &id, cryptonote::blobdata& tx, relay_category tx_category) const
   {
     return m_mempool.get_transaction(id, tx, tx_category);
@@ -1931,7 +1969,9 @@ namespace cryptonote
 "                 @@@@.....................................@@@@.                \n"
 "                     @@@@@...........................@@@@@.                    \n"
 "                           @@@@@@@@@@&#(#&@@@@@@@@@@                           \n"; // Zephyr logo
-      if (m_offline)
+      if (m_db_read_only_replica)
+        main_message = "The daemon is a read-only replica and will follow the blockchain written by its primary daemon.";
+      else if (m_offline)
         main_message = "The daemon is running offline and will not attempt to sync to the Zephyr network.";
       else
         main_message = "The daemon will start synchronizing with the network. This may take a long time to complete.";
@@ -1948,6 +1988,16 @@ namespace cryptonote
       m_starter_message_showed = true;
     }
 
+    if (m_db_read_only_replica)
+    {
+      // the primary owns the db and the txpool, we only follow them
+      m_replica_refresh_interval.do_call(boost::bind(&core::refresh_replica, this));
+      m_replica_txpool_refresh_interval.do_call(boost::bind(&tx_memory_pool::reload, &m_mempool));
+      m_check_updates_interval.do_call(boost::bind(&core::check_updates, this));
+      m_check_disk_space_interval.do_call(boost::bind(&core::check_disk_space, this));
+      return true;
+    }
+
     relay_txpool_transactions(); // txpool handles periodic DB checking
     m_check_updates_interval.do_call(boost::bind(&core::check_updates, this));
     m_check_disk_space_interval.do_call(boost::bind(&core::check_disk_space, this));
@@ -2209,6 +2259,20 @@ namespace cryptonote
     return m_mempool.get_complement(hashes, txes);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::refresh_replica()
+  {
+    bool changed = false;
+    if (!m_blockchain_storage.refresh_from_db(changed))
+    {
+      MERROR("Failed to follow the primary daemon's blockchain");
+      return false;
+    }
+    // mined txes leave the pool in the same commit as their block
+    if (changed)
+      m_mempool.reload();
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::update_blockchain_pruning()
   {
     return m_blockchain_storage.update_blockchain_pruning();
@@ -68,6 +68,7 @@ namespace cryptonote
   extern const command_line::arg_descriptor<bool, false> arg_regtest_on;
   extern const command_line::arg_descriptor<difficulty_type> arg_fixed_difficulty;
   extern const command_line::arg_descriptor<bool> arg_offline;
+  extern const command_line::arg_descriptor<bool> arg_db_read_only_replica;
   extern const command_line::arg_descriptor<size_t> arg_block_download_max_size;
   extern const command_line::arg_descriptor<bool> arg_sync_pruned_blocks;
 
@@ -232,7 +233,7 @@ namespace cryptonote
       * @note see Blockchain::create_block_template
       */
      virtual bool get_block_template(block& b, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash) override;
-     virtual bool get_block_template(block& b, const crypto::hash *prev_block, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash);
+     virtual bool get_block_template(block& b, const crypto::hash *prev_block, const account_public_address& adr, difficulty_type& diffic, uint64_t& height, uint64_t& expected_reward, const blobdata& ex_nonce, uint64_t &seed_height, crypto::hash &seed_hash, bool use_cache = true);
 
      /**
       * @copydoc Blockchain::get_miner_data
@@ -540,6 +541,13 @@ namespace cryptonote
       */
      bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx, relay_category tx_category) const;
 
+     /**
+      * @copydoc tx_memory_pool::cookie
+      *
+      * @note see tx_memory_pool::cookie
+      */
+     uint64_t get_pool_cookie() const;
+
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
       * @param include_sensitive_txes include private transactions
@@ -854,6 +862,13 @@ namespace cryptonote
       */
      bool offline() const { return m_offline; }
 
+     /**
+      * @brief get whether the core follows a db owned by another daemon
+      *
+      * @return whether the core is a read-only replica
+      */
+     bool is_read_only_replica() const { return m_db_read_only_replica; }
+
      /**
       * @brief get the blockchain pruning seed
       *
@@ -1086,6 +1101,13 @@ namespace cryptonote
       */
      bool check_block_rate();
 
+     /**
+      * @brief picks up blocks and pool changes the primary daemon wrote to the db
+      *
+      * @return true on success, false otherwise
+      */
+     bool refresh_replica();
+
      bool m_test_drop_download = true; //!< whether or not to drop incoming blocks (for testing)
 
      uint64_t m_test_drop_download_height = 0; //!< height under which to drop incoming blocks, if doing so
@@ -1112,6 +1134,8 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<90, false> m_block_rate_interval; //!< interval for checking block rate
      epee::math_helper::once_a_time_seconds<60*60*5, true> m_blockchain_pruning_interval; //!< interval for incremental blockchain pruning
      epee::math_helper::once_a_time_seconds<60*60*24*7, false> m_diff_recalc_interval; //!< interval for recalculating difficulties
+     epee::math_helper::once_a_time_seconds<1, true> m_replica_refresh_interval; //!< interval for following the primary's chain
+     epee::math_helper::once_a_time_seconds<10, true> m_replica_txpool_refresh_interval; //!< interval for reloading the primary's txpool
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -1148,6 +1172,7 @@ namespace cryptonote
 
      bool m_fluffy_blocks_enabled;
      bool m_offline;
+     bool m_db_read_only_replica;
 
     /* `boost::function` is used because the implementation never allocates if
        the callable object has a single `std::shared_ptr` or `std::weap_ptr`
@@ -344,6 +344,35 @@ namespace cryptonote
     return base_reward / 20; // 5% of base reward
   }
   //---------------------------------------------------------------
+  void get_block_reserve_rewards(uint64_t base_reward, const block &b, uint8_t hf_version, uint64_t &reserve_reward, uint64_t &yield_reward_zsd)
+  {
+    reserve_reward = 0;
+    if (hf_version >= HF_VERSION_DJED)
+      reserve_reward = get_reserve_reward(base_reward, hf_version);
+
+    yield_reward_zsd = 0;
+    if (hf_version >= HF_VERSION_V6)
+    {
+      const uint64_t yield_reward_in_zeph = get_zeph_yield_reward(base_reward);
+      reserve_reward += yield_reward_in_zeph;
+      if (!b.pricing_record.has_missing_rates(b.major_version))
+      {
+        const uint64_t YIELD_RSV_MIN = 2 * COIN; // 200%
+        if (b.pricing_record.reserve_ratio > YIELD_RSV_MIN && b.pricing_record.reserve_ratio_ma > YIELD_RSV_MIN)
+          yield_reward_zsd = zeph_to_zephusd(yield_reward_in_zeph, b.pricing_record, hf_version);
+      }
+    }
+  }
+  //---------------------------------------------------------------
+  void get_block_reserve_rewards_from_generated(uint64_t zeph_generated, uint64_t height, const block &b, uint64_t &reserve_reward, uint64_t &yield_reward_zsd)
+  {
+    // the coins generated include the unauditable amount paid out at the V11 fork, the base reward does not
+    uint64_t base_reward = zeph_generated;
+    if (height == HF_VERSION_V11_FORK_HEIGHT && base_reward >= UNAUDITABLE_ZEPH_AMOUNT)
+      base_reward -= UNAUDITABLE_ZEPH_AMOUNT;
+    get_block_reserve_rewards(base_reward, b, b.major_version, reserve_reward, yield_reward_zsd);
+  }
+  //---------------------------------------------------------------
   bool validate_governance_reward_key(uint64_t height, const std::string& governance_wallet_address_str, size_t output_index, const crypto::public_key& output_key, cryptonote::network_type nettype)
   {
     keypair gov_key = get_deterministic_keypair_from_height(height);
@@ -57,6 +57,10 @@ namespace cryptonote
     uint64_t get_governance_reward(uint64_t base_reward);
     uint64_t get_reserve_reward(uint64_t base_reward, const uint8_t hf_version);
     uint64_t get_zeph_yield_reward(uint64_t base_reward);
+    //! the reserve and yield rewards a block adds to the supply tallies, from its base reward without the unauditable amount
+    void get_block_reserve_rewards(uint64_t base_reward, const block &b, uint8_t hf_version, uint64_t &reserve_reward, uint64_t &yield_reward_zsd);
+    //! the same, from the coins a block at height generated, as the db records them, for tools replaying the chain
+    void get_block_reserve_rewards_from_generated(uint64_t zeph_generated, uint64_t height, const block &b, uint64_t &reserve_reward, uint64_t &yield_reward_zsd);
 
     
     bool get_deterministic_output_key(const account_public_address& address, const keypair& tx_key, size_t output_index, crypto::public_key& output_key);
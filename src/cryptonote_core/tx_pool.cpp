@@ -44,6 +44,7 @@
 #include "misc_language.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "common/metrics.h"
 #include "crypto/hash.h"
 #include "crypto/duration.h"
 
@@ -123,7 +124,7 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false), m_next_check(std::time(nullptr))
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false), m_template_selection(), m_next_check(std::time(nullptr))
   {
     // class code expects unsigned values throughout
     if (m_next_check < time_t(0))
@@ -150,6 +151,16 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
 
     PERF_TIMER(add_tx);
+    static tools::metrics::histogram &admission_seconds = tools::metrics::get_histogram("zephyr_txpool_admission_seconds",
+        "Time taken to check a transaction and add it to the pool", tools::metrics::latency_buckets());
+    static tools::metrics::counter &admitted = tools::metrics::get_counter("zephyr_txpool_admission_total",
+        "Transactions offered to the pool, by whether they were added", tools::metrics::label("result", "added"));
+    static tools::metrics::counter &refused = tools::metrics::get_counter("zephyr_txpool_admission_total",
+        "Transactions offered to the pool, by whether they were added", tools::metrics::label("result", "refused"));
+    auto admission_metrics = epee::misc_utils::create_scope_leave_handler([&]() {
+      admission_seconds.observe(PERF_TIMER_NAME(add_tx).value() / 1e9);
+      (tvc.m_added_to_pool ? admitted : refused).inc();
+    });
     if (tx.version == 0)
     {
       // v0 never accepted
@@ -277,7 +288,7 @@ namespace cryptonote
       }
 
       if (version >= HF_VERSION_V6) {
-        if (!rct::verRctSemanticsZeph(tx.rct_signatures, tvc.pr, tx_type, source, dest, tx.amount_burnt, tx.amount_minted, tx.vout, tx.vin, version)) {
+        if (!ver_rct_semantics_zeph_cached(tx, tvc.pr, tx_type, source, dest, version, m_blockchain.get_rct_semantics_cache())) {
           LOG_PRINT_L1(" transaction proof-of-value is invalid for tx " << tx.hash);
           tvc.m_verifivation_failed = true;
           return false;
@@ -1299,6 +1310,11 @@ namespace cryptonote
     }, false, category);
 
     stats.bytes_med = epee::misc_utils::median(weights);
+
+    const rct_ver_cache_t &sem_cache = m_blockchain.get_rct_semantics_cache();
+    const rct_ver_cache_t &ver_cache = m_blockchain.get_rct_ver_cache();
+    stats.ver_cache_hits = sem_cache.get_hits() + ver_cache.get_hits();
+    stats.ver_cache_misses = sem_cache.get_misses() + ver_cache.get_misses();
     if (stats.txs_total > 1)
     {
       /* looking for 98th percentile */
@@ -1755,9 +1771,8 @@ namespace cryptonote
   ){
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    using tt = cryptonote::transaction_type;
 
-    uint64_t best_coinbase = 0, coinbase = 0;
+    uint64_t best_coinbase = 0;
     total_weight = 0;
     
     //baseline empty block
@@ -1773,257 +1788,293 @@ namespace cryptonote
       return true;
     }
 
-    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight = max_total_weight_v5;
-    std::unordered_set<crypto::key_image> k_images;
-
-    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
-
     LockedTXN lock(m_blockchain.get_db());
 
-    bool have_valid_pr = true;
-    if (bl.pricing_record.empty() || bl.pricing_record.has_missing_rates(version)) {
-      if (version >= HF_VERSION_DJED) {
-        MWARNING("Failed to find a pricing record in last 10 blocks.");
-        MWARNING("Will not include any conversion transactions in block template.");
+    template_selection &sel = m_template_selection;
+    const bool same_chain = sel.valid && sel.prev_id == bl.prev_id && sel.pricing_record == bl.pricing_record
+      && sel.median_weight == median_weight && sel.already_generated_coins == already_generated_coins && sel.version == version;
+    const size_t n_changes = sel.changes.size();
+    // made invalid for as long as it is being changed, in case anything throws
+    sel.valid = false;
+    const template_pool pool{
+      [this](template_selection &sel, const crypto::hash &txid, double fee_per_byte) { return add_to_template(sel, txid, fee_per_byte); },
+      [this](const crypto::key_image &ki, std::vector<std::pair<crypto::hash, double>> &spenders) {
+        const auto it = m_spent_key_images.find(ki);
+        if (it == m_spent_key_images.end())
+          return;
+        for (const crypto::hash &txid: it->second)
+        {
+          const auto sorted_it = find_tx_in_sorted_container(txid);
+          if (sorted_it != m_txs_by_fee_and_receive_time.end())
+            spenders.push_back({txid, sorted_it->first.first});
+        }
       }
-      have_valid_pr = false;
+    };
+    if (same_chain && update_template_selection(sel, pool))
+    {
+      LOG_PRINT_L2("Updated block template with " << n_changes << " pool changes");
     }
-    // Convert stable and reserve fees into equivalent zeph value to maximize coinbase
-    uint64_t total_collected_fee_in_zeph = 0;
+    else
+    {
+      sel.prev_id = bl.prev_id;
+      sel.pricing_record = bl.pricing_record;
+      sel.median_weight = median_weight;
+      sel.already_generated_coins = already_generated_coins;
+      sel.version = version;
+      sel.max_total_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      sel.clear(best_coinbase);
+
+      LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+
+      sel.have_valid_pr = true;
+      if (bl.pricing_record.empty() || bl.pricing_record.has_missing_rates(version)) {
+        if (version >= HF_VERSION_DJED) {
+          MWARNING("Failed to find a pricing record in last 10 blocks.");
+          MWARNING("Will not include any conversion transactions in block template.");
+        }
+        sel.have_valid_pr = false;
+      }
+      sel.circ_supply = m_blockchain.get_db().get_circulating_supply();
+      sel.pricing_record_history = m_blockchain.get_db().get_pricing_record_history();
+
+      for (const auto &e: m_txs_by_fee_and_receive_time)
+        if (add_to_template(sel, e.second, e.first.first) == template_fit::no_room)
+          sel.no_room.emplace(e.second, e.first.first);
+    }
+    sel.changes.clear();
+    sel.valid = true;
+    lock.commit();
 
-    boost::multiprecision::int128_t total_conversion_zeph = 0;
-    boost::multiprecision::int128_t total_conversion_stables = 0;
-    boost::multiprecision::int128_t total_conversion_reserves = 0;
-    std::vector<std::pair<std::string, std::string>> circ_supply = m_blockchain.get_db().get_circulating_supply();
-    std::vector<oracle::pricing_record> pricing_record_history = m_blockchain.get_db().get_pricing_record_history();
+    for (const template_tx &e: sel.txes)
+      bl.tx_hashes.push_back(e.txid);
+    total_weight = sel.total_weight;
+    for (const auto &e: sel.fee_map)
+      fee_map[e.first] += e.second;
+    expected_reward = sel.coinbase;
+    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
+        << total_weight << "/" << sel.max_total_weight << ", coinbase " << print_money(expected_reward)
+        << " (including " << print_money(fee_map["ZEPH"]) << " ZEPH in fees | "
+        << print_money(fee_map["ZEPHUSD"]) << " ZSD in fees | "
+        << print_money(fee_map["ZEPHRSV"]) << " ZRS in fees | "
+        << print_money(fee_map["ZYIELD"]) << " ZYS in fees)");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  template_fit tx_memory_pool::add_to_template(template_selection &sel, const crypto::hash &txid, double fee_per_byte)
+  {
+    using tt = cryptonote::transaction_type;
+    const uint8_t version = sel.version;
 
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    txpool_tx_meta_t meta;
+    if (!m_blockchain.get_txpool_tx_meta(txid, meta))
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
-      {
-        static bool warned = false;
-        if (!warned)
-          MERROR("  failed to find tx meta: " << sorted_it->second << " (will only print once)");
-        warned = true;
-        continue;
-      }
+      static bool warned = false;
+      if (!warned)
+        MERROR("  failed to find tx meta: " << txid << " (will only print once)");
+      warned = true;
+      return template_fit::skipped;
+    }
 
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase) << ", relay method " << (unsigned)meta.get_relay_method());
+    LOG_PRINT_L2("Considering " << txid << ", weight " << meta.weight << ", current block weight " << sel.total_weight << "/" << sel.max_total_weight << ", current coinbase " << print_money(sel.coinbase) << ", relay method " << (unsigned)meta.get_relay_method());
 
-      if (!meta.matches(relay_category::legacy) && !(m_mine_stem_txes && meta.get_relay_method() == relay_method::stem))
-      {
-        LOG_PRINT_L2("  tx relay method is " << (unsigned)meta.get_relay_method());
-        // continue;
-      }
-      if (meta.pruned)
-      {
-        LOG_PRINT_L2("  tx is pruned");
-        continue;
-      }
+    if (!meta.matches(relay_category::legacy) && !(m_mine_stem_txes && meta.get_relay_method() == relay_method::stem))
+    {
+      LOG_PRINT_L2("  tx relay method is " << (unsigned)meta.get_relay_method());
+      // continue;
+    }
+    if (meta.pruned)
+    {
+      LOG_PRINT_L2("  tx is pruned");
+      return template_fit::skipped;
+    }
 
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
+    // Can not exceed maximum block weight
+    if (sel.max_total_weight < sel.total_weight + meta.weight)
+    {
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      return template_fit::no_room;
+    }
 
-      // If we're getting lower coinbase tx,
-      // stop including more tx
-      uint64_t block_reward;
-      if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
+    // If we're getting lower coinbase tx,
+    // stop including more tx
+    uint64_t block_reward;
+    if(!get_block_reward(sel.median_weight, sel.total_weight + meta.weight, sel.already_generated_coins, block_reward, version))
+    {
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      return template_fit::no_room;
+    }
 
-      uint64_t fee_this_tx_in_zeph = 0;
-      if (have_valid_pr) {
-        fee_this_tx_in_zeph = meta.weight * sorted_it->first.first; // fee in zeph
-      } else {
-        fee_this_tx_in_zeph = meta.fee; // fallback to fee in asset type (stable/reserve transfers in absence of pricing record)
-      }
+    uint64_t fee_this_tx_in_zeph = 0;
+    if (sel.have_valid_pr) {
+      fee_this_tx_in_zeph = meta.weight * fee_per_byte; // fee in zeph
+    } else {
+      fee_this_tx_in_zeph = meta.fee; // fallback to fee in asset type (stable/reserve transfers in absence of pricing record)
+    }
 
-      coinbase = block_reward + total_collected_fee_in_zeph + fee_this_tx_in_zeph;
+    const uint64_t coinbase = block_reward + sel.total_fee_in_zeph + fee_this_tx_in_zeph;
 
-      LOG_PRINT_L2(" coinbase " << print_money(coinbase) << ", best " << print_money(best_coinbase) <<  ", block reward " << print_money(block_reward) << ", total collected fee " << print_money(total_collected_fee_in_zeph) << ", fee this tx " << print_money(fee_this_tx_in_zeph));
+    LOG_PRINT_L2(" coinbase " << print_money(coinbase) << ", best " << print_money(sel.coinbase) <<  ", block reward " << print_money(block_reward) << ", total collected fee " << print_money(sel.total_fee_in_zeph) << ", fee this tx " << print_money(fee_this_tx_in_zeph));
 
-      if (coinbase < template_accept_threshold(best_coinbase))
-      {
-        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
-        continue;
-      }
+    if (coinbase < template_accept_threshold(sel.coinbase))
+    {
+      LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+      return template_fit::no_room;
+    }
 
-      // "local" and "stem" txes are filtered above
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second, relay_category::all);
+    // "local" and "stem" txes are filtered above
+    cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
 
-      cryptonote::transaction tx;
+    cryptonote::transaction tx;
 
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images
+    const cryptonote::txpool_tx_meta_t original_meta = meta;
+    bool ready = false;
+    try
+    {
+      ready = is_transaction_ready_to_go(meta, txid, txblob, tx);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to check transaction readiness: " << e.what());
+      // continue, not fatal
+    }
+    if (memcmp(&original_meta, &meta, sizeof(meta)))
+    {
       try
       {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
+        m_blockchain.update_txpool_tx(txid, meta);
       }
       catch (const std::exception &e)
       {
-        MERROR("Failed to check transaction readiness: " << e.what());
+        MERROR("Failed to update tx meta: " << e.what());
         // continue, not fatal
       }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
-      {
-        try
-        {
-          m_blockchain.update_txpool_tx(sorted_it->second, meta);
-        }
-        catch (const std::exception &e)
-        {
-          MERROR("Failed to update tx meta: " << e.what());
-          // continue, not fatal
-        }
-      }
-      if (!ready)
-      {
-        LOG_PRINT_L2("  not ready to go");
-        continue;
-      }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
-        continue;
-      }
-
-      // get the asset types
-      std::string source;
-      std::string dest;
-      tt tx_type;
-      if (!get_tx_asset_types(tx, sorted_it->second, source, dest, false)) {
-        LOG_PRINT_L2("At least 1 input or 1 output of the tx was invalid.");
-        continue;
-      }
-      if (!get_tx_type(source, dest, tx_type)) {
-        LOG_PRINT_L2(" transaction has invalid tx type " << sorted_it->second);
-        continue;
-      }
+    }
+    if (!ready)
+    {
+      LOG_PRINT_L2("  not ready to go");
+      return template_fit::skipped;
+    }
+    if (have_key_images(sel.key_images, tx))
+    {
+      LOG_PRINT_L2("  key images already seen");
+      return template_fit::skipped;
+    }
 
-      bool audit_tx = tx_type == tt::AUDIT_ZEPH || tx_type == tt::AUDIT_STABLE || tx_type == tt::AUDIT_RESERVE || tx_type == tt::AUDIT_YIELD;
-      if ((version == HF_VERSION_AUDIT || version == HF_VERSION_AUDIT_EXTENSION) && !audit_tx) {
-        LOG_PRINT_L2(" non-audit transaction ignored: " << sorted_it->second);
-        continue;
-      }
+    // get the asset types
+    std::string source;
+    std::string dest;
+    tt tx_type;
+    if (!get_tx_asset_types(tx, txid, source, dest, false)) {
+      LOG_PRINT_L2("At least 1 input or 1 output of the tx was invalid.");
+      return template_fit::skipped;
+    }
+    if (!get_tx_type(source, dest, tx_type)) {
+      LOG_PRINT_L2(" transaction has invalid tx type " << txid);
+      return template_fit::skipped;
+    }
 
-      if (version >= HF_VERSION_V11 && audit_tx) {
-        LOG_PRINT_L2(" audit transaction ignored: " << sorted_it->second);
-        continue;
-      }
+    bool audit_tx = tx_type == tt::AUDIT_ZEPH || tx_type == tt::AUDIT_STABLE || tx_type == tt::AUDIT_RESERVE || tx_type == tt::AUDIT_YIELD;
+    if ((version == HF_VERSION_AUDIT || version == HF_VERSION_AUDIT_EXTENSION) && !audit_tx) {
+      LOG_PRINT_L2(" non-audit transaction ignored: " << txid);
+      return template_fit::skipped;
+    }
 
-      boost::multiprecision::int128_t conversion_this_tx_zeph = 0;
-      boost::multiprecision::int128_t conversion_this_tx_stables = 0;
-      boost::multiprecision::int128_t conversion_this_tx_reserves = 0;
-      if (source != dest && !audit_tx)
-      {
-        if (!have_valid_pr) {
-          continue;
+    if (version >= HF_VERSION_V11 && audit_tx) {
+      LOG_PRINT_L2(" audit transaction ignored: " << txid);
+      return template_fit::skipped;
+    }
+
+    template_tx e = {};
+    e.txid = txid;
+    e.fee_per_byte = fee_per_byte;
+    e.weight = meta.weight;
+    e.fee_in_zeph = fee_this_tx_in_zeph;
+    e.fee = meta.fee;
+    e.conversion = source != dest && !audit_tx;
+    if (e.conversion)
+    {
+      if (!sel.have_valid_pr) {
+        return template_fit::skipped;
+      }
+
+      if (tx_type != tt::MINT_YIELD && tx_type != tt::REDEEM_YIELD) {
+        if (tx_type == tt::MINT_STABLE) {
+          e.conversion_zeph += tx.amount_burnt; // Added to the reserve
+          e.conversion_stables += tx.amount_minted;
+        } else if (tx_type == tt::REDEEM_STABLE) {
+          e.conversion_stables -= tx.amount_burnt;
+          e.conversion_zeph -= tx.amount_minted; // Deducted from the reserve
+        } else if (tx_type == tt::MINT_RESERVE) {
+          e.conversion_zeph += tx.amount_burnt;
+          e.conversion_reserves += tx.amount_minted;
+        } else if (tx_type == tt::REDEEM_RESERVE) {
+          e.conversion_reserves -= tx.amount_burnt;
+          e.conversion_zeph -= tx.amount_minted;
+        } else {
+          LOG_PRINT_L2(" conversion transaction has invalid tx type " << txid);
+          return template_fit::skipped;
         }
+      }
 
-        if (tx_type != tt::MINT_YIELD && tx_type != tt::REDEEM_YIELD) {
-          if (tx_type == tt::MINT_STABLE) {
-            conversion_this_tx_zeph += tx.amount_burnt; // Added to the reserve
-            conversion_this_tx_stables += tx.amount_minted;
-          } else if (tx_type == tt::REDEEM_STABLE) {
-            conversion_this_tx_stables -= tx.amount_burnt;
-            conversion_this_tx_zeph -= tx.amount_minted; // Deducted from the reserve
-          } else if (tx_type == tt::MINT_RESERVE) {
-            conversion_this_tx_zeph += tx.amount_burnt;
-            conversion_this_tx_reserves += tx.amount_minted;
-          } else if (tx_type == tt::REDEEM_RESERVE) {
-            conversion_this_tx_reserves -= tx.amount_burnt;
-            conversion_this_tx_zeph -= tx.amount_minted;
-          } else {
-            LOG_PRINT_L2(" conversion transaction has invalid tx type " << sorted_it->second);
-            continue;
-          }
-        }
+      boost::multiprecision::int128_t tally_zeph = sel.total_conversion_zeph + e.conversion_zeph;
+      boost::multiprecision::int128_t tally_stables = sel.total_conversion_stables + e.conversion_stables;
+      boost::multiprecision::int128_t tally_reserves = sel.total_conversion_reserves + e.conversion_reserves;
 
-        boost::multiprecision::int128_t tally_zeph = total_conversion_zeph + conversion_this_tx_zeph;
-        boost::multiprecision::int128_t tally_stables = total_conversion_stables + conversion_this_tx_stables;
-        boost::multiprecision::int128_t tally_reserves = total_conversion_reserves + conversion_this_tx_reserves;
+      if (!reserve_ratio_satisfied(sel.circ_supply, sel.pricing_record_history, sel.pricing_record, tx_type, tally_zeph, tally_stables, tally_reserves, version)) {
+        LOG_PRINT_L2(" transaction ignored: reserve ratio would be invalid " << txid);
+        return template_fit::skipped;
+      }
 
-        if (!reserve_ratio_satisfied(circ_supply, pricing_record_history, bl.pricing_record, tx_type, tally_zeph, tally_stables, tally_reserves, version)) {
-          LOG_PRINT_L2(" transaction ignored: reserve ratio would be invalid " << sorted_it->second);
-          continue;
-        }
+      // Validate that tx pricing record has not grown too old since it was first included in the pool
+      if (!tx_pr_height_valid(m_blockchain.get_current_blockchain_height(), tx.pricing_record_height, txid)) {
+        LOG_PRINT_L2("error : transaction references a pricing record that is too old (height " << tx.pricing_record_height << ")");
+        return template_fit::skipped;
+      }
 
-        // Validate that tx pricing record has not grown too old since it was first included in the pool
-        if (!tx_pr_height_valid(m_blockchain.get_current_blockchain_height(), tx.pricing_record_height, sorted_it->second)) {
-          LOG_PRINT_L2("error : transaction references a pricing record that is too old (height " << tx.pricing_record_height << ")");
-          continue;
-        }
+      // get pricing record for this tx
+      block tx_pr_block;
+      if (!m_blockchain.get_block_by_hash(m_blockchain.get_block_id_by_height(tx.pricing_record_height), tx_pr_block)) {
+        LOG_PRINT_L2("error: failed to get block containing pricing record");
+        return template_fit::skipped;
+      }
 
-        // get pricing record for this tx
-        block tx_pr_block;
-        if (!m_blockchain.get_block_by_hash(m_blockchain.get_block_id_by_height(tx.pricing_record_height), tx_pr_block)) {
-          LOG_PRINT_L2("error: failed to get block containing pricing record");
-          continue;
+      // make sure proof-of-value still holds
+      if (version >= HF_VERSION_V6) {
+        if (!rct::verRctSemanticsZeph(tx.rct_signatures, tx_pr_block.pricing_record, tx_type, source, dest, tx.amount_burnt, tx.amount_minted, tx.vout, tx.vin, version)) {
+          LOG_PRINT_L2(" transaction proof-of-value is now invalid for tx " << txid);
+          return template_fit::skipped;
         }
-
-        // make sure proof-of-value still holds
-        if (version >= HF_VERSION_V6) {
-          if (!rct::verRctSemanticsZeph(tx.rct_signatures, tx_pr_block.pricing_record, tx_type, source, dest, tx.amount_burnt, tx.amount_minted, tx.vout, tx.vin, version)) {
-            LOG_PRINT_L2(" transaction proof-of-value is now invalid for tx " << sorted_it->second);
-            continue;
-          }
-        } else {
-          if (!rct::verRctSemanticsSimple(tx.rct_signatures, tx_pr_block.pricing_record, tx_type, source, dest, tx.amount_burnt, tx.vout, tx.vin, version)) {
-            LOG_PRINT_L2(" transaction proof-of-value is now invalid for tx " << sorted_it->second);
-            continue;
-          }
+      } else {
+        if (!rct::verRctSemanticsSimple(tx.rct_signatures, tx_pr_block.pricing_record, tx_type, source, dest, tx.amount_burnt, tx.vout, tx.vin, version)) {
+          LOG_PRINT_L2(" transaction proof-of-value is now invalid for tx " << txid);
+          return template_fit::skipped;
         }
       }
+    }
 
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-
-      total_collected_fee_in_zeph += fee_this_tx_in_zeph;
-
-      std::string tx_fee_asset = meta.fee_asset_type;
-      if (version >= HF_VERSION_AUDIT) {
-        if (tx_fee_asset == "ZEPH")
-          tx_fee_asset = "ZPH";
-        else if (tx_fee_asset == "ZEPHUSD")
-          tx_fee_asset = "ZSD";
-        else if (tx_fee_asset == "ZEPHRSV")
-          tx_fee_asset = "ZRS";
-        else if (tx_fee_asset == "ZYIELD")
-          tx_fee_asset = "ZYS";
-      }
-      fee_map[tx_fee_asset] += meta.fee;
-
-      total_conversion_zeph += conversion_this_tx_zeph;
-      total_conversion_stables += conversion_this_tx_stables;
-      total_conversion_reserves += conversion_this_tx_reserves;
-
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+    e.fee_asset = meta.fee_asset_type;
+    if (version >= HF_VERSION_AUDIT) {
+      if (e.fee_asset == "ZEPH")
+        e.fee_asset = "ZPH";
+      else if (e.fee_asset == "ZEPHUSD")
+        e.fee_asset = "ZSD";
+      else if (e.fee_asset == "ZEPHRSV")
+        e.fee_asset = "ZRS";
+      else if (e.fee_asset == "ZYIELD")
+        e.fee_asset = "ZYS";
+    }
+    for (const txin_v &in: tx.vin)
+    {
+      if (in.type() == typeid(txin_zephyr_key))
+        e.key_images.push_back(boost::get<txin_zephyr_key>(in).k_image);
     }
-    lock.commit();
 
-    expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
-        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
-        << " (including " << print_money(fee_map["ZEPH"]) << " ZEPH in fees | "
-        << print_money(fee_map["ZEPHUSD"]) << " ZSD in fees | "
-        << print_money(fee_map["ZEPHRSV"]) << " ZRS in fees | "
-        << print_money(fee_map["ZYIELD"]) << " ZYS in fees)");
-    return true;
+    sel.add(std::move(e), coinbase);
+    LOG_PRINT_L2("  added, new block weight " << sel.total_weight << "/" << sel.max_total_weight << ", coinbase " << print_money(sel.coinbase));
+    return template_fit::added;
   }
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::validate(uint8_t version)
@@ -2123,6 +2174,7 @@ namespace cryptonote
       }
     }
     m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(fee, receive_time), txid);
+    m_template_selection.note_change(txid, fee, true);
 
     // Don't check for "resurrected" txs in case of reorgs i.e. don't check in 'm_removed_txs_by_time'
     // whether we have that txid there and if yes remove it; this results in possible duplicates
@@ -2144,6 +2196,7 @@ namespace cryptonote
     {
       m_txs_by_fee_and_receive_time.erase(sorted_it);
     }
+    m_template_selection.note_change(txid, 0, false);
 
     const std::unordered_map<crypto::hash, time_t>::iterator it = m_added_txs_by_id.find(txid);
     if (it != m_added_txs_by_id.end())
@@ -2207,7 +2260,10 @@ namespace cryptonote
     m_removed_txs_by_time.clear();
     m_removed_txs_start_time = (time_t)0;
     m_spent_key_images.clear();
+    m_unbroadcast_txids.clear();
     m_txpool_weight = 0;
+    m_template_selection.valid = false;
+    m_template_selection.changes.clear();
     std::vector<crypto::hash> remove;
 
     // first add the not kept by block, then the kept by block,
@@ -2231,13 +2287,15 @@ namespace cryptonote
           return false;
         }
         add_tx_to_transient_lists(txid, meta.fee / (double)meta.weight, meta.receive_time);
+        if (!meta.matches(relay_category::broadcasted))
+          m_unbroadcast_txids.insert(txid);
         m_txpool_weight += meta.weight;
         return true;
       }, true, relay_category::all);
       if (!r)
         return false;
     }
-    if (!remove.empty())
+    if (!remove.empty() && !m_blockchain.get_db().is_read_only())
     {
       LockedTXN lock(m_blockchain.get_db());
       for (const auto &txid: remove)
@@ -2261,6 +2319,84 @@ namespace cryptonote
     // Ignore deserialization error
     return true;
   }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::reload()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    // the pool as the process owning the db left it; only the txes that
+    // came or went since the last call are parsed, and the incremental
+    // pool info (added/removed since) carries on from there
+    std::unordered_map<crypto::hash, txpool_tx_meta_t> db_pool;
+    if (!m_blockchain.for_all_txpool_txes([&db_pool](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata_ref*) {
+      db_pool.emplace(txid, meta);
+      return true;
+    }, false, relay_category::all))
+      return false;
+
+    // removals first, so a replacement does not collide on its key images
+    std::unordered_set<crypto::hash> removed;
+    for (const auto &e: m_added_txs_by_id)
+      if (db_pool.find(e.first) == db_pool.end())
+        removed.insert(e.first);
+    if (!removed.empty())
+    {
+      for (auto it = m_spent_key_images.begin(); it != m_spent_key_images.end(); )
+      {
+        for (auto txid_it = it->second.begin(); txid_it != it->second.end(); )
+          txid_it = removed.count(*txid_it) ? it->second.erase(txid_it) : std::next(txid_it);
+        it = it->second.empty() ? m_spent_key_images.erase(it) : std::next(it);
+      }
+      for (const crypto::hash &txid: removed)
+      {
+        const bool sensitive = m_unbroadcast_txids.erase(txid) != 0;
+        remove_tx_from_transient_lists(find_tx_in_sorted_container(txid), txid, sensitive);
+      }
+      ++m_cookie;
+    }
+
+    // then the not kept by block, then the kept by block, as in init
+    m_txpool_weight = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      const bool kept = pass == 1;
+      for (const auto &e: db_pool)
+      {
+        const crypto::hash &txid = e.first;
+        const txpool_tx_meta_t &meta = e.second;
+        if (!kept)
+          m_txpool_weight += meta.weight;
+        if (!!kept != !!meta.kept_by_block)
+          continue;
+        const bool sensitive = !meta.matches(relay_category::broadcasted);
+        if (m_added_txs_by_id.find(txid) != m_added_txs_by_id.end())
+        {
+          // broadcast since the last call, make it visible to incremental queries
+          if (!sensitive && m_unbroadcast_txids.erase(txid))
+            add_tx_to_transient_lists(txid, meta.fee / (double)meta.weight, meta.receive_time);
+          continue;
+        }
+        cryptonote::blobdata bd;
+        cryptonote::transaction_prefix tx;
+        if (!m_blockchain.get_txpool_tx_blob(txid, bd, relay_category::all) || !parse_and_validate_tx_prefix_from_blob(bd, tx))
+        {
+          // gone again since the listing above, or still being written
+          MDEBUG("Failed to load tx " << txid << " from the txpool, leaving it for the next reload");
+          continue;
+        }
+        if (!insert_key_images(tx, txid, meta.get_relay_method()))
+        {
+          MWARNING("Txpool in the db does not match ours, reloading all of it");
+          return init(m_txpool_max_weight, m_mine_stem_txes);
+        }
+        add_tx_to_transient_lists(txid, meta.fee / (double)meta.weight, meta.receive_time);
+        if (sensitive)
+          m_unbroadcast_txids.insert(txid);
+      }
+    }
+    return true;
+  }
 
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
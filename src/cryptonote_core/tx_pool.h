@@ -46,6 +46,7 @@
 #include "math_helper.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
 #include "cryptonote_basic/verification_context.h"
+#include "block_template_selection.h"
 #include "cryptonote_protocol/enums.h"
 #include "blockchain_db/blockchain_db.h"
 #include "crypto/hash.h"
@@ -205,6 +206,17 @@ namespace cryptonote
      */
     bool init(size_t max_txpool_weight = 0, bool mine_stem_txes = false);
 
+    /**
+     * @brief catches up with pool changes made to the db by another process
+     *
+     * Used when another process owns the pool in a shared db. Txes added or
+     * removed since the last call are applied to the in memory state, which
+     * keeps incremental pool queries working across calls.
+     *
+     * @return false if the pool could not be read from the db
+     */
+    bool reload();
+
     /**
      * @brief attempts to save the transaction pool state to disk
      *
@@ -219,6 +231,10 @@ namespace cryptonote
     /**
      * @brief Chooses transactions for a block to include
      *
+     * The choice is kept, and while the chain tip and pricing record stay
+     * the same, the next call only applies the pool changes made since
+     * instead of going over the whole pool again.
+     *
      * @param bl return-by-reference the block to fill in with transactions
      * @param median_weight the current median block weight
      * @param already_generated_coins the current total number of coins "minted"
@@ -594,6 +610,14 @@ namespace cryptonote
     void remove_tx_from_transient_lists(const cryptonote::sorted_tx_container::iterator& sorted_it, const crypto::hash& txid, bool sensitive);
     void track_removed_tx(const crypto::hash& txid, bool sensitive);
 
+    /**
+     * @brief tries to add a pool transaction to the block template selection
+     *
+     * @return no_room if it was turned down for its weight
+     */
+    template_fit add_to_template(template_selection &sel, const crypto::hash &txid, double fee_per_byte);
+
+
     //TODO: confirm the below comments and investigate whether or not this
     //      is the desired behavior
     //! map key images to transactions which spent them
@@ -616,6 +640,9 @@ private:
     //! container for spent key images from the transactions in the pool
     key_images_container m_spent_key_images;  
 
+    //! txes not broadcast yet as of init() or the last reload(), so their removal stays private
+    std::unordered_set<crypto::hash> m_unbroadcast_txids;
+
     //TODO: this time should be a named constant somewhere, not hard-coded
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
@@ -674,6 +701,8 @@ private:
 
     std::unordered_map<crypto::hash, transaction> m_parsed_tx_cache;
 
+    template_selection m_template_selection;
+
     //! Next timestamp that a DB check for relayable txes is allowed
     std::atomic<time_t> m_next_check;
 
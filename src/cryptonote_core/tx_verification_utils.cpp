@@ -105,6 +105,21 @@ static crypto::hash calc_tx_mixring_hash(const transaction& tx, const rct::ctkey
     return tx_and_mixring_hash;
 }
 
+// Create a unique identifier for tx + pricing record + fork version, the inputs to the semantics checks
+static crypto::hash calc_tx_semantics_hash(const transaction& tx, const oracle::pricing_record& pr, uint8_t hf_version)
+{
+    std::string data(config::HASH_KEY_TXHASH_AND_PRICING_RECORD);
+    const crypto::hash tx_hash = get_transaction_hash(tx);
+    data.append(tx_hash.data, sizeof(crypto::hash));
+    // same raw layout the pricing record is serialized with in block headers
+    data.append(reinterpret_cast<const char*>(&pr), sizeof(oracle::pricing_record));
+    data.push_back(static_cast<char>(hf_version));
+
+    crypto::hash tx_semantics_hash;
+    get_blob_hash(data, tx_semantics_hash);
+    return tx_semantics_hash;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace cryptonote
@@ -146,7 +161,7 @@ bool ver_rct_non_semantics_simple_cached
     const crypto::hash tx_mixring_hash = calc_tx_mixring_hash(tx, mix_ring);
 
     // Search cache for successful verification of same TX + mix ring combination
-    if (cache.has(tx_mixring_hash))
+    if (cache.lookup(tx_mixring_hash))
     {
         MDEBUG("RCT cache: tx " << get_transaction_hash(tx) << " hit");
         return true;
@@ -165,4 +180,30 @@ bool ver_rct_non_semantics_simple_cached
     return true;
 }
 
+bool ver_rct_semantics_zeph_cached
+(
+    const transaction& tx,
+    const oracle::pricing_record& pr,
+    const transaction_type tx_type,
+    const std::string& source,
+    const std::string& dest,
+    const uint8_t hf_version,
+    rct_ver_cache_t& cache
+)
+{
+    const crypto::hash tx_semantics_hash = calc_tx_semantics_hash(tx, pr, hf_version);
+    if (cache.lookup(tx_semantics_hash))
+    {
+        MDEBUG("RCT semantics cache: tx " << get_transaction_hash(tx) << " hit");
+        return true;
+    }
+
+    MDEBUG("RCT semantics cache: tx " << get_transaction_hash(tx) << " missed");
+    if (!rct::verRctSemanticsZeph(tx.rct_signatures, pr, tx_type, source, dest, tx.amount_burnt, tx.amount_minted, tx.vout, tx.vin, hf_version))
+        return false;
+
+    cache.add(tx_semantics_hash);
+    return true;
+}
+
 } // namespace cryptonote
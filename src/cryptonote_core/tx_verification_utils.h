@@ -30,6 +30,7 @@
 
 #include "common/data_cache.h"
 #include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_protocol/enums.h"
 
 namespace cryptonote
 {
@@ -76,4 +77,31 @@ bool ver_rct_non_semantics_simple_cached
     uint8_t hf_version
 );
 
+/**
+ * @brief Cached version of rct::verRctSemanticsZeph
+ *
+ * A successful verification is remembered under a hash of the transaction hash, the pricing
+ * record it was checked against, and hf_version, which together are every input of the semantics
+ * checks. A block made of transactions that already passed at mempool admission therefore skips
+ * the range proofs and proof-of-value checks, leaving only the order dependent checks (key images,
+ * reserve ratio tallies) to the caller.
+ *
+ * The same staleness caveats as ver_rct_non_semantics_simple_cached apply to the tx hash.
+ *
+ * @param tx transaction to verify
+ * @param pr pricing record the transaction converts at
+ * @param cache saves tx+pricing record hashes of successfully verified transactions
+ * @return true when verRctSemanticsZeph() would return true
+ */
+bool ver_rct_semantics_zeph_cached
+(
+    const transaction& tx,
+    const oracle::pricing_record& pr,
+    const transaction_type tx_type,
+    const std::string& source,
+    const std::string& dest,
+    uint8_t hf_version,
+    rct_ver_cache_t& cache
+);
+
 } // namespace cryptonote
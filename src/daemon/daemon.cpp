@@ -82,7 +82,7 @@ public:
       boost::program_options::variables_map const & vm
     )
     : core{vm}
-    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline)}
+    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline) || command_line::get_arg(vm, cryptonote::arg_db_read_only_replica)}
     , p2p{vm, protocol}
     , zmq{nullptr}
   {
@@ -90,7 +90,8 @@ public:
     protocol.set_p2p_endpoint(p2p.get());
     core.set_protocol(protocol.get());
 
-    const auto restricted = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_restricted_rpc);
+    // a replica can't change the chain or the pool, so only serve the restricted surface
+    const auto restricted = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_restricted_rpc) || command_line::get_arg(vm, cryptonote::arg_db_read_only_replica);
     const auto main_rpc_port = command_line::get_arg(vm, cryptonote::core_rpc_server::arg_rpc_bind_port);
     const auto restricted_rpc_port_arg = cryptonote::core_rpc_server::arg_rpc_restricted_bind_port;
     const bool has_restricted_rpc_port_arg = !command_line::is_arg_defaulted(vm, restricted_rpc_port_arg);
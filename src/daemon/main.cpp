@@ -275,7 +275,9 @@ int main(int argc, char const * argv[])
     //   if log-file argument given:
     //     absolute path
     //     relative path: relative to data_dir
-    bf::path log_file_path {data_dir / std::string(CRYPTONOTE_NAME ".log")};
+    // a replica shares --data-dir with its primary, don't write to the same log
+    const bool read_only_replica = command_line::get_arg(vm, cryptonote::arg_db_read_only_replica);
+    bf::path log_file_path {data_dir / std::string(read_only_replica ? CRYPTONOTE_NAME "-replica.log" : CRYPTONOTE_NAME ".log")};
     if (!command_line::is_arg_defaulted(vm, daemon_args::arg_log_file))
       log_file_path = command_line::get_arg(vm, daemon_args::arg_log_file);
     if (!log_file_path.has_parent_path())
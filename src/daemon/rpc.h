@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "rpc/core_rpc_server.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -72,7 +74,9 @@ public:
   void run()
   {
     MGINFO("Starting " << m_description << " RPC server...");
-    if (!m_server.run(2, false))
+    // a thread for every call this server's worker classes let run or wait
+    // at once, unless --rpc-max-threads caps it
+    if (!m_server.run(std::max(2u, m_server.get_worker_threads()), false))
     {
       throw std::runtime_error("Failed to start " + m_description + " RPC server.");
     }
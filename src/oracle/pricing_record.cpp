@@ -31,6 +31,7 @@
 
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage.h"
+#include "storages/portable_storage_to_json_stream.h"
 
 #include "string_tools.h"
 namespace oracle
@@ -110,18 +111,29 @@ namespace oracle
     return false;
   }
 
-  bool pricing_record::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+  template<typename t_storage>
+  static bool store_pricing_record(const pricing_record& pr, t_storage& dest, typename t_storage::hsection hparent)
   {
     std::string sig_hex;
     for (unsigned int i=0; i<64; i++) {
       std::stringstream ss;
-      ss << std::hex << std::setw(2) << std::setfill('0') << (0xff & signature[i]);
+      ss << std::hex << std::setw(2) << std::setfill('0') << (0xff & pr.signature[i]);
       sig_hex += ss.str();
     }
-    const pr_serialized out{spot,moving_average,stable,stable_ma,reserve,reserve_ma,reserve_ratio,reserve_ratio_ma,yield_price,timestamp,sig_hex};
+    const pr_serialized out{pr.spot,pr.moving_average,pr.stable,pr.stable_ma,pr.reserve,pr.reserve_ma,pr.reserve_ratio,pr.reserve_ratio_ma,pr.yield_price,pr.timestamp,sig_hex};
     return out.store(dest, hparent);
   }
 
+  bool pricing_record::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+  {
+    return store_pricing_record(*this, dest, hparent);
+  }
+
+  bool pricing_record::store(epee::serialization::json_stream_writer& dest, epee::serialization::json_stream_frame* hparent) const
+  {
+    return store_pricing_record(*this, dest, hparent);
+  }
+
   pricing_record::pricing_record(const pricing_record& orig) noexcept
     : spot(orig.spot)
     , moving_average(orig.moving_average)
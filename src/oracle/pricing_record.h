@@ -52,6 +52,8 @@ namespace epee
   {
     class portable_storage;
     struct section;
+    class json_stream_writer;
+    struct json_stream_frame;
   }
 }
 
@@ -110,6 +112,8 @@ namespace oracle
       bool _load(epee::serialization::portable_storage& src, epee::serialization::section* hparent);
       //! Store in epee p2p format
       bool store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const;
+      //! Store as JSON, for streamed RPC responses
+      bool store(epee::serialization::json_stream_writer& dest, epee::serialization::json_stream_frame* hparent) const;
       pricing_record(const pricing_record& orig) noexcept;
       ~pricing_record() = default;
       bool equal(const pricing_record& other) const noexcept;
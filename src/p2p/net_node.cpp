@@ -36,9 +36,11 @@
 #include <boost/thread/future.hpp>
 #include <boost/utility/string_ref.hpp>
 #include <chrono>
+#include <unordered_map>
 #include <utility>
 
 #include "common/command_line.h"
+#include "common/metrics.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "net_node.h"
@@ -326,6 +328,35 @@ namespace nodetool
         return true;
     }
 
+    void record_levin_message(bool is_notify, int command, size_t bytes)
+    {
+        struct levin_counters
+        {
+            tools::metrics::counter* messages;
+            tools::metrics::counter* bytes;
+        };
+        // keeps the registry lock off the path of every message
+        static thread_local std::unordered_map<int, levin_counters> cache;
+
+        // peers pick the command, so only known ranges get their own series
+        const bool known = (command > P2P_COMMANDS_POOL_BASE && command < P2P_COMMANDS_POOL_BASE + 100)
+            || (command > BC_COMMANDS_POOL_BASE && command < BC_COMMANDS_POOL_BASE + 100);
+        if (!known)
+            command = 0;
+        const int key = command * 2 + (is_notify ? 1 : 0);
+        auto it = cache.find(key);
+        if (it == cache.end())
+        {
+            const std::string labels = tools::metrics::label("type", is_notify ? "notify" : "invoke") + "," + tools::metrics::label("command", known ? std::to_string(command) : "other");
+            it = cache.emplace(key, levin_counters{
+                &tools::metrics::get_counter("zephyr_levin_messages_total", "Levin messages received, by command", labels),
+                &tools::metrics::get_counter("zephyr_levin_bytes_total", "Bytes of levin messages received, by command", labels)
+            }).first;
+        }
+        it->second.messages->inc();
+        it->second.bytes->inc(bytes);
+    }
+
     boost::optional<boost::asio::ip::tcp::socket>
     socks_connect_internal(const std::atomic<bool>& stop_signal, boost::asio::io_service& service, const boost::asio::ip::tcp::endpoint& proxy, const epee::net_utils::network_address& remote)
     {
@@ -101,6 +101,9 @@ namespace nodetool
   //! \return True if `commnd` is filtered (ignored/dropped) for `address`
   bool is_filtered_command(epee::net_utils::network_address const& address, int command);
 
+  //! Counts a levin message received, and its bytes, for the metrics endpoint
+  void record_levin_message(bool is_notify, int command, size_t bytes);
+
   // hides boost::future and chrono stuff from mondo template file
   boost::optional<boost::asio::ip::tcp::socket>
   socks_connect_internal(const std::atomic<bool>& stop_signal, boost::asio::io_service& service, const boost::asio::ip::tcp::endpoint& proxy, const epee::net_utils::network_address& remote);
@@ -252,6 +255,7 @@ namespace nodetool
         m_hide_my_port(false),
         m_igd(no_igd),
         m_offline(false),
+        m_read_only_replica(false),
         is_closing(false),
         m_network_id(),
         m_enable_dns_seed_nodes(true),
@@ -309,6 +313,7 @@ namespace nodetool
     CHAIN_LEVIN_NOTIFY_MAP2(p2p_connection_context); //move levin_commands_handler interface notify(...) callbacks into nothing
 
     BEGIN_INVOKE_MAP2(node_server)
+      record_levin_message(is_notify, command, in_buff.size());
       if (is_filtered_command(context.m_remote_address, command))
         return LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED;
 
@@ -454,6 +459,7 @@ namespace nodetool
     bool m_hide_my_port;
     igd_t m_igd;
     bool m_offline;
+    bool m_read_only_replica;
     bool m_use_ipv6;
     bool m_require_ipv4;
     std::atomic<bool> is_closing;
@@ -448,7 +448,8 @@ namespace nodetool
       MFATAL("Invalid value for --" << arg_igd.name << ", expected enabled, disabled or delayed");
       return false;
     }
-    m_offline = command_line::get_arg(vm, cryptonote::arg_offline);
+    m_read_only_replica = command_line::get_arg(vm, cryptonote::arg_db_read_only_replica);
+    m_offline = command_line::get_arg(vm, cryptonote::arg_offline) || m_read_only_replica;
     m_use_ipv6 = command_line::get_arg(vm, arg_p2p_use_ipv6);
     m_require_ipv4 = !command_line::get_arg(vm, arg_p2p_ignore_ipv4);
     public_zone.m_notifier = cryptonote::levin::notify{
@@ -1074,6 +1075,9 @@ namespace nodetool
       if(m_igd == igd)
         delete_upnp_port_mapping(m_listening_port);
     }
+    // the peer list in --data-dir belongs to the primary daemon
+    if (m_read_only_replica)
+      return true;
     return store_config();
   }
   //-----------------------------------------------------------------------------------
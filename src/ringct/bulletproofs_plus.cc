@@ -42,6 +42,7 @@
 #include <boost/thread/lock_guard.hpp>
 #include "misc_log_ex.h"
 #include "span.h"
+#include "file_io_utils.h"
 #include "cryptonote_config.h"
 extern "C"
 {
@@ -57,6 +58,9 @@ extern "C"
 #define STRAUS_SIZE_LIMIT 232
 #define PIPPENGER_SIZE_LIMIT 0
 
+#define GENERATOR_CACHE_MAGIC "zephyr-bpp-generators"
+#define GENERATOR_CACHE_VERSION 1
+
 namespace rct
 {
     // Vector functions
@@ -83,19 +87,32 @@ namespace rct
     // Initial transcript hash
     static rct::key initial_transcript;
 
+    // Fixed generators, decompressed once
+    static ge_p3 G_p3, H_p3;
+
     static boost::mutex init_mutex;
+    static bool init_done = false;
+
+    // Precomputation settings, fixed once init_exponents has run
+    static bulletproof_plus_config multiexp_config;
+
+    static inline size_t pippenger_window(size_t npoints)
+    {
+        return multiexp_config.pippenger_window ? multiexp_config.pippenger_window : get_pippenger_c(npoints);
+    }
 
     // Use the generator caches to compute a multiscalar multiplication
     static inline rct::key multiexp(const std::vector<MultiexpData> &data, size_t HiGi_size)
     {
         if (HiGi_size > 0)
         {
-            static_assert(232 <= STRAUS_SIZE_LIMIT, "Straus in precalc mode can only be calculated till STRAUS_SIZE_LIMIT");
-            return HiGi_size <= 232 && data.size() == HiGi_size ? straus(data, straus_HiGi_cache, 0) : pippenger(data, pippenger_HiGi_cache, HiGi_size, get_pippenger_c(data.size()));
+            if (HiGi_size <= multiexp_config.straus_cached_points && data.size() == HiGi_size)
+                return straus(data, straus_HiGi_cache, 0);
+            return pippenger(data, pippenger_HiGi_cache, std::min(HiGi_size, pippenger_HiGi_cache->size()), pippenger_window(data.size()));
         }
         else
         {
-            return data.size() <= 95 ? straus(data, NULL, 0) : pippenger(data, NULL, 0, get_pippenger_c(data.size()));
+            return data.size() <= 95 ? straus(data, NULL, 0) : pippenger(data, NULL, 0, pippenger_window(data.size()));
         }
     }
 
@@ -117,29 +134,132 @@ namespace rct
         return generator_p3;
     }
 
+    // The generator cache file holds a header, the raw Hi_p3 and Gi_p3 arrays, and a hash of those.
+    // The layout of ge_p3 is platform dependent, so the header records enough to reject a foreign file.
+    struct generator_cache_header
+    {
+        char magic[sizeof(GENERATOR_CACHE_MAGIC)];
+        uint32_t version;
+        uint32_t endianness;
+        uint32_t point_size;
+        uint32_t n_points;
+    };
+
+    static generator_cache_header make_generator_cache_header()
+    {
+        generator_cache_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GENERATOR_CACHE_MAGIC, sizeof(header.magic));
+        header.version = GENERATOR_CACHE_VERSION;
+        header.endianness = 0x01020304;
+        header.point_size = sizeof(ge_p3);
+        header.n_points = maxN*maxM;
+        return header;
+    }
+
+    static bool same_point(const ge_p3 &a, const ge_p3 &b)
+    {
+        rct::key ka, kb;
+        ge_p3_tobytes(ka.bytes, &a);
+        ge_p3_tobytes(kb.bytes, &b);
+        return ka == kb;
+    }
+
+    static bool load_generator_cache(const std::string &filename)
+    {
+        std::string blob;
+        if (!epee::file_io_utils::is_file_exist(filename) || !epee::file_io_utils::load_file_to_string(filename, blob))
+            return false;
+
+        const generator_cache_header header = make_generator_cache_header();
+        const size_t payload_size = sizeof(Hi_p3) + sizeof(Gi_p3);
+        if (blob.size() != sizeof(header) + payload_size + sizeof(crypto::hash) || memcmp(blob.data(), &header, sizeof(header)))
+        {
+            MWARNING("Ignoring incompatible Bulletproof+ generator cache " << filename);
+            return false;
+        }
+        const char *payload = blob.data() + sizeof(header);
+        crypto::hash checksum;
+        crypto::cn_fast_hash(payload, payload_size, checksum);
+        if (memcmp(&checksum, payload + payload_size, sizeof(checksum)))
+        {
+            MWARNING("Ignoring corrupt Bulletproof+ generator cache " << filename);
+            return false;
+        }
+        memcpy(Hi_p3, payload, sizeof(Hi_p3));
+        memcpy(Gi_p3, payload + sizeof(Hi_p3), sizeof(Gi_p3));
+
+        // Spot check both ends of the tables against freshly derived generators
+        if (!same_point(Hi_p3[0], get_exponent(rct::H, 0)) || !same_point(Gi_p3[maxN*maxM-1], get_exponent(rct::H, maxN*maxM*2-1)))
+        {
+            MWARNING("Ignoring Bulletproof+ generator cache " << filename << " with unexpected generators");
+            return false;
+        }
+        return true;
+    }
+
+    static void save_generator_cache(const std::string &filename)
+    {
+        const generator_cache_header header = make_generator_cache_header();
+        std::string blob;
+        blob.reserve(sizeof(header) + sizeof(Hi_p3) + sizeof(Gi_p3) + sizeof(crypto::hash));
+        blob.append((const char*)&header, sizeof(header));
+        blob.append((const char*)Hi_p3, sizeof(Hi_p3));
+        blob.append((const char*)Gi_p3, sizeof(Gi_p3));
+        crypto::hash checksum;
+        crypto::cn_fast_hash(blob.data() + sizeof(header), sizeof(Hi_p3) + sizeof(Gi_p3), checksum);
+        blob.append((const char*)&checksum, sizeof(checksum));
+        if (!epee::file_io_utils::save_string_to_file(filename, blob))
+            MWARNING("Failed to save Bulletproof+ generator cache to " << filename);
+    }
+
+    bool bulletproof_plus_configure(const bulletproof_plus_config &cfg)
+    {
+        boost::lock_guard<boost::mutex> lock(init_mutex);
+        CHECK_AND_ASSERT_MES(!init_done, false, "Bulletproof+ generators are already initialized");
+        CHECK_AND_ASSERT_MES(cfg.straus_cached_points <= maxN*maxM*2, false, "Too many Straus cached points");
+        CHECK_AND_ASSERT_MES(cfg.pippenger_cached_points <= maxN*maxM*2, false, "Too many Pippenger cached points");
+        CHECK_AND_ASSERT_MES(cfg.pippenger_window <= 9, false, "Pippenger window is too large");
+        multiexp_config = cfg;
+        return true;
+    }
+
     // Construct public generators
     static void init_exponents()
     {
         boost::lock_guard<boost::mutex> lock(init_mutex);
 
         // Only needs to be done once
-        static bool init_done = false;
         if (init_done)
             return;
 
+        if (multiexp_config.straus_cached_points == 0)
+            multiexp_config.straus_cached_points = STRAUS_SIZE_LIMIT;
+        if (multiexp_config.pippenger_cached_points == 0)
+            multiexp_config.pippenger_cached_points = PIPPENGER_SIZE_LIMIT ? PIPPENGER_SIZE_LIMIT : maxN*maxM*2;
+
+        const bool cached = !multiexp_config.generator_cache_file.empty() && load_generator_cache(multiexp_config.generator_cache_file);
         std::vector<MultiexpData> data;
         data.reserve(maxN*maxM*2);
         for (size_t i = 0; i < maxN*maxM; ++i)
         {
-            Hi_p3[i] = get_exponent(rct::H, i * 2);
-            Gi_p3[i] = get_exponent(rct::H, i * 2 + 1);
+            if (!cached)
+            {
+                Hi_p3[i] = get_exponent(rct::H, i * 2);
+                Gi_p3[i] = get_exponent(rct::H, i * 2 + 1);
+            }
 
             data.push_back({rct::zero(), Gi_p3[i]});
             data.push_back({rct::zero(), Hi_p3[i]});
         }
+        if (!cached && !multiexp_config.generator_cache_file.empty())
+            save_generator_cache(multiexp_config.generator_cache_file);
+
+        straus_HiGi_cache = straus_init_cache(data, multiexp_config.straus_cached_points);
+        pippenger_HiGi_cache = pippenger_init_cache(data, 0, multiexp_config.pippenger_cached_points);
 
-        straus_HiGi_cache = straus_init_cache(data, STRAUS_SIZE_LIMIT);
-        pippenger_HiGi_cache = pippenger_init_cache(data, 0, PIPPENGER_SIZE_LIMIT);
+        CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&G_p3, rct::G.bytes) == 0, "ge_frombytes_vartime failed");
+        H_p3 = ge_p3_H;
 
         // Compute 2**64 - 1 for later use in simplifying verification
         TWO_SIXTY_FOUR_MINUS_ONE = TWO;
@@ -203,13 +323,9 @@ namespace rct
         }
 
         sc_mul(multiexp_data[2*size].scalar.bytes, c.bytes, INV_EIGHT.bytes);
-        ge_p3 H_p3;
-        ge_frombytes_vartime(&H_p3, rct::H.bytes);
         multiexp_data[2*size].point = H_p3;
 
         sc_mul(multiexp_data[2*size+1].scalar.bytes, d.bytes, INV_EIGHT.bytes);
-        ge_p3 G_p3;
-        ge_frombytes_vartime(&G_p3, rct::G.bytes);
         multiexp_data[2*size+1].point = G_p3;
 
         return multiexp(multiexp_data, 0);
@@ -553,7 +669,7 @@ namespace rct
             rct::key gamma8, sv8;
             sc_mul(gamma8.bytes, gamma[i].bytes, INV_EIGHT.bytes);
             sc_mul(sv8.bytes, sv[i].bytes, INV_EIGHT.bytes);
-            rct::addKeys2(V[i], gamma8, sv8, rct::H);
+            rct::addKeysGH(V[i], gamma8, sv8);
         }
 
         // Decompose values
@@ -730,8 +846,6 @@ try_again:
         A1_data[1].point = Hprime[0];
 
         sc_mul(A1_data[2].scalar.bytes, d_.bytes, INV_EIGHT.bytes);
-        ge_p3 G_p3;
-        ge_frombytes_vartime(&G_p3, rct::G.bytes);
         A1_data[2].point = G_p3;
 
         sc_mul(temp.bytes, r.bytes, y.bytes);
@@ -740,8 +854,6 @@ try_again:
         sc_mul(temp2.bytes, temp2.bytes, aprime[0].bytes);
         sc_add(temp.bytes, temp.bytes, temp2.bytes);
         sc_mul(A1_data[3].scalar.bytes, temp.bytes, INV_EIGHT.bytes);
-        ge_p3 H_p3;
-        ge_frombytes_vartime(&H_p3, rct::H.bytes);
         A1_data[3].point = H_p3;
 
         rct::key A1 = multiexp(A1_data, 0);
@@ -751,7 +863,7 @@ try_again:
         sc_mul(temp.bytes, temp.bytes, INV_EIGHT.bytes);
         sc_mul(temp2.bytes, eta.bytes, INV_EIGHT.bytes);
         rct::key B;
-        rct::addKeys2(B, temp2, temp, rct::H);
+        rct::addKeysGH(B, temp2, temp);
 
         rct::key e = transcript_update(transcript, A1, B);
         if (e == rct::zero())
@@ -1087,8 +1199,8 @@ try_again:
         }
 
         // Verify all proofs in the weighted batch
-        multiexp_data.emplace_back(G_scalar, rct::G);
-        multiexp_data.emplace_back(H_scalar, rct::H);
+        multiexp_data.emplace_back(G_scalar, G_p3);
+        multiexp_data.emplace_back(H_scalar, H_p3);
         for (size_t i = 0; i < maxMN; ++i)
         {
             multiexp_data[i * 2] = {Gi_scalars[i], Gi_p3[i]};
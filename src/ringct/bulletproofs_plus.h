@@ -33,9 +33,23 @@
 
 #include "rctTypes.h"
 
+#include <string>
+
 namespace rct
 {
 
+// Multiexp precomputation for the Hi/Gi generators. Zero values select the built in defaults
+struct bulletproof_plus_config
+{
+  size_t straus_cached_points = 0; // generators with Straus multiples precomputed, up to 2 * maxN * maxM
+  size_t pippenger_cached_points = 0; // generators in the Pippenger cache, up to 2 * maxN * maxM
+  size_t pippenger_window = 0; // Pippenger window size, 0 to pick it from the number of points
+  std::string generator_cache_file; // where to load/save the generators, empty to always compute them. Only for provers, the file is trusted
+};
+
+// Must be called before the first proof is built or verified, fails afterwards
+bool bulletproof_plus_configure(const bulletproof_plus_config &config);
+
 BulletproofPlus bulletproof_plus_PROVE(const rct::key &v, const rct::key &gamma);
 BulletproofPlus bulletproof_plus_PROVE(uint64_t v, const rct::key &gamma);
 BulletproofPlus bulletproof_plus_PROVE(const rct::keyV &v, const rct::keyV &gamma);
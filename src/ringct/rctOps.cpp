@@ -219,6 +219,17 @@ static const zero_commitment zero_commitments[] = {
 
 namespace rct {
 
+    //Fixed-base table for H, same layout as ge_base for G
+    struct H_precomp_table {
+        ge_precomp table[32][8];
+        H_precomp_table() { ge_precomp_table_init(table, &ge_p3_H); }
+    };
+
+    static const H_precomp_table &get_H_precomp_table() {
+        static const H_precomp_table t;
+        return t;
+    }
+
     //Various key initialization functions
 
     //initializes a key matrix;
@@ -295,7 +306,7 @@ namespace rct {
 
     //generates C =aG + bH from b, a is given..
     void genC(key & C, const key & a, xmr_amount amount) {
-        addKeys2(C, a, d2h(amount), rct::H);
+        addKeysGH(C, a, d2h(amount));
     }
 
     //generates a <secret , public> / Pedersen commitment to the amount
@@ -387,10 +398,10 @@ namespace rct {
 
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
     key scalarmultH(const key & a) {
-        ge_p2 R;
-        ge_scalarmult(&R, a.bytes, &ge_p3_H);
+        ge_p3 R;
+        ge_scalarmult_precomp_table(&R, a.bytes, get_H_precomp_table().table);
         key aP;
-        ge_tobytes(aP.bytes, &R);
+        ge_p3_tobytes(aP.bytes, &R);
         return aP;
     }
 
@@ -483,6 +494,24 @@ namespace rct {
         ge_tobytes(aGbB.bytes, &rv);
     }
 
+    //aGbH = aG + bH where a, b are scalars, G is the basepoint and H = toPoint(cn_fast_hash(G))
+    //both products use fixed-base tables, and run in constant time
+    void addKeysGH(key &aGbH, const key &a, const key &b) {
+        key ra, rb;
+        sc_reduce32copy(ra.bytes, a.bytes);
+        sc_reduce32copy(rb.bytes, b.bytes);
+        ge_p3 aG, bH;
+        ge_scalarmult_base(&aG, ra.bytes);
+        ge_scalarmult_precomp_table(&bH, rb.bytes, get_H_precomp_table().table);
+        ge_cached bH_cached;
+        ge_p3_to_cached(&bH_cached, &bH);
+        ge_p1p1 sum;
+        ge_add(&sum, &aG, &bH_cached);
+        ge_p2 rv;
+        ge_p1p1_to_p2(&rv, &sum);
+        ge_tobytes(aGbH.bytes, &rv);
+    }
+
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key & B) {
@@ -28,6 +28,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <exception>
 #include "misc_log_ex.h"
 #include "misc_language.h"
 #include "common/perf_timer.h"
@@ -1433,6 +1434,27 @@ namespace rct {
 
         key full_message = get_pre_mlsag_hash(rv,hwdev);
 
+        // inputs sign independently, so when asked to and the keys are in memory, spread the CLSAGs over
+        // the compute pool; hardware devices keep per-tx state and must see the inputs one at a time, in order
+        if (rct_config.parallel_signing && is_rct_clsag(rv.type) && inamounts.size() > 1 &&
+            hwdev.get_type() == hw::device::SOFTWARE && hwdev.get_mode() != hw::device::TRANSACTION_CREATE_FAKE)
+        {
+            std::vector<std::exception_ptr> errors(inamounts.size());
+            tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+            tools::threadpool::waiter waiter(tpool);
+            for (i = 0 ; i < inamounts.size(); i++)
+                tpool.submit(&waiter, [&, i] {
+                    try { rv.p.CLSAGs[i] = proveRctCLSAGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], index[i], hwdev); }
+                    catch (...) { errors[i] = std::current_exception(); }
+                });
+            CHECK_AND_ASSERT_THROW_MES(waiter.wait(), "Failed to generate CLSAG signatures");
+            // rethrow the first failure as-is, as signing serially would have
+            for (const std::exception_ptr &e: errors)
+                if (e)
+                    std::rethrow_exception(e);
+            return rv;
+        }
+
         for (i = 0 ; i < inamounts.size(); i++)
         {
             if (is_rct_clsag(rv.type))
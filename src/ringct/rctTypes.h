@@ -308,6 +308,7 @@ namespace rct {
     struct RCTConfig {
       RangeProofType range_proof_type;
       int bp_version;
+      bool parallel_signing = false; // not serialized, only asked for by the wallet building the tx
 
       BEGIN_SERIALIZE_OBJECT()
         VERSION_FIELD(0)
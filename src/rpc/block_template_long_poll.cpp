@@ -0,0 +1,200 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <ctime>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/lexical_cast.hpp>
+#include "misc_log_ex.h"
+#include "string_tools.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/tx_extra.h"
+#include "block_template_long_poll.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  block_template_long_poll::template_key block_template_long_poll::block_template::get_key() const
+  {
+    return {b.prev_id, b.pricing_record.timestamp, expected_reward};
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  block_template_long_poll::block_template_long_poll(template_source source, std::chrono::milliseconds check_interval, std::chrono::milliseconds pricing_record_interval):
+    m_source(std::move(source)),
+    m_check_interval(check_interval),
+    m_pricing_record_interval(pricing_record_interval),
+    m_valid(false),
+    m_building(false),
+    m_stopped(false),
+    m_tip_changed(false),
+    m_address(),
+    m_nonce_size(0),
+    m_pool_cookie(0),
+    m_template(),
+    m_checked(),
+    m_fetched()
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::string block_template_long_poll::get_id(const template_key &key)
+  {
+    return epee::string_tools::pod_to_hex(key.prev_id) + ":" + std::to_string(key.pricing_record_timestamp) + ":" + std::to_string(key.expected_reward);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool block_template_long_poll::parse_id(const std::string &id, template_key &key)
+  {
+    std::vector<std::string> parts;
+    boost::split(parts, id, boost::is_any_of(":"));
+    if (parts.size() != 3 || !epee::string_tools::hex_to_pod(parts[0], key.prev_id))
+      return false;
+    // lexical_cast would take a sign, and wrap negative numbers around
+    const auto parse = [](const std::string &s, uint64_t &value) {
+      return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos && boost::conversion::try_lexical_convert(s, value);
+    };
+    return parse(parts[1], key.pricing_record_timestamp) && parse(parts[2], key.expected_reward);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool block_template_long_poll::is_changed(const template_key &old, const template_key &current, uint64_t fee_threshold)
+  {
+    if (old.prev_id != current.prev_id || old.pricing_record_timestamp != current.pricing_record_timestamp)
+      return true;
+    // fewer fees means something in the old template left the pool, and it may not be valid anymore
+    if (current.expected_reward < old.expected_reward)
+      return true;
+    return current.expected_reward - old.expected_reward >= std::max<uint64_t>(fee_threshold, 1);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool block_template_long_poll::set_extra_nonce(block &b, const blobdata &extra_nonce)
+  {
+    // the same as construct_miner_tx does, so the miner tx ends up as if built with this nonce
+    std::vector<uint8_t> &extra = b.miner_tx.extra;
+    CHECK_AND_ASSERT_MES(remove_field_from_tx_extra(extra, typeid(tx_extra_nonce)), false, "Failed to remove extra nonce");
+    if (!extra_nonce.empty())
+      CHECK_AND_ASSERT_MES(add_extra_nonce_to_tx_extra(extra, extra_nonce), false, "Failed to add extra nonce");
+    CHECK_AND_ASSERT_MES(sort_tx_extra(extra, extra), false, "Failed to sort miner tx extra");
+    b.miner_tx.invalidate_hashes();
+    b.invalidate_hashes();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool block_template_long_poll::wait(const account_public_address &address, const blobdata &extra_nonce, const template_key &old, uint64_t fee_threshold, std::chrono::milliseconds timeout, block_template &t)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_stopped)
+    {
+      auto now = std::chrono::steady_clock::now();
+      if (!m_building)
+      {
+        const bool fresh = now - m_fetched >= m_pricing_record_interval;
+        bool rebuild = fresh || m_tip_changed;
+        if (!rebuild && now - m_checked >= m_check_interval)
+        {
+          m_checked = now;
+          rebuild = !m_valid || m_source.get_pool_cookie() != m_pool_cookie || m_source.get_tail_id() != m_template.b.prev_id;
+        }
+        if (rebuild)
+        {
+          refresh(lock, address, extra_nonce.size(), fresh);
+          continue;
+        }
+      }
+      if (m_valid && is_changed(old, m_template.get_key(), fee_threshold))
+        break;
+      if (now >= deadline)
+        break;
+      // whoever is building wakes everyone when done
+      const auto wake = m_building ? deadline : std::min({deadline, m_fetched + m_pricing_record_interval, m_checked + m_check_interval});
+      m_cond.wait_for(lock, boost::chrono::milliseconds(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1));
+    }
+
+    if (m_stopped || !m_valid || m_nonce_size != extra_nonce.size() || memcmp(&m_address, &address, sizeof(address)))
+      return false;
+    t = m_template;
+    lock.unlock();
+    const uint64_t now = time(NULL);
+    if (t.b.timestamp < now)
+      t.b.timestamp = now;
+    return set_extra_nonce(t.b, extra_nonce);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void block_template_long_poll::refresh(boost::unique_lock<boost::mutex> &lock, const account_public_address &address, size_t nonce_size, bool fresh)
+  {
+    m_building = true;
+    m_tip_changed = false;
+    // read before building, so a change made meanwhile is seen by the next check
+    const uint64_t pool_cookie = m_source.get_pool_cookie();
+    lock.unlock();
+
+    block_template t;
+    bool r = false;
+    try
+    {
+      r = m_source.build(address, blobdata(nonce_size, 0), fresh, t);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to build block template for long polls: " << e.what());
+    }
+
+    lock.lock();
+    m_building = false;
+    m_checked = std::chrono::steady_clock::now();
+    // even if it failed, so as not to keep the oracle busy
+    if (fresh)
+      m_fetched = m_checked;
+    if (r)
+    {
+      MDEBUG("Block template for long polls is now at " << t.b.prev_id << ", reward " << t.expected_reward);
+      m_template = std::move(t);
+      m_address = address;
+      m_nonce_size = nonce_size;
+      m_pool_cookie = pool_cookie;
+      m_valid = true;
+    }
+    m_cond.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void block_template_long_poll::on_block_added()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_tip_changed = true;
+    m_cond.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void block_template_long_poll::stop()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_stopped = true;
+    m_cond.notify_all();
+  }
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/difficulty.h"
+
+namespace cryptonote
+{
+  /*! Lets pools wait for the block template to change instead of polling for
+    it. While anyone waits, one template is kept up to date for all of them:
+    it is rebuilt when the chain tip or the pool moves, and every so often to
+    pick up a new pricing record. A waiter is woken when the template differs
+    from the one it has by more than it cares about, and is given the shared
+    template with its own extra nonce in the miner tx, if it mines to the same
+    address with an extra nonce of the same size. Otherwise it has to build
+    its own, which the block weight, and so the reward, depend on. */
+  class block_template_long_poll
+  {
+  public:
+    //! what templates are compared by, carried in long_poll_id
+    struct template_key
+    {
+      crypto::hash prev_id;
+      uint64_t pricing_record_timestamp;
+      uint64_t expected_reward;
+    };
+
+    struct block_template
+    {
+      block b;
+      difficulty_type difficulty;
+      uint64_t height;
+      uint64_t expected_reward;
+      uint64_t seed_height;
+      crypto::hash seed_hash;
+      crypto::hash next_seed_hash;
+      size_t reserved_offset;
+
+      template_key get_key() const;
+    };
+
+    struct template_source
+    {
+      //! builds a template, with a new pricing record if `fresh`
+      std::function<bool(const account_public_address &address, const blobdata &extra_nonce, bool fresh, block_template &t)> build;
+      //! changes whenever the pool does
+      std::function<uint64_t()> get_pool_cookie;
+      std::function<crypto::hash()> get_tail_id;
+    };
+
+    block_template_long_poll(template_source source, std::chrono::milliseconds check_interval = std::chrono::seconds(1),
+        std::chrono::milliseconds pricing_record_interval = std::chrono::seconds(60));
+
+    static std::string get_id(const template_key &key);
+    static bool parse_id(const std::string &id, template_key &key);
+    //! whether a client holding a template like `old` should be given `current`
+    static bool is_changed(const template_key &old, const template_key &current, uint64_t fee_threshold);
+    //! puts `extra_nonce` in the miner tx of `b`, in place of the one it has
+    static bool set_extra_nonce(block &b, const blobdata &extra_nonce);
+
+    /*! Waits until the template differs from `old`, or for `timeout`. Returns
+      true with the shared template in `t`, with `extra_nonce` set, or false if
+      the caller has to build its own. */
+    bool wait(const account_public_address &address, const blobdata &extra_nonce, const template_key &old, uint64_t fee_threshold, std::chrono::milliseconds timeout, block_template &t);
+
+    //! wakes waiters up at once for a new chain tip
+    void on_block_added();
+    //! lets everyone waiting go, and makes later waits return at once
+    void stop();
+
+  private:
+    void refresh(boost::unique_lock<boost::mutex> &lock, const account_public_address &address, size_t nonce_size, bool fresh);
+
+    const template_source m_source;
+    const std::chrono::milliseconds m_check_interval;
+    const std::chrono::milliseconds m_pricing_record_interval;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_valid;
+    bool m_building;
+    bool m_stopped;
+    bool m_tip_changed;
+    account_public_address m_address;
+    size_t m_nonce_size;
+    uint64_t m_pool_cookie;
+    block_template m_template;
+    std::chrono::steady_clock::time_point m_checked; //!< when the tip and pool were last looked at
+    std::chrono::steady_clock::time_point m_fetched; //!< when a pricing record was last asked for
+  };
+}
@@ -41,11 +41,15 @@ using namespace epee;
 #include "common/download.h"
 #include "common/util.h"
 #include "common/perf_timer.h"
+#include "common/metrics.h"
 #include "int-util.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
 #include "cryptonote_basic/merge_mining.h"
+#include "cryptonote_basic/compact_output_indices.h"
+#include "cryptonote_basic/scan_view.h"
+#include "serialization/binary_utils.h"
 #include "cryptonote_core/tx_sanity_check.h"
 #include "misc_language.h"
 #include "net/local_ip.h"
@@ -76,6 +80,12 @@ using namespace epee;
 #define RESTRICTED_SPENT_KEY_IMAGES_COUNT 5000
 #define RESTRICTED_BLOCK_COUNT 1000
 
+#define GET_BLOCKS_CACHE_CHUNK_BLOCKS 100
+#define GET_BLOCKS_CACHE_MAX_SIZE (256*1024*1024)
+
+#define BLOCK_TEMPLATE_LONG_POLL_DEFAULT_TIMEOUT 30 // seconds
+#define BLOCK_TEMPLATE_LONG_POLL_MAX_TIMEOUT 60
+
 #define RPC_TRACKER(rpc) \
   PERF_TIMER(rpc); \
   RPCTracker tracker(#rpc, PERF_TIMER_NAME(rpc))
@@ -163,6 +173,8 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_payment_difficulty);
     command_line::add_arg(desc, arg_rpc_payment_credits);
     command_line::add_arg(desc, arg_rpc_payment_allow_free_loopback);
+    command_line::add_arg(desc, arg_rpc_worker_class);
+    command_line::add_arg(desc, arg_rpc_max_threads);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -174,7 +186,17 @@ namespace cryptonote
     , m_was_bootstrap_ever_used(false)
     , disable_rpc_ban(false)
     , m_rpc_payment_allow_free_loopback(false)
-  {}
+    , m_max_threads(0)
+    , m_get_blocks_cache(GET_BLOCKS_CACHE_MAX_SIZE)
+  {
+    m_block_template_long_poll = std::make_shared<block_template_long_poll>(block_template_long_poll::template_source{
+      [this](const account_public_address &address, const blobdata &extra_nonce, bool fresh, block_template_long_poll::block_template &t) {
+        return build_long_poll_template(address, extra_nonce, fresh, t);
+      },
+      [this]() { return m_core.get_pool_cookie(); },
+      [this]() { return m_core.get_tail_id(); }
+    });
+  }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::set_bootstrap_daemon(
     const std::string &address,
@@ -290,6 +312,25 @@ namespace cryptonote
       }
     }
     disable_rpc_ban = rpc_config->disable_rpc_ban;
+    m_workers.set_server_name(restricted ? "restricted" : "unrestricted");
+    for (const std::string &spec: command_line::get_arg(vm, arg_rpc_worker_class))
+    {
+      if (!m_workers.set_limits(spec))
+        return false;
+    }
+    // long polls are only served unrestricted, so need no threads here
+    if (restricted)
+      m_workers.set_limits(rpc_workers::worker_class_long_poll, {0, 0});
+    m_max_threads = command_line::get_arg(vm, arg_rpc_max_threads);
+    if (m_max_threads && m_max_threads < m_workers.get_threads())
+      MWARNING("--" << arg_rpc_max_threads.name << " is below the " << m_workers.get_threads()
+          << " threads the RPC worker classes need, calls may wait for a thread beyond their class limits");
+    // the core may add blocks after this server is gone
+    std::weak_ptr<block_template_long_poll> long_poll = m_block_template_long_poll;
+    m_core.get_blockchain_storage().add_block_notify([long_poll](uint64_t, epee::span<const block>) {
+      if (const auto p = long_poll.lock())
+        p->on_block_added();
+    });
     const std::string data_dir{command_line::get_arg(vm, cryptonote::arg_data_dir)};
     std::string address = command_line::get_arg(vm, arg_rpc_payment_address);
     if (!address.empty() && allow_rpc_payment)
@@ -416,6 +457,19 @@ namespace cryptonote
     return inited;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  unsigned core_rpc_server::get_worker_threads() const
+  {
+    const unsigned threads = m_workers.get_threads();
+    return m_max_threads ? std::min(threads, m_max_threads) : threads;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::send_stop_signal()
+  {
+    // long polls would otherwise hold their threads until they time out
+    m_block_template_long_poll->stop();
+    return epee::http_server_impl_base<core_rpc_server>::send_stop_signal();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_payment(const std::string &client_message, uint64_t payment, const std::string &rpc, bool same_ts, std::string &message, uint64_t &credits, std::string &top_hash)
   {
     if (m_rpc_payment == NULL)
@@ -598,6 +652,29 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_metrics(std::string& body, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_metrics);
+    // No bootstrap daemon check: Only ever get metrics about local server
+    const bool restricted = m_restricted && ctx;
+    crypto::hash top_hash;
+    uint64_t height;
+    m_core.get_blockchain_top(height, top_hash);
+    tools::metrics::write_gauge(body, "zephyr_height", "Height of the blockchain", height + 1);
+    tools::metrics::write_gauge(body, "zephyr_target_height", "Height the daemon is syncing to, 0 once synchronized",
+        m_p2p.get_payload_object().is_synchronized() ? 0 : m_core.get_target_blockchain_height());
+    tools::metrics::write_gauge(body, "zephyr_txpool_transactions", "Transactions in the pool", m_core.get_pool_transactions_count(!restricted));
+    if (!restricted)
+    {
+      const uint64_t connections = m_p2p.get_public_connections_count();
+      const uint64_t outgoing = m_p2p.get_public_outgoing_connections_count();
+      tools::metrics::write_gauge(body, "zephyr_connections", "Public P2P connections", outgoing, tools::metrics::label("direction", "out"));
+      tools::metrics::write_gauge(body, "zephyr_connections", "Public P2P connections", connections - outgoing, tools::metrics::label("direction", "in"));
+    }
+    tools::metrics::render(body);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   class pruned_transaction {
     transaction& tx;
   public:
@@ -632,6 +709,7 @@ namespace cryptonote
 
     bool get_blocks = false;
     bool get_pool = false;
+    bool get_scan_views = false;
     switch (req.requested_info)
     {
       case COMMAND_RPC_GET_BLOCKS_FAST::BLOCKS_ONLY:
@@ -645,6 +723,15 @@ namespace cryptonote
       case COMMAND_RPC_GET_BLOCKS_FAST::POOL_ONLY:
         get_pool = true;
         break;
+      case COMMAND_RPC_GET_BLOCKS_FAST::SCAN_VIEW_ONLY:
+        get_blocks = true;
+        get_scan_views = true;
+        break;
+      case COMMAND_RPC_GET_BLOCKS_FAST::SCAN_VIEW_AND_POOL:
+        get_blocks = true;
+        get_pool = true;
+        get_scan_views = true;
+        break;
       default:
         res.status = "Failed, wrong requested info";
         return true;
@@ -729,80 +816,270 @@ namespace cryptonote
         }
       }
 
+      // find where the client's chain forks off ours, without fetching any blocks yet
       std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
-      if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, max_blocks, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT))
+      const bool prune = req.prune || get_scan_views;
+      if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, prune, !req.no_miner_tx, 0, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT))
       {
         res.status = "Failed";
         add_host_fail(ctx);
         return true;
       }
 
-      CHECK_PAYMENT_SAME_TS(req, res, bs.size() * COST_PER_BLOCK);
-
+      // full chunks come from the cache, and the partial one at the tip from the db,
+      // within the same limits find_blockchain_supplement applies
+      const bool compact = !get_scan_views && req.compact_output_indices;
+      std::vector<size_t> block_sizes, block_ntxes;
       size_t size = 0, ntxes = 0;
-      res.blocks.reserve(bs.size());
-      res.output_indices.reserve(bs.size());
-      res.asset_type_output_indices.reserve(bs.size());
-      for(auto& bd: bs)
-      {
-        res.blocks.resize(res.blocks.size()+1);
-        res.blocks.back().pruned = req.prune;
-        res.blocks.back().block = bd.first.first;
-        size += bd.first.first.size();
-        res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
-        res.asset_type_output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices());
-        ntxes += bd.second.size();
-        res.output_indices.back().indices.reserve(1 + bd.second.size());
-        res.asset_type_output_indices.back().indices.reserve(1 + bd.second.size());
-        if (req.no_miner_tx)
-        {
-          res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-          res.asset_type_output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_asset_type_output_indices());
-        }
-        res.blocks.back().txs.reserve(bd.second.size());
-        for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
-        {
-          res.blocks.back().txs.push_back({std::move(i->second), crypto::null_hash});
-          i->second.clear();
-          i->second.shrink_to_fit();
-          size += res.blocks.back().txs.back().blob.size();
-        }
-        const size_t n_txes_to_lookup = bd.second.size() + (req.no_miner_tx ? 0 : 1);
-        if (n_txes_to_lookup > 0)
+      uint64_t height = res.start_height;
+      const auto want_more = [&]() {
+        return height < res.current_height && res.blocks.size() < max_blocks && (res.blocks.size() < 3 || (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE && ntxes < COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT));
+      };
+      while (want_more())
+      {
+        const uint64_t chunk_start = height - height % GET_BLOCKS_CACHE_CHUNK_BLOCKS;
+        std::shared_ptr<const get_blocks_chunk> chunk;
+        if (chunk_start + GET_BLOCKS_CACHE_CHUNK_BLOCKS <= res.current_height)
+          chunk = get_cached_blocks_chunk(chunk_start, prune, req.no_miner_tx);
+        if (!chunk)
         {
-          std::vector<std::vector<std::pair<uint64_t, uint64_t>>> indices;
-          bool r = m_core.get_tx_outputs_gindexs(req.no_miner_tx ? bd.second.front().first : bd.first.second, n_txes_to_lookup, indices);
-          if (!r)
+          const size_t min_blocks = res.blocks.size() < 3 ? 3 - res.blocks.size() : 0;
+          bs.clear();
+          block_sizes.clear();
+          block_ntxes.clear();
+          if (!m_core.get_blockchain_storage().get_db().get_blocks_from(height, min_blocks, max_blocks - res.blocks.size(),
+              COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT - std::min<size_t>(ntxes, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT),
+              FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE - std::min<size_t>(size, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE), bs, prune, true, !req.no_miner_tx))
           {
             res.status = "Failed";
             return true;
           }
-          if (indices.size() != n_txes_to_lookup || res.output_indices.back().indices.size() != (req.no_miner_tx ? 1 : 0))
+          std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> output_indices;
+          std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> asset_type_output_indices;
+          if (!fill_get_blocks_entries(bs, prune, req.no_miner_tx, res.blocks, compact ? output_indices : res.output_indices,
+              compact ? asset_type_output_indices : res.asset_type_output_indices, block_sizes, block_ntxes))
           {
             res.status = "Failed";
             return true;
           }
-
-          LOG_PRINT_L1("COMMAND_RPC_GET_BLOCKS_FAST HAS " << indices.size() << " indices size");
-          for (size_t i = 0; i < indices.size(); ++i)
+          if (compact && !get_compact_output_indices_blobs(output_indices, asset_type_output_indices, res.compact_output_indices))
           {
-            cryptonote::rpc::tx_output_indices tx_indices;
-            cryptonote::rpc::tx_asset_type_output_indices tx_asset_type_output_indices;
-            for (size_t j = 0; j < indices[i].size(); ++j)
-            {
-              tx_indices.push_back(indices[i][j].first);
-              tx_asset_type_output_indices.push_back(indices[i][j].second);
-            }
-            res.output_indices.back().indices.push_back({std::move(tx_indices)});
-            res.asset_type_output_indices.back().indices.push_back({std::move(tx_asset_type_output_indices)});
+            res.status = "Failed to compact output indices";
+            return true;
+          }
+          for (size_t i = 0; i < block_sizes.size(); ++i)
+          {
+            size += block_sizes[i];
+            ntxes += block_ntxes[i];
           }
+          break;
         }
+        for (size_t i = height - chunk_start; i < chunk->blocks.size() && want_more(); ++i, ++height)
+        {
+          res.blocks.push_back(chunk->blocks[i]);
+          if (compact)
+          {
+            res.compact_output_indices.push_back(chunk->compact_output_indices[i]);
+          }
+          else
+          {
+            res.output_indices.push_back(chunk->output_indices[i]);
+            res.asset_type_output_indices.push_back(chunk->asset_type_output_indices[i]);
+          }
+          size += chunk->block_sizes[i];
+          ntxes += chunk->block_ntxes[i];
+        }
+      }
+
+      CHECK_PAYMENT_SAME_TS(req, res, res.blocks.size() * COST_PER_BLOCK);
+      MDEBUG("on_get_blocks: " << res.blocks.size() << " blocks, " << ntxes << " txes, size " << size);
+
+      if (get_scan_views && !get_blocks_scan_views(res, req.no_miner_tx))
+      {
+        res.status = "Failed to build scan views";
+        return true;
       }
-      MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, size " << size);
     }
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::fill_get_blocks_entries(std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> &bs, bool prune, bool no_miner_tx, std::vector<block_complete_entry> &blocks, std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &output_indices, std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<size_t> &block_sizes, std::vector<size_t> &block_ntxes)
+  {
+    blocks.reserve(blocks.size() + bs.size());
+    output_indices.reserve(output_indices.size() + bs.size());
+    asset_type_output_indices.reserve(asset_type_output_indices.size() + bs.size());
+    for(auto& bd: bs)
+    {
+      blocks.resize(blocks.size()+1);
+      blocks.back().pruned = prune;
+      blocks.back().block = bd.first.first;
+      size_t size = bd.first.first.size();
+      output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      asset_type_output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices());
+      output_indices.back().indices.reserve(1 + bd.second.size());
+      asset_type_output_indices.back().indices.reserve(1 + bd.second.size());
+      if (no_miner_tx)
+      {
+        output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+        asset_type_output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_asset_type_output_indices());
+      }
+      blocks.back().txs.reserve(bd.second.size());
+      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
+      {
+        blocks.back().txs.push_back({std::move(i->second), crypto::null_hash});
+        i->second.clear();
+        i->second.shrink_to_fit();
+        size += blocks.back().txs.back().blob.size();
+      }
+      block_sizes.push_back(size);
+      block_ntxes.push_back(bd.second.size());
+      const size_t n_txes_to_lookup = bd.second.size() + (no_miner_tx ? 0 : 1);
+      if (n_txes_to_lookup > 0)
+      {
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> indices;
+        bool r = m_core.get_tx_outputs_gindexs(no_miner_tx ? bd.second.front().first : bd.first.second, n_txes_to_lookup, indices);
+        if (!r)
+          return false;
+        if (indices.size() != n_txes_to_lookup || output_indices.back().indices.size() != (no_miner_tx ? 1 : 0))
+          return false;
+
+        LOG_PRINT_L1("COMMAND_RPC_GET_BLOCKS_FAST HAS " << indices.size() << " indices size");
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+          cryptonote::rpc::tx_output_indices tx_indices;
+          cryptonote::rpc::tx_asset_type_output_indices tx_asset_type_output_indices;
+          for (size_t j = 0; j < indices[i].size(); ++j)
+          {
+            tx_indices.push_back(indices[i][j].first);
+            tx_asset_type_output_indices.push_back(indices[i][j].second);
+          }
+          output_indices.back().indices.push_back({std::move(tx_indices)});
+          asset_type_output_indices.back().indices.push_back({std::move(tx_asset_type_output_indices)});
+        }
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_blocks_scan_views(COMMAND_RPC_GET_BLOCKS_FAST::response& res, bool no_miner_tx)
+  {
+    // the views take the place of the txes and output indices, with the
+    // miner tx's first as in output_indices, empty if it was not asked for
+    res.scan_views.resize(res.blocks.size());
+    for (size_t i = 0; i < res.blocks.size(); ++i)
+    {
+      block_complete_entry &bce = res.blocks[i];
+      const auto &indices = res.output_indices[i].indices;
+      const auto &asset_type_indices = res.asset_type_output_indices[i].indices;
+      CHECK_AND_ASSERT_MES(indices.size() == bce.txs.size() + 1 && asset_type_indices.size() == bce.txs.size() + 1, false, "Mismatched txes and output indices");
+      std::vector<tx_scan_view> views(bce.txs.size() + 1);
+      if (!no_miner_tx)
+      {
+        block b;
+        CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(bce.block, b), false, "Failed to parse block");
+        CHECK_AND_ASSERT_MES(get_tx_scan_view(b.miner_tx, indices[0].indices, asset_type_indices[0].indices, views[0]), false, "Failed to get miner tx scan view");
+      }
+      for (size_t j = 0; j < bce.txs.size(); ++j)
+      {
+        transaction tx;
+        CHECK_AND_ASSERT_MES(parse_and_validate_tx_base_from_blob(bce.txs[j].blob, tx), false, "Failed to parse tx");
+        CHECK_AND_ASSERT_MES(get_tx_scan_view(tx, indices[j + 1].indices, asset_type_indices[j + 1].indices, views[j + 1]), false, "Failed to get tx scan view");
+      }
+      block_scan_view block_view;
+      get_block_scan_view(views, block_view);
+      CHECK_AND_ASSERT_MES(::serialization::dump_binary(block_view, res.scan_views[i]), false, "Failed to serialize scan view");
+      bce.txs.clear();
+      bce.pruned = true;
+    }
+    res.output_indices.clear();
+    res.asset_type_output_indices.clear();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_compact_output_indices_blobs(const std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &output_indices, const std::vector<COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<std::string> &blobs)
+  {
+    CHECK_AND_ASSERT_MES(output_indices.size() == asset_type_output_indices.size(), false, "Mismatched output indices and asset type output indices");
+    blobs.reserve(blobs.size() + output_indices.size());
+    std::vector<std::vector<uint64_t>> indices, asset_type_indices;
+    for (size_t i = 0; i < output_indices.size(); ++i)
+    {
+      indices.clear();
+      asset_type_indices.clear();
+      for (const auto &tx_indices: output_indices[i].indices)
+        indices.push_back(tx_indices.indices);
+      for (const auto &tx_indices: asset_type_output_indices[i].indices)
+        asset_type_indices.push_back(tx_indices.indices);
+      compact_output_indices compact;
+      CHECK_AND_ASSERT_MES(get_compact_output_indices(indices, asset_type_indices, compact), false, "Failed to compact output indices");
+      blobs.emplace_back();
+      CHECK_AND_ASSERT_MES(::serialization::dump_binary(compact, blobs.back()), false, "Failed to serialize compact output indices");
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::run_json_rpc_batch(std::vector<std::function<void()>> &jobs)
+  {
+    // each item is admitted as if it came alone, so the items can share the
+    // server threads the worker classes are counted in, like separate calls
+    epee::json_rpc::run_batch_concurrently(jobs, [this](std::function<void()> job) {
+      m_net_server.get_io_service().post(std::move(job));
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<const core_rpc_server::get_blocks_chunk> core_rpc_server::get_cached_blocks_chunk(uint64_t start_height, bool prune, bool no_miner_tx)
+  {
+    // a reorg changes the hash of every block after the split, so checking the
+    // last block of the chunk is enough to drop stale entries
+    const uint64_t top_height = start_height + GET_BLOCKS_CACHE_CHUNK_BLOCKS - 1;
+    const crypto::hash top_hash = m_core.get_block_id_by_height(top_height);
+    if (top_hash == crypto::null_hash)
+      return nullptr;
+    const get_blocks_chunk_key key(start_height, prune, no_miner_tx);
+    std::shared_ptr<const get_blocks_chunk> cached;
+    if (m_get_blocks_cache.get(key, cached))
+    {
+      if (cached->top_hash == top_hash)
+        return cached;
+      m_get_blocks_cache.remove(key);
+    }
+
+    // concurrent misses on the same chunk may both build it, the last one wins
+    std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> bs;
+    try
+    {
+      if (!m_core.get_blockchain_storage().get_db().get_blocks_from(start_height, GET_BLOCKS_CACHE_CHUNK_BLOCKS, GET_BLOCKS_CACHE_CHUNK_BLOCKS,
+          std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max(), bs, prune, true, !no_miner_tx))
+        return nullptr;
+    }
+    catch (const std::exception &e)
+    {
+      MDEBUG("Failed to get blocks from " << start_height << " for the get_blocks cache: " << e.what());
+      return nullptr;
+    }
+    if (bs.size() != GET_BLOCKS_CACHE_CHUNK_BLOCKS)
+      return nullptr;
+
+    // the chain may have moved on since top_hash was read
+    auto chunk = std::make_shared<get_blocks_chunk>();
+    cryptonote::block b;
+    if (!cryptonote::parse_and_validate_block_from_blob(bs.back().first.first, b, chunk->top_hash) || chunk->top_hash != top_hash)
+      return nullptr;
+    if (!fill_get_blocks_entries(bs, prune, no_miner_tx, chunk->blocks, chunk->output_indices, chunk->asset_type_output_indices, chunk->block_sizes, chunk->block_ntxes))
+      return nullptr;
+    if (!get_compact_output_indices_blobs(chunk->output_indices, chunk->asset_type_output_indices, chunk->compact_output_indices))
+      return nullptr;
+    if (m_core.get_block_id_by_height(top_height) != top_hash)
+      return nullptr;
+    chunk->size = 0;
+    for (size_t block_size: chunk->block_sizes)
+      chunk->size += block_size;
+    for (const std::string &blob: chunk->compact_output_indices)
+      chunk->size += blob.size();
+
+    m_get_blocks_cache.add(key, chunk);
+    return chunk;
   }
     bool core_rpc_server::on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res, const connection_context *ctx)
     {
@@ -1336,6 +1613,38 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_is_key_image_spent_bin(const COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response& res, const connection_context *ctx)
+  {
+    RPC_TRACKER(is_key_image_spent_bin);
+    bool ok;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN>(invoke_http_mode::BIN, "/is_key_image_spent.bin", req, res, ok))
+      return ok;
+
+    const bool restricted = m_restricted && ctx;
+    if (restricted && req.key_images.size() > RESTRICTED_SPENT_KEY_IMAGES_COUNT)
+    {
+      res.status = "Too many key images queried in restricted mode";
+      return true;
+    }
+
+    CHECK_PAYMENT_MIN1(req, res, req.key_images.size() * COST_PER_KEY_IMAGE, false);
+
+    std::vector<bool> spent_status, spent_in_pool;
+    if (!m_core.are_key_images_spent(req.key_images, spent_status) || !m_core.are_key_images_spent_in_pool(req.key_images, spent_in_pool))
+    {
+      res.status = "Failed";
+      return true;
+    }
+    res.spent_status.clear();
+    res.spent_status.reserve(spent_status.size());
+    for (size_t n = 0; n < spent_status.size(); ++n)
+      res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN :
+          spent_in_pool[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res, const connection_context *ctx)
   {
     RPC_TRACKER(send_raw_tx);
@@ -1365,6 +1674,13 @@ namespace cryptonote
       CHECK_CORE_READY();
     }
 
+    if (m_core.is_read_only_replica())
+    {
+      res.status = "Failed";
+      res.reason = "Daemon is a read-only replica, send transactions to its primary daemon";
+      return true;
+    }
+
     CHECK_PAYMENT_MIN1(req, res, COST_PER_TX_RELAY, false);
 
     std::string tx_blob;
@@ -1877,10 +2193,10 @@ namespace cryptonote
     return 0;
   }
   //------------------------------------------------------------------------------------------------------------------------------
-  bool core_rpc_server::get_block_template(const account_public_address &address, const crypto::hash *prev_block, const cryptonote::blobdata &extra_nonce, size_t &reserved_offset, cryptonote::difficulty_type  &difficulty, uint64_t &height, uint64_t &expected_reward, block &b, uint64_t &seed_height, crypto::hash &seed_hash, crypto::hash &next_seed_hash, epee::json_rpc::error &error_resp)
+  bool core_rpc_server::get_block_template(const account_public_address &address, const crypto::hash *prev_block, const cryptonote::blobdata &extra_nonce, size_t &reserved_offset, cryptonote::difficulty_type  &difficulty, uint64_t &height, uint64_t &expected_reward, block &b, uint64_t &seed_height, crypto::hash &seed_hash, crypto::hash &next_seed_hash, epee::json_rpc::error &error_resp, bool use_cache)
   {
     b = boost::value_initialized<cryptonote::block>();
-    if(!m_core.get_block_template(b, prev_block, address, difficulty, height, expected_reward, extra_nonce, seed_height, seed_hash))
+    if(!m_core.get_block_template(b, prev_block, address, difficulty, height, expected_reward, extra_nonce, seed_height, seed_hash, use_cache))
     {
       error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
       error_resp.message = "Internal error: failed to create block template";
@@ -1936,6 +2252,31 @@ namespace cryptonote
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GETBLOCKTEMPLATE>(invoke_http_mode::JON_RPC, "getblocktemplate", req, res, r))
       return r;
 
+    return fill_block_template_response(req, res, error_resp, false);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_getblocktemplate_long_poll(const COMMAND_RPC_GETBLOCKTEMPLATE::request& req, COMMAND_RPC_GETBLOCKTEMPLATE::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(getblocktemplate_long_poll);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GETBLOCKTEMPLATE>(invoke_http_mode::JON_RPC, "get_block_template_long_poll", req, res, r))
+      return r;
+
+    return fill_block_template_response(req, res, error_resp, true);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::build_long_poll_template(const account_public_address &address, const cryptonote::blobdata &extra_nonce, bool fresh, block_template_long_poll::block_template &t)
+  {
+    if (!check_core_ready())
+      return false;
+    // a fresh template bypasses the cache, rather than dropping the template
+    // ordinary get_block_template callers are being served from
+    epee::json_rpc::error error_resp;
+    return get_block_template(address, NULL, extra_nonce, t.reserved_offset, t.difficulty, t.height, t.expected_reward, t.b, t.seed_height, t.seed_hash, t.next_seed_hash, error_resp, !fresh);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::fill_block_template_response(const COMMAND_RPC_GETBLOCKTEMPLATE::request& req, COMMAND_RPC_GETBLOCKTEMPLATE::response& res, epee::json_rpc::error& error_resp, bool long_poll)
+  {
     if(!check_core_ready())
     {
       error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
@@ -2005,9 +2346,42 @@ namespace cryptonote
       }
     }
     crypto::hash seed_hash, next_seed_hash;
-    if (!get_block_template(info.address, req.prev_block.empty() ? NULL : &prev_block, blob_reserve, reserved_offset, wdiff, res.height, res.expected_reward, b, res.seed_height, seed_hash, next_seed_hash, error_resp))
+    bool waited = false;
+    if (long_poll && !req.long_poll_id.empty())
+    {
+      if (!req.prev_block.empty())
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "Cannot specify both a prev_block and a long_poll_id";
+        return false;
+      }
+      block_template_long_poll::template_key key;
+      if (!block_template_long_poll::parse_id(req.long_poll_id, key))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "Invalid long_poll_id";
+        return false;
+      }
+      const uint64_t timeout = std::min<uint64_t>(req.long_poll_timeout ? req.long_poll_timeout : BLOCK_TEMPLATE_LONG_POLL_DEFAULT_TIMEOUT, BLOCK_TEMPLATE_LONG_POLL_MAX_TIMEOUT);
+      block_template_long_poll::block_template t;
+      waited = m_block_template_long_poll->wait(info.address, blob_reserve, key, req.long_poll_fee_threshold, std::chrono::seconds(timeout), t);
+      if (waited)
+      {
+        b = std::move(t.b);
+        wdiff = t.difficulty;
+        res.height = t.height;
+        res.expected_reward = t.expected_reward;
+        res.seed_height = t.seed_height;
+        seed_hash = t.seed_hash;
+        next_seed_hash = t.next_seed_hash;
+        reserved_offset = t.reserved_offset;
+      }
+    }
+    if (!waited && !get_block_template(info.address, req.prev_block.empty() ? NULL : &prev_block, blob_reserve, reserved_offset, wdiff, res.height, res.expected_reward, b, res.seed_height, seed_hash, next_seed_hash, error_resp))
       return false;
-    
+    if (long_poll)
+      res.long_poll_id = block_template_long_poll::get_id({b.prev_id, b.pricing_record.timestamp, res.expected_reward});
+
     res.seed_hash = string_tools::pod_to_hex(seed_hash);
     if (seed_hash != next_seed_hash)
       res.next_seed_hash = string_tools::pod_to_hex(next_seed_hash);
@@ -2247,6 +2621,12 @@ namespace cryptonote
         return false;
       }
     }
+    if (m_core.is_read_only_replica())
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_RESTRICTED;
+      error_resp.message = "Daemon is a read-only replica, submit blocks to its primary daemon";
+      return false;
+    }
     CHECK_CORE_READY();
     if(req.size()!=1)
     {
@@ -2404,6 +2784,29 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::fill_block_header_response(const Blockchain::block_header_record& record, block_header_response& response)
+  {
+    PERF_TIMER(fill_block_header_response);
+    response.major_version = record.major_version;
+    response.minor_version = record.minor_version;
+    response.timestamp = record.timestamp;
+    response.prev_hash = string_tools::pod_to_hex(record.prev_id);
+    response.nonce = record.nonce;
+    response.pricing_record = record.pricing_record;
+    response.orphan_status = false;
+    response.height = record.height;
+    response.depth = m_core.get_current_blockchain_height() - record.height - 1;
+    response.hash = string_tools::pod_to_hex(record.hash);
+    store_difficulty(record.difficulty, response.difficulty, response.wide_difficulty, response.difficulty_top64);
+    store_difficulty(record.cumulative_difficulty, response.cumulative_difficulty, response.wide_cumulative_difficulty, response.cumulative_difficulty_top64);
+    response.reward = record.reward;
+    response.block_size = response.block_weight = record.weight;
+    response.num_txes = record.num_txes;
+    response.pow_hash = "";
+    response.long_term_weight = record.long_term_weight;
+    response.miner_tx_hash = string_tools::pod_to_hex(record.miner_tx_hash);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   template <typename COMMAND_TYPE>
   bool core_rpc_server::use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r)
   {
@@ -2507,6 +2910,14 @@ namespace cryptonote
     uint64_t last_block_height;
     crypto::hash last_block_hash;
     m_core.get_blockchain_top(last_block_height, last_block_hash);
+    const bool restricted = m_restricted && ctx;
+    Blockchain::block_header_record record;
+    if (!(req.fill_pow_hash && !restricted) && m_core.get_blockchain_storage().get_block_header_record(last_block_hash, record))
+    {
+      fill_block_header_response(record, res.block_header);
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
     block last_block;
     bool have_last_block = m_core.get_block_by_hash(last_block_hash, last_block);
     if (!have_last_block)
@@ -2515,7 +2926,6 @@ namespace cryptonote
       error_resp.message = "Internal error: can't get last block.";
       return false;
     }
-    const bool restricted = m_restricted && ctx;
     bool response_filled = fill_block_header_response(last_block, false, last_block_height, last_block_hash, res.block_header, req.fill_pow_hash && !restricted);
     if (!response_filled)
     {
@@ -2553,6 +2963,12 @@ namespace cryptonote
         error_resp.message = "Failed to parse hex representation of block hash. Hex = " + hash + '.';
         return false;
       }
+      Blockchain::block_header_record record;
+      if (!(fill_pow_hash && !restricted) && m_core.get_blockchain_storage().get_block_header_record(block_hash, record))
+      {
+        fill_block_header_response(record, block_header);
+        return true;
+      }
       block blk;
       bool orphan = false;
       bool have_block = m_core.get_block_by_hash(block_hash, blk, &orphan);
@@ -2621,6 +3037,13 @@ namespace cryptonote
     CHECK_PAYMENT_MIN1(req, res, (req.end_height - req.start_height + 1) * COST_PER_BLOCK_HEADER, false);
     for (uint64_t h = req.start_height; h <= req.end_height; ++h)
     {
+      Blockchain::block_header_record record;
+      if (!(req.fill_pow_hash && !restricted) && m_core.get_blockchain_storage().get_block_header_record(h, record))
+      {
+        res.headers.push_back(block_header_response());
+        fill_block_header_response(record, res.headers.back());
+        continue;
+      }
       crypto::hash block_hash = m_core.get_block_id_by_height(h);
       block blk;
       bool have_block = m_core.get_block_by_hash(block_hash, blk);
@@ -2670,6 +3093,14 @@ namespace cryptonote
       return false;
     }
     CHECK_PAYMENT_MIN1(req, res, COST_PER_BLOCK_HEADER, false);
+    const bool restricted = m_restricted && ctx;
+    Blockchain::block_header_record record;
+    if (!(req.fill_pow_hash && !restricted) && m_core.get_blockchain_storage().get_block_header_record(req.height, record))
+    {
+      fill_block_header_response(record, res.block_header);
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
     crypto::hash block_hash = m_core.get_block_id_by_height(req.height);
     block blk;
     bool have_block = m_core.get_block_by_hash(block_hash, blk);
@@ -2679,7 +3110,6 @@ namespace cryptonote
       error_resp.message = "Internal error: can't get block by height. Height = " + std::to_string(req.height) + '.';
       return false;
     }
-    const bool restricted = m_restricted && ctx;
     bool response_filled = fill_block_header_response(blk, false, req.height, block_hash, res.block_header, req.fill_pow_hash && !restricted);
     if (!response_filled)
     {
@@ -3890,6 +4320,30 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_rpc_worker_stats(const COMMAND_RPC_GET_RPC_WORKER_STATS::request& req, COMMAND_RPC_GET_RPC_WORKER_STATS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_rpc_worker_stats);
+
+    std::vector<rpc_workers::class_stats> classes;
+    std::map<std::string, rpc_workers::method_stats> methods;
+    m_workers.get_stats(classes, methods);
+    if (req.clear)
+      m_workers.clear_stats();
+
+    for (const auto &c: classes)
+    {
+      res.classes.push_back({c.name, c.limits.concurrency, c.limits.queue, c.active, c.queued, c.count, c.rejected});
+    }
+    for (const auto &m: methods)
+    {
+      res.methods.push_back({m.first, rpc_workers::get_class_name(m.second.wclass), m.second.count, m.second.rejected,
+          m.second.queue_time, m.second.max_queue_time, m.second.service_time, m.second.max_service_time});
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_rpc_access_data(const COMMAND_RPC_ACCESS_DATA::request& req, COMMAND_RPC_ACCESS_DATA::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(rpc_access_data);
@@ -4016,4 +4470,16 @@ namespace cryptonote
     , "Allow free access from the loopback address (ie, the local host)"
     , false
     };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_max_threads = {
+      "rpc-max-threads"
+    , "Most threads each RPC server runs, 0 for as many as its worker classes let run or wait at once"
+    , 0
+    };
+
+  const command_line::arg_descriptor<std::vector<std::string>> core_rpc_server::arg_rpc_worker_class = {
+      "rpc-worker-class"
+    , "Set how many calls of an RPC worker class (priority, standard, slow or long_poll) may run at once, and optionally how many more may wait, as <class>=<concurrency>[:<queue>]. "
+      "Calls beyond the queue are turned away as busy; only long_poll has a queue limit by default, so other calls wait for their turn"
+    };
 }  // namespace cryptonote
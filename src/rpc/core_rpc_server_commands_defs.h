@@ -88,7 +88,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 13
+#define CORE_RPC_VERSION_MINOR 19
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -166,7 +166,10 @@ namespace cryptonote
     {
       BLOCKS_ONLY = 0,
       BLOCKS_AND_POOL = 1,
-      POOL_ONLY = 2
+      POOL_ONLY = 2,
+      // blocks without their txes, with a serialized block_scan_view each instead
+      SCAN_VIEW_ONLY = 3,
+      SCAN_VIEW_AND_POOL = 4
     };
 
     struct request_t: public rpc_access_request_base
@@ -177,6 +180,7 @@ namespace cryptonote
       bool        prune;
       bool        no_miner_tx;
       uint64_t    pool_info_since;
+      bool        compact_output_indices;
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_request_base)
         KV_SERIALIZE_OPT(requested_info, (uint8_t)0)
@@ -185,6 +189,7 @@ namespace cryptonote
         KV_SERIALIZE(prune)
         KV_SERIALIZE_OPT(no_miner_tx, false)
         KV_SERIALIZE_OPT(pool_info_since, (uint64_t)0)
+        KV_SERIALIZE_OPT(compact_output_indices, false)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -257,6 +262,8 @@ namespace cryptonote
       std::vector<pool_tx_info> added_pool_txs;
       std::vector<crypto::hash> remaining_added_pool_txids;
       std::vector<crypto::hash> removed_pool_txids;
+      std::vector<blobdata> scan_views;
+      std::vector<blobdata> compact_output_indices;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_response_base)
@@ -276,6 +283,8 @@ namespace cryptonote
         {
           KV_SERIALIZE_CONTAINER_POD_AS_BLOB(removed_pool_txids)
         }
+        KV_SERIALIZE_OPT(scan_views, std::vector<blobdata>())
+        KV_SERIALIZE_OPT(compact_output_indices, std::vector<blobdata>())
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -505,6 +514,32 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  //-----------------------------------------------
+  struct COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN
+  {
+    struct request_t: public rpc_access_request_base
+    {
+      std::vector<crypto::key_image> key_images;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_access_request_base)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct response_t: public rpc_access_response_base
+    {
+      std::vector<uint8_t> spent_status; // COMMAND_RPC_IS_KEY_IMAGE_SPENT::STATUS, one per key image
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_access_response_base)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(spent_status)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES
   {
@@ -1001,6 +1036,10 @@ namespace cryptonote
       std::string wallet_address;
       std::string prev_block;
       std::string extra_nonce;
+      // get_block_template_long_poll: waits while the template is like the one this came with
+      std::string long_poll_id;
+      uint64_t long_poll_timeout; // seconds
+      uint64_t long_poll_fee_threshold; // smallest rise in the reward to wake up for
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_request_base)
@@ -1008,6 +1047,9 @@ namespace cryptonote
         KV_SERIALIZE(wallet_address)
         KV_SERIALIZE(prev_block)
         KV_SERIALIZE(extra_nonce)
+        KV_SERIALIZE_OPT(long_poll_id, std::string())
+        KV_SERIALIZE_OPT(long_poll_timeout, (uint64_t)0)
+        KV_SERIALIZE_OPT(long_poll_fee_threshold, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -1026,6 +1068,7 @@ namespace cryptonote
       std::string next_seed_hash;
       blobdata blocktemplate_blob;
       blobdata blockhashing_blob;
+      std::string long_poll_id;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
@@ -1041,6 +1084,7 @@ namespace cryptonote
         KV_SERIALIZE(blockhashing_blob)
         KV_SERIALIZE(seed_hash)
         KV_SERIALIZE(next_seed_hash)
+        KV_SERIALIZE(long_poll_id)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -1756,8 +1800,10 @@ namespace cryptonote
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
     uint32_t num_double_spends;
+    uint64_t ver_cache_hits;
+    uint64_t ver_cache_misses;
 
-    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0) {}
+    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0), ver_cache_hits(0), ver_cache_misses(0) {}
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1773,6 +1819,8 @@ namespace cryptonote
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE(histo)
       KV_SERIALIZE(num_double_spends)
+      KV_SERIALIZE_OPT(ver_cache_hits, (uint64_t)0)
+      KV_SERIALIZE_OPT(ver_cache_misses, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -2824,6 +2872,78 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  struct COMMAND_RPC_GET_RPC_WORKER_STATS
+  {
+    struct request_t: public rpc_request_base
+    {
+      bool clear;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_request_base)
+        KV_SERIALIZE_OPT(clear, false)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct worker_class
+    {
+      std::string name;
+      uint32_t max_concurrency;
+      uint32_t max_queue; // 4294967295 if calls are never turned away
+      uint32_t active;
+      uint32_t queued;
+      uint64_t count;
+      uint64_t rejected;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(max_concurrency)
+        KV_SERIALIZE(max_queue)
+        KV_SERIALIZE(active)
+        KV_SERIALIZE(queued)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(rejected)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    // times are in nanoseconds
+    struct method
+    {
+      std::string rpc;
+      std::string worker_class;
+      uint64_t count;
+      uint64_t rejected;
+      uint64_t queue_time;
+      uint64_t max_queue_time;
+      uint64_t service_time;
+      uint64_t max_service_time;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(rpc)
+        KV_SERIALIZE(worker_class)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(rejected)
+        KV_SERIALIZE(queue_time)
+        KV_SERIALIZE(max_queue_time)
+        KV_SERIALIZE(service_time)
+        KV_SERIALIZE(max_service_time)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response_t: public rpc_response_base
+    {
+      std::vector<worker_class> classes;
+      std::vector<method> methods;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_response_base)
+        KV_SERIALIZE(classes)
+        KV_SERIALIZE(methods)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
   struct COMMAND_RPC_ACCESS_DATA
   {
     struct request_t: public rpc_request_base
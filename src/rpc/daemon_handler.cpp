@@ -397,6 +397,13 @@ namespace rpc
       return;
     }
 
+    if (m_core.is_read_only_replica())
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "Daemon is a read-only replica, send transactions to its primary daemon";
+      return;
+    }
+
     tx_verification_context tvc = AUTO_VAL_INIT(tvc);
 
     if(!m_core.handle_incoming_tx({tx_blob, crypto::null_hash}, tvc, (relay ? relay_method::local : relay_method::none), false) || tvc.m_verifivation_failed)
@@ -0,0 +1,273 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <unordered_set>
+#include <boost/lexical_cast.hpp>
+#include "misc_log_ex.h"
+#include "common/perf_timer.h"
+#include "rpc_workers.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+// each call that may run or wait takes a server thread, so these are kept small. Calls only
+// get turned away once a queue limit is set, except long polls, which clients retry anyway
+#define DEFAULT_PRIORITY_CONCURRENCY 2
+#define DEFAULT_STANDARD_CONCURRENCY 4
+#define DEFAULT_SLOW_CONCURRENCY 2
+#define DEFAULT_LONG_POLL_CONCURRENCY 4
+#define DEFAULT_LONG_POLL_QUEUE 0
+
+namespace cryptonote
+{
+  namespace
+  {
+    // cheap calls, and those mining depends on
+    const std::unordered_set<std::string> priority_methods = {
+      "/get_height", "/getheight", "/get_info", "/getinfo", "get_info",
+      "get_block_count", "getblockcount", "on_get_block_hash", "on_getblockhash",
+      "get_block_template", "getblocktemplate", "get_miner_data", "add_aux_pow",
+      "submit_block", "submitblock", "get_last_block_header", "getlastblockheader",
+      "get_version", "hard_fork_info", "get_fee_estimate", "/metrics",
+    };
+
+    // calls whose cost grows with what they are asked for
+    const std::unordered_set<std::string> slow_methods = {
+      "/get_blocks.bin", "/getblocks.bin", "/get_blocks_by_height.bin", "/getblocks_by_height.bin",
+      "/get_hashes.bin", "/gethashes.bin", "/get_outs.bin", "/get_outs", "/get_transactions", "/gettransactions",
+      "/get_alt_blocks_hashes", "/get_transaction_pool", "/get_output_distribution.bin",
+      "get_output_distribution", "get_output_histogram", "get_pricing_record_history", "get_coinbase_tx_sum",
+      "get_block_headers_range", "getblockheadersrange", "get_txpool_backlog", "get_txids_loose",
+      "calc_pow", "generateblocks",
+    };
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  constexpr unsigned rpc_workers::no_queue_limit;
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::slot::slot(rpc_workers &workers, method_state &method):
+    m_workers(&workers), m_method(&method), m_start(tools::get_tick_count())
+  {
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::slot::slot(slot &&other) noexcept:
+    m_workers(other.m_workers), m_method(other.m_method), m_start(other.m_start)
+  {
+    other.m_workers = nullptr;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::slot::~slot()
+  {
+    if (m_workers)
+    {
+      const uint64_t service_time = tools::ticks_to_ns(tools::get_tick_count() - m_start);
+      m_method->service_seconds->observe(service_time / 1e9);
+      m_workers->release(*m_method, service_time);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::rpc_workers()
+  {
+    const class_limits defaults[num_worker_classes] = {
+      {DEFAULT_PRIORITY_CONCURRENCY, no_queue_limit},
+      {DEFAULT_STANDARD_CONCURRENCY, no_queue_limit},
+      {DEFAULT_SLOW_CONCURRENCY, no_queue_limit},
+      {DEFAULT_LONG_POLL_CONCURRENCY, DEFAULT_LONG_POLL_QUEUE},
+    };
+    for (int i = 0; i < num_worker_classes; ++i)
+    {
+      worker_class_state &state = m_classes[i];
+      state.limits = defaults[i];
+      state.active = 0;
+      state.queued = 0;
+      state.count = 0;
+      state.rejected = 0;
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  const char *rpc_workers::get_class_name(worker_class wclass)
+  {
+    switch (wclass)
+    {
+      case worker_class_priority: return "priority";
+      case worker_class_standard: return "standard";
+      case worker_class_slow: return "slow";
+      case worker_class_long_poll: return "long_poll";
+      default: return "unknown";
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::worker_class rpc_workers::get_worker_class(const std::string &method)
+  {
+    if (priority_methods.find(method) != priority_methods.end())
+      return worker_class_priority;
+    if (slow_methods.find(method) != slow_methods.end())
+      return worker_class_slow;
+    if (method == "get_block_template_long_poll")
+      return worker_class_long_poll;
+    return worker_class_standard;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_workers::set_limits(const std::string &spec)
+  {
+    const size_t eq = spec.find('=');
+    const size_t colon = eq == std::string::npos ? eq : spec.find(':', eq);
+    if (eq == std::string::npos)
+    {
+      MERROR("Invalid RPC worker class limits, expected <class>=<concurrency>[:<queue>]: " << spec);
+      return false;
+    }
+    const std::string name = spec.substr(0, eq);
+    int wclass = 0;
+    while (wclass < num_worker_classes && name != get_class_name((worker_class)wclass))
+      ++wclass;
+    CHECK_AND_ASSERT_MES(wclass < num_worker_classes, false, "Unknown RPC worker class: " << name);
+    // lexical_cast would take a sign, and wrap negative numbers around
+    const auto parse = [](const std::string &s, unsigned &value) {
+      return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos && boost::conversion::try_lexical_convert(s, value);
+    };
+    class_limits limits{0, no_queue_limit};
+    if (!parse(spec.substr(eq + 1, colon == std::string::npos ? colon : colon - eq - 1), limits.concurrency) ||
+        (colon != std::string::npos && !parse(spec.substr(colon + 1), limits.queue)))
+    {
+      MERROR("Invalid RPC worker class limits: " << spec);
+      return false;
+    }
+    CHECK_AND_ASSERT_MES(limits.concurrency > 0, false, "RPC worker class " << name << " must run at least one call at once");
+    set_limits((worker_class)wclass, limits);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_workers::set_limits(worker_class wclass, const class_limits &limits)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_classes[wclass].limits = limits;
+    m_classes[wclass].cond.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::class_limits rpc_workers::get_limits(worker_class wclass) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_classes[wclass].limits;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  unsigned rpc_workers::get_threads() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    unsigned threads = 0;
+    for (const worker_class_state &state: m_classes)
+      threads += state.limits.concurrency + (state.limits.queue == no_queue_limit ? state.limits.concurrency : state.limits.queue);
+    return threads;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_workers::set_server_name(const std::string &name)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_server_name = name;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_workers::slot rpc_workers::admit(const std::string &method)
+  {
+    tools::LoggingPerformanceTimer queue_timer("rpc_queue:" + method, "perf." MONERO_DEFAULT_LOG_CATEGORY, 1000000, tools::performance_timer_log_level);
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    auto it = m_methods.find(method);
+    if (it == m_methods.end())
+    {
+      const std::string labels = (m_server_name.empty() ? std::string() : tools::metrics::label("server", m_server_name) + ",")
+          + tools::metrics::label("method", method);
+      it = m_methods.emplace(method, method_state{method_stats{get_worker_class(method), 0, 0, 0, 0, 0, 0},
+        &tools::metrics::get_histogram("zephyr_rpc_queue_seconds", "Time RPC calls waited for their turn to run", tools::metrics::latency_buckets(), labels),
+        &tools::metrics::get_histogram("zephyr_rpc_request_seconds", "Time taken to serve RPC calls", tools::metrics::latency_buckets(), labels),
+        &tools::metrics::get_counter("zephyr_rpc_rejected_total", "RPC calls turned away because their class was busy", labels)}).first;
+    }
+    method_state &mstate = it->second;
+    method_stats &stats = mstate.stats;
+    worker_class_state &state = m_classes[stats.wclass];
+    if (state.active >= state.limits.concurrency)
+    {
+      if (state.limits.queue != no_queue_limit && state.queued >= state.limits.queue)
+      {
+        ++state.rejected;
+        ++stats.rejected;
+        mstate.rejected->inc();
+        MDEBUG("Turning away " << method << ", " << get_class_name(stats.wclass) << " RPC calls are all busy");
+        return slot();
+      }
+      ++state.queued;
+      while (state.active >= state.limits.concurrency)
+        state.cond.wait(lock);
+      --state.queued;
+    }
+    ++state.active;
+    ++state.count;
+    ++stats.count;
+    const uint64_t queue_time = queue_timer.value();
+    stats.queue_time += queue_time;
+    stats.max_queue_time = std::max(stats.max_queue_time, queue_time);
+    mstate.queue_seconds->observe(queue_time / 1e9);
+    return slot(*this, mstate);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_workers::release(method_state &method, uint64_t service_time)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    method_stats &stats = method.stats;
+    stats.service_time += service_time;
+    stats.max_service_time = std::max(stats.max_service_time, service_time);
+    worker_class_state &state = m_classes[stats.wclass];
+    --state.active;
+    state.cond.notify_one();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_workers::get_stats(std::vector<class_stats> &classes, std::map<std::string, method_stats> &methods) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    classes.clear();
+    for (int i = 0; i < num_worker_classes; ++i)
+    {
+      const worker_class_state &state = m_classes[i];
+      classes.push_back({get_class_name((worker_class)i), state.limits, state.active, state.queued, state.count, state.rejected});
+    }
+    methods.clear();
+    for (const auto &e: m_methods)
+      methods.emplace(e.first, e.second.stats);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_workers::clear_stats()
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    for (worker_class_state &state: m_classes)
+    {
+      state.count = 0;
+      state.rejected = 0;
+    }
+    // calls still running hold on to their entries
+    for (auto &e: m_methods)
+      e.second.stats = method_stats{e.second.stats.wclass, 0, 0, 0, 0, 0, 0};
+  }
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "common/metrics.h"
+
+namespace cryptonote
+{
+  /*! Splits RPC calls into classes, each with its own limit on how many of
+    its calls run at once, so a flood of slow calls cannot keep cheap and
+    mining calls from running. Calls beyond that wait for a turn. A class may
+    also limit how many calls wait, and turn away those beyond it; by default
+    only long polls do. A waiting call keeps its server thread, so with a
+    limited queue a flood of slow calls cannot hold all the server threads
+    either. get_threads() gives how many threads the classes need. Long polls
+    spend most of their time waiting for something to happen, so they have a
+    class of their own. */
+  class rpc_workers
+  {
+    struct method_state;
+
+  public:
+    enum worker_class
+    {
+      worker_class_priority,
+      worker_class_standard,
+      worker_class_slow,
+      worker_class_long_poll,
+      num_worker_classes
+    };
+
+    //! for calls beyond the concurrency of a class to always wait, rather than be turned away
+    static constexpr unsigned no_queue_limit = std::numeric_limits<unsigned>::max();
+
+    struct class_limits
+    {
+      unsigned concurrency;
+      unsigned queue;
+    };
+
+    struct class_stats
+    {
+      std::string name;
+      class_limits limits;
+      unsigned active;
+      unsigned queued;
+      uint64_t count;
+      uint64_t rejected;
+    };
+
+    //! times are in nanoseconds
+    struct method_stats
+    {
+      worker_class wclass;
+      uint64_t count;
+      uint64_t rejected;
+      uint64_t queue_time;
+      uint64_t max_queue_time;
+      uint64_t service_time;
+      uint64_t max_service_time;
+    };
+
+    //! A call's turn to run: it gives the turn back, and records how long the call took, when it goes
+    class slot
+    {
+    public:
+      slot() noexcept: m_workers(nullptr), m_method(nullptr), m_start(0) {}
+      slot(slot &&other) noexcept;
+      slot &operator=(slot &&other) = delete;
+      ~slot();
+
+      //! false if the call was turned away
+      explicit operator bool() const noexcept { return m_workers != nullptr; }
+
+    private:
+      friend class rpc_workers;
+      slot(rpc_workers &workers, method_state &method);
+
+      rpc_workers *m_workers;
+      method_state *m_method;
+      uint64_t m_start;
+    };
+
+    rpc_workers();
+
+    static const char *get_class_name(worker_class wclass);
+    //! takes both the URI ("/get_info") and JSON RPC ("get_info") names of a call
+    static worker_class get_worker_class(const std::string &method);
+
+    //! sets the limits of a class from "<class>=<concurrency>[:<queue>]", with no queue limit if left out
+    bool set_limits(const std::string &spec);
+    void set_limits(worker_class wclass, const class_limits &limits);
+    class_limits get_limits(worker_class wclass) const;
+    /*! how many calls may run or wait at once, over all classes. A class with
+      no queue limit counts as many waiting calls as it runs, calls beyond
+      those wait for a server thread */
+    unsigned get_threads() const;
+
+    //! waits for a turn to run a call, if its class has room for one more to wait
+    slot admit(const std::string &method);
+
+    //! names the server in the metrics labels, so each server has its own series
+    void set_server_name(const std::string &name);
+
+    void get_stats(std::vector<class_stats> &classes, std::map<std::string, method_stats> &methods) const;
+    void clear_stats();
+
+  private:
+    struct worker_class_state
+    {
+      class_limits limits;
+      unsigned active;
+      unsigned queued;
+      uint64_t count;
+      uint64_t rejected;
+      boost::condition_variable cond;
+    };
+
+    //! the metrics are looked up once per method, and kept across clear_stats
+    struct method_state
+    {
+      method_stats stats;
+      tools::metrics::histogram *queue_seconds;
+      tools::metrics::histogram *service_seconds;
+      tools::metrics::counter *rejected;
+    };
+
+    void release(method_state &method, uint64_t service_time);
+
+    mutable boost::mutex m_mutex;
+    worker_class_state m_classes[num_worker_classes];
+    std::unordered_map<std::string, method_state> m_methods;
+    std::string m_server_name;
+  };
+}
@@ -0,0 +1,227 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "misc_log_ex.h"
+#include "daemon_zmq_listener.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.zmq"
+
+namespace
+{
+  // the minimal variants, as only the fact that something happened is used
+  constexpr const char chain_topic[] = "json-minimal-chain_main";
+  constexpr const char pool_topic[] = "json-minimal-txpool_add";
+  constexpr const char *const topics[] = {chain_topic, pool_topic};
+  constexpr const char monitor_endpoint[] = "inproc://daemon_zmq_monitor";
+  constexpr const int max_message_size = 10 * 1024 * 1024; // 10 MiB
+  constexpr const int heartbeat_interval = 10000; // ms
+  constexpr const int heartbeat_timeout = 30000; // ms
+
+  bool set_option(void *socket, int option, int value)
+  {
+    return zmq_setsockopt(socket, option, &value, sizeof(value)) == 0;
+  }
+}
+
+namespace tools
+{
+  //----------------------------------------------------------------------------------------------------
+  daemon_zmq_listener::daemon_zmq_listener():
+    m_connected(false),
+    m_chain_news(true),
+    m_pool_news(false)
+  {
+  }
+  //----------------------------------------------------------------------------------------------------
+  daemon_zmq_listener::~daemon_zmq_listener()
+  {
+    stop();
+  }
+  //----------------------------------------------------------------------------------------------------
+  bool daemon_zmq_listener::start(const std::string &address, const std::string &proxy)
+  {
+    stop();
+
+    m_context.reset(zmq_init(1));
+    if (!m_context)
+    {
+      MONERO_LOG_ZMQ_ERROR("Unable to create ZMQ context");
+      return false;
+    }
+    net::zmq::socket sub{zmq_socket(m_context.get(), ZMQ_SUB)};
+    net::zmq::socket monitor{zmq_socket(m_context.get(), ZMQ_PAIR)};
+    if (!sub || !monitor)
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to create ZMQ socket");
+      return false;
+    }
+
+    const int64_t max_size = max_message_size;
+    if (zmq_setsockopt(sub.get(), ZMQ_MAXMSGSIZE, &max_size, sizeof(max_size)) != 0 || !set_option(sub.get(), ZMQ_LINGER, 0) || !set_option(monitor.get(), ZMQ_LINGER, 0))
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to set ZMQ socket options");
+      return false;
+    }
+#ifdef ZMQ_HEARTBEAT_IVL
+    // a daemon that goes away without closing the connection is otherwise never noticed
+    if (!set_option(sub.get(), ZMQ_HEARTBEAT_IVL, heartbeat_interval) || !set_option(sub.get(), ZMQ_HEARTBEAT_TIMEOUT, heartbeat_timeout))
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to set ZMQ heartbeats");
+      return false;
+    }
+#endif
+    if (!proxy.empty() && zmq_setsockopt(sub.get(), ZMQ_SOCKS_PROXY, proxy.data(), proxy.size()) != 0)
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to set ZMQ socks proxy");
+      return false;
+    }
+    for (const char *topic: topics)
+    {
+      if (zmq_setsockopt(sub.get(), ZMQ_SUBSCRIBE, topic, std::strlen(topic)) != 0)
+      {
+        MONERO_LOG_ZMQ_ERROR("Failed to subscribe to " << topic);
+        return false;
+      }
+    }
+    if (zmq_socket_monitor(sub.get(), monitor_endpoint, ZMQ_EVENT_CONNECTED | ZMQ_EVENT_DISCONNECTED) != 0 || zmq_connect(monitor.get(), monitor_endpoint) != 0)
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to monitor ZMQ socket");
+      return false;
+    }
+    if (zmq_connect(sub.get(), address.c_str()) != 0)
+    {
+      MONERO_LOG_ZMQ_ERROR("Failed to connect to daemon ZMQ pub at " << address);
+      return false;
+    }
+
+    m_address = address;
+    m_proxy = proxy;
+    m_connected = false;
+    m_chain_news = true;
+    m_pool_news = false;
+    m_sub = std::move(sub);
+    m_monitor = std::move(monitor);
+    m_thread = boost::thread(&daemon_zmq_listener::run, this);
+    MINFO("Listening to daemon ZMQ pub at " << address);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void daemon_zmq_listener::stop()
+  {
+    m_context.reset(); // destroying context terminates all calls
+    if (m_thread.joinable())
+      m_thread.join();
+    m_address.clear();
+    m_proxy.clear();
+    m_connected = false;
+    m_chain_news = true;
+    m_pool_news = false;
+  }
+  //----------------------------------------------------------------------------------------------------
+  void daemon_zmq_listener::run()
+  {
+    try
+    {
+      // socket must close before `zmq_term` will exit.
+      const net::zmq::socket sub = std::move(m_sub);
+      const net::zmq::socket monitor = std::move(m_monitor);
+
+      std::array<zmq_pollitem_t, 2> sockets =
+      {{
+        {sub.get(), 0, ZMQ_POLLIN, 0},
+        {monitor.get(), 0, ZMQ_POLLIN, 0}
+      }};
+
+      while (1)
+      {
+        MONERO_UNWRAP(net::zmq::retry_op(zmq_poll, sockets.data(), sockets.size(), -1));
+
+        if (sockets[0].revents)
+        {
+          const expect<std::string> message = net::zmq::receive(sub.get(), ZMQ_DONTWAIT);
+          if (!message)
+          {
+            if (message != net::zmq::make_error_code(EAGAIN))
+              MONERO_THROW(message.error(), "Read failure on daemon ZMQ pub");
+          }
+          else
+          {
+            const std::string topic = message->substr(0, message->find(':'));
+            MDEBUG("Daemon announced " << topic);
+            if (topic == chain_topic)
+              m_chain_news = true;
+            else if (topic == pool_topic)
+              m_pool_news = true;
+          }
+        }
+
+        if (sockets[1].revents)
+        {
+          // a 16 bit event and a 32 bit value, then the endpoint
+          const expect<std::string> event = net::zmq::receive(monitor.get(), ZMQ_DONTWAIT);
+          if (!event)
+          {
+            if (event != net::zmq::make_error_code(EAGAIN))
+              MONERO_THROW(event.error(), "Read failure on daemon ZMQ pub monitor");
+          }
+          else if (event->size() >= sizeof(uint16_t))
+          {
+            uint16_t id;
+            std::memcpy(&id, event->data(), sizeof(id));
+            if (id == ZMQ_EVENT_CONNECTED)
+            {
+              MINFO("Connected to daemon ZMQ pub");
+              m_connected = true;
+              m_chain_news = true;
+            }
+            else if (id == ZMQ_EVENT_DISCONNECTED)
+            {
+              MWARNING("Lost connection to daemon ZMQ pub, polling the daemon until it is back");
+              m_connected = false;
+            }
+          }
+        }
+      }
+    }
+    catch (const std::system_error& e)
+    {
+      if (e.code() != net::zmq::make_error_code(ETERM))
+        MERROR("Daemon ZMQ pub listener error: " << e.what());
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Daemon ZMQ pub listener error: " << e.what());
+    }
+    m_connected = false;
+  }
+}
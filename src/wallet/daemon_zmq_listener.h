@@ -0,0 +1,81 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <boost/thread/thread.hpp>
+
+#include "net/zmq.h"
+
+namespace tools
+{
+  /*! Subscribes to the new block and pool tx notifications a daemon publishes
+    over ZMQ (at its `--zmq-pub` address), so a wallet can refresh when there
+    is something new rather than asking the daemon every so often. ZMQ keeps
+    reconnecting by itself; while the daemon is not connected, notifications
+    may be missed, and callers should poll the daemon as they would without. */
+  class daemon_zmq_listener
+  {
+  public:
+    daemon_zmq_listener();
+    ~daemon_zmq_listener();
+
+    daemon_zmq_listener(const daemon_zmq_listener&) = delete;
+    daemon_zmq_listener& operator=(const daemon_zmq_listener&) = delete;
+
+    /*! Starts listening to the daemon at `address` (e.g. tcp://127.0.0.1:<port>),
+      through the socks `proxy` (<ip>:<port>) if not empty. */
+    bool start(const std::string &address, const std::string &proxy = std::string());
+    void stop();
+
+    const std::string &address() const noexcept { return m_address; }
+    const std::string &proxy() const noexcept { return m_proxy; }
+    //! whether the daemon is connected, so its notifications can be relied upon
+    bool connected() const noexcept { return m_connected; }
+    /*! whether a block was announced since the last call, or the daemon
+      connected, as whatever it announced before that was missed */
+    bool take_chain_news() noexcept { return m_chain_news.exchange(false); }
+    //! whether a pool tx was announced since the last call
+    bool take_pool_news() noexcept { return m_pool_news.exchange(false); }
+
+  private:
+    void run();
+
+    std::string m_address;
+    std::string m_proxy;
+    net::zmq::context m_context;
+    net::zmq::socket m_sub;
+    net::zmq::socket m_monitor;
+    boost::thread m_thread;
+    std::atomic<bool> m_connected;
+    std::atomic<bool> m_chain_news;
+    std::atomic<bool> m_pool_news;
+  };
+}
@@ -59,6 +59,8 @@ using namespace epee;
 #include "rpc/core_rpc_server_error_codes.h"
 #include "misc_language.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/compact_output_indices.h"
+#include "cryptonote_basic/scan_view.h"
 #include "multisig/multisig.h"
 #include "multisig/multisig_account.h"
 #include "multisig/multisig_kex_msg.h"
@@ -87,6 +89,7 @@ using namespace epee;
 #include "common/perf_timer.h"
 #include "ringct/rctSigs.h"
 #include "ringdb.h"
+#include "daemon_zmq_listener.h"
 #include "device/device_cold.hpp"
 #include "device_trezor/device_trezor.hpp"
 #include "net/socks_connect.h"
@@ -276,6 +279,7 @@ struct options {
   const command_line::arg_descriptor<bool> offline = {"offline", tools::wallet2::tr("Do not connect to a daemon, nor use DNS"), false};
   const command_line::arg_descriptor<std::string> extra_entropy = {"extra-entropy", tools::wallet2::tr("File containing extra entropy to initialize the PRNG (any data, aim for 256 bits of entropy to be useful, which typically means more than 256 bits of data)")};
   const command_line::arg_descriptor<bool> allow_mismatched_daemon_version = {"allow-mismatched-daemon-version", tools::wallet2::tr("Allow communicating with a daemon that uses a different version"), false};
+  const command_line::arg_descriptor<std::string> daemon_zmq_pub = {"daemon-zmq-pub", tools::wallet2::tr("Listen to the daemon's ZMQ pub socket at <arg> (its --zmq-pub address) for new blocks and pool txes, rather than polling the daemon while it is connected"), ""};
 };
 
 void do_prepare_file_names(const std::string& file_path, std::string& keys_file, std::string& wallet_file, std::string &mms_file)
@@ -488,6 +492,13 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
   if (command_line::has_arg(vm, opts.allow_mismatched_daemon_version))
     wallet->allow_mismatched_daemon_version(true);
 
+  const std::string daemon_zmq_pub = command_line::get_arg(vm, opts.daemon_zmq_pub);
+  if (!daemon_zmq_pub.empty() && !command_line::get_arg(vm, opts.offline))
+  {
+    THROW_WALLET_EXCEPTION_IF(!wallet->set_daemon_zmq_pub(daemon_zmq_pub), tools::error::wallet_internal_error,
+      std::string(tools::wallet2::tr("Failed to listen to the daemon ZMQ pub socket at ")) + daemon_zmq_pub);
+  }
+
   try
   {
     if (!command_line::is_arg_defaulted(vm, opts.tx_notify))
@@ -1199,6 +1210,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, std
   m_ignore_outputs_above(MONEY_SUPPLY),
   m_ignore_outputs_below(0),
   m_track_uses(false),
+  m_scan_view_refresh(true),
   m_show_wallet_name_when_locked(false),
   m_inactivity_lock_timeout(DEFAULT_INACTIVITY_LOCK_TIMEOUT),
   m_setup_background_mining(BackgroundMiningMaybe),
@@ -1217,6 +1229,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, std
   m_key_device_type(hw::device::device_type::SOFTWARE),
   m_ring_history_saved(false),
   m_ringdb(),
+  m_daemon_zmq_listener(),
   m_last_block_reward(0),
   m_unattended(unattended),
   m_devices_registered(false),
@@ -1294,6 +1307,7 @@ void wallet2::init_options(boost::program_options::options_description& desc_par
   command_line::add_arg(desc_params, opts.offline);
   command_line::add_arg(desc_params, opts.extra_entropy);
   command_line::add_arg(desc_params, opts.allow_mismatched_daemon_version);
+  command_line::add_arg(desc_params, opts.daemon_zmq_pub);
 }
 
 std::pair<std::unique_ptr<wallet2>, tools::password_container> wallet2::make_from_json(const boost::program_options::variables_map& vm, bool unattended, const std::string& json_file, const std::function<boost::optional<tools::password_container>(const char *, bool)> &password_prompter)
@@ -1346,6 +1360,7 @@ bool wallet2::set_daemon(std::string daemon_address, boost::optional<epee::net_u
   CHECK_AND_ASSERT_MES2(m_proxy.empty() || proxy.empty() , "It is not possible to set global proxy (--proxy) and daemon specific proxy together.");
   if(m_proxy.empty())
     CHECK_AND_ASSERT_MES(set_proxy(proxy), false, "failed to set proxy address");
+  m_daemon_proxy = m_proxy.empty() ? proxy : m_proxy;
   const bool changed = m_daemon_address != daemon_address;
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
@@ -1355,6 +1370,23 @@ bool wallet2::set_daemon(std::string daemon_address, boost::optional<epee::net_u
     m_rpc_version = 0;
     m_node_rpc_proxy.invalidate();
     m_pool_info_query_time = 0;
+    m_rct_distribution_cache.clear();
+  }
+
+  if (m_daemon_zmq_listener)
+  {
+    if (changed)
+    {
+      // its pub address was given for the old daemon
+      MWARNING("Daemon changed, no longer listening to the ZMQ pub socket at " << m_daemon_zmq_listener->address());
+      m_daemon_zmq_listener.reset();
+    }
+    else if (m_daemon_zmq_listener->proxy() != m_daemon_proxy)
+    {
+      const std::string pub_address = m_daemon_zmq_listener->address();
+      if (!set_daemon_zmq_pub(pub_address))
+        MERROR("Failed to listen to the daemon ZMQ pub socket at " << pub_address << " through the new proxy");
+    }
   }
 
   const std::string address = get_daemon_address();
@@ -2353,6 +2385,15 @@ bool wallet2::get_pricing_record_history(std::vector<oracle::pricing_record> &pr
   }
 }
 //----------------------------------------------------------------------------------------------------
+wallet2::tx_daemon_state wallet2::get_tx_daemon_state()
+{
+  tx_daemon_state state;
+  THROW_WALLET_EXCEPTION_IF(!get_circulating_supply(state.circ_amounts), error::wallet_internal_error, "Failed to get circulating supply");
+  THROW_WALLET_EXCEPTION_IF(!get_pricing_record_history(state.pricing_record_history), error::wallet_internal_error, "Failed to get pricing record history");
+  state.hf_version = get_current_hard_fork();
+  return state;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, const std::vector<uint64_t> &asset_type_output_indices, uint64_t height, uint8_t block_version, uint64_t ts, bool miner_tx, bool pool, bool double_spend_seen, const tx_cache_data &tx_cache_data, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache, bool ignore_callbacks)
 {
   PERF_TIMER(process_new_transaction);
@@ -3013,7 +3054,7 @@ bool wallet2::should_skip_block(const cryptonote::block &b, uint64_t height) con
   return !(b.timestamp + 60*60*24 > m_account.get_createtime() && height >= m_refresh_from_block_height && height >= m_skip_to_height);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const parsed_block &parsed_block, const crypto::hash& bl_id, uint64_t height, const std::vector<tx_cache_data> &tx_cache_data, size_t tx_cache_data_offset, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache)
+void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const parsed_block &parsed_block, const crypto::hash& bl_id, uint64_t height, const std::vector<tx_cache_data> &tx_cache_data, size_t tx_cache_data_offset, std::unordered_map<crypto::hash, cryptonote::transaction> &spend_txes, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache)
 {
   THROW_WALLET_EXCEPTION_IF(bche.txs.size() + 1 != parsed_block.o_indices.indices.size(), error::wallet_internal_error,
       "block transactions=" + std::to_string(bche.txs.size()) +
@@ -3036,6 +3077,25 @@ void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cry
     THROW_WALLET_EXCEPTION_IF(bche.txs.size() != parsed_block.txes.size(), error::wallet_internal_error, "Wrong amount of transactions for block");
     for (size_t idx = 0; idx < b.tx_hashes.size(); ++idx)
     {
+      const auto unfetched = parsed_block.unfetched_txes.find(idx);
+      if (unfetched != parsed_block.unfetched_txes.end())
+      {
+        if (is_scan_view_spend(b.tx_hashes[idx], unfetched->second))
+        {
+          auto fetched = spend_txes.find(b.tx_hashes[idx]);
+          if (fetched == spend_txes.end())
+          {
+            std::vector<cryptonote::blobdata> blobs;
+            get_pruned_tx_blobs({b.tx_hashes[idx]}, blobs);
+            cryptonote::transaction tx;
+            THROW_WALLET_EXCEPTION_IF(!parse_and_validate_tx_base_from_blob(blobs.front(), tx), error::wallet_internal_error, "Failed to parse transaction from daemon");
+            fetched = spend_txes.emplace(b.tx_hashes[idx], std::move(tx)).first;
+          }
+          process_new_transaction(b.tx_hashes[idx], fetched->second, parsed_block.o_indices.indices[idx+1].indices, parsed_block.asset_type_output_indices.indices[idx+1].indices, height, b.major_version, b.timestamp, false, false, false, tx_cache_data[tx_cache_data_offset], output_tracker_cache);
+        }
+        ++tx_cache_data_offset;
+        continue;
+      }
       process_new_transaction(b.tx_hashes[idx], parsed_block.txes[idx], parsed_block.o_indices.indices[idx+1].indices, parsed_block.asset_type_output_indices.indices[idx+1].indices, height, b.major_version, b.timestamp, false, false, false, tx_cache_data[tx_cache_data_offset++], output_tracker_cache);
     }
     TIME_MEASURE_FINISH(txs_handle_time);
@@ -3166,7 +3226,26 @@ void wallet2::process_pool_info_extent(const cryptonote::COMMAND_RPC_GET_BLOCKS_
   update_pool_state_from_pool_data(res.pool_info_extent == COMMAND_RPC_GET_BLOCKS_FAST::INCREMENTAL, res.removed_pool_txids, added_pool_txs, process_txs, refreshed);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, uint64_t &current_height, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs)
+static void get_blocks_output_indices(const std::vector<cryptonote::blobdata> &compact_output_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices)
+{
+  o_indices.clear();
+  o_indices.resize(compact_output_indices.size());
+  asset_type_output_indices.clear();
+  asset_type_output_indices.resize(compact_output_indices.size());
+  std::vector<std::vector<uint64_t>> indices, asset_type_indices;
+  for (size_t i = 0; i < compact_output_indices.size(); ++i)
+  {
+    cryptonote::compact_output_indices compact;
+    THROW_WALLET_EXCEPTION_IF(!::serialization::parse_binary(compact_output_indices[i], compact) || !cryptonote::get_output_indices(compact, indices, asset_type_indices),
+        error::wallet_internal_error, "Failed to parse compact output indices from daemon");
+    for (auto &tx_indices: indices)
+      o_indices[i].indices.push_back({std::move(tx_indices)});
+    for (auto &tx_indices: asset_type_indices)
+      asset_type_output_indices[i].indices.push_back({std::move(tx_indices)});
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<std::unordered_map<size_t, std::vector<crypto::key_image>>> &unfetched_txes, uint64_t &current_height, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
@@ -3178,7 +3257,12 @@ void wallet2::pull_blocks(bool first, bool try_incremental, uint64_t start_heigh
   req.start_height = start_height;
   req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
 
-  req.requested_info = first ? COMMAND_RPC_GET_BLOCKS_FAST::BLOCKS_AND_POOL : COMMAND_RPC_GET_BLOCKS_FAST::BLOCKS_ONLY;
+  const bool scan_views = use_scan_views();
+  if (scan_views)
+    req.requested_info = first ? COMMAND_RPC_GET_BLOCKS_FAST::SCAN_VIEW_AND_POOL : COMMAND_RPC_GET_BLOCKS_FAST::SCAN_VIEW_ONLY;
+  else
+    req.requested_info = first ? COMMAND_RPC_GET_BLOCKS_FAST::BLOCKS_AND_POOL : COMMAND_RPC_GET_BLOCKS_FAST::BLOCKS_ONLY;
+  req.compact_output_indices = !scan_views && m_rpc_version >= MAKE_CORE_RPC_VERSION(3, 17);
   if (try_incremental)
     req.pool_info_since = m_pool_info_query_time;
 
@@ -3187,19 +3271,47 @@ void wallet2::pull_blocks(bool first, bool try_incremental, uint64_t start_heigh
     bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, *m_http_client, rpc_timeout);
     THROW_ON_RPC_RESPONSE_ERROR(r, {}, res, "getblocks.bin", error::get_blocks_error, get_rpc_status(res.status));
 
-    THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.output_indices.size(), error::wallet_internal_error,
-        "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and output_indices (" +
-        boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
+    if (scan_views)
+    {
+      THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.scan_views.size(), error::wallet_internal_error,
+          "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and scan_views (" +
+          boost::lexical_cast<std::string>(res.scan_views.size()) + ") sizes from daemon");
+    }
+    else if (!res.compact_output_indices.empty())
+    {
+      THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.compact_output_indices.size(), error::wallet_internal_error,
+          "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and compact_output_indices (" +
+          boost::lexical_cast<std::string>(res.compact_output_indices.size()) + ") sizes from daemon");
+    }
+    else
+    {
+      THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.output_indices.size(), error::wallet_internal_error,
+          "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and output_indices (" +
+          boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
 
-    THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.asset_type_output_indices.size(), error::wallet_internal_error,
-        "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and asset_type_output_indices (" +
-        boost::lexical_cast<std::string>(res.asset_type_output_indices.size()) + ") sizes from daemon");
+      THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.asset_type_output_indices.size(), error::wallet_internal_error,
+          "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and asset_type_output_indices (" +
+          boost::lexical_cast<std::string>(res.asset_type_output_indices.size()) + ") sizes from daemon");
+    }
   }
 
   blocks_start_height = res.start_height;
   blocks = std::move(res.blocks);
-  o_indices = std::move(res.output_indices);
-  asset_type_output_indices = std::move(res.asset_type_output_indices);
+  if (scan_views)
+  {
+    fetch_scan_view_txes(blocks_start_height, blocks, res.scan_views, o_indices, asset_type_output_indices, unfetched_txes);
+  }
+  else if (!res.compact_output_indices.empty())
+  {
+    get_blocks_output_indices(res.compact_output_indices, o_indices, asset_type_output_indices);
+    unfetched_txes.clear();
+  }
+  else
+  {
+    o_indices = std::move(res.output_indices);
+    asset_type_output_indices = std::move(res.asset_type_output_indices);
+    unfetched_txes.clear();
+  }
   current_height = res.current_height;
   if (res.pool_info_extent != COMMAND_RPC_GET_BLOCKS_FAST::NONE)
     m_pool_info_query_time = res.daemon_time;
@@ -3225,6 +3337,177 @@ void wallet2::pull_blocks(bool first, bool try_incremental, uint64_t start_heigh
 
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::use_scan_views() const
+{
+  // scan views let the wallet find its outputs by view tag and its spends by
+  // key image, but not the uses of its outputs as decoys; fetching only the
+  // matching txes tells the daemon which ones are likely ours, so this is
+  // only done with a trusted daemon
+  return m_scan_view_refresh && m_trusted_daemon && !m_track_uses && m_rpc_version >= MAKE_CORE_RPC_VERSION(3, 16)
+      && m_account.get_device().get_type() == hw::device::SOFTWARE;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::is_scan_view_spend(const crypto::hash &txid, const std::vector<crypto::key_image> &key_images) const
+{
+  // a tx left out by the scan view is only ours if it spends one of our outputs, or we sent it
+  return m_unconfirmed_txs.find(txid) != m_unconfirmed_txs.end()
+      || std::any_of(key_images.begin(), key_images.end(), [this](const crypto::key_image &ki) { return m_key_images.find(ki) != m_key_images.end(); });
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::fetch_scan_view_spends(const std::vector<parsed_block> &parsed_blocks, std::unordered_map<crypto::hash, cryptonote::transaction> &txes)
+{
+  // spends of outputs received in these same blocks are only seen once those
+  // are processed, and are fetched on their own then
+  std::vector<crypto::hash> txids;
+  for (const parsed_block &pb: parsed_blocks)
+    for (const auto &e: pb.unfetched_txes)
+      if (is_scan_view_spend(pb.block.tx_hashes[e.first], e.second))
+        txids.push_back(pb.block.tx_hashes[e.first]);
+  if (txids.empty())
+    return;
+
+  std::vector<cryptonote::blobdata> blobs;
+  get_pruned_tx_blobs(txids, blobs);
+  for (size_t i = 0; i < txids.size(); ++i)
+  {
+    cryptonote::transaction tx;
+    THROW_WALLET_EXCEPTION_IF(!parse_and_validate_tx_base_from_blob(blobs[i], tx), error::wallet_internal_error, "Failed to parse transaction from daemon");
+    txes.emplace(txids[i], std::move(tx));
+  }
+}
+//----------------------------------------------------------------------------------------------------
+static bool scan_view_has_view_tag_match(const cryptonote::tx_scan_view &view, const crypto::secret_key &view_secret_key)
+{
+  crypto::key_derivation derivation;
+  crypto::view_tag view_tag;
+  for (const crypto::public_key &pub_key: view.pub_keys)
+  {
+    if (!crypto::generate_key_derivation(pub_key, view_secret_key, derivation))
+      continue;
+    for (size_t k = 0; k < view.view_tags.size(); ++k)
+    {
+      crypto::derive_view_tag(derivation, k, view_tag);
+      if (view_tag == view.view_tags[k])
+        return true;
+    }
+  }
+  if (view.additional_pub_keys.size() == view.view_tags.size())
+  {
+    for (size_t k = 0; k < view.view_tags.size(); ++k)
+    {
+      if (!crypto::generate_key_derivation(view.additional_pub_keys[k], view_secret_key, derivation))
+        continue;
+      crypto::derive_view_tag(derivation, k, view_tag);
+      if (view_tag == view.view_tags[k])
+        return true;
+    }
+  }
+  return false;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::fetch_scan_view_txes(uint64_t blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::blobdata> &scan_views, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<std::unordered_map<size_t, std::vector<crypto::key_image>>> &unfetched_txes)
+{
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != scan_views.size(), error::wallet_internal_error, "Mismatched blocks and scan views");
+
+  // Only txes with an output matching a view tag are fetched now. Whether a
+  // tx spends one of our outputs depends on the outputs received up to it,
+  // so those are checked, and fetched, as the blocks get processed.
+  tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+  tools::threadpool::waiter waiter(tpool);
+  const crypto::secret_key &view_secret_key = m_account.get_keys().m_view_secret_key;
+  o_indices.clear();
+  o_indices.resize(blocks.size());
+  asset_type_output_indices.clear();
+  asset_type_output_indices.resize(blocks.size());
+  unfetched_txes.clear();
+  unfetched_txes.resize(blocks.size());
+  std::vector<std::vector<crypto::hash>> tx_hashes(blocks.size());
+  std::atomic<bool> error(false);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    tpool.submit(&waiter, [&, i](){
+      cryptonote::block b;
+      cryptonote::block_scan_view block_view;
+      std::vector<cryptonote::tx_scan_view> views;
+      if (!cryptonote::parse_and_validate_block_from_blob(blocks[i].block, b) || !::serialization::parse_binary(scan_views[i], block_view)
+          || !cryptonote::get_tx_scan_views(block_view, views) || views.size() != b.tx_hashes.size() + 1)
+      {
+        error = true;
+        return;
+      }
+      for (const auto &view: views)
+      {
+        o_indices[i].indices.push_back({view.output_indices});
+        asset_type_output_indices[i].indices.push_back({view.asset_type_output_indices});
+      }
+      const bool skip = should_skip_block(b, blocks_start_height + i);
+      for (size_t j = 0; j < b.tx_hashes.size(); ++j)
+      {
+        if (!skip && scan_view_has_view_tag_match(views[j + 1], view_secret_key))
+          tx_hashes[i].push_back(b.tx_hashes[j]);
+        else
+          unfetched_txes[i].emplace(j, std::move(views[j + 1].key_images));
+      }
+      blocks[i].txs.resize(b.tx_hashes.size());
+    }, true);
+  }
+  THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
+  THROW_WALLET_EXCEPTION_IF(error, error::wallet_internal_error, "Invalid scan view from daemon");
+
+  std::vector<crypto::hash> txids;
+  for (const auto &hashes: tx_hashes)
+    txids.insert(txids.end(), hashes.begin(), hashes.end());
+  std::vector<cryptonote::blobdata> blobs;
+  get_pruned_tx_blobs(txids, blobs);
+  size_t blob_idx = 0;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      if (unfetched_txes[i].find(j) == unfetched_txes[i].end())
+        blocks[i].txs[j].blob = std::move(blobs[blob_idx++]);
+    }
+  }
+  MDEBUG("Fetched " << txids.size() << " txes matching view tags in " << blocks.size() << " blocks");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_pruned_tx_blobs(const std::vector<crypto::hash> &txids, std::vector<cryptonote::blobdata> &blobs)
+{
+  blobs.clear();
+  blobs.reserve(txids.size());
+
+  const size_t SLICE_SIZE =  100; // RESTRICTED_TRANSACTIONS_COUNT as defined in rpc/core_rpc_server.cpp, hardcoded in daemon code
+  for(size_t slice = 0; slice < txids.size(); slice += SLICE_SIZE) {
+    cryptonote::COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
+    cryptonote::COMMAND_RPC_GET_TRANSACTIONS::response res = AUTO_VAL_INIT(res);
+    req.decode_as_json = false;
+    req.prune = true;
+
+    const size_t ntxes = std::min(SLICE_SIZE, txids.size() - slice);
+    for (size_t i = slice; i < slice + ntxes; ++i)
+      req.txs_hashes.push_back(epee::string_tools::pod_to_hex(txids[i]));
+
+    {
+      const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+      bool r = epee::net_utils::invoke_http_json("/gettransactions", req, res, *m_http_client, rpc_timeout);
+      THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to get transaction from daemon");
+      THROW_WALLET_EXCEPTION_IF(res.txs.size() != req.txs_hashes.size(), error::wallet_internal_error, "Failed to get transaction from daemon");
+    }
+
+    for (size_t i = 0; i < res.txs.size(); ++i)
+    {
+      cryptonote::transaction tx;
+      crypto::hash tx_hash;
+      THROW_WALLET_EXCEPTION_IF(!get_pruned_tx(res.txs[i], tx, tx_hash) || tx_hash != txids[slice + i],
+          error::wallet_internal_error, "Failed to get transaction from daemon");
+      cryptonote::blobdata bd;
+      THROW_WALLET_EXCEPTION_IF(!epee::string_tools::parse_hexstr_to_binbuff(res.txs[i].as_hex.empty() ? res.txs[i].pruned_as_hex : res.txs[i].as_hex, bd),
+          error::wallet_internal_error, "Failed to parse transaction from daemon");
+      blobs.push_back(std::move(bd));
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes)
 {
   cryptonote::COMMAND_RPC_GET_HASHES_FAST::request req = AUTO_VAL_INIT(req);
@@ -3312,17 +3595,61 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }
   };
 
-  for (size_t i = 0; i < tx_cache_data.size(); ++i)
+  if (hwdev.get_type() == hw::device::SOFTWARE)
   {
-    if (tx_cache_data[i].empty())
-      continue;
-    tpool.submit(&waiter, [&gender, &tx_cache_data, i]() {
-      auto &slot = tx_cache_data[i];
+    // derive the whole batch in a few large chunks, so each chunk pays for a single field inversion
+    std::vector<wallet2::is_out_data*> iods;
+    for (auto &slot: tx_cache_data)
+    {
       for (auto &iod: slot.primary)
-        gender(iod);
+        iods.push_back(&iod);
       for (auto &iod: slot.additional)
-        gender(iod);
-    }, true);
+        iods.push_back(&iod);
+    }
+    const size_t n_chunks = std::max<size_t>(1, tpool.get_max_concurrency());
+    const size_t chunk_size = std::max<size_t>(1, (iods.size() + n_chunks - 1) / n_chunks);
+    for (size_t start = 0; start < iods.size(); start += chunk_size)
+    {
+      const size_t end = std::min(start + chunk_size, iods.size());
+      tpool.submit(&waiter, [&iods, &keys, start, end]() {
+        const size_t n = end - start;
+        std::vector<crypto::public_key> pkeys(n);
+        std::vector<crypto::key_derivation> derivations(n);
+        std::unique_ptr<bool[]> valid(new bool[n]);
+        for (size_t i = 0; i < n; ++i)
+          pkeys[i] = iods[start + i]->pkey;
+        crypto::generate_key_derivations(pkeys.data(), n, keys.m_view_secret_key, derivations.data(), valid.get());
+        for (size_t i = 0; i < n; ++i)
+        {
+          wallet2::is_out_data &iod = *iods[start + i];
+          if (valid[i])
+          {
+            iod.derivation = derivations[i];
+          }
+          else
+          {
+            MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+            static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+            memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+          }
+        }
+      }, true);
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < tx_cache_data.size(); ++i)
+    {
+      if (tx_cache_data[i].empty())
+        continue;
+      tpool.submit(&waiter, [&gender, &tx_cache_data, i]() {
+        auto &slot = tx_cache_data[i];
+        for (auto &iod: slot.primary)
+          gender(iod);
+        for (auto &iod: slot.additional)
+          gender(iod);
+      }, true);
+    }
   }
   THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Exception in thread pool");
 
@@ -3415,6 +3742,10 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
 
   hwdev.set_mode(hw::device::NONE);
 
+  // txes the scan views left out, but which spend our outputs
+  std::unordered_map<crypto::hash, cryptonote::transaction> spend_txes;
+  fetch_scan_view_spends(parsed_blocks, spend_txes);
+
   size_t tx_cache_data_offset = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
@@ -3423,7 +3754,7 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
 
     if(current_index >= m_blockchain.size())
     {
-      process_new_blockchain_entry(bl, blocks[i], parsed_blocks[i], bl_id, current_index, tx_cache_data, tx_cache_data_offset, output_tracker_cache);
+      process_new_blockchain_entry(bl, blocks[i], parsed_blocks[i], bl_id, current_index, tx_cache_data, tx_cache_data_offset, spend_txes, output_tracker_cache);
       ++blocks_added;
     }
     else if(bl_id != m_blockchain[current_index])
@@ -3440,7 +3771,7 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
         std::to_string(reorg_depth));
 
       handle_reorg(current_index, output_tracker_cache);
-      process_new_blockchain_entry(bl, blocks[i], parsed_blocks[i], bl_id, current_index, tx_cache_data, tx_cache_data_offset, output_tracker_cache);
+      process_new_blockchain_entry(bl, blocks[i], parsed_blocks[i], bl_id, current_index, tx_cache_data, tx_cache_data_offset, spend_txes, output_tracker_cache);
     }
     else
     {
@@ -3510,9 +3841,10 @@ void wallet2::pull_and_parse_next_blocks(bool first, bool try_incremental, uint6
     // pull the new blocks
     std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
     std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> asset_type_output_indices;
+    std::vector<std::unordered_map<size_t, std::vector<crypto::key_image>>> unfetched_txes;
 
     uint64_t current_height;
-    pull_blocks(first, try_incremental, start_height, blocks_start_height, short_chain_history, blocks, o_indices, asset_type_output_indices, current_height, process_pool_txs);
+    pull_blocks(first, try_incremental, start_height, blocks_start_height, short_chain_history, blocks, o_indices, asset_type_output_indices, unfetched_txes, current_height, process_pool_txs);
     THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
 
     THROW_WALLET_EXCEPTION_IF(blocks.size() != asset_type_output_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and asset_type_output_indices");
@@ -3552,6 +3884,8 @@ void wallet2::pull_and_parse_next_blocks(bool first, bool try_incremental, uint6
 
       parsed_blocks[i].o_indices = std::move(o_indices[i]);
       parsed_blocks[i].asset_type_output_indices = std::move(asset_type_output_indices[i]);
+      if (!unfetched_txes.empty())
+        parsed_blocks[i].unfetched_txes = std::move(unfetched_txes[i]);
     }
 
     boost::mutex error_lock;
@@ -3560,6 +3894,8 @@ void wallet2::pull_and_parse_next_blocks(bool first, bool try_incremental, uint6
       parsed_blocks[i].txes.resize(blocks[i].txs.size());
       for (size_t j = 0; j < blocks[i].txs.size(); ++j)
       {
+        if (parsed_blocks[i].unfetched_txes.find(j) != parsed_blocks[i].unfetched_txes.end())
+          continue;
         tpool.submit(&waiter, [&, i, j](){
           if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j].blob, parsed_blocks[i].txes[j]))
           {
@@ -4301,48 +4637,96 @@ bool wallet2::refresh(bool trusted_daemon, uint64_t & blocks_fetched, bool& rece
 //----------------------------------------------------------------------------------------------------
 bool wallet2::get_rct_distribution(const std::string rct_asset_type, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &num_spendable_global_outs)
 {
-  cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
-  cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
-  req.amounts.push_back(0);
+  // re-requested blocks at the end of the cached distribution, to catch reorgs
+  static constexpr uint64_t RCT_DISTRIBUTION_OVERLAP = CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
 
+  uint64_t fork_height;
   if (rct_asset_type == "ZYIELD")
-    req.from_height = YIELD_FORK_HEIGHT;
+    fork_height = YIELD_FORK_HEIGHT;
   else if (rct_asset_type == "ZPH" || rct_asset_type == "ZSD" || rct_asset_type == "ZRS" || rct_asset_type == "ZYS")
-    req.from_height = AUDIT_FORK_HEIGHT;
+    fork_height = AUDIT_FORK_HEIGHT;
   else
-    req.from_height = 0;
+    fork_height = 0;
+
+  const auto request = [&](uint64_t from_height, cryptonote::rpc::output_distribution_data &data) {
+    cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
+    cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
+    req.amounts.push_back(0);
+    req.from_height = from_height;
+    req.rct_asset_type = rct_asset_type;
+    req.cumulative = false;
+    req.binary = true;
+    req.compress = true;
 
-  req.rct_asset_type = rct_asset_type;
-  req.cumulative = false;
-  req.binary = true;
-  req.compress = true;
+    bool r;
+    try
+    {
+      const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+      r = net_utils::invoke_http_bin("/get_output_distribution.bin", req, res, *m_http_client, rpc_timeout);
+      THROW_ON_RPC_RESPONSE_ERROR_GENERIC(r, {}, res, "/get_output_distribution.bin");
+    }
+    catch(...)
+    {
+      return false;
+    }
+    if (res.distributions.size() != 1)
+    {
+      MWARNING("Failed to request output distribution: not the expected single result");
+      return false;
+    }
+    if (res.distributions[0].amount != 0)
+    {
+      MWARNING("Failed to request output distribution: results are not for amount 0");
+      return false;
+    }
+    for (size_t i = 1; i < res.distributions[0].data.distribution.size(); ++i)
+      res.distributions[0].data.distribution[i] += res.distributions[0].data.distribution[i-1];
+    data = std::move(res.distributions[0].data);
+    return true;
+  };
 
-  bool r;
-  try
-  {
-    const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
-    r = net_utils::invoke_http_bin("/get_output_distribution.bin", req, res, *m_http_client, rpc_timeout);
-    THROW_ON_RPC_RESPONSE_ERROR_GENERIC(r, {}, res, "/get_output_distribution.bin");
-  }
-  catch(...)
+  cryptonote::rpc::output_distribution_data data;
+  auto it = m_rct_distribution_cache.find(rct_asset_type);
+  bool have_delta = false;
+  if (it != m_rct_distribution_cache.end() && it->second.distribution.size() > RCT_DISTRIBUTION_OVERLAP)
   {
-    return false;
-  }
-  if (res.distributions.size() != 1)
-  {
-    MWARNING("Failed to request output distribution: not the expected single result");
-    return false;
+    // only ask for what was added since, and check the overlap still matches
+    rct_distribution_cache_entry &entry = it->second;
+    const uint64_t keep = entry.distribution.size() - RCT_DISTRIBUTION_OVERLAP;
+    if (request(entry.start_height + keep, data) && data.start_height == entry.start_height + keep
+        && data.base == entry.base + entry.distribution[keep - 1] && data.distribution.size() >= RCT_DISTRIBUTION_OVERLAP)
+    {
+      bool match = true;
+      for (size_t i = 0; i < RCT_DISTRIBUTION_OVERLAP && match; ++i)
+        match = data.distribution[i] + entry.distribution[keep - 1] == entry.distribution[keep + i];
+      if (match)
+      {
+        entry.distribution.resize(keep);
+        for (uint64_t d: data.distribution)
+          entry.distribution.push_back(d + entry.distribution[keep - 1]);
+        have_delta = true;
+      }
+    }
+    if (!have_delta)
+      MDEBUG("Cached " << rct_asset_type << " rct distribution is stale, requesting it in full");
   }
-  if (res.distributions[0].amount != 0)
+  if (!have_delta)
   {
-    MWARNING("Failed to request output distribution: results are not for amount 0");
-    return false;
+    if (!request(fork_height, data))
+    {
+      m_rct_distribution_cache.erase(rct_asset_type);
+      return false;
+    }
+    rct_distribution_cache_entry &entry = m_rct_distribution_cache[rct_asset_type];
+    entry.start_height = data.start_height;
+    entry.base = data.base;
+    entry.distribution = std::move(data.distribution);
+    it = m_rct_distribution_cache.find(rct_asset_type);
   }
-  for (size_t i = 1; i < res.distributions[0].data.distribution.size(); ++i)
-    res.distributions[0].data.distribution[i] += res.distributions[0].data.distribution[i-1];
-  start_height = res.distributions[0].data.start_height;
-  num_spendable_global_outs = res.distributions[0].data.num_spendable_global_outs;
-  distribution = std::move(res.distributions[0].data.distribution);
+
+  start_height = it->second.start_height;
+  num_spendable_global_outs = data.num_spendable_global_outs;
+  distribution = it->second.distribution;
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -4453,6 +4837,7 @@ void wallet2::handle_reorg(uint64_t height, std::map<std::pair<uint64_t, uint64_
 //----------------------------------------------------------------------------------------------------
 bool wallet2::deinit()
 {
+  m_daemon_zmq_listener.reset();
   if(m_is_initialized) {
     m_is_initialized = false;
     unlock_keys_file();
@@ -4693,6 +5078,9 @@ boost::optional<wallet2::keys_file_data> wallet2::get_keys_file_data(const epee:
   value2.SetInt(m_track_uses ? 1 : 0);
   json.AddMember("track_uses", value2, json.GetAllocator());
 
+  value2.SetInt(m_scan_view_refresh ? 1 : 0);
+  json.AddMember("scan_view_refresh", value2, json.GetAllocator());
+
   value2.SetInt(m_show_wallet_name_when_locked ? 1 : 0);
   json.AddMember("show_wallet_name_when_locked", value2, json.GetAllocator());
 
@@ -4882,6 +5270,7 @@ bool wallet2::load_keys_buf(const std::string& keys_buf, const epee::wipeable_st
     m_ignore_outputs_above = MONEY_SUPPLY;
     m_ignore_outputs_below = 0;
     m_track_uses = false;
+    m_scan_view_refresh = true;
     m_show_wallet_name_when_locked = false;
     m_inactivity_lock_timeout = DEFAULT_INACTIVITY_LOCK_TIMEOUT;
     m_setup_background_mining = BackgroundMiningMaybe;
@@ -5056,6 +5445,8 @@ bool wallet2::load_keys_buf(const std::string& keys_buf, const epee::wipeable_st
     m_ignore_outputs_below = field_ignore_outputs_below;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, track_uses, int, Int, false, false);
     m_track_uses = field_track_uses;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, scan_view_refresh, int, Int, false, true);
+    m_scan_view_refresh = field_scan_view_refresh;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, show_wallet_name_when_locked, int, Int, false, false);
     m_show_wallet_name_when_locked = field_show_wallet_name_when_locked;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, inactivity_lock_timeout, uint32_t, Uint, false, DEFAULT_INACTIVITY_LOCK_TIMEOUT);
@@ -6184,6 +6575,39 @@ void wallet2::set_offline(bool offline)
   }
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::set_daemon_zmq_pub(const std::string &address)
+{
+  if (address.empty())
+  {
+    m_daemon_zmq_listener.reset();
+    return true;
+  }
+  if (!m_daemon_zmq_listener)
+    m_daemon_zmq_listener.reset(new daemon_zmq_listener());
+  // the same proxy as for the daemon RPC, so the connection does not give the wallet away
+  if (!m_daemon_zmq_listener->start(address, m_daemon_proxy))
+  {
+    m_daemon_zmq_listener.reset();
+    return false;
+  }
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::is_daemon_zmq_pub_connected() const
+{
+  return m_daemon_zmq_listener && !m_offline && m_daemon_zmq_listener->connected();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::take_daemon_zmq_chain_news()
+{
+  return m_daemon_zmq_listener && m_daemon_zmq_listener->take_chain_news();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::take_daemon_zmq_pool_news()
+{
+  return m_daemon_zmq_listener && m_daemon_zmq_listener->take_pool_news();
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::generate_chacha_key_from_secret_keys(crypto::chacha_key &key) const
 {
   hw::device &hwdev =  m_account.get_device();
@@ -8733,6 +9157,15 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
   THROW_WALLET_EXCEPTION(error::wallet_internal_error, tr("Transaction sanity check failed"));
 }
 
+void wallet2::prefetch_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, std::unordered_set<crypto::public_key> &valid_public_keys_cache)
+{
+  // the selection pass normally leaves the rings in place already
+  if (!outs.empty())
+    return;
+  const bool all_rct = std::all_of(selected_transfers.begin(), selected_transfers.end(), [this](size_t idx) { return m_transfers[idx].is_rct(); });
+  get_outs(outs, selected_transfers, fake_outputs_count, all_rct, valid_public_keys_cache);
+}
+
 void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, std::vector<uint64_t> &rct_offsets, uint64_t &num_spendable_global_outs, std::unordered_set<crypto::public_key> &valid_public_keys_cache)
 {
   LOG_PRINT_L2("fake_outputs_count: " << fake_outputs_count);
@@ -9402,7 +9835,7 @@ template<typename T>
 void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_entry>& dsts, const std::vector<size_t>& selected_transfers, size_t fake_outputs_count,
   std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, std::unordered_set<crypto::public_key> &valid_public_keys_cache,
   uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy, cryptonote::transaction& tx, pending_tx &ptx,
-  bool use_view_tags)
+  bool use_view_tags, const tx_daemon_state *daemon_state)
 {
   using namespace cryptonote;
   // throw if attempting a transaction with no destinations
@@ -9513,13 +9946,12 @@ void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_ent
   std::vector<crypto::secret_key> additional_tx_keys;
   LOG_PRINT_L2("constructing tx");
 
-  // Get the circulating supply data
-  std::vector<std::pair<std::string, std::string>> circ_amounts;
-  THROW_WALLET_EXCEPTION_IF(!get_circulating_supply(circ_amounts), error::wallet_internal_error, "Failed to get circulating supply");
-  std::vector<oracle::pricing_record> pricing_record_history;
-  THROW_WALLET_EXCEPTION_IF(!get_pricing_record_history(pricing_record_history), error::wallet_internal_error, "Failed to get pricing record history");
-  uint32_t hf_version = get_current_hard_fork();
-  bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), m_subaddresses, sources, splitted_dsts, change_dts.addr, extra, tx, "ZEPH", "ZEPH", 1, hf_version, oracle::pricing_record(), circ_amounts, pricing_record_history, unlock_time, tx_key, additional_tx_keys, false, {}, use_view_tags);
+  // Get the circulating supply data, unless the caller fetched it already
+  tx_daemon_state fetched_state;
+  if (!daemon_state)
+    fetched_state = get_tx_daemon_state();
+  const tx_daemon_state &state = daemon_state ? *daemon_state : fetched_state;
+  bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), m_subaddresses, sources, splitted_dsts, change_dts.addr, extra, tx, "ZEPH", "ZEPH", 1, state.hf_version, oracle::pricing_record(), state.circ_amounts, state.pricing_record_history, unlock_time, tx_key, additional_tx_keys, false, {}, use_view_tags);
   LOG_PRINT_L2("constructed tx, r="<<r);
   THROW_WALLET_EXCEPTION_IF(!r, error::tx_not_constructed, sources, splitted_dsts, unlock_time, m_nettype);
   THROW_WALLET_EXCEPTION_IF(upper_transaction_weight_limit <= get_transaction_weight(tx), error::tx_too_big, tx, upper_transaction_weight_limit);
@@ -9582,7 +10014,8 @@ void wallet2::transfer_selected_rct(
   bool use_view_tags,
   const std::string& source_asset,
   const std::string& dest_asset,
-  const oracle::pricing_record& pr
+  const oracle::pricing_record& pr,
+  const tx_daemon_state *daemon_state
 ){
   using namespace cryptonote;
   // throw if attempting a transaction with no destinations
@@ -9831,12 +10264,11 @@ void wallet2::transfer_selected_rct(
     );
   }
   else {
-    uint32_t hf_version = get_current_hard_fork();
-    // Get the circulating supply data
-    std::vector<std::pair<std::string, std::string>> circ_amounts;
-    THROW_WALLET_EXCEPTION_IF(!get_circulating_supply(circ_amounts), error::wallet_internal_error, "Failed to get circulating supply");
-    std::vector<oracle::pricing_record> pricing_record_history;
-    THROW_WALLET_EXCEPTION_IF(!get_pricing_record_history(pricing_record_history), error::wallet_internal_error, "Failed to get pricing record history");
+    // Get the circulating supply data, unless the caller fetched it already
+    tx_daemon_state fetched_state;
+    if (!daemon_state)
+      fetched_state = get_tx_daemon_state();
+    const tx_daemon_state &state = daemon_state ? *daemon_state : fetched_state;
     // make a normal tx
     bool r = cryptonote::construct_tx_and_get_tx_key(
       m_account.get_keys(),
@@ -9849,10 +10281,10 @@ void wallet2::transfer_selected_rct(
       source_asset,
       dest_asset,
       current_height,
-      hf_version,
+      state.hf_version,
       pr,
-      circ_amounts,
-      pricing_record_history,
+      state.circ_amounts,
+      state.pricing_record_history,
       unlock_time,
       tx_key,
       additional_tx_keys,
@@ -10212,7 +10644,8 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(
   const std::vector<uint8_t>& extra,
   uint32_t subaddr_account,
   std::set<uint32_t> subaddr_indices,
-  const unique_index_container& subtract_fee_from_outputs
+  const unique_index_container& subtract_fee_from_outputs,
+  bool parallel
 ){
   //ensure device is let in NONE mode in any case
   hw::device &hwdev = m_account.get_device();
@@ -10338,7 +10771,8 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(
   const bool bulletproof = true;
   const bool bulletproof_plus = true;
   const bool clsag = true;
-  const rct::RCTConfig rct_config { rct::RangeProofPaddedBulletproof, 4 };
+  rct::RCTConfig rct_config { rct::RangeProofPaddedBulletproof, 4 };
+  rct_config.parallel_signing = parallel;
 
   const bool use_view_tags = true;
   std::unordered_set<crypto::public_key> valid_public_keys_cache;
@@ -10976,10 +11410,17 @@ skip_tx:
     " total fee, " << print_money(accumulated_change) << " total change");
 
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  // the concurrent pass must not wait on the daemon, so fetch what it needs here
+  const bool parallel_final = parallel && txes.size() > 1 && !m_multisig && hwdev.get_type() == hw::device::SOFTWARE;
+  tx_daemon_state daemon_state;
+  if (parallel_final)
+  {
+    daemon_state = get_tx_daemon_state();
+    for (TX &tx: txes)
+      prefetch_outs(tx.outs, tx.selected_transfers, fake_outs_count, valid_public_keys_cache);
+  }
+  const auto construct_final_tx = [&](TX &tx)
   {
-    TX &tx = *i;
-
     const auto tx_dsts = tx.get_adjusted_dsts(tx.needed_fee);
 
     cryptonote::transaction test_tx;
@@ -10999,14 +11440,16 @@ skip_tx:
                           use_view_tags,              /* const bool use_view_tags */
                           source_asset,
                           dest_asset,
-                          pricing_record
+                          pricing_record,
+                          parallel_final ? &daemon_state : NULL
                         );            
 
     auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
     tx.tx = test_tx;
     tx.ptx = test_ptx;
     tx.weight = get_transaction_weight(test_tx, txBlob.size());
-  }
+  };
+  detail::construct_final_txes(txes, construct_final_tx, parallel_final);
 
   std::vector<wallet2::pending_tx> ptx_vector;
   for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -11132,7 +11575,8 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(
   uint32_t priority,
   const std::vector<uint8_t>& extra,
   uint32_t subaddr_account,
-  std::set<uint32_t> subaddr_indices
+  std::set<uint32_t> subaddr_indices,
+  bool parallel
 ){
   std::vector<size_t> unused_transfers_indices;
   std::vector<size_t> unused_dust_indices;
@@ -11205,7 +11649,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(
     }
   }
 
-  return create_transactions_from(address, source_asset, dest_asset, is_subaddress, outputs, unused_transfers_indices, unused_dust_indices, fake_outs_count, unlock_time, priority, extra);
+  return create_transactions_from(address, source_asset, dest_asset, is_subaddress, outputs, unused_transfers_indices, unused_dust_indices, fake_outs_count, unlock_time, priority, extra, parallel);
 }
 
 std::vector<wallet2::pending_tx> wallet2::create_transactions_single(const crypto::key_image &ki, const cryptonote::account_public_address &address, bool is_subaddress, const size_t outputs, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra)
@@ -11241,7 +11685,8 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(
   const size_t fake_outs_count,
   const uint64_t unlock_time,
   uint32_t priority,
-  const std::vector<uint8_t>& extra
+  const std::vector<uint8_t>& extra,
+  bool parallel
 ){
   using tt = cryptonote::transaction_type;
   //ensure device is let in NONE mode in any case
@@ -11272,10 +11717,11 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(
   const bool bulletproof = true;
   const bool bulletproof_plus = true;
   const bool clsag = true;
-  const rct::RCTConfig rct_config {
+  rct::RCTConfig rct_config {
     rct::RangeProofPaddedBulletproof,
     bulletproof_plus ? 4 : 3
   };
+  rct_config.parallel_signing = parallel;
   const bool use_view_tags = true;
   const uint64_t base_fee  = get_base_fee(priority);
   const uint64_t fee_quantization_mask = get_fee_quantization_mask();
@@ -11491,23 +11937,32 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_from(
     " total fee, " << print_money(accumulated_change) << " total change");
  
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  // the concurrent pass must not wait on the daemon, so fetch what it needs here
+  const bool parallel_final = parallel && txes.size() > 1 && !m_multisig && hwdev.get_type() == hw::device::SOFTWARE;
+  tx_daemon_state daemon_state;
+  if (parallel_final)
+  {
+    daemon_state = get_tx_daemon_state();
+    for (TX &tx: txes)
+      prefetch_outs(tx.outs, tx.selected_transfers, fake_outs_count, valid_public_keys_cache);
+  }
+  const auto construct_final_tx = [&](TX &tx)
   {
-    TX &tx = *i;
     cryptonote::transaction test_tx;
     pending_tx test_ptx;
     if (use_rct) {
       transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, valid_public_keys_cache, unlock_time, tx.needed_fee, extra,
-        test_tx, test_ptx, rct_config, use_view_tags, source_asset, dest_asset, pricing_record);
+        test_tx, test_ptx, rct_config, use_view_tags, source_asset, dest_asset, pricing_record, parallel_final ? &daemon_state : NULL);
     } else {
       transfer_selected(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, valid_public_keys_cache, unlock_time, tx.needed_fee, extra,
-        detail::digit_split_strategy, tx_dust_policy(::config::DEFAULT_DUST_THRESHOLD), test_tx, test_ptx, use_view_tags);
+        detail::digit_split_strategy, tx_dust_policy(::config::DEFAULT_DUST_THRESHOLD), test_tx, test_ptx, use_view_tags, parallel_final ? &daemon_state : NULL);
     }
     auto txBlob = t_serializable_object_to_blob(test_ptx.tx);
     tx.tx = test_tx;
     tx.ptx = test_ptx;
     tx.weight = get_transaction_weight(test_tx, txBlob.size());
-  }
+  };
+  detail::construct_final_txes(txes, construct_final_tx, parallel_final);
 
   std::vector<wallet2::pending_tx> ptx_vector;
   for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
@@ -55,6 +55,7 @@
 #include "cryptonote_core/cryptonote_tx_utils.h"
 #include "common/unordered_containers_boost_serialization.h"
 #include "common/util.h"
+#include "common/threadpool.h"
 #include "crypto/chacha.h"
 #include "crypto/hash.h"
 #include "ringct/rctTypes.h"
@@ -89,6 +90,7 @@ class wallet_accessor_test;
 namespace tools
 {
   class ringdb;
+  class daemon_zmq_listener;
   class wallet2;
   class Notify;
 
@@ -798,6 +800,14 @@ private:
 
     typedef std::tuple<uint64_t, crypto::public_key, rct::key> get_outs_entry;
 
+    // Daemon state a tx is built against, fetched up front when several txes are built concurrently
+    struct tx_daemon_state
+    {
+      uint32_t hf_version;
+      std::vector<std::pair<std::string, std::string>> circ_amounts;
+      std::vector<oracle::pricing_record> pricing_record_history;
+    };
+
     struct parsed_block
     {
       crypto::hash hash;
@@ -805,6 +815,7 @@ private:
       std::vector<cryptonote::transaction> txes;
       cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices o_indices;
       cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices asset_type_output_indices;
+      std::unordered_map<size_t, std::vector<crypto::key_image>> unfetched_txes; // scan view refresh: txes left out, with their key images
       bool error;
     };
 
@@ -1084,6 +1095,7 @@ private:
     bool get_audited_supply(std::vector<std::pair<std::string, std::string>> &amounts);
     bool get_circulating_supply(std::vector<std::pair<std::string, std::string>> &amounts);
     bool get_pricing_record_history(std::vector<oracle::pricing_record> &pricing_record_history);
+    tx_daemon_state get_tx_daemon_state();
 
      // locked & unlocked balance of given or current subaddress account
     std::map<uint32_t, std::map<std::string, uint64_t>> balance(uint32_t subaddr_index_major, bool strict);
@@ -1101,7 +1113,8 @@ private:
     template<typename T>
     void transfer_selected(const std::vector<cryptonote::tx_destination_entry>& dsts, const std::vector<size_t>& selected_transfers, size_t fake_outputs_count,
       std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, std::unordered_set<crypto::public_key> &valid_public_keys_cache,
-      uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy, cryptonote::transaction& tx, pending_tx &ptx, const bool use_view_tags);
+      uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy, cryptonote::transaction& tx, pending_tx &ptx, const bool use_view_tags,
+      const tx_daemon_state *daemon_state = NULL);
     void transfer_selected_rct(
       std::vector<cryptonote::tx_destination_entry> dsts,
       const std::vector<size_t>& selected_transfers,
@@ -1117,7 +1130,8 @@ private:
       const bool use_view_tags,
       const std::string& source_asset,
       const std::string& dest_asset,
-      const oracle::pricing_record& pr
+      const oracle::pricing_record& pr,
+      const tx_daemon_state *daemon_state = NULL
     );
 
     void commit_tx(pending_tx& ptx_vector);
@@ -1180,7 +1194,8 @@ private:
       const std::vector<uint8_t>& extra,
       uint32_t subaddr_account,
       std::set<uint32_t> subaddr_indices, // pass subaddr_indices by value on purpose
-      const unique_index_container& subtract_fee_from_outputs = {}
+      const unique_index_container& subtract_fee_from_outputs = {},
+      bool parallel = false
     );     
     std::vector<wallet2::pending_tx> create_transactions_all(
       uint64_t below,
@@ -1194,7 +1209,8 @@ private:
       uint32_t priority,
       const std::vector<uint8_t>& extra,
       uint32_t subaddr_account,
-      std::set<uint32_t> subaddr_indices
+      std::set<uint32_t> subaddr_indices,
+      bool parallel = false
     );
     std::vector<wallet2::pending_tx> create_transactions_single(const crypto::key_image &ki, const cryptonote::account_public_address &address, bool is_subaddress, const size_t outputs, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra);
     std::vector<wallet2::pending_tx> create_transactions_from(
@@ -1208,7 +1224,8 @@ private:
       const size_t fake_outs_count,
       const uint64_t unlock_time,
       uint32_t priority,
-      const std::vector<uint8_t>& extra
+      const std::vector<uint8_t>& extra,
+      bool parallel = false
     );
     bool sanity_check(const std::vector<wallet2::pending_tx> &ptx_vector, const std::vector<cryptonote::tx_destination_entry>& dsts, const unique_index_container& subtract_fee_from_outputs = {}) const;
     void cold_tx_aux_import(const std::vector<pending_tx>& ptx, const std::vector<std::string>& tx_device_aux);
@@ -1455,6 +1472,8 @@ private:
     void ignore_outputs_below(uint64_t value) { m_ignore_outputs_below = value; }
     bool track_uses() const { return m_track_uses; }
     void track_uses(bool value) { m_track_uses = value; }
+    bool scan_view_refresh() const { return m_scan_view_refresh; }
+    void scan_view_refresh(bool value) { m_scan_view_refresh = value; }
     bool show_wallet_name_when_locked() const { return m_show_wallet_name_when_locked; }
     void show_wallet_name_when_locked(bool value) { m_show_wallet_name_when_locked = value; }
     BackgroundMiningSetupType setup_background_mining() const { return m_setup_background_mining; }
@@ -1750,6 +1769,19 @@ private:
     void set_offline(bool offline = true);
     bool is_offline() const { return m_offline; }
 
+    /*!
+     * \brief  Listens to the daemon's ZMQ pub socket for new blocks and pool txes
+     * \param  address  The daemon's --zmq-pub address, or empty to stop listening
+     * \return          Whether it is listening, or stopped if `address` is empty
+     */
+    bool set_daemon_zmq_pub(const std::string &address);
+    //! whether the daemon's ZMQ pub socket is connected, so there is no need to poll the daemon
+    bool is_daemon_zmq_pub_connected() const;
+    //! whether the daemon announced a block since the last call, or its ZMQ pub socket (re)connected
+    bool take_daemon_zmq_chain_news();
+    //! whether the daemon announced a pool tx since the last call
+    bool take_daemon_zmq_pool_news();
+
     static std::string get_default_daemon_address() { CRITICAL_REGION_LOCAL(default_daemon_address_lock); return default_daemon_address; }
 
     wallet2::transfers_iterator_container get_specific_transfers(const std::string& asset);
@@ -1778,13 +1810,18 @@ private:
     bool load_keys_buf(const std::string& keys_buf, const epee::wipeable_string& password, boost::optional<crypto::chacha_key>& keys_to_encrypt);
     void process_new_transaction(const crypto::hash &txid, const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, const std::vector<uint64_t> &asset_type_output_indices, uint64_t height, uint8_t block_version, uint64_t ts, bool miner_tx, bool pool, bool double_spend_seen, const tx_cache_data &tx_cache_data, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL, bool ignore_callbacks = false);
     bool should_skip_block(const cryptonote::block &b, uint64_t height) const;
-    void process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const parsed_block &parsed_block, const crypto::hash& bl_id, uint64_t height, const std::vector<tx_cache_data> &tx_cache_data, size_t tx_cache_data_offset, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
+    void process_new_blockchain_entry(const cryptonote::block& b, const cryptonote::block_complete_entry& bche, const parsed_block &parsed_block, const crypto::hash& bl_id, uint64_t height, const std::vector<tx_cache_data> &tx_cache_data, size_t tx_cache_data_offset, std::unordered_map<crypto::hash, cryptonote::transaction> &spend_txes, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
     detached_blockchain_data detach_blockchain(uint64_t height, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
     void handle_reorg(uint64_t height, std::map<std::pair<uint64_t, uint64_t>, size_t> *output_tracker_cache = NULL);
     void get_short_chain_history(std::list<crypto::hash>& ids, uint64_t granularity = 1) const;
     bool clear();
     void clear_soft(bool keep_key_images=false);
-    void pull_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, uint64_t &current_height, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs);
+    void pull_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<std::unordered_map<size_t, std::vector<crypto::key_image>>> &unfetched_txes, uint64_t &current_height, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs);
+    bool use_scan_views() const;
+    bool is_scan_view_spend(const crypto::hash &txid, const std::vector<crypto::key_image> &key_images) const;
+    void fetch_scan_view_spends(const std::vector<parsed_block> &parsed_blocks, std::unordered_map<crypto::hash, cryptonote::transaction> &txes);
+    void fetch_scan_view_txes(uint64_t blocks_start_height, std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<cryptonote::blobdata> &scan_views, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_asset_type_output_indices> &asset_type_output_indices, std::vector<std::unordered_map<size_t, std::vector<crypto::key_image>>> &unfetched_txes);
+    void get_pruned_tx_blobs(const std::vector<crypto::hash> &txids, std::vector<cryptonote::blobdata> &blobs);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
     void pull_and_parse_next_blocks(bool first, bool try_incremental, uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::vector<std::tuple<cryptonote::transaction, crypto::hash, bool>>& process_pool_txs, bool &last, bool &error, std::exception_ptr &exception);
@@ -1818,6 +1855,7 @@ private:
     bool is_spent(size_t idx, bool strict = true) const;
     void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, bool rct, std::unordered_set<crypto::public_key> &valid_public_keys_cache);
     void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, std::vector<uint64_t> &rct_offsets, uint64_t &num_spendable_global_outs, std::unordered_set<crypto::public_key> &valid_public_keys_cache);
+    void prefetch_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count, std::unordered_set<crypto::public_key> &valid_public_keys_cache);
     bool tx_add_fake_output(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, uint64_t global_index, const crypto::public_key& tx_public_key, const rct::key& mask, uint64_t real_index, bool unlocked, std::unordered_set<crypto::public_key> &valid_public_keys_cache) const;
     bool should_pick_a_second_output(bool use_rct, size_t n_transfers, const std::vector<size_t> &unused_transfers_indices, const std::vector<size_t> &unused_dust_indices) const;
     std::vector<size_t> get_only_rct(const std::vector<size_t> &unused_dust_indices, const std::vector<size_t> &unused_transfers_indices) const;
@@ -1870,6 +1908,7 @@ private:
     boost::optional<epee::net_utils::http::login> m_daemon_login;
     std::string m_daemon_address;
     std::string m_proxy;
+    std::string m_daemon_proxy; // the proxy in effect for the daemon, either m_proxy or the one given to set_daemon
     std::string m_wallet_file;
     std::string m_keys_file;
     std::string m_mms_file;
@@ -1903,6 +1942,16 @@ private:
 
     boost::recursive_mutex m_daemon_rpc_mutex;
 
+    // last rct output distribution fetched per asset type, so later fetches
+    // only need the blocks added since
+    struct rct_distribution_cache_entry
+    {
+      uint64_t start_height;
+      uint64_t base;
+      std::vector<uint64_t> distribution; // cumulative, relative to base
+    };
+    std::unordered_map<std::string, rct_distribution_cache_entry> m_rct_distribution_cache;
+
     bool m_trusted_daemon;
     i_wallet2_callback* m_callback;
     hw::device::device_type m_key_device_type;
@@ -1950,6 +1999,7 @@ private:
     uint64_t m_ignore_outputs_above;
     uint64_t m_ignore_outputs_below;
     bool m_track_uses;
+    bool m_scan_view_refresh;
     bool m_show_wallet_name_when_locked;
     uint32_t m_inactivity_lock_timeout;
     BackgroundMiningSetupType m_setup_background_mining;
@@ -1973,6 +2023,7 @@ private:
     std::string m_ring_database;
     bool m_ring_history_saved;
     std::unique_ptr<ringdb> m_ringdb;
+    std::unique_ptr<daemon_zmq_listener> m_daemon_zmq_listener;
     boost::optional<crypto::chacha_key> m_ringdb_key;
 
     uint64_t m_last_block_reward;
@@ -2570,6 +2621,37 @@ namespace tools
       LOG_PRINT_L0("amount=" << cryptonote::print_money(src.amount) << ", real_output=" <<src.real_output << ", real_output_in_tx_index=" << src.real_output_in_tx_index << ", indexes: " << indexes);
     }
     //----------------------------------------------------------------------------------------------------
+    // Runs the final construction pass over a split transfer. Each tx already has its
+    // inputs, rings and fee fixed, so they can be proven and signed concurrently; the
+    // results land in their own slot, keeping the output order deterministic.
+    // construct must not talk to the daemon when parallel is set.
+    template<typename TX, typename F>
+    void construct_final_txes(std::vector<TX> &txes, const F &construct, bool parallel)
+    {
+      if (!parallel || txes.size() < 2)
+      {
+        for (TX &tx: txes)
+          construct(tx);
+        return;
+      }
+
+      std::vector<std::exception_ptr> errors(txes.size());
+      tools::threadpool& tpool = tools::threadpool::getInstanceForCompute();
+      tools::threadpool::waiter waiter(tpool);
+      for (size_t i = 0; i < txes.size(); ++i)
+      {
+        tpool.submit(&waiter, [&, i] {
+          try { construct(txes[i]); }
+          catch (...) { errors[i] = std::current_exception(); }
+        });
+      }
+      THROW_WALLET_EXCEPTION_IF(!waiter.wait(), error::wallet_internal_error, "Failed to construct transactions");
+      // rethrow the first failure as-is, so callers still see e.g. tx_too_big
+      for (const std::exception_ptr &e: errors)
+        if (e)
+          std::rethrow_exception(e);
+    }
+    //----------------------------------------------------------------------------------------------------
   }
   //----------------------------------------------------------------------------------------------------
 }
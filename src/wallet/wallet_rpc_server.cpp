@@ -55,6 +55,7 @@ using namespace epee;
 #include "rpc/rpc_args.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "daemonizer/daemonizer.h"
+#include "ringct/bulletproofs_plus.h"
 
 #include "oracle/asset_types.h"
 
@@ -83,6 +84,7 @@ namespace
   const command_line::arg_descriptor<std::string> arg_wallet_dir = {"wallet-dir", "Directory for newly created wallets"};
   const command_line::arg_descriptor<bool> arg_prompt_for_password = {"prompt-for-password", "Prompts for password when not provided", false};
   const command_line::arg_descriptor<bool> arg_no_initial_sync = {"no-initial-sync", "Skips the initial sync before listening for connections", false};
+  const command_line::arg_descriptor<std::string> arg_bpp_generator_cache = {"bpp-generator-cache", "File to load/save the Bulletproof+ generators from, to speed up startup", ""};
 
   constexpr const char default_rpc_username[] = "zephyr";
 
@@ -151,8 +153,24 @@ namespace tools
     m_net_server.add_idle_handler([this](){
       if (m_auto_refresh_period == 0) // disabled
         return true;
-      if (boost::posix_time::microsec_clock::universal_time() < m_last_auto_refresh_time + boost::posix_time::seconds(m_auto_refresh_period))
-        return true;
+      if (!m_auto_refresh_unfinished)
+      {
+        const bool period_elapsed = boost::posix_time::microsec_clock::universal_time() >= m_last_auto_refresh_time + boost::posix_time::seconds(m_auto_refresh_period);
+        // while the daemon tells us about new blocks and pool txes, there is no need to ask it every so often;
+        // new blocks are picked up right away, but a busy pool does not get to refresh more often than polling would
+        if (m_wallet && m_wallet->is_daemon_zmq_pub_connected())
+        {
+          const bool chain_news = m_wallet->take_daemon_zmq_chain_news();
+          if (!chain_news && !period_elapsed)
+            return true;
+          // the refresh checks the pool too, so it covers any pool news
+          const bool pool_news = m_wallet->take_daemon_zmq_pool_news();
+          if (!chain_news && !pool_news)
+            return true;
+        }
+        else if (!period_elapsed)
+          return true;
+      }
       uint64_t blocks_fetched = 0;
       try {
         bool received_money = false;
@@ -162,7 +180,8 @@ namespace tools
       }
       // if we got the max amount of blocks, do not set the last refresh time, we did only part of the refresh and will
       // continue asap, and only set the last refresh time once the refresh is actually finished
-      if (blocks_fetched < REFRESH_INFICATIVE_BLOCK_CHUNK_SIZE)
+      m_auto_refresh_unfinished = blocks_fetched >= REFRESH_INFICATIVE_BLOCK_CHUNK_SIZE;
+      if (!m_auto_refresh_unfinished)
         m_last_auto_refresh_time = boost::posix_time::microsec_clock::universal_time();
       return true;
     }, 1000);
@@ -202,6 +221,13 @@ namespace tools
     std::string bind_port = command_line::get_arg(*m_vm, arg_rpc_bind_port);
     const bool disable_auth = command_line::get_arg(*m_vm, arg_disable_rpc_login);
     m_restricted = command_line::get_arg(*m_vm, arg_restricted);
+    if (!command_line::is_arg_defaulted(*m_vm, arg_bpp_generator_cache))
+    {
+      rct::bulletproof_plus_config bpp_config;
+      bpp_config.generator_cache_file = command_line::get_arg(*m_vm, arg_bpp_generator_cache);
+      if (!rct::bulletproof_plus_configure(bpp_config))
+        MWARNING("Failed to set up the Bulletproof+ generator cache");
+    }
     if (!command_line::is_arg_defaulted(*m_vm, arg_wallet_dir))
     {
       if (!command_line::is_arg_defaulted(*m_vm, wallet_args::arg_wallet_file()))
@@ -276,6 +302,7 @@ namespace tools
 
     m_auto_refresh_period = DEFAULT_AUTO_REFRESH_PERIOD;
     m_last_auto_refresh_time = boost::posix_time::min_date_time;
+    m_auto_refresh_unfinished = false;
 
     check_background_mining();
 
@@ -1214,7 +1241,7 @@ namespace tools
       uint64_t mixin = m_wallet->adjust_mixin(req.ring_size ? req.ring_size - 1 : 0);
       uint32_t priority = m_wallet->adjust_priority(req.priority);
       LOG_PRINT_L2("on_transfer_split calling create_transactions_2");
-      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_2(dsts, source_asset, mixin, req.unlock_time, priority, extra, req.account_index, req.subaddr_indices);
+      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_2(dsts, source_asset, mixin, req.unlock_time, priority, extra, req.account_index, req.subaddr_indices, {}, req.parallel);
       LOG_PRINT_L2("on_transfer_split called create_transactions_2");
 
       if (ptx_vector.empty())
@@ -1672,7 +1699,7 @@ namespace tools
     {
       uint64_t mixin = m_wallet->adjust_mixin(req.ring_size ? req.ring_size - 1 : 0);
       uint32_t priority = m_wallet->adjust_priority(req.priority);
-      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_all(req.below_amount, asset_type, asset_type, dsts[0].addr, dsts[0].is_subaddress, req.outputs, mixin, req.unlock_time, priority, extra, req.account_index, subaddr_indices);
+      std::vector<wallet2::pending_tx> ptx_vector = m_wallet->create_transactions_all(req.below_amount, asset_type, asset_type, dsts[0].addr, dsts[0].is_subaddress, req.outputs, mixin, req.unlock_time, priority, extra, req.account_index, subaddr_indices, req.parallel);
 
       return fill_response(ptx_vector, req.get_tx_keys, res.tx_key_list, res.amount_list, res.amounts_by_dest_list, res.fee_list, res.weight_list, res.multisig_txset, res.unsigned_txset, req.do_not_relay,
           res.tx_hash_list, req.get_tx_hex, res.tx_blob_list, req.get_tx_metadata, res.tx_metadata_list, res.spent_key_images_list, er);
@@ -4867,6 +4894,7 @@ int main(int argc, char** argv) {
   command_line::add_arg(desc_params, arg_wallet_dir);
   command_line::add_arg(desc_params, arg_prompt_for_password);
   command_line::add_arg(desc_params, arg_no_initial_sync);
+  command_line::add_arg(desc_params, arg_bpp_generator_cache);
   command_line::add_arg(hidden_options, daemonizer::arg_non_interactive);
 
   daemonizer::init_options(hidden_options, desc_params);
@@ -281,5 +281,6 @@ namespace tools
       const boost::program_options::variables_map *m_vm;
       uint32_t m_auto_refresh_period;
       boost::posix_time::ptime m_last_auto_refresh_time;
+      bool m_auto_refresh_unfinished; //!< the last auto refresh only got part of the blocks
   };
 }
@@ -0,0 +1,78 @@
+// Copyright (c) 2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdlib>
+#include <cstring>
+#include "include_base_utils.h"
+extern "C"
+{
+#include "crypto/crypto-ops.h"
+}
+#include "fuzzer.h"
+
+// Decodes each 32 byte chunk of the input with every available field
+// backend and aborts if any of them disagrees with ref10
+static void decode(int backend, const uint8_t *s, int &r, unsigned char *point, unsigned char *hashed)
+{
+  if (fe_select_backend(backend) != 0)
+    abort();
+  ge_p3 p3;
+  r = ge_frombytes_vartime(&p3, s);
+  if (r == 0)
+    ge_p3_tobytes(point, &p3);
+  ge_p2 p2;
+  ge_fromfe_frombytes_vartime(&p2, s);
+  ge_tobytes(hashed, &p2);
+}
+
+BEGIN_INIT_SIMPLE_FUZZER()
+END_INIT_SIMPLE_FUZZER()
+
+BEGIN_SIMPLE_FUZZER()
+  static const int backends[] = {
+    FE_BACKEND_REF10,
+#if defined(FE_HAVE_RADIX51)
+    FE_BACKEND_RADIX51,
+#endif
+  };
+  for (size_t offset = 0; offset + 32 <= len; offset += 32)
+  {
+    int r_ref;
+    unsigned char point_ref[32], hashed_ref[32];
+    decode(FE_BACKEND_REF10, buf + offset, r_ref, point_ref, hashed_ref);
+    for (int backend: backends)
+    {
+      int r;
+      unsigned char point[32], hashed[32];
+      decode(backend, buf + offset, r, point, hashed);
+      if (r != r_ref || (r == 0 && memcmp(point, point_ref, 32)) || memcmp(hashed, hashed_ref, 32))
+        abort();
+    }
+  }
+  fe_select_backend(FE_BACKEND_DEFAULT);
+END_SIMPLE_FUZZER()
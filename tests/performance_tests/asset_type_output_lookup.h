@@ -0,0 +1,182 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#pragma once
+
+#include <memory>
+#include <random>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+#include "crypto/crypto.h"
+#include "ringct/rctOps.h"
+
+// A synthetic chain of coinbase-only blocks, shared by all the output lookup tests since
+// writing a few million outputs takes a while
+class synthetic_output_db
+{
+public:
+  static const size_t num_outputs = 1 << 21;
+  static const size_t outputs_per_block = 2048;
+
+  static synthetic_output_db *instance()
+  {
+    static std::unique_ptr<synthetic_output_db> db;
+    if (!db)
+    {
+      db.reset(new synthetic_output_db());
+      if (!db->init())
+        db.reset();
+    }
+    return db.get();
+  }
+
+  ~synthetic_output_db()
+  {
+    if (m_db)
+    {
+      m_db->close();
+      m_db.reset();
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_path, ec);
+  }
+
+  cryptonote::BlockchainDB &db() { return *m_db; }
+
+private:
+  bool init()
+  {
+    m_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    m_db.reset(new cryptonote::BlockchainLMDB());
+    m_db->open(m_path, DBF_FASTEST);
+    m_hardfork.reset(new cryptonote::HardFork(*m_db, 1, 0));
+    m_hardfork->init();
+    m_db->set_hard_fork(m_hardfork.get());
+
+    crypto::hash prev_id = crypto::null_hash;
+    for (uint64_t height = 0; height < num_outputs / outputs_per_block; ++height)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = height;
+      b.prev_id = prev_id;
+      b.miner_tx.version = 2;
+      b.miner_tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{height});
+      b.miner_tx.rct_signatures.type = rct::RCTTypeNull;
+      for (size_t n = 0; n < outputs_per_block; ++n)
+      {
+        // the db does not validate outputs, so random keys will do
+        cryptonote::tx_out out;
+        out.amount = 1;
+        out.target = cryptonote::txout_zephyr_tagged_key(rct::rct2pk(rct::skGen()), "ZPH", crypto::view_tag{});
+        b.miner_tx.vout.push_back(out);
+      }
+      cryptonote::db_wtxn_guard guard(m_db.get());
+      m_db->add_block(std::make_pair(b, cryptonote::block_to_blob(b)), 0, 0, 1, 0, 0, 0, 0, {});
+      prev_id = cryptonote::get_block_hash(b);
+    }
+    return m_db->get_num_outputs_of_asset_type("ZPH") == num_outputs;
+  }
+
+  std::string m_path;
+  std::unique_ptr<cryptonote::BlockchainDB> m_db;
+  std::unique_ptr<cryptonote::HardFork> m_hardfork;
+};
+
+// Resolves the asset type output indices of a get_outs.bin request (16 rings of 16 members)
+// to output keys, either one lookup at a time or with the sorted bulk lookup
+template<bool bulk>
+class test_asset_type_output_lookup
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t ring_size = 16;
+  static const size_t num_inputs = 16;
+  static const size_t num_requests = 64;
+
+  bool init()
+  {
+    m_db = synthetic_output_db::instance();
+    if (!m_db)
+      return false;
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<uint64_t> index(0, synthetic_output_db::num_outputs - 1);
+    m_requests.resize(num_requests);
+    for (auto &request: m_requests)
+      for (size_t n = 0; n < ring_size * num_inputs; ++n)
+        request.push_back(index(rng));
+    m_request = 0;
+
+    // both paths must agree before timing either of them
+    std::vector<uint64_t> ids, bulk_ids;
+    std::vector<cryptonote::output_data_t> outputs, bulk_outputs;
+    lookup_one_by_one(m_requests[0], ids, outputs);
+    m_db->db().get_output_data_from_asset_type_output_indices("ZPH", m_requests[0], bulk_ids, bulk_outputs);
+    if (ids != bulk_ids || outputs.size() != bulk_outputs.size())
+      return false;
+    for (size_t n = 0; n < outputs.size(); ++n)
+      if (outputs[n].pubkey != bulk_outputs[n].pubkey || !(outputs[n].commitment == bulk_outputs[n].commitment) || outputs[n].height != bulk_outputs[n].height)
+        return false;
+    return true;
+  }
+
+  bool test()
+  {
+    const std::vector<uint64_t> &request = m_requests[m_request++ % num_requests];
+    std::vector<uint64_t> ids;
+    std::vector<cryptonote::output_data_t> outputs;
+    if (bulk)
+      m_db->db().get_output_data_from_asset_type_output_indices("ZPH", request, ids, outputs);
+    else
+      lookup_one_by_one(request, ids, outputs);
+    return outputs.size() == request.size();
+  }
+
+private:
+  // the path get_outs used to take
+  void lookup_one_by_one(const std::vector<uint64_t> &request, std::vector<uint64_t> &ids, std::vector<cryptonote::output_data_t> &outputs)
+  {
+    m_db->db().get_output_id_from_asset_type_output_index("ZPH", request, ids);
+    const uint64_t amount = 0;
+    m_db->db().get_output_key(epee::span<const uint64_t>(&amount, 1), ids, outputs);
+  }
+
+  synthetic_output_db *m_db;
+  std::vector<std::vector<uint64_t>> m_requests;
+  size_t m_request;
+};
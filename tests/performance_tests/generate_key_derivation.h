@@ -30,6 +30,9 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 
@@ -47,3 +50,37 @@ public:
     return true;
   }
 };
+
+template<size_t batch_size>
+class test_generate_key_derivations
+{
+public:
+  static const size_t loop_count = batch_size >= 1024 ? 10 : batch_size >= 64 ? 100 : 1000;
+
+  bool init()
+  {
+    crypto::public_key pub;
+    crypto::generate_keys(pub, m_view_secret_key);
+    m_tx_pub_keys.resize(batch_size);
+    for (auto &key: m_tx_pub_keys)
+    {
+      crypto::secret_key sec;
+      crypto::generate_keys(key, sec);
+    }
+    m_derivations.resize(batch_size);
+    m_results.reset(new bool[batch_size]);
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::generate_key_derivations(m_tx_pub_keys.data(), batch_size, m_view_secret_key, m_derivations.data(), m_results.get());
+    return true;
+  }
+
+private:
+  crypto::secret_key m_view_secret_key;
+  std::vector<crypto::public_key> m_tx_pub_keys;
+  std::vector<crypto::key_derivation> m_derivations;
+  std::unique_ptr<bool[]> m_results;
+};
@@ -0,0 +1,152 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#pragma once
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "byte_slice.h"
+#include "cryptonote_basic/compact_output_indices.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "serialization/binary_utils.h"
+#include "storages/portable_storage_template_helper.h"
+
+// Stores (or loads) the output indices of a 1000 block get_blocks.bin response, either as
+// the per tx vectors of portable storage or as one compact_output_indices blob per block
+template<bool compact, bool load>
+class test_get_blocks_output_indices
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t num_blocks = 1000;
+
+  typedef cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response response;
+
+  bool init()
+  {
+    // a miner tx with two outputs, and up to 16 txes with two outputs each in
+    // one of four asset types, starting from a mainnet sized chain
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> n_txes(0, 16), asset_type(0, 3);
+    uint64_t index = 5000000;
+    uint64_t asset_type_index[] = {4000000, 600000, 300000, 100000};
+    m_indices.resize(num_blocks);
+    m_asset_type_indices.resize(num_blocks);
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+      const size_t n = 1 + n_txes(rng);
+      for (size_t t = 0; t < n; ++t)
+      {
+        m_indices[i].emplace_back();
+        m_asset_type_indices[i].emplace_back();
+        for (size_t o = 0; o < 2; ++o)
+        {
+          const size_t asset = t == 0 ? 0 : asset_type(rng);
+          m_indices[i].back().push_back(index++);
+          m_asset_type_indices[i].back().push_back(asset_type_index[asset]++);
+        }
+      }
+    }
+
+    response res;
+    epee::byte_slice blob;
+    if (!store(res, blob))
+      return false;
+    m_blob.assign(reinterpret_cast<const char*>(blob.data()), blob.size());
+    if (!test())
+      return false;
+    std::cout << "  " << (compact ? "compact" : "portable storage") << " output indices: " << m_blob.size() << " bytes for " << num_blocks << " blocks" << std::endl;
+    return true;
+  }
+
+  bool test()
+  {
+    response res;
+    if (load)
+      return load_response(res);
+    epee::byte_slice blob;
+    return store(res, blob) && blob.size() == m_blob.size();
+  }
+
+private:
+  bool store(response &res, epee::byte_slice &blob)
+  {
+    if (compact)
+    {
+      res.compact_output_indices.resize(num_blocks);
+      for (size_t i = 0; i < num_blocks; ++i)
+      {
+        cryptonote::compact_output_indices compact_indices;
+        if (!cryptonote::get_compact_output_indices(m_indices[i], m_asset_type_indices[i], compact_indices)
+            || !::serialization::dump_binary(compact_indices, res.compact_output_indices[i]))
+          return false;
+      }
+    }
+    else
+    {
+      res.output_indices.resize(num_blocks);
+      res.asset_type_output_indices.resize(num_blocks);
+      for (size_t i = 0; i < num_blocks; ++i)
+      {
+        for (const auto &tx_indices: m_indices[i])
+          res.output_indices[i].indices.push_back({tx_indices});
+        for (const auto &tx_indices: m_asset_type_indices[i])
+          res.asset_type_output_indices[i].indices.push_back({tx_indices});
+      }
+    }
+    return epee::serialization::store_t_to_binary(res, blob);
+  }
+
+  bool load_response(response &res)
+  {
+    if (!epee::serialization::load_t_from_binary(res, m_blob))
+      return false;
+    if (!compact)
+      return res.output_indices.size() == num_blocks && res.output_indices.back().indices.back().indices == m_indices.back().back();
+    if (res.compact_output_indices.size() != num_blocks)
+      return false;
+    std::vector<std::vector<uint64_t>> indices, asset_type_indices;
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+      cryptonote::compact_output_indices compact_indices;
+      if (!::serialization::parse_binary(res.compact_output_indices[i], compact_indices)
+          || !cryptonote::get_output_indices(compact_indices, indices, asset_type_indices))
+        return false;
+    }
+    return indices == m_indices.back() && asset_type_indices == m_asset_type_indices.back();
+  }
+
+  std::vector<std::vector<std::vector<uint64_t>>> m_indices;
+  std::vector<std::vector<std::vector<uint64_t>>> m_asset_type_indices;
+  std::string m_blob;
+};
@@ -36,6 +36,7 @@
 #include "performance_utils.h"
 
 // tests
+#include "asset_type_output_lookup.h"
 #include "construct_tx.h"
 #include "check_tx_signature.h"
 #include "check_hash.h"
@@ -49,6 +50,7 @@
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
+#include "get_blocks_output_indices.h"
 #include "signature.h"
 #include "is_out_to_acc.h"
 #include "out_can_be_to_acc.h"
@@ -196,6 +198,14 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE4(filter, p, test_check_hash, 0xffffffffffffffff, 0xffffffffffffffff, 0, 1);
   TEST_PERFORMANCE4(filter, p, test_check_hash, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff, 0xffffffffffffffff);
 
+  TEST_PERFORMANCE1(filter, p, test_asset_type_output_lookup, false);
+  TEST_PERFORMANCE1(filter, p, test_asset_type_output_lookup, true);
+
+  TEST_PERFORMANCE2(filter, p, test_get_blocks_output_indices, false, false); // portable storage, store
+  TEST_PERFORMANCE2(filter, p, test_get_blocks_output_indices, false, true); // portable storage, load
+  TEST_PERFORMANCE2(filter, p, test_get_blocks_output_indices, true, false); // compact, store
+  TEST_PERFORMANCE2(filter, p, test_get_blocks_output_indices, true, true); // compact, load
+
   TEST_PERFORMANCE0(filter, p, test_is_out_to_acc);
   TEST_PERFORMANCE0(filter, p, test_is_out_to_acc_precomp);
   TEST_PERFORMANCE2(filter, p, test_out_can_be_to_acc, false, true); // no view tag, owned
@@ -203,6 +213,12 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, p, test_out_can_be_to_acc, true, true); // use view tag, owned
   TEST_PERFORMANCE0(filter, p, test_generate_key_image_helper);
   TEST_PERFORMANCE0(filter, p, test_generate_key_derivation);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 1);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 16);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 64);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 256);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 1024);
+  TEST_PERFORMANCE1(filter, p, test_generate_key_derivations, 4096);
   TEST_PERFORMANCE0(filter, p, test_generate_key_image);
   TEST_PERFORMANCE0(filter, p, test_derive_public_key);
   TEST_PERFORMANCE0(filter, p, test_derive_secret_key);
@@ -0,0 +1,287 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <thread>
+#include <boost/thread/mutex.hpp>
+#include "gtest/gtest.h"
+#include "string_tools.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "rpc/block_template_long_poll.h"
+
+using cryptonote::block_template_long_poll;
+
+namespace
+{
+  crypto::hash make_hash(uint8_t n)
+  {
+    crypto::hash h = crypto::null_hash;
+    h.data[0] = n;
+    return h;
+  }
+
+  cryptonote::account_public_address make_address(uint8_t n)
+  {
+    cryptonote::account_public_address address{};
+    address.m_spend_public_key.data[0] = n;
+    address.m_view_public_key.data[0] = n;
+    return address;
+  }
+
+  struct fake_chain
+  {
+    boost::mutex mutex;
+    crypto::hash tail_id = make_hash(1);
+    uint64_t pool_cookie = 0;
+    uint64_t fees = 0;
+    uint64_t pricing_record_timestamp = 1000;
+    std::atomic<unsigned> builds{0};
+    std::atomic<unsigned> fresh_builds{0};
+
+    block_template_long_poll::template_source source()
+    {
+      return {
+        [this](const cryptonote::account_public_address &address, const cryptonote::blobdata &extra_nonce, bool fresh, block_template_long_poll::block_template &t) {
+          boost::unique_lock<boost::mutex> lock(mutex);
+          ++builds;
+          if (fresh)
+            ++fresh_builds;
+          t = block_template_long_poll::block_template();
+          t.b.prev_id = tail_id;
+          t.b.pricing_record.timestamp = pricing_record_timestamp;
+          t.expected_reward = 100 + fees;
+          t.height = 10;
+          return cryptonote::add_extra_nonce_to_tx_extra(t.b.miner_tx.extra, extra_nonce);
+        },
+        [this]() { boost::unique_lock<boost::mutex> lock(mutex); return pool_cookie; },
+        [this]() { boost::unique_lock<boost::mutex> lock(mutex); return tail_id; }
+      };
+    }
+
+    void add_tx(uint64_t fee)
+    {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      ++pool_cookie;
+      fees += fee;
+    }
+
+    void add_block(block_template_long_poll &long_poll)
+    {
+      {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        tail_id = make_hash(tail_id.data[0] + 1);
+        fees = 0;
+      }
+      long_poll.on_block_added();
+    }
+  };
+
+  bool get_extra_nonce(const cryptonote::block &b, cryptonote::blobdata &extra_nonce)
+  {
+    std::vector<cryptonote::tx_extra_field> fields;
+    cryptonote::parse_tx_extra(b.miner_tx.extra, fields);
+    cryptonote::tx_extra_nonce nonce;
+    if (!cryptonote::find_tx_extra_field_by_type(fields, nonce))
+      return false;
+    extra_nonce = nonce.nonce;
+    return true;
+  }
+}
+
+TEST(block_template_long_poll, id)
+{
+  const block_template_long_poll::template_key key{make_hash(7), 1234, 600000000000};
+  const std::string id = block_template_long_poll::get_id(key);
+
+  block_template_long_poll::template_key parsed;
+  ASSERT_TRUE(block_template_long_poll::parse_id(id, parsed));
+  EXPECT_EQ(key.prev_id, parsed.prev_id);
+  EXPECT_EQ(key.pricing_record_timestamp, parsed.pricing_record_timestamp);
+  EXPECT_EQ(key.expected_reward, parsed.expected_reward);
+
+  const std::string hex = epee::string_tools::pod_to_hex(make_hash(7));
+  EXPECT_FALSE(block_template_long_poll::parse_id("", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id(hex + ":1", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id(hex + ":1:2:3", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id("zz:1:2", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id(hex + ":-1:2", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id(hex + ":1:", parsed));
+  EXPECT_FALSE(block_template_long_poll::parse_id(hex + ":1:99999999999999999999", parsed));
+}
+
+TEST(block_template_long_poll, is_changed)
+{
+  const block_template_long_poll::template_key old{make_hash(1), 1000, 500};
+
+  EXPECT_FALSE(block_template_long_poll::is_changed(old, old, 0));
+  EXPECT_TRUE(block_template_long_poll::is_changed(old, {make_hash(2), 1000, 500}, 0));
+  EXPECT_TRUE(block_template_long_poll::is_changed(old, {make_hash(1), 1120, 500}, 0));
+  EXPECT_TRUE(block_template_long_poll::is_changed(old, {make_hash(1), 1000, 499}, 1000));
+  EXPECT_TRUE(block_template_long_poll::is_changed(old, {make_hash(1), 1000, 501}, 0));
+  EXPECT_FALSE(block_template_long_poll::is_changed(old, {make_hash(1), 1000, 549}, 50));
+  EXPECT_TRUE(block_template_long_poll::is_changed(old, {make_hash(1), 1000, 550}, 50));
+}
+
+TEST(block_template_long_poll, set_extra_nonce)
+{
+  cryptonote::block b{};
+  ASSERT_TRUE(cryptonote::add_extra_nonce_to_tx_extra(b.miner_tx.extra, cryptonote::blobdata(8, 0)));
+  const size_t size = b.miner_tx.extra.size();
+
+  ASSERT_TRUE(block_template_long_poll::set_extra_nonce(b, "abcdefgh"));
+  cryptonote::blobdata extra_nonce;
+  ASSERT_TRUE(get_extra_nonce(b, extra_nonce));
+  EXPECT_EQ("abcdefgh", extra_nonce);
+  EXPECT_EQ(size, b.miner_tx.extra.size());
+
+  ASSERT_TRUE(block_template_long_poll::set_extra_nonce(b, ""));
+  EXPECT_FALSE(get_extra_nonce(b, extra_nonce));
+}
+
+TEST(block_template_long_poll, times_out_unchanged)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::milliseconds(10));
+  const auto address = make_address(1);
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(address, "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  EXPECT_EQ(chain.tail_id, t.b.prev_id);
+  EXPECT_EQ(100u, t.expected_reward);
+  EXPECT_EQ(1u, chain.fresh_builds);
+
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(long_poll.wait(address, "", t.get_key(), 0, std::chrono::milliseconds(100), t));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+  EXPECT_EQ(chain.tail_id, t.b.prev_id);
+  EXPECT_EQ(100u, t.expected_reward);
+  // nothing changed, so the pricing record is not asked for again
+  EXPECT_EQ(1u, chain.fresh_builds);
+  EXPECT_EQ(1u, chain.builds);
+}
+
+TEST(block_template_long_poll, wakes_on_new_block)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::seconds(60));
+  const auto address = make_address(1);
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(address, "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  const auto old = t.get_key();
+
+  std::thread thread([&]{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    chain.add_block(long_poll);
+  });
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(long_poll.wait(address, "", old, 0, std::chrono::seconds(30), t));
+  thread.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+  EXPECT_EQ(chain.tail_id, t.b.prev_id);
+  EXPECT_NE(old.prev_id, t.b.prev_id);
+}
+
+TEST(block_template_long_poll, fee_threshold)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::milliseconds(10));
+  const auto address = make_address(1);
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(address, "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  const auto old = t.get_key();
+
+  // too little to care about
+  chain.add_tx(10);
+  ASSERT_TRUE(long_poll.wait(address, "", old, 50, std::chrono::milliseconds(100), t));
+  EXPECT_EQ(110u, t.expected_reward);
+  EXPECT_FALSE(block_template_long_poll::is_changed(old, t.get_key(), 50));
+
+  std::thread thread([&]{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    chain.add_tx(40);
+  });
+  const auto start = std::chrono::steady_clock::now();
+  ASSERT_TRUE(long_poll.wait(address, "", old, 50, std::chrono::seconds(30), t));
+  thread.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+  EXPECT_EQ(150u, t.expected_reward);
+}
+
+TEST(block_template_long_poll, own_extra_nonce)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::seconds(60));
+  const auto address = make_address(1);
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(address, "1234", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  cryptonote::blobdata extra_nonce;
+  ASSERT_TRUE(get_extra_nonce(t.b, extra_nonce));
+  EXPECT_EQ("1234", extra_nonce);
+
+  ASSERT_TRUE(long_poll.wait(address, "5678", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  ASSERT_TRUE(get_extra_nonce(t.b, extra_nonce));
+  EXPECT_EQ("5678", extra_nonce);
+  EXPECT_EQ(1u, chain.builds);
+
+  // a nonce of another size changes the block weight, and so the reward
+  EXPECT_FALSE(long_poll.wait(address, "123456", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+}
+
+TEST(block_template_long_poll, other_address)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::seconds(60));
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(make_address(1), "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  EXPECT_FALSE(long_poll.wait(make_address(2), "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+}
+
+TEST(block_template_long_poll, stop)
+{
+  fake_chain chain;
+  block_template_long_poll long_poll(chain.source(), std::chrono::seconds(60));
+  const auto address = make_address(1);
+
+  block_template_long_poll::block_template t;
+  ASSERT_TRUE(long_poll.wait(address, "", {crypto::null_hash, 0, 0}, 0, std::chrono::seconds(5), t));
+  const auto old = t.get_key();
+
+  std::thread thread([&]{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    long_poll.stop();
+  });
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(long_poll.wait(address, "", old, 0, std::chrono::seconds(30), t));
+  thread.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+  EXPECT_FALSE(long_poll.wait(address, "", old, 0, std::chrono::seconds(30), t));
+}
@@ -0,0 +1,313 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gtest/gtest.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_core/block_template_selection.h"
+
+using cryptonote::template_fit;
+using cryptonote::template_selection;
+using cryptonote::template_tx;
+
+namespace
+{
+  crypto::hash make_txid(int n)
+  {
+    crypto::hash h = crypto::null_hash;
+    memcpy(h.data, &n, sizeof(n));
+    return h;
+  }
+
+  crypto::key_image make_key_image(int n)
+  {
+    crypto::key_image ki;
+    memset(ki.data, 0, sizeof(ki.data));
+    memcpy(ki.data, &n, sizeof(n));
+    return ki;
+  }
+
+  struct fake_tx
+  {
+    double fee_per_byte;
+    size_t weight;
+    std::vector<int> key_images;
+    int64_t reserve_change; //!< 0 for a plain transfer
+  };
+
+  // a pool whose checks stand in for the real ones: a conversion may not take
+  // the reserve below 0, which depends on the conversions chosen before it
+  class fake_pool
+  {
+  public:
+    void add_tx(template_selection &sel, int n, const fake_tx &tx)
+    {
+      m_txes[make_txid(n)] = tx;
+      m_order.push_back(n);
+      sel.note_change(make_txid(n), tx.fee_per_byte, true);
+    }
+
+    void remove_tx(template_selection &sel, int n)
+    {
+      m_txes.erase(make_txid(n));
+      m_order.erase(std::find(m_order.begin(), m_order.end(), n));
+      sel.note_change(make_txid(n), 0, false);
+    }
+
+    // what fill_block_template does without a selection to update
+    void fill(template_selection &sel)
+    {
+      sel.median_weight = 300000;
+      sel.already_generated_coins = 1000000000000000000ull;
+      sel.version = 1;
+      sel.max_total_weight = 2 * sel.median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+      uint64_t reward;
+      ASSERT_TRUE(cryptonote::get_block_reward(sel.median_weight, 0, sel.already_generated_coins, reward, sel.version));
+      sel.clear(reward);
+      std::vector<int> order = m_order;
+      std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return m_txes[make_txid(a)].fee_per_byte > m_txes[make_txid(b)].fee_per_byte;
+      });
+      for (int n: order)
+        if (add(sel, make_txid(n), m_txes[make_txid(n)].fee_per_byte) == template_fit::no_room)
+          sel.no_room.emplace(make_txid(n), m_txes[make_txid(n)].fee_per_byte);
+      sel.changes.clear();
+      sel.valid = true;
+    }
+
+    //! returns whether the changes could be applied without a full pass
+    bool update(template_selection &sel)
+    {
+      const bool incremental = sel.valid && cryptonote::update_template_selection(sel, get_pool());
+      if (!incremental)
+        fill(sel);
+      sel.changes.clear();
+      sel.valid = true;
+      return incremental;
+    }
+
+  private:
+    cryptonote::template_pool get_pool()
+    {
+      return {
+        [this](template_selection &sel, const crypto::hash &txid, double fee_per_byte) { return add(sel, txid, fee_per_byte); },
+        [this](const crypto::key_image &ki, std::vector<std::pair<crypto::hash, double>> &spenders) {
+          for (const auto &e: m_txes)
+            for (int n: e.second.key_images)
+              if (make_key_image(n) == ki)
+                spenders.push_back({e.first, e.second.fee_per_byte});
+        }
+      };
+    }
+
+    template_fit add(template_selection &sel, const crypto::hash &txid, double fee_per_byte)
+    {
+      const auto it = m_txes.find(txid);
+      if (it == m_txes.end())
+        return template_fit::skipped;
+      const fake_tx &tx = it->second;
+      if (sel.total_weight + tx.weight > sel.max_total_weight)
+        return template_fit::no_room;
+      for (int n: tx.key_images)
+        if (sel.key_images.find(make_key_image(n)) != sel.key_images.end())
+          return template_fit::skipped;
+      if (tx.reserve_change && sel.total_conversion_zeph + tx.reserve_change < 0)
+        return template_fit::skipped;
+      uint64_t reward;
+      if (!cryptonote::get_block_reward(sel.median_weight, sel.total_weight + tx.weight, sel.already_generated_coins, reward, sel.version))
+        return template_fit::no_room;
+
+      template_tx e = {};
+      e.txid = txid;
+      e.fee_per_byte = fee_per_byte;
+      e.weight = tx.weight;
+      e.fee_in_zeph = tx.weight * fee_per_byte;
+      e.fee_asset = "ZPH";
+      e.fee = e.fee_in_zeph;
+      e.conversion = tx.reserve_change != 0;
+      e.conversion_zeph = tx.reserve_change;
+      for (int n: tx.key_images)
+        e.key_images.push_back(make_key_image(n));
+      const uint64_t coinbase = reward + sel.total_fee_in_zeph + e.fee_in_zeph;
+      sel.add(std::move(e), coinbase);
+      return template_fit::added;
+    }
+
+    std::unordered_map<crypto::hash, fake_tx> m_txes;
+    std::vector<int> m_order; //!< as received
+  };
+
+  std::vector<std::string> get_txids(const template_selection &sel)
+  {
+    std::vector<std::string> txids;
+    for (const template_tx &e: sel.txes)
+      txids.emplace_back(e.txid.data, sizeof(e.txid.data));
+    std::sort(txids.begin(), txids.end());
+    return txids;
+  }
+
+  // an update may append where a full pass would sort by fee, but must choose the same
+  void check_same_as_full_pass(fake_pool &pool, template_selection &sel)
+  {
+    template_selection full;
+    pool.fill(full);
+    ASSERT_EQ(get_txids(sel), get_txids(full));
+    ASSERT_EQ(sel.total_weight, full.total_weight);
+    ASSERT_EQ(sel.total_fee_in_zeph, full.total_fee_in_zeph);
+    ASSERT_EQ(sel.coinbase, full.coinbase);
+    ASSERT_EQ(sel.total_conversion_zeph, full.total_conversion_zeph);
+    ASSERT_EQ(sel.key_images, full.key_images);
+    ASSERT_EQ(sel.fee_map["ZPH"], full.fee_map["ZPH"]);
+    ASSERT_EQ(sel.tx_indices.size(), sel.txes.size());
+    for (size_t i = 0; i < sel.txes.size(); ++i)
+      ASSERT_EQ(sel.tx_indices.at(sel.txes[i].txid), i);
+  }
+}
+
+TEST(block_template_selection, adds)
+{
+  fake_pool pool;
+  template_selection sel;
+  pool.add_tx(sel, 1, {10, 2000, {1}, 0});
+  pool.add_tx(sel, 2, {5, 3000, {2}, 0});
+  pool.fill(sel);
+  ASSERT_EQ(sel.txes.size(), 2);
+
+  pool.add_tx(sel, 3, {20, 1500, {3}, 0});
+  pool.add_tx(sel, 4, {1, 1000, {4}, 0});
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_EQ(sel.txes.size(), 4);
+  check_same_as_full_pass(pool, sel);
+}
+
+TEST(block_template_selection, remove_plain_transfer)
+{
+  fake_pool pool;
+  template_selection sel;
+  for (int n = 1; n <= 5; ++n)
+    pool.add_tx(sel, n, {double(10 - n), 1000 * size_t(n), {n}, 0});
+  pool.fill(sel);
+  ASSERT_EQ(sel.txes.size(), 5);
+
+  // one from the middle, then one after it, whose index has moved
+  pool.remove_tx(sel, 2);
+  ASSERT_TRUE(pool.update(sel));
+  check_same_as_full_pass(pool, sel);
+  pool.remove_tx(sel, 4);
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_EQ(sel.txes.size(), 3);
+  check_same_as_full_pass(pool, sel);
+}
+
+TEST(block_template_selection, remove_conversion)
+{
+  fake_pool pool;
+  template_selection sel;
+  // the redeem only passes with the mint before it counted in
+  pool.add_tx(sel, 1, {10, 2000, {1}, 100});
+  pool.add_tx(sel, 2, {5, 2000, {2}, -80});
+  pool.add_tx(sel, 3, {1, 2000, {3}, 0});
+  pool.fill(sel);
+  ASSERT_EQ(sel.txes.size(), 3);
+
+  pool.remove_tx(sel, 1);
+  ASSERT_FALSE(pool.update(sel));
+  ASSERT_EQ(sel.txes.size(), 1);
+  ASSERT_EQ(sel.txes[0].txid, make_txid(3));
+  check_same_as_full_pass(pool, sel);
+}
+
+TEST(block_template_selection, remove_frees_room)
+{
+  fake_pool pool;
+  template_selection sel;
+  pool.add_tx(sel, 1, {10, 400000, {1}, 0});
+  pool.add_tx(sel, 2, {5, 300000, {2}, 0});
+  pool.add_tx(sel, 3, {1, 100000, {3}, 0});
+  pool.fill(sel);
+  ASSERT_EQ(sel.txes.size(), 2);
+  ASSERT_EQ(sel.no_room.size(), 1);
+
+  // the one that did not fit does once the big one goes
+  pool.remove_tx(sel, 1);
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_EQ(sel.txes.size(), 2);
+  ASSERT_TRUE(sel.no_room.empty());
+  check_same_as_full_pass(pool, sel);
+
+  // and one that still does not fit is not tried again once gone
+  pool.add_tx(sel, 4, {0.5, 500000, {4}, 0});
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_EQ(sel.no_room.size(), 1);
+  pool.remove_tx(sel, 4);
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_TRUE(sel.no_room.empty());
+  check_same_as_full_pass(pool, sel);
+}
+
+TEST(block_template_selection, double_spend_replacement)
+{
+  fake_pool pool;
+  template_selection sel;
+  pool.add_tx(sel, 1, {10, 2000, {1, 2}, 0});
+  pool.add_tx(sel, 2, {5, 2000, {2}, 0});
+  pool.fill(sel);
+  ASSERT_EQ(sel.txes.size(), 1);
+
+  // another double spend comes in, then the chosen one goes
+  pool.add_tx(sel, 3, {4, 2000, {1}, 0});
+  pool.remove_tx(sel, 1);
+  ASSERT_TRUE(pool.update(sel));
+  ASSERT_EQ(sel.txes.size(), 2);
+  check_same_as_full_pass(pool, sel);
+}
+
+TEST(block_template_selection, change_cap)
+{
+  fake_pool pool;
+  template_selection sel;
+  pool.add_tx(sel, 0, {10, 2000, {0}, 0});
+  pool.fill(sel);
+
+  for (size_t n = 1; n <= template_selection::max_changes; ++n)
+    pool.add_tx(sel, n, {1, 100, {int(n)}, 0});
+  ASSERT_TRUE(sel.valid);
+  ASSERT_EQ(sel.changes.size(), template_selection::max_changes);
+  pool.add_tx(sel, template_selection::max_changes + 1, {20, 100, {-1}, 0});
+  ASSERT_FALSE(sel.valid);
+  ASSERT_TRUE(sel.changes.empty());
+  pool.remove_tx(sel, 0);
+  ASSERT_TRUE(sel.changes.empty());
+
+  ASSERT_FALSE(pool.update(sel));
+  check_same_as_full_pass(pool, sel);
+}
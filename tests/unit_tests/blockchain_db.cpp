@@ -36,6 +36,7 @@
 #include "gtest/gtest.h"
 
 #include "string_tools.h"
+#include "common/zstd_dict_codec.h"
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -149,6 +150,31 @@ std::string h2b(const std::string& s)
   return result;
 }
 
+// reads or writes the version an lmdb blockchain at dir was made by, while it is closed
+bool lmdb_db_version(const std::string &dir, uint32_t &version, bool write)
+{
+  MDB_env *env;
+  if (mdb_env_create(&env))
+    return false;
+  MDB_txn *txn = nullptr;
+  MDB_dbi dbi;
+  MDB_val k = {sizeof("version"), (void *)"version"}, v = {sizeof(version), &version};
+  bool ok = !mdb_env_set_maxdbs(env, 32) && !mdb_env_open(env, dir.c_str(), 0, 0644) &&
+    !mdb_txn_begin(env, NULL, 0, &txn) && !mdb_dbi_open(txn, "properties", 0, &dbi);
+  if (ok && write)
+    ok = !mdb_put(txn, dbi, &k, &v, 0);
+  else if (ok)
+  {
+    ok = !mdb_get(txn, dbi, &k, &v) && v.mv_size == sizeof(version);
+    if (ok)
+      memcpy(&version, v.mv_data, sizeof(version));
+  }
+  if (txn)
+    ok = !mdb_txn_commit(txn) && ok;
+  mdb_env_close(env);
+  return ok;
+}
+
 template <typename T>
 class BlockchainDBTest : public testing::Test
 {
@@ -341,4 +367,108 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, AssetTypeOutputsSingleOutput)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  // give the second coinbase output an asset type of its own, so that asset type has a
+  // single output and no duplicate tree for the bulk lookup to page through
+  block blk = this->m_blocks[0].first;
+  ASSERT_EQ(2, blk.miner_tx.vout.size());
+  boost::get<txout_zephyr_tagged_key>(blk.miner_tx.vout[1].target).asset_type = "ZSD";
+  blk.miner_tx.invalidate_hashes();
+  blk.invalidate_hashes();
+  const std::pair<block, blobdata> b0 = std::make_pair(blk, block_to_blob(blk));
+  ASSERT_NO_THROW(this->m_db->add_block(b0, t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], 0, 0, 0, this->m_txs[0]));
+
+  std::vector<uint64_t> output_ids;
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_data_from_asset_type_output_indices("ZSD", {0, 0}, output_ids, outputs));
+  ASSERT_EQ(2, output_ids.size());
+  ASSERT_EQ(1, output_ids[0]);
+  ASSERT_EQ(1, output_ids[1]);
+  ASSERT_HASH_EQ(boost::get<txout_zephyr_tagged_key>(blk.miner_tx.vout[1].target).key, outputs[0].pubkey);
+  ASSERT_THROW(this->m_db->get_output_data_from_asset_type_output_indices("ZSD", {0, 1}, output_ids, outputs), OUTPUT_DNE);
+
+  const uint64_t n_zeph = this->m_db->get_num_outputs_of_asset_type("ZEPH");
+  ASSERT_GE(n_zeph, 1);
+  std::vector<uint64_t> indices;
+  for (uint64_t i = n_zeph; i-- > 0; )
+    indices.push_back(i);
+  ASSERT_NO_THROW(this->m_db->get_output_data_from_asset_type_output_indices("ZEPH", indices, output_ids, outputs));
+  ASSERT_EQ(0, output_ids.back());
+  ASSERT_HASH_EQ(boost::get<txout_zephyr_tagged_key>(blk.miner_tx.vout[0].target).key, outputs.back().pubkey);
+}
+
+TYPED_TEST(BlockchainDBTest, TxCompressionRefusedByOlderVersions)
+{
+  if (!tools::zstd_dict_codec::available())
+    return;
+
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // enough distinct coinbase txes to train a dictionary from. They have no prunable
+  // data, so that table is left uncompressed
+  std::vector<crypto::hash> tx_hashes;
+  {
+    db_wtxn_guard guard(this->m_db);
+    block blk = this->m_blocks[1].first;
+    for (uint64_t height = 0; height < 256; ++height)
+    {
+      blk.prev_id = this->m_db->top_block_hash();
+      boost::get<txin_gen>(blk.miner_tx.vin[0]).height = height;
+      blk.miner_tx.invalidate_hashes();
+      blk.invalidate_hashes();
+      tx_hashes.push_back(get_transaction_hash(blk.miner_tx));
+      ASSERT_NO_THROW(this->m_db->add_block(std::make_pair(blk, block_to_blob(blk)), t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], 0, 0, 0, this->m_txs[1]));
+    }
+  }
+  this->m_db->close();
+
+  uint32_t uncompressed_version = 0;
+  ASSERT_TRUE(lmdb_db_version(dirPath, uncompressed_version, false));
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_TRUE(this->m_db->train_tx_compression(256, 4096));
+  ASSERT_EQ(0, this->m_db->compress_txs(1000));
+  for (const crypto::hash &h: tx_hashes)
+  {
+    transaction tx;
+    ASSERT_NO_THROW(tx = this->m_db->get_tx(h));
+    ASSERT_HASH_EQ(h, get_transaction_hash(tx));
+  }
+  this->m_db->close();
+
+  // binaries from before compression only open dbs up to the uncompressed version
+  uint32_t version = 0;
+  ASSERT_TRUE(lmdb_db_version(dirPath, version, false));
+  ASSERT_GT(version, uncompressed_version);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  ASSERT_TRUE(this->m_db->is_open());
+  this->m_db->close();
+
+  // and this one refuses later versions the same way
+  ++version;
+  ASSERT_TRUE(lmdb_db_version(dirPath, version, true));
+  this->m_db->open(dirPath);
+  ASSERT_FALSE(this->m_db->is_open());
+}
+
 }  // anonymous namespace
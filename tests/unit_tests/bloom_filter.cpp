@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "common/bloom_filter.h"
+
+TEST(bloom_filter, no_false_negatives)
+{
+  tools::blocked_bloom_filter f;
+  ASSERT_TRUE(f.empty());
+  f.init(10000);
+  ASSERT_FALSE(f.empty());
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> keys;
+  for (size_t i = 0; i < 10000; ++i)
+  {
+    keys.push_back(rng());
+    f.insert(keys.back());
+  }
+  ASSERT_EQ(f.get_count(), 10000);
+  for (uint64_t k: keys)
+    ASSERT_TRUE(f.maybe_contains(k));
+}
+
+TEST(bloom_filter, false_positive_rate)
+{
+  tools::blocked_bloom_filter f;
+  f.init(100000);
+  std::mt19937_64 rng(42);
+  for (size_t i = 0; i < 100000; ++i)
+    f.insert(rng());
+  size_t false_positives = 0;
+  for (size_t i = 0; i < 100000; ++i)
+    false_positives += f.maybe_contains(rng());
+  ASSERT_LT(false_positives, 2000);
+}
+
+TEST(bloom_filter, clear)
+{
+  tools::blocked_bloom_filter f;
+  f.init(100);
+  f.insert(1);
+  ASSERT_TRUE(f.maybe_contains(1));
+  f.clear();
+  ASSERT_FALSE(f.maybe_contains(1));
+  ASSERT_EQ(f.get_count(), 0);
+}
+
+TEST(bloom_filter, save_load)
+{
+  tools::blocked_bloom_filter f, g;
+  f.init(1000);
+  for (uint64_t i = 0; i < 1000; ++i)
+    f.insert(i * 0x9e3779b97f4a7c15ull);
+  std::vector<uint64_t> words(f.get_num_blocks() * tools::blocked_bloom_filter::BLOCK_WORDS);
+  f.save(words.data());
+  g.load(f.get_num_blocks(), words.data(), f.get_count(), f.get_capacity());
+  ASSERT_EQ(g.get_count(), 1000);
+  ASSERT_EQ(g.get_capacity(), 1000);
+  for (uint64_t i = 0; i < 1000; ++i)
+    ASSERT_TRUE(g.maybe_contains(i * 0x9e3779b97f4a7c15ull));
+}
+
+TEST(bloom_filter, full)
+{
+  tools::blocked_bloom_filter f;
+  f.init(100);
+  ASSERT_EQ(f.get_capacity(), 100);
+  for (uint64_t i = 0; i < 100; ++i)
+    f.insert(i * 0x9e3779b97f4a7c15ull);
+  ASSERT_FALSE(f.is_full());
+  f.insert(100 * 0x9e3779b97f4a7c15ull);
+  ASSERT_TRUE(f.is_full());
+  f.clear();
+  ASSERT_FALSE(f.is_full());
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "cryptonote_basic/compact_output_indices.h"
+#include "serialization/binary_utils.h"
+
+static void check_round_trip(const std::vector<std::vector<uint64_t>> &indices, const std::vector<std::vector<uint64_t>> &asset_type_indices)
+{
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices(indices, asset_type_indices, compact));
+  std::string blob;
+  ASSERT_TRUE(::serialization::dump_binary(compact, blob));
+
+  cryptonote::compact_output_indices parsed_compact;
+  ASSERT_TRUE(::serialization::parse_binary(blob, parsed_compact));
+  std::vector<std::vector<uint64_t>> parsed, parsed_asset_type;
+  ASSERT_TRUE(cryptonote::get_output_indices(parsed_compact, parsed, parsed_asset_type));
+  ASSERT_EQ(parsed, indices);
+  ASSERT_EQ(parsed_asset_type, asset_type_indices);
+}
+
+TEST(compact_output_indices, round_trip)
+{
+  // a miner tx, a conversion paying out in two asset types, and a tx without outputs
+  check_round_trip({{1000000}, {1000001, 1000002, 1000003}, {}, {1000004, 1000005}},
+      {{500000}, {20, 500001, 21}, {}, {22, 500002}});
+}
+
+TEST(compact_output_indices, global_deltas)
+{
+  // the first delta is the base, and consecutive indices cost one each after it
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices({{1000}, {}, {1001, 1002}}, {{7}, {}, {8, 9}}, compact));
+  ASSERT_EQ(compact.n_outputs, std::vector<uint64_t>({1, 0, 2}));
+  ASSERT_EQ(compact.output_index_deltas, std::vector<uint64_t>({1000, 1, 1}));
+  ASSERT_EQ(compact.asset_type_output_index_runs, std::vector<uint64_t>({0, 0, 0}));
+  ASSERT_EQ(compact.asset_type_output_index_deltas, std::vector<uint64_t>({7, 1, 1}));
+}
+
+TEST(compact_output_indices, decreasing_indices_wrap)
+{
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices({{5000, 10}}, {{1, 2}}, compact));
+  ASSERT_EQ(compact.output_index_deltas, std::vector<uint64_t>({5000, (uint64_t)10 - 5000}));
+  check_round_trip({{5000, 5001}, {10, 11}, {(uint64_t)-1, 0}}, {{7000, 7001}, {3, 7000}, {0, (uint64_t)-1}});
+}
+
+TEST(compact_output_indices, closest_run_below)
+{
+  // runs end at 100 and 500: 501 continues the 500 run rather than the 100
+  // one, 101 continues the 100 one, and 50 is below both so starts a new run
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices({{1, 2, 3, 4, 5}}, {{100, 500, 501, 101, 50}}, compact));
+  ASSERT_EQ(compact.asset_type_output_index_runs, std::vector<uint64_t>({0, 0, 0, 1, 2}));
+  ASSERT_EQ(compact.asset_type_output_index_deltas, std::vector<uint64_t>({100, 400, 1, 101, 50}));
+  check_round_trip({{1, 2, 3, 4, 5}}, {{100, 500, 501, 101, 50}});
+}
+
+TEST(compact_output_indices, equal_index_starts_new_run)
+{
+  // a run only continues from strictly below, so a repeated index gets a new
+  // run, whose delta is the whole index
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices({{1, 2}}, {{300, 300}}, compact));
+  ASSERT_EQ(compact.asset_type_output_index_runs, std::vector<uint64_t>({0, 1}));
+  ASSERT_EQ(compact.asset_type_output_index_deltas, std::vector<uint64_t>({300, 300}));
+  check_round_trip({{1, 2}}, {{300, 300}});
+}
+
+TEST(compact_output_indices, interleaved_runs)
+{
+  // two interleaved asset types settle into two runs with deltas of one; the
+  // second type's first index continues the first type's run, being above it,
+  // so the first type's next index is the one that starts run 1
+  std::vector<std::vector<uint64_t>> indices(1), asset_type_indices(1);
+  for (uint64_t i = 0; i < 100; ++i)
+  {
+    indices[0].push_back(123456789 + i);
+    asset_type_indices[0].push_back(i % 2 ? 98765432 + i / 2 : 1234 + i / 2);
+  }
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices(indices, asset_type_indices, compact));
+  ASSERT_EQ(compact.asset_type_output_index_runs[1], 0);
+  ASSERT_EQ(compact.asset_type_output_index_runs[2], 1);
+  ASSERT_EQ(compact.asset_type_output_index_deltas[2], 1235);
+  for (size_t i = 3; i < 100; ++i)
+  {
+    ASSERT_EQ(compact.output_index_deltas[i], 1);
+    ASSERT_EQ(compact.asset_type_output_index_runs[i], i % 2 ? 0 : 1);
+    ASSERT_EQ(compact.asset_type_output_index_deltas[i], 1);
+  }
+  check_round_trip(indices, asset_type_indices);
+}
+
+TEST(compact_output_indices, decoder_runs)
+{
+  cryptonote::output_index_delta_decoder decoder;
+  uint64_t index;
+  ASSERT_FALSE(decoder.run_index(1, 5, index));
+  ASSERT_TRUE(decoder.run_index(0, 5, index));
+  ASSERT_EQ(index, 5);
+  ASSERT_TRUE(decoder.run_index(1, 7, index));
+  ASSERT_EQ(index, 7);
+  ASSERT_TRUE(decoder.run_index(0, 2, index));
+  ASSERT_EQ(index, 7);
+  ASSERT_FALSE(decoder.run_index(3, 1, index));
+}
+
+TEST(compact_output_indices, mismatched)
+{
+  cryptonote::compact_output_indices compact;
+  ASSERT_FALSE(cryptonote::get_compact_output_indices({{1, 2}}, {{1}}, compact));
+  ASSERT_FALSE(cryptonote::get_compact_output_indices({{1}}, {{1}, {2}}, compact));
+}
+
+TEST(compact_output_indices, invalid)
+{
+  cryptonote::compact_output_indices compact;
+  ASSERT_TRUE(cryptonote::get_compact_output_indices({{10, 11, 12}}, {{10, 11, 12}}, compact));
+  std::vector<std::vector<uint64_t>> parsed, parsed_asset_type;
+
+  cryptonote::compact_output_indices truncated = compact;
+  truncated.output_index_deltas.pop_back();
+  ASSERT_FALSE(cryptonote::get_output_indices(truncated, parsed, parsed_asset_type));
+
+  cryptonote::compact_output_indices too_many = compact;
+  too_many.n_outputs.back() = 4;
+  ASSERT_FALSE(cryptonote::get_output_indices(too_many, parsed, parsed_asset_type));
+
+  cryptonote::compact_output_indices too_few = compact;
+  too_few.n_outputs.back() = 2;
+  ASSERT_FALSE(cryptonote::get_output_indices(too_few, parsed, parsed_asset_type));
+
+  cryptonote::compact_output_indices bad_run = compact;
+  bad_run.asset_type_output_index_runs.back() = 2;
+  ASSERT_FALSE(cryptonote::get_output_indices(bad_run, parsed, parsed_asset_type));
+}
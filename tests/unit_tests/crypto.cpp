@@ -31,6 +31,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 extern "C"
 {
@@ -340,3 +341,62 @@ TEST(Crypto, generator_consistency)
   // ringct/rctTypes.h
   ASSERT_TRUE(memcmp(H.data, rct::H.bytes, 32) == 0);
 }
+
+TEST(Crypto, generate_key_derivations)
+{
+  crypto::public_key pub;
+  crypto::secret_key sec;
+  crypto::generate_keys(pub, sec);
+
+  for (size_t count: {0, 1, 2, 3, 17, 64})
+  {
+    std::vector<crypto::public_key> keys(count);
+    for (auto &key: keys)
+    {
+      crypto::secret_key unused;
+      crypto::generate_keys(key, unused);
+    }
+    if (count > 2)
+      memset(&keys[1], 0xff, sizeof(keys[1])); // not a valid point
+
+    std::vector<crypto::key_derivation> derivations(count);
+    std::unique_ptr<bool[]> results(new bool[count]);
+    crypto::generate_key_derivations(keys.data(), count, sec, derivations.data(), results.get());
+    for (size_t i = 0; i < count; ++i)
+    {
+      crypto::key_derivation expected;
+      const bool r = crypto::generate_key_derivation(keys[i], sec, expected);
+      ASSERT_EQ(r, results[i]);
+      if (r)
+        ASSERT_TRUE(memcmp(&expected, &derivations[i], sizeof(expected)) == 0);
+    }
+  }
+}
+
+TEST(Crypto, fe_backends_agree)
+{
+  const int backend = fe_get_backend();
+  for (size_t n = 0; n < 256; ++n)
+  {
+    const rct::key k = n % 2 ? rct::skGen() : rct::scalarmultBase(rct::skGen());
+    ge_p3 ref_p3, p3;
+    ge_p2 ref_p2, p2;
+    unsigned char ref_bytes[32], bytes[32];
+
+    ASSERT_EQ(fe_select_backend(FE_BACKEND_REF10), 0);
+    const int ref_r = ge_frombytes_vartime(&ref_p3, k.bytes);
+    ge_fromfe_frombytes_vartime(&ref_p2, k.bytes);
+    ge_tobytes(ref_bytes, &ref_p2);
+
+    ASSERT_EQ(fe_select_backend(backend), 0);
+    ASSERT_EQ(ge_frombytes_vartime(&p3, k.bytes), ref_r);
+    ge_fromfe_frombytes_vartime(&p2, k.bytes);
+    ge_tobytes(bytes, &p2);
+    ASSERT_TRUE(memcmp(bytes, ref_bytes, 32) == 0);
+    if (ref_r == 0)
+    {
+      ge_p3_tobytes(bytes, &p3);
+      ASSERT_TRUE(memcmp(bytes, k.bytes, 32) == 0);
+    }
+  }
+}
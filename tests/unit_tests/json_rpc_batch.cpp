@@ -0,0 +1,293 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "syncobj.h"
+#include "net/http_protocol_handler.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  struct COMMAND_ECHO
+  {
+    struct request_t
+    {
+      uint64_t value;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+    typedef request response;
+  };
+
+  class test_json_rpc_server: public epee::net_utils::http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+  public:
+    test_json_rpc_server(bool restricted): m_restricted(restricted), m_batches(0) {}
+
+    CHAIN_HTTP_TO_MAP2(epee::net_utils::connection_context_base);
+
+    BEGIN_URI_MAP2()
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC_WE("echo", on_echo, COMMAND_ECHO)
+        MAP_JON_RPC_WE_IF("unrestricted_echo", on_echo, COMMAND_ECHO, !m_restricted)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    bool on_echo(const COMMAND_ECHO::request &req, COMMAND_ECHO::response &res, epee::json_rpc::error &error_resp, const epee::net_utils::connection_context_base *ctx)
+    {
+      if (req.value == 0)
+      {
+        error_resp.code = -1;
+        error_resp.message = "zero";
+        return false;
+      }
+      res.value = req.value;
+      return true;
+    }
+
+    // runs the jobs backwards, the responses must still come out in order
+    void run_json_rpc_batch(std::vector<std::function<void()>> &jobs)
+    {
+      ++m_batches;
+      for (auto it = jobs.rbegin(); it != jobs.rend(); ++it)
+        (*it)();
+    }
+
+    bool m_restricted;
+    size_t m_batches;
+  };
+
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    virtual bool do_send(epee::byte_slice message) override { sent.emplace_back(reinterpret_cast<const char*>(message.data()), message.size()); return true; }
+    virtual bool close() override { return true; }
+    virtual bool send_done() override { return true; }
+    virtual bool call_run_once_service_io() override { return true; }
+    virtual bool request_callback() override { return true; }
+    virtual boost::asio::io_service& get_io_service() override { return io_service; }
+    virtual bool add_ref() override { return true; }
+    virtual bool release() override { return true; }
+
+    boost::asio::io_service io_service;
+    std::vector<std::string> sent;
+  };
+
+  std::string call(test_json_rpc_server &server, const std::string &body)
+  {
+    epee::net_utils::http::http_request_info query_info;
+    epee::net_utils::http::http_response_info response_info;
+    epee::net_utils::connection_context_base context;
+    query_info.m_URI = "/json_rpc";
+    query_info.m_body = body;
+    EXPECT_TRUE(server.handle_http_request(query_info, response_info, context));
+    EXPECT_EQ(response_info.m_response_code, 200);
+    return response_info.m_body;
+  }
+
+  bool get_result(const std::string &body, uint64_t &value)
+  {
+    epee::json_rpc::response<COMMAND_ECHO::response, epee::json_rpc::dummy_error> resp;
+    if (!epee::serialization::load_t_from_json(resp, body))
+      return false;
+    value = resp.result.value;
+    return true;
+  }
+
+  int64_t get_error(const std::string &body)
+  {
+    epee::json_rpc::error_response resp;
+    if (!epee::serialization::load_t_from_json(resp, body))
+      return 0;
+    return resp.error.code;
+  }
+}
+
+TEST(json_rpc_batch, split)
+{
+  std::vector<std::string> items;
+  ASSERT_TRUE(epee::json_rpc::split_batch(" [ {\"a\": [1, 2]} ,{\"b\":\"],}\\\"[\"}]\r\n", items));
+  ASSERT_EQ(items, std::vector<std::string>({"{\"a\": [1, 2]}", "{\"b\":\"],}\\\"[\"}"}));
+  ASSERT_TRUE(epee::json_rpc::split_batch("[]", items));
+  ASSERT_TRUE(items.empty());
+  ASSERT_TRUE(epee::json_rpc::split_batch("[1, \"x\"]", items));
+  ASSERT_EQ(items, std::vector<std::string>({"1", "\"x\""}));
+
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}, ]", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[, {}]", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}] {}", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{}}", items));
+  ASSERT_FALSE(epee::json_rpc::split_batch("[{\"a\": \"]}", items));
+}
+
+TEST(json_rpc_batch, split_ids)
+{
+  std::vector<std::string> items;
+  std::vector<char> has_id;
+  ASSERT_TRUE(epee::json_rpc::split_batch("[{\"id\":1,\"a\":{\"id\":2}}, {\"a\":{\"id\":2},\"b\":[\"id\"]},"
+      " {\"x\":\"id\", \"y\" : 1}, { \"id\" :null}, {\"\\\"id\":1}, 1]", items, &has_id));
+  ASSERT_EQ(items.size(), 6);
+  ASSERT_EQ(has_id, std::vector<char>({1, 0, 0, 1, 0, 0}));
+}
+
+TEST(json_rpc_batch, run_concurrently)
+{
+  std::vector<size_t> runs(16, 0);
+  std::vector<std::function<void()>> jobs;
+  for (size_t i = 0; i < runs.size(); ++i)
+    jobs.push_back([&runs, i]() { ++runs[i]; });
+
+  std::vector<std::thread> threads;
+  epee::json_rpc::run_batch_concurrently(jobs, [&threads](std::function<void()> job) { threads.emplace_back(std::move(job)); });
+  for (std::thread &thread: threads)
+    thread.join();
+  ASSERT_EQ(threads.size(), jobs.size() - 1);
+  ASSERT_EQ(runs, std::vector<size_t>(runs.size(), 1));
+
+  // with no thread to spare the caller runs them all, and late helpers find nothing to do
+  std::vector<std::function<void()>> helpers;
+  epee::json_rpc::run_batch_concurrently(jobs, [&helpers](std::function<void()> job) { helpers.push_back(std::move(job)); });
+  ASSERT_EQ(runs, std::vector<size_t>(runs.size(), 2));
+  jobs.clear();
+  for (auto &helper: helpers)
+    helper();
+  ASSERT_EQ(runs, std::vector<size_t>(runs.size(), 2));
+}
+
+TEST(json_rpc_batch, single_request)
+{
+  test_json_rpc_server server(false);
+  uint64_t value = 0;
+  ASSERT_TRUE(get_result(call(server, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"value\":7}}"), value));
+  ASSERT_EQ(value, 7);
+  ASSERT_EQ(server.m_batches, 0);
+}
+
+TEST(json_rpc_batch, batch)
+{
+  test_json_rpc_server server(true);
+  const std::string body = call(server, "["
+      "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"value\":1}},"
+      "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"unrestricted_echo\",\"params\":{\"value\":2}},"
+      "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"echo\",\"params\":{\"value\":0}},"
+      "42,"
+      "{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"echo\",\"params\":{\"value\":5}}"
+    "]");
+  ASSERT_EQ(server.m_batches, 1);
+
+  std::vector<std::string> items;
+  ASSERT_TRUE(epee::json_rpc::split_batch(body, items));
+  ASSERT_EQ(items.size(), 5);
+  uint64_t value = 0;
+  ASSERT_TRUE(get_result(items[0], value));
+  ASSERT_EQ(value, 1);
+  ASSERT_EQ(get_error(items[1]), -32601); // restricted, so not found
+  ASSERT_EQ(get_error(items[2]), -1);
+  ASSERT_EQ(get_error(items[3]), -32600);
+  ASSERT_TRUE(get_result(items[4], value));
+  ASSERT_EQ(value, 5);
+}
+
+TEST(json_rpc_batch, notifications)
+{
+  test_json_rpc_server server(false);
+  const std::string body = call(server, "["
+      "{\"jsonrpc\":\"2.0\",\"method\":\"echo\",\"params\":{\"value\":1}},"
+      "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{\"value\":2}},"
+      "{\"jsonrpc\":\"2.0\",\"method\":\"echo\",\"params\":{\"value\":0}}"
+    "]");
+  std::vector<std::string> items;
+  ASSERT_TRUE(epee::json_rpc::split_batch(body, items));
+  ASSERT_EQ(items.size(), 1);
+  uint64_t value = 0;
+  ASSERT_TRUE(get_result(items[0], value));
+  ASSERT_EQ(value, 2);
+
+  // nothing at all when every item is a notification
+  epee::net_utils::http::http_request_info query_info;
+  epee::net_utils::http::http_response_info response_info;
+  epee::net_utils::connection_context_base context;
+  query_info.m_URI = "/json_rpc";
+  query_info.m_body = "[{\"jsonrpc\":\"2.0\",\"method\":\"echo\",\"params\":{\"value\":1}}]";
+  ASSERT_TRUE(server.handle_http_request(query_info, response_info, context));
+  ASSERT_EQ(response_info.m_response_code, 204);
+  ASSERT_TRUE(response_info.m_body.empty());
+  ASSERT_EQ(server.m_batches, 2);
+}
+
+TEST(json_rpc_batch, invalid_batch)
+{
+  test_json_rpc_server server(false);
+  ASSERT_EQ(get_error(call(server, "[]")), -32600);
+  ASSERT_EQ(get_error(call(server, "[{}")), -32700);
+  std::string body = "[";
+  for (size_t i = 0; i <= JSON_RPC_MAX_BATCH_SIZE; ++i)
+    body += std::string(i ? "," : "") + "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"value\":1}}";
+  ASSERT_EQ(get_error(call(server, body + "]")), -32600);
+  ASSERT_EQ(server.m_batches, 0);
+}
+
+TEST(json_rpc_batch, pipelined_requests)
+{
+  test_json_rpc_server server(false);
+  epee::net_utils::http::custum_handler_config<epee::net_utils::connection_context_base> config;
+  config.m_phandler = &server;
+  epee::net_utils::connection_context_base context;
+  test_endpoint endpoint;
+  epee::net_utils::http::http_custom_handler<epee::net_utils::connection_context_base> handler(&endpoint, config, context);
+
+  std::string requests;
+  for (uint64_t value = 1; value <= 3; ++value)
+  {
+    const std::string body = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"value\":" + std::to_string(value) + "}}";
+    requests += "POST /json_rpc HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+
+  // all three in one go, then split mid request
+  ASSERT_TRUE(handler.handle_recv(requests.data(), requests.size()));
+  ASSERT_EQ(endpoint.sent.size(), 3);
+  ASSERT_TRUE(handler.handle_recv(requests.data(), requests.size() / 2));
+  ASSERT_TRUE(handler.handle_recv(requests.data() + requests.size() / 2, requests.size() - requests.size() / 2));
+  ASSERT_EQ(endpoint.sent.size(), 6);
+  for (size_t i = 0; i < endpoint.sent.size(); ++i)
+  {
+    const size_t pos = endpoint.sent[i].find("\r\n\r\n");
+    ASSERT_NE(pos, std::string::npos);
+    uint64_t value = 0;
+    ASSERT_TRUE(get_result(endpoint.sent[i].substr(pos + 4), value));
+    ASSERT_EQ(value, i % 3 + 1);
+  }
+}
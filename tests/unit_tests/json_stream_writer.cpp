@@ -0,0 +1,342 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <list>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "syncobj.h"
+#include "net/http_protocol_handler.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+#include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_to_json_stream.h"
+
+namespace
+{
+  struct empty_t
+  {
+    BEGIN_KV_SERIALIZE_MAP()
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct inner_t
+  {
+    std::string a_str;
+    uint64_t b_num;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a_str)
+      KV_SERIALIZE(b_num)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  // keys in sorted order, as portable_storage prints them
+  struct outer_t
+  {
+    bool a_flag;
+    double b_double;
+    int8_t c_small;
+    std::vector<inner_t> d_items;
+    std::vector<uint64_t> e_values;
+    std::list<std::string> f_strings;
+    inner_t g_child;
+    std::vector<uint64_t> h_none;
+    epee::serialization::storage_entry i_id;
+    int64_t j_negative;
+    empty_t k_empty;
+    uint8_t l_byte;
+    std::vector<inner_t> m_last;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a_flag)
+      KV_SERIALIZE(b_double)
+      KV_SERIALIZE(c_small)
+      KV_SERIALIZE(d_items)
+      KV_SERIALIZE(e_values)
+      KV_SERIALIZE(f_strings)
+      KV_SERIALIZE(g_child)
+      KV_SERIALIZE(h_none)
+      KV_SERIALIZE(i_id)
+      KV_SERIALIZE(j_negative)
+      KV_SERIALIZE(k_empty)
+      KV_SERIALIZE(l_byte)
+      KV_SERIALIZE(m_last)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct unsorted_t
+  {
+    uint64_t z;
+    std::string a;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(z)
+      KV_SERIALIZE(a)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  outer_t make_outer()
+  {
+    outer_t outer;
+    outer.a_flag = true;
+    outer.b_double = 0.25;
+    outer.c_small = -3;
+    outer.d_items = {{"one", 1}, {"\"two\"\n", 2}, {"", 3}};
+    outer.e_values = {7, 8, 9};
+    outer.f_strings = {"x", "y\\z"};
+    outer.g_child = {"child", 18446744073709551615ull};
+    outer.i_id = epee::serialization::storage_entry(std::string("id"));
+    outer.j_negative = -1234567890123;
+    outer.l_byte = 255;
+    outer.m_last = {{"last", 0}};
+    return outer;
+  }
+
+  std::string to_string(const epee::byte_slice &chunk)
+  {
+    return std::string(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+  }
+
+  std::string stream_to_json(const outer_t &outer, bool insert_newlines)
+  {
+    epee::serialization::json_stream_writer writer(nullptr, 64 * 1024, insert_newlines);
+    EXPECT_TRUE(epee::serialization::store_t_to_json_stream(outer, writer));
+    return std::string(reinterpret_cast<const char*>(writer.stream().data()), writer.stream().size());
+  }
+
+  struct COMMAND_VALUES
+  {
+    struct request_t
+    {
+      uint64_t count;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(count)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct response_t
+    {
+      std::vector<inner_t> values;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(values)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
+  class test_stream_server: public epee::net_utils::http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+  public:
+    CHAIN_HTTP_TO_MAP2(epee::net_utils::connection_context_base);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_JON2_STREAM("/values", on_values, COMMAND_VALUES)
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC_WE_STREAM("values", on_values_json, COMMAND_VALUES)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    bool on_values(const COMMAND_VALUES::request &req, COMMAND_VALUES::response &res, const epee::net_utils::connection_context_base *ctx)
+    {
+      for (uint64_t i = 0; i < req.count; ++i)
+        res.values.push_back({std::string(100, 'a' + i % 26), i});
+      return true;
+    }
+
+    bool on_values_json(const COMMAND_VALUES::request &req, COMMAND_VALUES::response &res, epee::json_rpc::error &error_resp, const epee::net_utils::connection_context_base *ctx)
+    {
+      return on_values(req, res, ctx);
+    }
+
+    void run_json_rpc_batch(std::vector<std::function<void()>> &jobs)
+    {
+      for (auto &job: jobs)
+        job();
+    }
+  };
+
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    virtual bool do_send(epee::byte_slice message) override { sent += to_string(message); return true; }
+    virtual bool close() override { return true; }
+    virtual bool send_done() override { return true; }
+    virtual bool call_run_once_service_io() override { return true; }
+    virtual bool request_callback() override { return true; }
+    virtual boost::asio::io_service& get_io_service() override { return io_service; }
+    virtual bool add_ref() override { return true; }
+    virtual bool release() override { return true; }
+
+    boost::asio::io_service io_service;
+    std::string sent;
+  };
+
+  std::string send(test_stream_server &server, const std::string &version, const std::string &uri, const std::string &body)
+  {
+    epee::net_utils::http::custum_handler_config<epee::net_utils::connection_context_base> config;
+    config.m_phandler = &server;
+    epee::net_utils::connection_context_base context;
+    test_endpoint endpoint;
+    epee::net_utils::http::http_custom_handler<epee::net_utils::connection_context_base> handler(&endpoint, config, context);
+    const std::string request = "POST " + uri + " HTTP/" + version + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    EXPECT_TRUE(handler.handle_recv(request.data(), request.size()));
+    return endpoint.sent;
+  }
+
+  bool decode_chunked(const std::string &body, std::string &decoded, size_t &chunks)
+  {
+    decoded.clear();
+    chunks = 0;
+    size_t pos = 0;
+    for (;;)
+    {
+      const size_t eol = body.find("\r\n", pos);
+      if (eol == std::string::npos)
+        return false;
+      const size_t size = std::stoul(body.substr(pos, eol - pos), nullptr, 16);
+      pos = eol + 2;
+      if (size == 0)
+        return body.substr(pos) == "\r\n";
+      if (body.size() < pos + size + 2 || body.compare(pos + size, 2, "\r\n") != 0)
+        return false;
+      decoded += body.substr(pos, size);
+      pos += size + 2;
+      ++chunks;
+    }
+  }
+}
+
+TEST(json_stream_writer, same_as_portable_storage)
+{
+  const outer_t outer = make_outer();
+  ASSERT_EQ(stream_to_json(outer, true), epee::serialization::store_t_to_json(outer));
+  ASSERT_EQ(stream_to_json(outer, false), epee::serialization::store_t_to_json(outer, 0, false));
+
+  const empty_t empty;
+  epee::serialization::json_stream_writer writer;
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(empty, writer));
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(writer.stream().data()), writer.stream().size()), epee::serialization::store_t_to_json(empty));
+}
+
+TEST(json_stream_writer, keeps_key_order)
+{
+  const unsorted_t unsorted{7, "x"};
+  epee::serialization::json_stream_writer writer(nullptr, 64 * 1024, false);
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(unsorted, writer));
+  const std::string json(reinterpret_cast<const char*>(writer.stream().data()), writer.stream().size());
+  ASSERT_EQ(json, "{  \"z\": 7,  \"a\": \"x\"}");
+
+  unsorted_t loaded{};
+  ASSERT_TRUE(epee::serialization::load_t_from_json(loaded, json));
+  ASSERT_EQ(loaded.z, 7);
+  ASSERT_EQ(loaded.a, "x");
+}
+
+TEST(json_stream_writer, chunks)
+{
+  const outer_t outer = make_outer();
+  std::vector<std::string> chunks;
+  epee::serialization::json_stream_writer writer([&chunks](epee::byte_slice chunk) { chunks.push_back(to_string(chunk)); return true; }, 16);
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(outer, writer));
+  ASSERT_EQ(writer.stream().size(), 0);
+  ASSERT_GT(chunks.size(), 1);
+  std::string json;
+  for (const std::string &chunk: chunks)
+    json += chunk;
+  ASSERT_EQ(json, epee::serialization::store_t_to_json(outer));
+
+  size_t calls = 0;
+  epee::serialization::json_stream_writer failing([&calls](epee::byte_slice) { ++calls; return false; }, 16);
+  ASSERT_FALSE(epee::serialization::store_t_to_json_stream(outer, failing));
+  ASSERT_EQ(calls, 1);
+}
+
+TEST(json_stream_writer, chunked_response)
+{
+  test_stream_server server;
+  const std::string response = send(server, "1.1", "/values", "{\"count\": 2000}");
+  const size_t header_end = response.find("\r\n\r\n");
+  ASSERT_NE(header_end, std::string::npos);
+  const std::string header = response.substr(0, header_end + 2);
+  ASSERT_NE(header.find("Transfer-Encoding: chunked\r\n"), std::string::npos);
+  ASSERT_EQ(header.find("Content-Length:"), std::string::npos);
+
+  std::string body;
+  size_t chunks = 0;
+  ASSERT_TRUE(decode_chunked(response.substr(header_end + 4), body, chunks));
+  ASSERT_GT(chunks, 1);
+  COMMAND_VALUES::response res;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(res, body));
+  ASSERT_EQ(res.values.size(), 2000);
+  ASSERT_EQ(res.values[1999].b_num, 1999);
+}
+
+TEST(json_stream_writer, http10_response)
+{
+  test_stream_server server;
+  const std::string response = send(server, "1.0", "/values", "{\"count\": 10}");
+  const size_t header_end = response.find("\r\n\r\n");
+  ASSERT_NE(header_end, std::string::npos);
+  const std::string body = response.substr(header_end + 4);
+  ASSERT_EQ(response.find("Transfer-Encoding"), std::string::npos);
+  ASSERT_NE(response.find("Content-Length: " + std::to_string(body.size()) + "\r\n"), std::string::npos);
+  COMMAND_VALUES::response res;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(res, body));
+  ASSERT_EQ(res.values.size(), 10);
+}
+
+TEST(json_stream_writer, json_rpc)
+{
+  test_stream_server server;
+  epee::net_utils::http::http_request_info query_info;
+  epee::net_utils::http::http_response_info response_info;
+  epee::net_utils::connection_context_base context;
+  query_info.m_URI = "/json_rpc";
+  query_info.m_body = "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"values\",\"params\":{\"count\":5}}";
+  ASSERT_TRUE(server.handle_http_request(query_info, response_info, context));
+  ASSERT_TRUE(response_info.m_body.empty());
+  ASSERT_TRUE(bool(response_info.m_body_writer));
+  ASSERT_TRUE(epee::net_utils::http::render_body(response_info));
+  epee::json_rpc::response<COMMAND_VALUES::response, epee::json_rpc::dummy_error> resp;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(resp, response_info.m_body));
+  ASSERT_EQ(resp.result.values.size(), 5);
+
+  // batches hold the whole of each response
+  response_info = epee::net_utils::http::http_response_info{};
+  query_info.m_body = "[" + query_info.m_body + "," + query_info.m_body + "]";
+  ASSERT_TRUE(server.handle_http_request(query_info, response_info, context));
+  ASSERT_FALSE(bool(response_info.m_body_writer));
+  std::vector<std::string> items;
+  ASSERT_TRUE(epee::json_rpc::split_batch(response_info.m_body, items));
+  ASSERT_EQ(items.size(), 2);
+  ASSERT_TRUE(epee::serialization::load_t_from_json(resp, items[1]));
+  ASSERT_EQ(resp.result.values.size(), 5);
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+#include "common/lru_cache.h"
+
+TEST(lru_cache, get_add)
+{
+  tools::lru_cache<int, std::string> c(2);
+  std::string s;
+  ASSERT_FALSE(c.get(1, s));
+  c.add(1, "one");
+  ASSERT_TRUE(c.get(1, s));
+  ASSERT_EQ(s, "one");
+  c.add(1, "uno");
+  ASSERT_TRUE(c.get(1, s));
+  ASSERT_EQ(s, "uno");
+  ASSERT_EQ(c.size(), 1);
+  ASSERT_EQ(c.get_hits(), 2);
+  ASSERT_EQ(c.get_misses(), 1);
+}
+
+TEST(lru_cache, evicts_least_recently_used)
+{
+  tools::lru_cache<int, int> c(2);
+  int v;
+  c.add(1, 10);
+  c.add(2, 20);
+  ASSERT_TRUE(c.get(1, v)); // 2 is now the least recently used
+  c.add(3, 30);
+  ASSERT_EQ(c.size(), 2);
+  ASSERT_FALSE(c.get(2, v));
+  ASSERT_TRUE(c.get(1, v));
+  ASSERT_EQ(v, 10);
+  ASSERT_TRUE(c.get(3, v));
+  ASSERT_EQ(v, 30);
+}
+
+TEST(lru_cache, remove_clear)
+{
+  tools::lru_cache<int, int> c(4);
+  int v;
+  c.add(1, 10);
+  c.add(2, 20);
+  c.remove(1);
+  c.remove(5);
+  ASSERT_FALSE(c.get(1, v));
+  ASSERT_TRUE(c.get(2, v));
+  c.clear();
+  ASSERT_EQ(c.size(), 0);
+  ASSERT_FALSE(c.get(2, v));
+}
+
+TEST(lru_cache, zero_size)
+{
+  tools::lru_cache<int, int> c(0);
+  int v;
+  c.add(1, 10);
+  ASSERT_EQ(c.size(), 0);
+  ASSERT_FALSE(c.get(1, v));
+}
+
+namespace
+{
+  struct string_cost
+  {
+    size_t operator()(const std::string &s) const { return s.size(); }
+  };
+}
+
+TEST(lru_cache, weighted_hits_and_eviction)
+{
+  tools::lru_cache<int, std::string, std::hash<int>, string_cost> c(10);
+  std::string s;
+  c.add(1, "aaaa");
+  c.add(2, "bbbb");
+  ASSERT_EQ(c.get_total_cost(), 8);
+  ASSERT_TRUE(c.get(1, s)); // 2 is now the least recently used
+  ASSERT_EQ(s, "aaaa");
+
+  // needs room for 5, so 2 goes
+  c.add(3, "ccccc");
+  ASSERT_EQ(c.size(), 2);
+  ASSERT_EQ(c.get_total_cost(), 9);
+  ASSERT_FALSE(c.get(2, s));
+  ASSERT_TRUE(c.get(3, s));
+
+  // growing an entry in place evicts others, not itself
+  c.add(3, "cccccccc");
+  ASSERT_EQ(c.size(), 1);
+  ASSERT_EQ(c.get_total_cost(), 8);
+  ASSERT_FALSE(c.get(1, s));
+  ASSERT_TRUE(c.get(3, s));
+  ASSERT_EQ(s, "cccccccc");
+
+  c.remove(3);
+  ASSERT_EQ(c.get_total_cost(), 0);
+  ASSERT_EQ(c.get_hits(), 3);
+  ASSERT_EQ(c.get_misses(), 2);
+}
+
+TEST(lru_cache, weighted_entry_larger_than_capacity)
+{
+  tools::lru_cache<int, std::string, std::hash<int>, string_cost> c(4);
+  std::string s;
+  c.add(1, "aa");
+  c.add(2, "bbbbb");
+  ASSERT_EQ(c.size(), 0);
+  ASSERT_EQ(c.get_total_cost(), 0);
+  ASSERT_FALSE(c.get(1, s));
+  ASSERT_FALSE(c.get(2, s));
+}
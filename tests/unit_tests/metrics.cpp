@@ -0,0 +1,152 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "syncobj.h"
+#include "net/http_protocol_handler.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+#include "common/metrics.h"
+
+namespace
+{
+  class test_server: public epee::net_utils::http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+  public:
+    CHAIN_HTTP_TO_MAP2(epee::net_utils::connection_context_base);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_TEXT("/metrics", on_metrics, "text/plain; version=0.0.4")
+    END_URI_MAP2()
+
+    bool on_metrics(std::string &body, const epee::net_utils::connection_context_base *ctx)
+    {
+      tools::metrics::write_gauge(body, "test_metrics_server_gauge", "A gauge", 3);
+      return succeed;
+    }
+
+    bool succeed = true;
+  };
+
+  bool contains(const std::string &s, const std::string &line)
+  {
+    return s.find(line + "\n") != std::string::npos;
+  }
+}
+
+TEST(metrics, counter)
+{
+  tools::metrics::counter &c = tools::metrics::get_counter("test_metrics_counter_total", "A counter");
+  ASSERT_EQ(&c, &tools::metrics::get_counter("test_metrics_counter_total", "A counter"));
+  const uint64_t start = c.value();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.emplace_back([&c]() { for (int n = 0; n < 10000; ++n) c.inc(); });
+  for (auto &t: threads)
+    t.join();
+  c.inc(5);
+  ASSERT_EQ(c.value() - start, 80005);
+}
+
+TEST(metrics, histogram)
+{
+  tools::metrics::histogram h({1, 0.1, 10});
+  ASSERT_EQ(h.bounds(), std::vector<double>({0.1, 1, 10}));
+  for (double v: {0.05, 0.1, 0.5, 5.0, 50.0})
+    h.observe(v);
+
+  std::vector<uint64_t> buckets;
+  double sum;
+  h.get(buckets, sum);
+  ASSERT_EQ(buckets, std::vector<uint64_t>({2, 3, 4, 5}));
+  ASSERT_DOUBLE_EQ(sum, 55.65);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i)
+    threads.emplace_back([&h]() { for (int n = 0; n < 1000; ++n) h.observe(0.5); });
+  for (auto &t: threads)
+    t.join();
+  h.get(buckets, sum);
+  ASSERT_EQ(buckets, std::vector<uint64_t>({2, 4003, 4004, 4005}));
+  ASSERT_DOUBLE_EQ(sum, 2055.65);
+}
+
+TEST(metrics, label)
+{
+  ASSERT_EQ(tools::metrics::label("method", "get_info"), "method=\"get_info\"");
+  ASSERT_EQ(tools::metrics::label("k", "a\"b\\c\nd"), "k=\"a\\\"b\\\\c\\nd\"");
+}
+
+TEST(metrics, render)
+{
+  tools::metrics::get_counter("test_metrics_render_total", "Things", tools::metrics::label("kind", "a")).inc(2);
+  tools::metrics::get_counter("test_metrics_render_total", "Things", tools::metrics::label("kind", "b")).inc();
+  tools::metrics::histogram &h = tools::metrics::get_histogram("test_metrics_render_seconds", "Times", {0.5, 1}, tools::metrics::label("stage", "x"));
+  h.observe(0.25);
+  h.observe(2);
+
+  std::string out;
+  tools::metrics::render(out);
+  ASSERT_TRUE(contains(out, "# HELP test_metrics_render_total Things"));
+  ASSERT_TRUE(contains(out, "# TYPE test_metrics_render_total counter"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_total{kind=\"a\"} 2"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_total{kind=\"b\"} 1"));
+  ASSERT_TRUE(contains(out, "# TYPE test_metrics_render_seconds histogram"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_seconds_bucket{stage=\"x\",le=\"0.5\"} 1"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_seconds_bucket{stage=\"x\",le=\"1\"} 1"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_seconds_bucket{stage=\"x\",le=\"+Inf\"} 2"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_seconds_sum{stage=\"x\"} 2.25"));
+  ASSERT_TRUE(contains(out, "test_metrics_render_seconds_count{stage=\"x\"} 2"));
+  // one header per name, whatever the labels
+  ASSERT_EQ(out.find("# TYPE test_metrics_render_total"), out.rfind("# TYPE test_metrics_render_total"));
+
+  ASSERT_THROW(tools::metrics::get_histogram("test_metrics_render_total", "Things", {1}), std::exception);
+}
+
+TEST(metrics, endpoint)
+{
+  test_server server;
+  epee::net_utils::http::http_request_info query_info;
+  epee::net_utils::http::http_response_info response_info;
+  epee::net_utils::connection_context_base context;
+  query_info.m_URI = "/metrics";
+  response_info.m_response_code = 200;
+  ASSERT_TRUE(server.handle_http_request(query_info, response_info, context));
+  ASSERT_EQ(response_info.m_response_code, 200);
+  ASSERT_EQ(response_info.m_mime_tipe, "text/plain; version=0.0.4");
+  ASSERT_EQ(response_info.m_body, "# HELP test_metrics_server_gauge A gauge\n# TYPE test_metrics_server_gauge gauge\ntest_metrics_server_gauge 3\n");
+
+  server.succeed = false;
+  response_info = epee::net_utils::http::http_response_info();
+  ASSERT_TRUE(server.handle_http_request(query_info, response_info, context));
+  ASSERT_EQ(response_info.m_response_code, 500);
+  ASSERT_TRUE(response_info.m_body.empty());
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "device/device.hpp"
+#include "device/device_default.hpp"
+#include "ringct/rctSigs.h"
+#include "wallet/wallet2.h"
+
+namespace
+{
+  // Inputs, rings and fee fixed, as in the final pass of a split transfer
+  struct test_tx
+  {
+    rct::ctkeyV sc, pc;
+    std::vector<uint64_t> inamounts, outamounts;
+    rct::keyV destinations, amount_keys;
+    rct::rctSig rv;
+  };
+
+  std::vector<test_tx> make_txes(size_t n)
+  {
+    std::vector<test_tx> txes(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      test_tx &tx = txes[i];
+      for (uint64_t amount: {6000 + i, 7000 + i})
+      {
+        rct::ctkey sk, pk;
+        std::tie(sk, pk) = rct::ctskpkGen(amount);
+        tx.inamounts.push_back(amount);
+        tx.sc.push_back(sk);
+        tx.pc.push_back(pk);
+      }
+      for (uint64_t amount: {500 + i, 12500 + i})
+      {
+        rct::key sk, pk;
+        rct::skpkGen(sk, pk);
+        tx.outamounts.push_back(amount);
+        tx.destinations.push_back(pk);
+        tx.amount_keys.push_back(rct::skGen());
+      }
+    }
+    return txes;
+  }
+
+  void construct_signing(test_tx &tx, bool parallel_signing, hw::device &hwdev)
+  {
+    rct::RCTConfig rct_config{ rct::RangeProofPaddedBulletproof, 4 };
+    rct_config.parallel_signing = parallel_signing;
+    std::map<size_t, std::string> outamounts_features;
+    tx.rv = rct::genRctSimple(rct::zero(), tx.sc, tx.pc, tx.destinations, cryptonote::transaction_type::TRANSFER, "ZEPH", oracle::pricing_record(),
+      tx.inamounts, tx.outamounts, outamounts_features, tx.amount_keys, 0, 3, rct_config, hwdev, HF_VERSION_DJED);
+  }
+
+  void construct(test_tx &tx)
+  {
+    construct_signing(tx, false, hw::get_device("default"));
+  }
+
+  // a software device whose signing fails, to check what the caller sees
+  struct failing_device: public hw::core::device_default
+  {
+    bool clsag_prepare(const rct::key &p, const rct::key &z, rct::key &I, rct::key &D, const rct::key &H, rct::key &a, rct::key &aG, rct::key &aH) override
+    {
+      throw std::invalid_argument("test signing failure");
+    }
+  };
+}
+
+TEST(parallel_tx_construction, same_txes_as_serial)
+{
+  std::vector<test_tx> serial = make_txes(4);
+  std::vector<test_tx> parallel = serial;
+  tools::detail::construct_final_txes(serial, construct, false);
+  tools::detail::construct_final_txes(parallel, construct, true);
+
+  ASSERT_EQ(serial.size(), parallel.size());
+  for (size_t i = 0; i < serial.size(); ++i)
+  {
+    const rct::rctSig &s = serial[i].rv, &p = parallel[i].rv;
+    // the per-asset sum check needs the tx's vin/vout, the signatures and proofs do not
+    ASSERT_TRUE(rct::verRctNonSemanticsSimple(s));
+    ASSERT_TRUE(rct::verRctNonSemanticsSimple(p));
+
+    // signing and proving are randomized, but what they commit to is not
+    EXPECT_EQ(s.type, p.type);
+    EXPECT_EQ(s.txnFee, p.txnFee);
+    ASSERT_EQ(s.outPk.size(), p.outPk.size());
+    for (size_t j = 0; j < s.outPk.size(); ++j)
+    {
+      EXPECT_EQ(s.outPk[j].dest, p.outPk[j].dest);
+      EXPECT_EQ(s.outPk[j].mask, p.outPk[j].mask);
+    }
+    ASSERT_EQ(s.p.CLSAGs.size(), serial[i].inamounts.size());
+    ASSERT_EQ(s.p.CLSAGs.size(), p.p.CLSAGs.size());
+    for (size_t j = 0; j < s.p.CLSAGs.size(); ++j)
+      EXPECT_EQ(s.p.CLSAGs[j].I, p.p.CLSAGs[j].I);
+  }
+}
+
+TEST(parallel_tx_construction, rethrows_first_failure)
+{
+  std::vector<int> txes(8);
+  for (size_t i = 0; i < txes.size(); ++i)
+    txes[i] = i;
+  std::atomic<size_t> constructed(0);
+  const auto construct = [&](int &tx) {
+    if (tx == 3)
+      throw tools::error::tx_not_possible("test", 1, 2, 0);
+    if (tx == 5)
+      throw std::runtime_error("later failure");
+    ++constructed;
+  };
+  EXPECT_THROW(tools::detail::construct_final_txes(txes, construct, true), tools::error::tx_not_possible);
+  // the other txes still ran, nothing was left behind on the pool
+  EXPECT_EQ(constructed.load(), txes.size() - 2);
+}
+
+TEST(parallel_tx_construction, parallel_clsag_signing)
+{
+  std::vector<test_tx> txes = make_txes(2);
+  construct_signing(txes[0], true, hw::get_device("default"));
+  ASSERT_EQ(txes[0].rv.p.CLSAGs.size(), txes[0].inamounts.size());
+  ASSERT_TRUE(rct::verRctNonSemanticsSimple(txes[0].rv));
+
+  // a signing failure reaches the caller as thrown, not as a generic one
+  failing_device hwdev;
+  EXPECT_THROW(construct_signing(txes[1], true, hwdev), std::invalid_argument);
+  EXPECT_THROW(construct_signing(txes[1], false, hwdev), std::invalid_argument);
+}
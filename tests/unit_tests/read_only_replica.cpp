@@ -0,0 +1,285 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define IN_UNIT_TESTS
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "blockchain_db/testdb.h"
+
+namespace
+{
+
+class TestDB: public cryptonote::BaseTestDB
+{
+public:
+  TestDB() { m_open = true; }
+
+  // the pool as another process left it in the db
+  std::unordered_map<crypto::hash, std::pair<cryptonote::txpool_tx_meta_t, cryptonote::blobdata>> pool;
+
+  virtual uint64_t get_txpool_tx_count(cryptonote::relay_category category = cryptonote::relay_category::broadcasted) const override
+  {
+    uint64_t count = 0;
+    for (const auto &e: pool)
+      count += e.second.first.matches(category);
+    return count;
+  }
+  virtual bool txpool_has_tx(const crypto::hash &txid, cryptonote::relay_category category) const override
+  {
+    const auto it = pool.find(txid);
+    return it != pool.end() && it->second.first.matches(category);
+  }
+  virtual bool get_txpool_tx_meta(const crypto::hash& txid, cryptonote::txpool_tx_meta_t &meta) const override
+  {
+    const auto it = pool.find(txid);
+    if (it == pool.end())
+      return false;
+    meta = it->second.first;
+    return true;
+  }
+  virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd, cryptonote::relay_category category) const override
+  {
+    const auto it = pool.find(txid);
+    if (it == pool.end() || !it->second.first.matches(category))
+      return false;
+    bd = it->second.second;
+    return true;
+  }
+  virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid, cryptonote::relay_category category) const override
+  {
+    cryptonote::blobdata bd;
+    get_txpool_tx_blob(txid, bd, category);
+    return bd;
+  }
+  virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const cryptonote::txpool_tx_meta_t&, const cryptonote::blobdata_ref*)> f, bool include_blob = false, cryptonote::relay_category category = cryptonote::relay_category::broadcasted) const override
+  {
+    for (const auto &e: pool)
+    {
+      if (!e.second.first.matches(category))
+        continue;
+      const cryptonote::blobdata_ref bd{e.second.second.data(), e.second.second.size()};
+      if (!f(e.first, e.second.first, include_blob ? &bd : NULL))
+        return false;
+    }
+    return true;
+  }
+
+  crypto::hash add(const crypto::key_image &ki, cryptonote::relay_method relay = cryptonote::relay_method::fluff)
+  {
+    cryptonote::transaction tx;
+    tx.version = 2;
+    cryptonote::txin_zephyr_key in;
+    in.amount = 0;
+    in.asset_type = "ZPH";
+    in.key_offsets.push_back(1);
+    in.k_image = ki;
+    tx.vin.push_back(in);
+    tx.rct_signatures.type = rct::RCTTypeNull;
+
+    cryptonote::txpool_tx_meta_t meta{};
+    meta.weight = 1000;
+    meta.fee = 1000000;
+    meta.receive_time = time(NULL);
+    meta.set_relay_method(relay);
+
+    const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+    const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+    pool[txid] = std::make_pair(meta, blob);
+    return txid;
+  }
+};
+
+crypto::hash make_hash(unsigned char c)
+{
+  crypto::hash h;
+  memset(h.data, c, sizeof(h.data));
+  return h;
+}
+
+crypto::key_image make_key_image(unsigned char c)
+{
+  crypto::key_image ki;
+  memset(ki.data, c, sizeof(ki.data));
+  return ki;
+}
+
+struct split_test
+{
+  std::vector<crypto::hash> tip_hashes;
+  uint64_t start;
+  std::vector<crypto::hash> db;
+
+  uint64_t split(uint64_t db_height, bool &lost_track) const
+  {
+    return cryptonote::Blockchain::find_db_split_height(tip_hashes, start, db_height,
+        [this](uint64_t height) { return db[height]; }, lost_track);
+  }
+};
+
+// a view of blocks 10..19 of a chain where block i hashes to i
+split_test make_split_test()
+{
+  split_test t;
+  t.start = 10;
+  for (unsigned char i = 0; i < 30; ++i)
+    t.db.push_back(make_hash(i));
+  t.tip_hashes.assign(t.db.begin() + 10, t.db.begin() + 20);
+  return t;
+}
+
+bool contains(const std::vector<crypto::hash> &txids, const crypto::hash &txid)
+{
+  return std::find(txids.begin(), txids.end(), txid) != txids.end();
+}
+
+}
+
+#define PREFIX \
+  struct get_test_options { \
+    const std::pair<uint8_t, uint64_t> hard_forks[2]; \
+    const cryptonote::test_options test_options = { \
+      hard_forks, \
+      0, \
+    }; \
+    get_test_options(): hard_forks{std::make_pair(1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)} {} \
+  } opts; \
+  cryptonote::BlockchainAndPool bap; \
+  TestDB *db = new TestDB(); \
+  ASSERT_TRUE(bap.blockchain.init(db, cryptonote::FAKECHAIN, true, &opts.test_options, 0, NULL))
+
+TEST(read_only_replica, split_blocks_appended)
+{
+  const split_test t = make_split_test();
+  bool lost_track;
+  ASSERT_EQ(t.split(25, lost_track), 20);
+  ASSERT_FALSE(lost_track);
+  ASSERT_EQ(t.split(20, lost_track), 20);
+  ASSERT_FALSE(lost_track);
+}
+
+TEST(read_only_replica, split_reorg_within_window)
+{
+  split_test t = make_split_test();
+  for (size_t i = 16; i < t.db.size(); ++i)
+    t.db[i] = make_hash(100 + i);
+  bool lost_track;
+  ASSERT_EQ(t.split(22, lost_track), 16);
+  ASSERT_FALSE(lost_track);
+}
+
+TEST(read_only_replica, split_blocks_popped)
+{
+  const split_test t = make_split_test();
+  bool lost_track;
+  ASSERT_EQ(t.split(17, lost_track), 17);
+  ASSERT_FALSE(lost_track);
+}
+
+TEST(read_only_replica, split_reorg_deeper_than_window)
+{
+  split_test t = make_split_test();
+  for (size_t i = 5; i < t.db.size(); ++i)
+    t.db[i] = make_hash(100 + i);
+  bool lost_track;
+  ASSERT_EQ(t.split(22, lost_track), 10);
+  ASSERT_TRUE(lost_track);
+}
+
+TEST(read_only_replica, split_nothing_tracked)
+{
+  split_test t = make_split_test();
+  t.tip_hashes.clear();
+  t.start = 0;
+  bool lost_track;
+  ASSERT_EQ(t.split(22, lost_track), 0);
+  ASSERT_TRUE(lost_track);
+}
+
+TEST(read_only_replica, pool_reload_is_incremental)
+{
+  PREFIX;
+  const crypto::hash a = db->add(make_key_image(1));
+  const crypto::hash b = db->add(make_key_image(2));
+  ASSERT_TRUE(bap.tx_pool.init());
+  ASSERT_EQ(bap.tx_pool.get_transactions_count(), 2);
+
+  // the incremental lists need a removal before they can answer anything
+  db->pool.erase(b);
+  const crypto::hash c = db->add(make_key_image(3));
+  ASSERT_TRUE(bap.tx_pool.reload());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  const time_t since = time(NULL);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+  // a replacement spending the key image of a removed tx
+  db->pool.erase(a);
+  const crypto::hash d = db->add(make_key_image(1));
+  const crypto::hash stem = db->add(make_key_image(4), cryptonote::relay_method::stem);
+  ASSERT_TRUE(bap.tx_pool.reload());
+
+  std::vector<std::pair<crypto::hash, cryptonote::tx_memory_pool::tx_details>> added;
+  std::vector<crypto::hash> remaining, removed;
+  bool incremental = false;
+  ASSERT_TRUE(bap.tx_pool.get_pool_info(since, false, 100, added, remaining, removed, incremental));
+  ASSERT_TRUE(incremental);
+  ASSERT_EQ(added.size(), 1);
+  ASSERT_EQ(added[0].first, d);
+  ASSERT_TRUE(remaining.empty());
+  ASSERT_EQ(removed, std::vector<crypto::hash>{a});
+
+  std::vector<bool> spent;
+  ASSERT_TRUE(bap.tx_pool.check_for_key_images({make_key_image(1), make_key_image(2), make_key_image(3), make_key_image(4)}, spent));
+  ASSERT_EQ(spent, (std::vector<bool>{true, false, true, false}));
+
+  std::vector<crypto::hash> txids;
+  bap.tx_pool.get_transaction_hashes(txids, true);
+  ASSERT_EQ(txids.size(), 3);
+  ASSERT_TRUE(contains(txids, c));
+  ASSERT_TRUE(contains(txids, d));
+  ASSERT_TRUE(contains(txids, stem));
+
+  // the stem tx going away is not reported to non sensitive queries
+  db->pool.erase(stem);
+  ASSERT_TRUE(bap.tx_pool.reload());
+  ASSERT_TRUE(bap.tx_pool.get_pool_info(since, false, 100, added, remaining, removed, incremental));
+  ASSERT_TRUE(incremental);
+  ASSERT_EQ(removed, std::vector<crypto::hash>{a});
+  ASSERT_TRUE(bap.tx_pool.get_pool_info(since, true, 100, added, remaining, removed, incremental));
+  ASSERT_EQ(removed.size(), 2);
+  ASSERT_TRUE(contains(removed, stem));
+}
@@ -1279,3 +1279,17 @@ TEST(ringct, aggregated)
     ASSERT_TRUE(rct::verRctSemanticsSimple(*sp[n]));
   }
 }
+
+TEST(ringct, fixed_base_H)
+{
+  for (size_t n = 0; n < 64; ++n)
+  {
+    const key a = skGen();
+    const key b = n ? skGen() : d2h(n);
+    ASSERT_EQ(scalarmultH(b), scalarmultKey(H, b));
+    key gh, expected;
+    addKeysGH(gh, a, b);
+    addKeys2(expected, a, b, H);
+    ASSERT_EQ(gh, expected);
+  }
+}
@@ -0,0 +1,274 @@
+// Copyright (c) 2024, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+#include "syncobj.h"
+#include "net/http_protocol_handler.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+#include "rpc/rpc_workers.h"
+#include "storages/portable_storage_template_helper.h"
+
+using cryptonote::rpc_workers;
+
+namespace
+{
+  struct COMMAND_NOTHING
+  {
+    struct request_t
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+    typedef request response;
+  };
+
+  class test_server: public epee::net_utils::http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+  public:
+    CHAIN_HTTP_TO_MAP2(epee::net_utils::connection_context_base);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_JON2("/get_transactions", on_nothing, COMMAND_NOTHING)
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC_WE("get_output_histogram", on_nothing_json, COMMAND_NOTHING)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    bool on_nothing(const COMMAND_NOTHING::request &req, COMMAND_NOTHING::response &res, const epee::net_utils::connection_context_base *ctx) { return true; }
+    bool on_nothing_json(const COMMAND_NOTHING::request &req, COMMAND_NOTHING::response &res, epee::json_rpc::error &error_resp, const epee::net_utils::connection_context_base *ctx) { return true; }
+    void run_json_rpc_batch(std::vector<std::function<void()>> &jobs) { for (auto &job: jobs) job(); }
+
+    rpc_workers::slot admit_rpc_call(const char *method) { return workers.admit(method); }
+
+    rpc_workers workers;
+  };
+
+  epee::net_utils::http::http_response_info call(test_server &server, const std::string &uri, const std::string &body)
+  {
+    epee::net_utils::http::http_request_info query_info;
+    epee::net_utils::http::http_response_info response_info;
+    epee::net_utils::connection_context_base context;
+    query_info.m_URI = uri;
+    query_info.m_body = body;
+    EXPECT_TRUE(server.handle_http_request(query_info, response_info, context));
+    return response_info;
+  }
+
+  const rpc_workers::method_stats *find_method(const std::map<std::string, rpc_workers::method_stats> &methods, const std::string &method)
+  {
+    const auto it = methods.find(method);
+    return it == methods.end() ? nullptr : &it->second;
+  }
+}
+
+TEST(rpc_workers, classes)
+{
+  ASSERT_EQ(rpc_workers::get_worker_class("get_block_template"), rpc_workers::worker_class_priority);
+  ASSERT_EQ(rpc_workers::get_worker_class("/get_info"), rpc_workers::worker_class_priority);
+  ASSERT_EQ(rpc_workers::get_worker_class("submit_block"), rpc_workers::worker_class_priority);
+  ASSERT_EQ(rpc_workers::get_worker_class("get_output_distribution"), rpc_workers::worker_class_slow);
+  ASSERT_EQ(rpc_workers::get_worker_class("get_pricing_record_history"), rpc_workers::worker_class_slow);
+  ASSERT_EQ(rpc_workers::get_worker_class("/get_transactions"), rpc_workers::worker_class_slow);
+  ASSERT_EQ(rpc_workers::get_worker_class("get_block"), rpc_workers::worker_class_standard);
+  ASSERT_EQ(rpc_workers::get_worker_class("get_block_template_long_poll"), rpc_workers::worker_class_long_poll);
+  ASSERT_EQ(rpc_workers::get_worker_class("no_such_call"), rpc_workers::worker_class_standard);
+}
+
+TEST(rpc_workers, set_limits)
+{
+  rpc_workers workers;
+  ASSERT_TRUE(workers.set_limits("slow=3:7"));
+  ASSERT_EQ(workers.get_limits(rpc_workers::worker_class_slow).concurrency, 3);
+  ASSERT_EQ(workers.get_limits(rpc_workers::worker_class_slow).queue, 7);
+  ASSERT_TRUE(workers.set_limits("priority=1:0"));
+  ASSERT_TRUE(workers.set_limits("standard=1:1"));
+  ASSERT_TRUE(workers.set_limits("long_poll=4:0"));
+  ASSERT_EQ(workers.get_threads(), 3 + 7 + 1 + 0 + 1 + 1 + 4 + 0);
+
+  // without a queue limit, as many threads wait as run
+  ASSERT_TRUE(workers.set_limits("slow=3"));
+  ASSERT_EQ(workers.get_limits(rpc_workers::worker_class_slow).queue, rpc_workers::no_queue_limit);
+  ASSERT_EQ(workers.get_threads(), 3 + 3 + 1 + 0 + 1 + 1 + 4 + 0);
+
+  ASSERT_FALSE(workers.set_limits("slow"));
+  ASSERT_FALSE(workers.set_limits("slow=3:"));
+  ASSERT_FALSE(workers.set_limits("fast=1:1"));
+  ASSERT_FALSE(workers.set_limits("slow=x:1"));
+  ASSERT_FALSE(workers.set_limits("slow=0:1"));
+  ASSERT_FALSE(workers.set_limits("slow=1:-1"));
+  ASSERT_EQ(workers.get_limits(rpc_workers::worker_class_slow).concurrency, 3);
+}
+
+TEST(rpc_workers, disabled_class)
+{
+  // how a restricted server leaves out long polls
+  rpc_workers workers;
+  const unsigned threads = workers.get_threads();
+  const rpc_workers::class_limits long_poll = workers.get_limits(rpc_workers::worker_class_long_poll);
+  workers.set_limits(rpc_workers::worker_class_long_poll, {0, 0});
+  ASSERT_EQ(workers.get_threads(), threads - long_poll.concurrency - long_poll.queue);
+  ASSERT_FALSE(bool(workers.admit("get_block_template_long_poll")));
+}
+
+TEST(rpc_workers, server_metrics)
+{
+  rpc_workers restricted, unrestricted;
+  restricted.set_server_name("restricted");
+  unrestricted.set_server_name("unrestricted");
+  ASSERT_TRUE(bool(restricted.admit("get_height_for_server_metrics")));
+  ASSERT_TRUE(bool(unrestricted.admit("get_height_for_server_metrics")));
+  std::string body;
+  tools::metrics::render(body);
+  ASSERT_NE(body.find("zephyr_rpc_request_seconds_count{server=\"restricted\",method=\"get_height_for_server_metrics\"} 1"), std::string::npos);
+  ASSERT_NE(body.find("zephyr_rpc_request_seconds_count{server=\"unrestricted\",method=\"get_height_for_server_metrics\"} 1"), std::string::npos);
+}
+
+TEST(rpc_workers, turns_away_when_full)
+{
+  rpc_workers workers;
+  workers.set_limits(rpc_workers::worker_class_slow, {1, 0});
+  {
+    rpc_workers::slot slot = workers.admit("get_output_distribution");
+    ASSERT_TRUE(bool(slot));
+    ASSERT_FALSE(bool(workers.admit("get_pricing_record_history")));
+    // other classes are not held back
+    ASSERT_TRUE(bool(workers.admit("get_info")));
+    ASSERT_TRUE(bool(workers.admit("get_block")));
+  }
+  ASSERT_TRUE(bool(workers.admit("get_pricing_record_history")));
+
+  std::vector<rpc_workers::class_stats> classes;
+  std::map<std::string, rpc_workers::method_stats> methods;
+  workers.get_stats(classes, methods);
+  ASSERT_EQ(classes.size(), rpc_workers::num_worker_classes);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].name, "slow");
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].count, 2);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].rejected, 1);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].active, 0);
+  const rpc_workers::method_stats *stats = find_method(methods, "get_pricing_record_history");
+  ASSERT_TRUE(stats != nullptr);
+  ASSERT_EQ(stats->count, 1);
+  ASSERT_EQ(stats->rejected, 1);
+
+  workers.clear_stats();
+  workers.get_stats(classes, methods);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].count, 0);
+  ASSERT_EQ(find_method(methods, "get_pricing_record_history")->count, 0);
+}
+
+TEST(rpc_workers, queues)
+{
+  rpc_workers workers;
+  workers.set_limits(rpc_workers::worker_class_slow, {1, 1});
+  std::atomic<bool> admitted(false);
+  std::unique_ptr<rpc_workers::slot> slot(new rpc_workers::slot(workers.admit("get_output_distribution")));
+  ASSERT_TRUE(bool(*slot));
+  boost::thread waiter([&]() {
+    rpc_workers::slot queued = workers.admit("get_output_distribution");
+    admitted = bool(queued);
+  });
+  std::vector<rpc_workers::class_stats> classes;
+  std::map<std::string, rpc_workers::method_stats> methods;
+  for (int i = 0; i < 1000; ++i)
+  {
+    workers.get_stats(classes, methods);
+    if (classes[rpc_workers::worker_class_slow].queued == 1)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].queued, 1);
+  // one running and one waiting, the next is turned away
+  ASSERT_FALSE(bool(workers.admit("get_output_distribution")));
+  ASSERT_FALSE(admitted);
+  slot.reset();
+  waiter.join();
+  ASSERT_TRUE(admitted);
+
+  workers.get_stats(classes, methods);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].active, 0);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].queued, 0);
+  const rpc_workers::method_stats *stats = find_method(methods, "get_output_distribution");
+  ASSERT_TRUE(stats != nullptr);
+  ASSERT_EQ(stats->count, 2);
+  ASSERT_EQ(stats->rejected, 1);
+  ASSERT_GT(stats->max_queue_time, 0);
+}
+
+TEST(rpc_workers, waits_without_queue_limit)
+{
+  rpc_workers workers;
+  const rpc_workers::class_limits limits = workers.get_limits(rpc_workers::worker_class_slow);
+  ASSERT_EQ(limits.queue, rpc_workers::no_queue_limit);
+  std::vector<std::unique_ptr<rpc_workers::slot>> slots;
+  for (unsigned i = 0; i < limits.concurrency; ++i)
+  {
+    slots.emplace_back(new rpc_workers::slot(workers.admit("/get_blocks.bin")));
+    ASSERT_TRUE(bool(*slots.back()));
+  }
+  std::atomic<unsigned> admitted(0);
+  std::vector<boost::thread> waiters;
+  for (int i = 0; i < 4; ++i)
+    waiters.emplace_back([&]() { admitted += bool(workers.admit("/get_blocks.bin")); });
+  std::vector<rpc_workers::class_stats> classes;
+  std::map<std::string, rpc_workers::method_stats> methods;
+  for (int i = 0; i < 1000; ++i)
+  {
+    workers.get_stats(classes, methods);
+    if (classes[rpc_workers::worker_class_slow].queued == 4)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].queued, 4);
+  ASSERT_EQ(admitted, 0);
+  slots.clear();
+  for (boost::thread &waiter: waiters)
+    waiter.join();
+  ASSERT_EQ(admitted, 4);
+  workers.get_stats(classes, methods);
+  ASSERT_EQ(classes[rpc_workers::worker_class_slow].rejected, 0);
+}
+
+TEST(rpc_workers, server_busy)
+{
+  test_server server;
+  server.workers.set_limits(rpc_workers::worker_class_slow, {1, 0});
+  ASSERT_EQ(call(server, "/get_transactions", "{}").m_response_code, 200);
+  ASSERT_EQ(call(server, "/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"get_output_histogram\",\"params\":{}}").m_body.find("error"), std::string::npos);
+
+  rpc_workers::slot slot = server.workers.admit("get_coinbase_tx_sum");
+  ASSERT_EQ(call(server, "/get_transactions", "{}").m_response_code, 503);
+  epee::json_rpc::error_response error;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(error, call(server, "/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"get_output_histogram\",\"params\":{}}").m_body));
+  ASSERT_EQ(error.error.code, JSON_RPC_SERVER_BUSY);
+}
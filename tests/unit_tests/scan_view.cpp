@@ -0,0 +1,133 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/scan_view.h"
+#include "serialization/binary_utils.h"
+
+static cryptonote::tx_scan_view make_view(size_t n_outputs, size_t n_key_images, bool additional, uint64_t first_index, const std::vector<std::string> &asset_types, uint64_t first_asset_index)
+{
+  cryptonote::tx_scan_view view;
+  view.pub_keys.push_back(crypto::rand<crypto::public_key>());
+  for (size_t i = 0; i < n_key_images; ++i)
+    view.key_images.push_back(crypto::rand<crypto::key_image>());
+  for (size_t i = 0; i < n_outputs; ++i)
+  {
+    if (additional)
+      view.additional_pub_keys.push_back(crypto::rand<crypto::public_key>());
+    view.output_keys.push_back(crypto::rand<crypto::public_key>());
+    view.view_tags.push_back(crypto::rand<crypto::view_tag>());
+    view.asset_types.push_back(asset_types[i % asset_types.size()]);
+    view.output_indices.push_back(first_index + i);
+    view.asset_type_output_indices.push_back(first_asset_index + i);
+  }
+  return view;
+}
+
+static void check_equal(const cryptonote::tx_scan_view &a, const cryptonote::tx_scan_view &b)
+{
+  ASSERT_EQ(a.pub_keys, b.pub_keys);
+  ASSERT_EQ(a.additional_pub_keys, b.additional_pub_keys);
+  ASSERT_EQ(a.key_images, b.key_images);
+  ASSERT_EQ(a.output_keys, b.output_keys);
+  ASSERT_EQ(a.view_tags.size(), b.view_tags.size());
+  for (size_t i = 0; i < a.view_tags.size(); ++i)
+    ASSERT_EQ(a.view_tags[i], b.view_tags[i]);
+  ASSERT_EQ(a.asset_types, b.asset_types);
+  ASSERT_EQ(a.output_indices, b.output_indices);
+  ASSERT_EQ(a.asset_type_output_indices, b.asset_type_output_indices);
+}
+
+TEST(scan_view, round_trip)
+{
+  std::vector<cryptonote::tx_scan_view> views;
+  views.push_back(make_view(1, 0, false, 1000000, {"ZPH"}, 500000));
+  views.push_back(make_view(2, 3, false, 1000001, {"ZPH", "ZSD"}, 500001));
+  views.push_back(make_view(16, 1, true, 1000003, {"ZSD"}, 20));
+  views.push_back(cryptonote::tx_scan_view());
+
+  cryptonote::block_scan_view block_view;
+  cryptonote::get_block_scan_view(views, block_view);
+  std::string blob;
+  ASSERT_TRUE(::serialization::dump_binary(block_view, blob));
+
+  cryptonote::block_scan_view parsed_block_view;
+  ASSERT_TRUE(::serialization::parse_binary(blob, parsed_block_view));
+  std::vector<cryptonote::tx_scan_view> parsed;
+  ASSERT_TRUE(cryptonote::get_tx_scan_views(parsed_block_view, parsed));
+  ASSERT_EQ(parsed.size(), views.size());
+  for (size_t i = 0; i < views.size(); ++i)
+    check_equal(views[i], parsed[i]);
+}
+
+TEST(scan_view, decreasing_indices)
+{
+  std::vector<cryptonote::tx_scan_view> views;
+  views.push_back(make_view(2, 1, false, 5000, {"ZPH"}, 7000));
+  views.push_back(make_view(2, 1, false, 10, {"ZPH"}, 3));
+
+  cryptonote::block_scan_view block_view;
+  cryptonote::get_block_scan_view(views, block_view);
+  std::vector<cryptonote::tx_scan_view> parsed;
+  ASSERT_TRUE(cryptonote::get_tx_scan_views(block_view, parsed));
+  ASSERT_EQ(parsed.size(), views.size());
+  for (size_t i = 0; i < views.size(); ++i)
+    check_equal(views[i], parsed[i]);
+}
+
+TEST(scan_view, indices_are_small)
+{
+  // consecutive indices should take a byte each, not a full varint
+  std::vector<cryptonote::tx_scan_view> views;
+  views.push_back(make_view(100, 0, false, 123456789, {"ZPH"}, 98765432));
+  cryptonote::block_scan_view block_view;
+  cryptonote::get_block_scan_view(views, block_view);
+  std::string blob;
+  ASSERT_TRUE(::serialization::dump_binary(block_view, blob));
+  // keys and view tags, then a byte per output for the asset type and each index
+  const size_t keys_size = 32 * 101 + 100;
+  ASSERT_LT(blob.size(), keys_size + 3 * 100 + 64);
+}
+
+TEST(scan_view, truncated)
+{
+  std::vector<cryptonote::tx_scan_view> views;
+  views.push_back(make_view(3, 2, false, 10, {"ZPH"}, 10));
+  cryptonote::block_scan_view block_view;
+  cryptonote::get_block_scan_view(views, block_view);
+  block_view.output_keys.pop_back();
+  std::vector<cryptonote::tx_scan_view> parsed;
+  ASSERT_FALSE(cryptonote::get_tx_scan_views(block_view, parsed));
+
+  cryptonote::get_block_scan_view(views, block_view);
+  block_view.n_key_images.back() = 5;
+  ASSERT_FALSE(cryptonote::get_tx_scan_views(block_view, parsed));
+}
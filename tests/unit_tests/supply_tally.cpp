@@ -0,0 +1,162 @@
+// Copyright (c) 2024, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <random>
+
+#include "blockchain_utilities/supply_tally.h"
+
+using cryptonote::int128;
+using cryptonote::tally_key;
+
+namespace
+{
+  enum op_type { op_plus, op_minus_clamped, op_set };
+  struct op
+  {
+    op_type type;
+    int128 value;
+  };
+
+  template<typename Sink>
+  void apply(Sink &sink, const tally_key &k, const std::vector<op> &ops)
+  {
+    for (const op &o: ops)
+    {
+      switch (o.type)
+      {
+        case op_plus: sink.plus(k, o.value); break;
+        case op_minus_clamped: sink.minus_clamped(k, o.value); break;
+        case op_set: sink.set(k, o.value); break;
+      }
+    }
+  }
+
+  cryptonote::transaction make_tx(const std::string &source, const std::string &dest, uint64_t burnt, uint64_t minted)
+  {
+    cryptonote::transaction tx;
+    tx.version = 3;
+    cryptonote::txin_zephyr_key in;
+    in.asset_type = source;
+    tx.vin.push_back(in);
+    cryptonote::txout_zephyr_tagged_key out, change;
+    out.asset_type = dest;
+    change.asset_type = source;
+    tx.vout.resize(2);
+    tx.vout[0].target = out;
+    tx.vout[1].target = change;
+    tx.amount_burnt = burnt;
+    tx.amount_minted = minted;
+    return tx;
+  }
+
+  void replay(cryptonote::supply_tallies &tallies, const cryptonote::transaction &tx)
+  {
+    cryptonote::state_sink sink{tallies};
+    cryptonote::replay_tx(sink, tx, crypto::null_hash, HF_VERSION_AUDIT);
+  }
+}
+
+TEST(supply_tally, ranges_match_sequential_replay)
+{
+  const tally_key k = cryptonote::total("ZSD");
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> type_dist(0, 9), value_dist(0, 100), length_dist(0, 12);
+  for (int trial = 0; trial < 2000; ++trial)
+  {
+    std::vector<op> ops(length_dist(rng));
+    for (op &o: ops)
+    {
+      const int t = type_dist(rng);
+      o.type = t < 5 ? op_plus : t < 9 ? op_minus_clamped : op_set;
+      o.value = value_dist(rng);
+    }
+    const size_t split = ops.empty() ? 0 : rng() % (ops.size() + 1);
+    const std::vector<op> first(ops.begin(), ops.begin() + split), second(ops.begin() + split, ops.end());
+
+    cryptonote::range_sink range, range1, range2;
+    apply(range, k, ops);
+    apply(range1, k, first);
+    apply(range2, k, second);
+
+    for (const int128 x: {int128(0), int128(7), int128(60), int128(1000)})
+    {
+      cryptonote::supply_tallies tallies;
+      tallies[k] = x;
+      cryptonote::state_sink state{tallies};
+      apply(state, k, ops);
+
+      ASSERT_EQ(range.fns[k](x), tallies[k]);
+      ASSERT_EQ(range2.fns[k](range1.fns[k](x)), tallies[k]);
+    }
+  }
+}
+
+TEST(supply_tally, range_refuses_cross_tally_copy)
+{
+  cryptonote::range_sink range;
+  ASSERT_THROW(range.copy(cryptonote::total("ZPH"), cryptonote::reserve("DJED")), std::runtime_error);
+}
+
+TEST(supply_tally, transfer_leaves_tallies_alone)
+{
+  cryptonote::supply_tallies tallies;
+  replay(tallies, make_tx("ZPH", "ZPH", 0, 0));
+  ASSERT_TRUE(tallies.empty());
+}
+
+TEST(supply_tally, stable_mint_and_redeem)
+{
+  cryptonote::supply_tallies tallies;
+  replay(tallies, make_tx("ZPH", "ZSD", 100, 7));
+  ASSERT_EQ(tallies[cryptonote::reserve("DJED")], 100);
+  ASSERT_EQ(tallies[cryptonote::total("ZSD")], 7);
+
+  replay(tallies, make_tx("ZSD", "ZPH", 3, 40));
+  ASSERT_EQ(tallies[cryptonote::reserve("DJED")], 60);
+  ASSERT_EQ(tallies[cryptonote::total("ZSD")], 4);
+
+  // subtractions are clamped at zero, as in the db
+  replay(tallies, make_tx("ZSD", "ZPH", 10, 80));
+  ASSERT_EQ(tallies[cryptonote::reserve("DJED")], 0);
+  ASSERT_EQ(tallies[cryptonote::total("ZSD")], 0);
+}
+
+TEST(supply_tally, yield_mint_and_redeem)
+{
+  cryptonote::supply_tallies tallies;
+  replay(tallies, make_tx("ZSD", "ZYS", 50, 45));
+  ASSERT_EQ(tallies[cryptonote::reserve("YIELD")], 50);
+  ASSERT_EQ(tallies[cryptonote::total("ZYS")], 45);
+  ASSERT_EQ(tallies.count(cryptonote::total("ZSD")), 0);
+
+  replay(tallies, make_tx("ZYS", "ZSD", 45, 52));
+  ASSERT_EQ(tallies[cryptonote::reserve("YIELD")], 0);
+  ASSERT_EQ(tallies[cryptonote::total("ZYS")], 0);
+}
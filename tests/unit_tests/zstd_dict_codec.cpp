@@ -0,0 +1,113 @@
+// Copyright (c) 2014-2023, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <random>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "common/zstd_dict_codec.h"
+
+static std::vector<std::string> make_samples(size_t n)
+{
+  // blobs sharing most of their structure, like tx prefixes
+  std::mt19937_64 rng(42);
+  std::vector<std::string> samples;
+  for (size_t i = 0; i < n; ++i)
+  {
+    std::string s = "\x02\x00\x02\x02\x00\x0b\xf0\x9f\x8d\xa9";
+    for (size_t j = 0; j < 16; ++j)
+    {
+      s += "output_key_" + std::to_string(j % 4) + ":";
+      for (size_t k = 0; k < 8; ++k)
+        s += (char)(rng() & 0xff);
+    }
+    samples.push_back(s);
+  }
+  return samples;
+}
+
+TEST(zstd_dict_codec, empty)
+{
+  tools::zstd_dict_codec c;
+  ASSERT_TRUE(c.empty());
+  std::string out;
+  ASSERT_FALSE(c.compress("abc", 3, out));
+  ASSERT_FALSE(c.decompress("abc", 3, out));
+}
+
+TEST(zstd_dict_codec, round_trip)
+{
+  if (!tools::zstd_dict_codec::available())
+    return;
+  const std::vector<std::string> samples = make_samples(1000);
+  std::string dict;
+  ASSERT_TRUE(tools::zstd_dict_codec::train(samples, 16384, dict));
+  tools::zstd_dict_codec c;
+  ASSERT_TRUE(c.set_dictionary(dict));
+  ASSERT_FALSE(c.empty());
+  ASSERT_NE(c.dictionary_id(), 0);
+
+  size_t raw = 0, compressed = 0;
+  for (const std::string &s: samples)
+  {
+    std::string frame, out = "prefix";
+    ASSERT_TRUE(c.compress(s.data(), s.size(), frame));
+    ASSERT_TRUE(tools::zstd_dict_codec::is_frame(frame.data(), frame.size()));
+    ASSERT_TRUE(c.decompress(frame.data(), frame.size(), out));
+    ASSERT_EQ(out, "prefix" + s);
+    raw += s.size();
+    compressed += frame.size();
+  }
+  ASSERT_LT(compressed, raw);
+}
+
+TEST(zstd_dict_codec, foreign_data)
+{
+  if (!tools::zstd_dict_codec::available())
+    return;
+  const std::vector<std::string> samples = make_samples(1000);
+  std::string dict;
+  ASSERT_TRUE(tools::zstd_dict_codec::train(samples, 16384, dict));
+  tools::zstd_dict_codec c;
+  ASSERT_TRUE(c.set_dictionary(dict));
+
+  // raw data starting with the frame magic is left alone
+  const std::string raw("\x28\xb5\x2f\xfd" "not a frame", 15);
+  ASSERT_TRUE(tools::zstd_dict_codec::is_frame(raw.data(), raw.size()));
+  std::string out = "x";
+  ASSERT_FALSE(c.decompress(raw.data(), raw.size(), out));
+  ASSERT_EQ(out, "x");
+
+  // so is a corrupted frame
+  std::string frame;
+  ASSERT_TRUE(c.compress(samples[0].data(), samples[0].size(), frame));
+  frame[frame.size() - 1] ^= 1;
+  ASSERT_FALSE(c.decompress(frame.data(), frame.size(), out));
+  ASSERT_EQ(out, "x");
+}